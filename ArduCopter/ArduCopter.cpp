@@ -416,7 +416,7 @@ void Copter::ten_hz_logging_loop()
 
     Vector3f mag_variances;
     if (EKF2.getMagStateVariances(0, mag_variances)) {
-        DataFlash_Class::instance()->Log_Write("EK2M", "TimeUS,MVarX,MVarY,MVarZ", "Qfff",
+        DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f'>("EK2M", "TimeUS,MVarX,MVarY,MVarZ",
                                                AP_HAL::micros64(),
                                                mag_variances.x,
                                                mag_variances.y,
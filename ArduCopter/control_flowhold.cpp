@@ -207,7 +207,7 @@ void FlowHold::flowhold_flow_to_angle(Vector2f &bf_angles, bool stick_input)
     bf_angles.y = constrain_float(bf_angles.y, -copter.aparm.angle_max, copter.aparm.angle_max);
 
     if (log_counter++ % 20 == 0) {
-        DataFlash_Class::instance()->Log_Write("FHLD", "TimeUS,SFx,SFy,Ax,Ay,Qual,Ix,Iy", "Qfffffffff",
+        DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f','f'>("FHLD", "TimeUS,SFx,SFy,Ax,Ay,Qual,Ix,Iy",
                                                AP_HAL::micros64(),
                                                sensor_flow.x, sensor_flow.y,
                                                bf_angles.x, bf_angles.y,
@@ -516,7 +516,7 @@ void FlowHold::update_height_estimate(void)
     // new height estimate for logging
     height_estimate = ins_height + height_offset;
     
-    DataFlash_Class::instance()->Log_Write("FXY", "TimeUS,DFx,DFy,DVx,DVy,Hest,DH,Hofs,InsH,LastInsH,DTms", "QfffffffffI",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f','f','f','f','I'>("FXY", "TimeUS,DFx,DFy,DVx,DVy,Hest,DH,Hofs,InsH,LastInsH,DTms",
                                            AP_HAL::micros64(),
                                            delta_flowrate.x,
                                            delta_flowrate.y,
@@ -75,7 +75,7 @@ void Copter::crash_check()
         if (motors->limit.throttle_upper) {
             flags |= 2;
         }
-        DataFlash_Class::instance()->Log_Write("CCHK", "TimeUS,Count,FCRt,AErr,SThr,Flags", "QHfffB",
+        DataFlash_Class::instance()->Log_Write_Typed<'Q','H','f','f','f','B'>("CCHK", "TimeUS,Count,FCRt,AErr,SThr,Flags",
                                                AP_HAL::micros64(),
                                                crash.counter, (double)crash.filtered_climb_rate,
                                                (double)angle_error_deg, (double)scaled_throttle, flags);
@@ -1,6 +1,7 @@
 #include "DataFlashFileReader.h"
 
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <stdio.h>
@@ -32,6 +33,63 @@ bool DataFlashFileReader::open_log(const char *logfile)
     if (fd == -1) {
         return false;
     }
+    if (seek_time_us != 0 && !load_index(logfile)) {
+        ::printf("No usable index for %s - reading from start\n", logfile);
+    }
+    return true;
+}
+
+/*
+  read the index sidecar (NN.IDX for NN.BIN) to find the offset to
+  seek to once the startup messages have been read
+ */
+bool DataFlashFileReader::load_index(const char *logfile)
+{
+    const size_t len = strlen(logfile);
+    if (len < 4) {
+        return false;
+    }
+    char *fname = strdup(logfile);
+    if (fname == nullptr) {
+        return false;
+    }
+    // preserve the case of the log's extension
+    const bool lower = (fname[len-3] == 'b');
+    memcpy(&fname[len-3], lower?"idx":"IDX", 3);
+    int ifd = ::open(fname, O_RDONLY|O_CLOEXEC);
+    free(fname);
+    if (ifd == -1) {
+        return false;
+    }
+
+    struct log_index_header hdr;
+    if (::read(ifd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        hdr.magic != LOG_INDEX_MAGIC ||
+        hdr.version != LOG_INDEX_VERSION) {
+        ::close(ifd);
+        return false;
+    }
+
+    struct log_index_entry e;
+    while (::read(ifd, &e, sizeof(e)) == sizeof(e)) {
+        if (e.type == LOG_INDEX_STARTUP_END) {
+            seek_startup_end = e.offset;
+        } else if (e.type == LOG_INDEX_TIME) {
+            if (e.time_us > seek_time_us) {
+                break;
+            }
+            seek_offset = e.offset;
+        }
+    }
+    ::close(ifd);
+
+    if (seek_offset <= seek_startup_end) {
+        // nothing to skip
+        seek_offset = 0;
+        return true;
+    }
+    ::printf("Seeking to offset %u for time %.3fs\n",
+             (unsigned)seek_offset, seek_time_us*1.0e-6);
     return true;
 }
 
@@ -39,6 +97,7 @@ ssize_t DataFlashFileReader::read_input(void *buffer, const size_t count)
 {
     uint64_t ret = ::read(fd, buffer, count);
     bytes_read += ret;
+    file_offset += ret;
     return ret;
 }
 
@@ -58,6 +117,14 @@ void DataFlashFileReader::get_packet_counts(uint64_t dest[])
 
 bool DataFlashFileReader::update(char type[5])
 {
+    if (seek_offset != 0 && file_offset >= seek_startup_end) {
+        if (::lseek(fd, seek_offset, SEEK_SET) == (off_t)-1) {
+            return false;
+        }
+        file_offset = seek_offset;
+        seek_offset = 0;
+    }
+
     uint8_t hdr[3];
     if (read_input(hdr, 3) != 3) {
         return false;
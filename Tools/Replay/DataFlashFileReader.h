@@ -1,6 +1,7 @@
 #pragma once
 
 #include <DataFlash/DataFlash.h>
+#include <DataFlash/LogIndex.h>
 
 #define LOGREADER_MAX_FORMATS 255 // must be >= highest MESSAGE
 
@@ -14,6 +15,10 @@ public:
     bool open_log(const char *logfile);
     bool update(char type[5]);
 
+    // skip to time_us (boot time) once the startup messages have been
+    // read, using the log's index sidecar. Must be called before open_log
+    void set_seek_time(uint64_t time_us) { seek_time_us = time_us; }
+
     virtual bool handle_log_format_msg(const struct log_Format &f) = 0;
     virtual bool handle_msg(const struct log_Format &f, uint8_t *msg) = 0;
 
@@ -29,6 +34,12 @@ protected:
 
 private:
     ssize_t read_input(void *buf, size_t count);
+    bool load_index(const char *logfile);
+
+    uint64_t seek_time_us = 0;
+    uint32_t seek_startup_end = 0;
+    uint32_t seek_offset = 0;
+    uint64_t file_offset = 0;
 
     uint64_t bytes_read = 0;
     uint32_t message_count = 0;
@@ -157,6 +157,7 @@ void Replay::usage(void)
     ::printf("\t--no-params        don't use parameters from the log\n");
     ::printf("\t--no-fpe           do not generate floating point exceptions\n");
     ::printf("\t--packet-counts    print packet counts at end of processing\n");
+    ::printf("\t--seek-time time   skip to time (seconds since boot) using the log index\n");
 }
 
 
@@ -173,6 +174,7 @@ enum {
     OPT_PARAM_FILE,
     OPT_NO_FPE,
     OPT_PACKET_COUNTS,
+    OPT_SEEK_TIME,
 };
 
 void Replay::flush_dataflash(void) {
@@ -230,6 +232,7 @@ void Replay::_parse_command_line(uint8_t argc, char * const argv[])
         {"no-params",       false,  0, OPT_NOPARAMS},
         {"no-fpe",          false,  0, OPT_NO_FPE},
         {"packet-counts",   false,  0, OPT_PACKET_COUNTS},
+        {"seek-time",       true,   0, OPT_SEEK_TIME},
         {0, false, 0, 0}
     };
 
@@ -317,6 +320,10 @@ void Replay::_parse_command_line(uint8_t argc, char * const argv[])
             packet_counts = true;
             break;
 
+        case OPT_SEEK_TIME:
+            logreader.set_seek_time(atof(gopt.optarg) * 1.0e6);
+            break;
+
         case 'h':
         default:
             usage();
@@ -41,7 +41,7 @@ void AC_AttitudeControl::control_monitor_update(void)
  */
 void AC_AttitudeControl::control_monitor_log(void)
 {
-    DataFlash_Class::instance()->Log_Write("CTRL", "TimeUS,RMSRollP,RMSRollD,RMSPitchP,RMSPitchD,RMSYaw", "Qfffff",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f'>("CTRL", "TimeUS,RMSRollP,RMSRollD,RMSPitchP,RMSPitchD,RMSYaw",
                                            AP_HAL::micros64(),
                                            (double)sqrtf(_control_monitor.rms_roll_P),
                                            (double)sqrtf(_control_monitor.rms_roll_D),
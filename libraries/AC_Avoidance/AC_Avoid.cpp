@@ -341,10 +341,23 @@ void AC_Avoid::adjust_velocity_polygon(float kP, float accel_cmss, Vector2f &des
     // calc margin in cm
     float margin_cm = MAX(margin * 100.0f, 0);
 
-    uint16_t i, j;
-    for (i = 1, j = num_points-1; i < num_points; j = i++) {
-        // end points of current edge
-        Vector2f start = boundary[j];
+    // an edge further away than the margin plus our stopping distance cannot limit the velocity, so when the
+    // fence can tell us which edges are near only check those.  A little is added to the stopping distance
+    // to cover rounding as limit_velocity's maximum speed is the inverse of the stopping distance
+    AC_PolyFence_loader::EdgeMask near_edges;
+    bool use_near_edges = false;
+    if (earth_frame && is_positive(kP) && is_positive(accel_cmss)) {
+        const float radius = margin_cm + get_stopping_distance(kP, accel_cmss, safe_vel.length()) * 1.01f + 1.0f;
+        use_near_edges = _fence.boundary_edges_near(position_xy, radius, num_points, boundary, near_edges);
+    }
+
+    for (uint16_t i = 1; i < num_points; i++) {
+        // skip edges which are too far away to matter
+        if (use_near_edges && (near_edges[i / 32] & (1U << (i % 32))) == 0) {
+            continue;
+        }
+        // end points of current edge.  The fence's points may hold several polygons so it tells us where each edge starts
+        Vector2f start = boundary[_fence.boundary_edge_start(i, num_points, boundary)];
         Vector2f end = boundary[i];
         // vector from current position to closest point on current edge
         Vector2f limit_direction = Vector2f::closest_point(position_xy, start, end) - position_xy;
@@ -55,8 +55,8 @@ const AP_Param::GroupInfo AC_Fence::var_info[] = {
 
     // @Param: TOTAL
     // @DisplayName: Fence polygon point total
-    // @Description: Number of polygon points saved in eeprom (do not update manually)
-    // @Range: 1 20
+    // @Description: Number of polygon points saved in eeprom, not including any zones (do not update manually)
+    // @Range: 1 84
     // @User: Standard
     AP_GROUPINFO("TOTAL",       6,  AC_Fence,   _total, 0),
 
@@ -224,7 +224,7 @@ uint8_t AC_Fence::check_fence(float curr_alt)
     // polygon fence check
     if ((_enabled_fences & AC_FENCE_TYPE_POLYGON) != 0 ) {
         // check consistency of number of points
-        if (_boundary_num_points != _total) {
+        if (_boundary_total != _total) {
             _boundary_loaded = false;
         }
         // load fence if necessary
@@ -233,7 +233,7 @@ uint8_t AC_Fence::check_fence(float curr_alt)
         } else if (_boundary_valid) {
             // check if vehicle is outside the polygon fence
             const Vector3f& position = _inav.get_position();
-            if (_poly_loader.boundary_breached(Vector2f(position.x, position.y), _boundary_num_points, _boundary, true)) {
+            if (polygon_breached(Vector2f(position.x, position.y))) {
                 // check if this is a new breach
                 if ((_breached_fences & AC_FENCE_TYPE_POLYGON) == 0) {
                     // record that we have breached the polygon
@@ -280,7 +280,7 @@ bool AC_Fence::check_destination_within_fence(const Location_Class& loc)
         if (_inav.get_location(temp_loc)) {
             const struct Location &ekf_origin = _inav.get_origin();
             Vector2f position = location_diff(ekf_origin, loc) * 100.0f;
-            if (_poly_loader.boundary_breached(position, _boundary_num_points, _boundary, true)) {
+            if (polygon_breached(position)) {
                 return false;
             }
         }
@@ -359,9 +359,24 @@ Vector2f* AC_Fence::get_polygon_points(uint16_t& num_points) const
 /// returns true if we've breached the polygon boundary.  simple passthrough to underlying _poly_loader object
 bool AC_Fence::boundary_breached(const Vector2f& location, uint16_t num_points, const Vector2f* points) const
 {
+    if (points == _boundary && num_points == _boundary_num_points) {
+        return polygon_breached(location);
+    }
     return _poly_loader.boundary_breached(location, num_points, points, true);
 }
 
+/// get the edges of the polygon boundary which may be within radius of location.  simple passthrough to underlying _poly_loader object
+bool AC_Fence::boundary_edges_near(const Vector2f& location, float radius, uint16_t num_points, const Vector2f* points, AC_PolyFence_loader::EdgeMask &edges) const
+{
+    return _poly_loader.boundary_edges_near(location, radius, num_points, points, true, edges);
+}
+
+/// get the index of the start point of an edge identified by its end point.  simple passthrough to underlying _poly_loader object
+uint16_t AC_Fence::boundary_edge_start(uint16_t edge, uint16_t num_points, const Vector2f* points) const
+{
+    return _poly_loader.edge_start(edge, num_points, points, true);
+}
+
 /// handler for polygon fence messages with GCS
 void AC_Fence::handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg)
 {
@@ -375,6 +390,11 @@ void AC_Fence::handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg)
         case MAVLINK_MSG_ID_FENCE_POINT: {
             mavlink_fence_point_t packet;
             mavlink_msg_fence_point_decode(msg, &packet);
+            if (packet.idx >= _total && _total > 0) {
+                // zones follow the boundary
+                handle_zone_point(link, packet);
+                break;
+            }
             if (!check_latlng(packet.lat,packet.lng)) {
                 link.send_text(MAV_SEVERITY_WARNING, "Invalid fence point, lat or lng too large");
             } else {
@@ -384,6 +404,10 @@ void AC_Fence::handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg)
                 if (!_poly_loader.save_point_to_eeprom(packet.idx, point)) {
                     link.send_text(MAV_SEVERITY_WARNING, "Failed to save polygon point, too many points?");
                 } else {
+                    // a boundary uploaded without zones replaces any we have
+                    if (packet.count <= _total) {
+                        _poly_loader.set_num_zone_points(0);
+                    }
                     // trigger reload of points
                     _boundary_loaded = false;
                 }
@@ -395,10 +419,19 @@ void AC_Fence::handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg)
         case MAVLINK_MSG_ID_FENCE_FETCH_POINT: {
             mavlink_fence_fetch_point_t packet;
             mavlink_msg_fence_fetch_point_decode(msg, &packet);
-            // attempt to retrieve from eeprom
+            // attempt to retrieve from eeprom.  Zones follow the boundary, their markers having a latitude of +/-100 degrees
             Vector2l point;
-            if (_poly_loader.load_point_from_eeprom(packet.idx, point)) {
-                mavlink_msg_fence_point_send_buf(msg, link.get_chan(), msg->sysid, msg->compid, packet.idx, _total, point.x*1.0e-7f, point.y*1.0e-7f);
+            bool loaded;
+            if (packet.idx < _total || _total <= 0) {
+                loaded = _poly_loader.load_point_from_eeprom(packet.idx, point);
+            } else {
+                Vector2l origin;
+                loaded = _poly_loader.load_point_from_eeprom(0, origin) &&
+                         _poly_loader.load_zone_point_from_eeprom(packet.idx - _total, origin, point);
+            }
+            if (loaded) {
+                const uint8_t count = MIN(_total + _poly_loader.num_zone_points(), 255);
+                mavlink_msg_fence_point_send_buf(msg, link.get_chan(), msg->sysid, msg->compid, packet.idx, count, point.x*1.0e-7f, point.y*1.0e-7f);
             } else {
                 link.send_text(MAV_SEVERITY_WARNING, "Bad fence point");
             }
@@ -411,6 +444,36 @@ void AC_Fence::handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg)
     }
 }
 
+/// save a zone point received from the GCS.  packet.count is the total number of points including the zones
+void AC_Fence::handle_zone_point(GCS_MAVLINK &link, const mavlink_fence_point_t &packet)
+{
+    Vector2l point;
+    if (fabsf(packet.lat) > 90.0f) {
+        // a marker starting a zone
+        point.x = is_positive(packet.lat) ? AC_POLYFENCE_ZONE_INCLUSION : AC_POLYFENCE_ZONE_EXCLUSION;
+        point.y = 0;
+    } else if (!check_latlng(packet.lat,packet.lng)) {
+        link.send_text(MAV_SEVERITY_WARNING, "Invalid fence point, lat or lng too large");
+        return;
+    } else {
+        point.x = packet.lat*1.0e7f;
+        point.y = packet.lng*1.0e7f;
+    }
+
+    // corners are stored relative to the return point
+    Vector2l origin;
+    if (packet.count <= _total ||
+        !_poly_loader.load_point_from_eeprom(0, origin) ||
+        !_poly_loader.set_num_zone_points(packet.count - _total) ||
+        !_poly_loader.save_zone_point_to_eeprom(packet.idx - _total, origin, point)) {
+        link.send_text(MAV_SEVERITY_WARNING, "Failed to save zone point, too many points or too far away?");
+        return;
+    }
+
+    // trigger reload of points
+    _boundary_loaded = false;
+}
+
 /// load polygon points stored in eeprom into boundary array and perform validation
 bool AC_Fence::load_polygon_from_eeprom(bool force_reload)
 {
@@ -442,19 +505,75 @@ bool AC_Fence::load_polygon_from_eeprom(bool force_reload)
 
     // load each point from eeprom
     Vector2l temp_latlon;
+    Vector2l return_point;
     for (uint16_t index=0; index<_total; index++) {
         // load boundary point as lat/lon point
         _poly_loader.load_point_from_eeprom(index, temp_latlon);
+        if (index == 0) {
+            return_point = temp_latlon;
+        }
         // move into location structure and convert to offset from ekf origin
         temp_loc.lat = temp_latlon.x;
         temp_loc.lng = temp_latlon.y;
         _boundary[index] = location_diff(ekf_origin, temp_loc) * 100.0f;
     }
-    _boundary_num_points = _total;
+
+    // load the zones after the boundary.  Each starts with a marker giving its type, and is closed here
+    uint16_t polygon_start[AC_POLYFENCE_POLYGONS_MAX+1];
+    uint8_t num_polygons = 1;
+    uint16_t num_points = _total;
+    bool zones_valid = true;
+    _polygon_inclusion = 0;
+    polygon_start[0] = 1;
+    const uint8_t num_zone_points = (_total > 0) ? _poly_loader.num_zone_points() : 0;
+    for (uint16_t i=0; i<num_zone_points && zones_valid; i++) {
+        _poly_loader.load_zone_point_from_eeprom(i, return_point, temp_latlon);
+        if (temp_latlon.x == AC_POLYFENCE_ZONE_INCLUSION || temp_latlon.x == AC_POLYFENCE_ZONE_EXCLUSION) {
+            if (num_polygons > 1) {
+                _boundary[num_points++] = _boundary[polygon_start[num_polygons-1]];
+            }
+            if (num_polygons >= AC_POLYFENCE_POLYGONS_MAX) {
+                zones_valid = false;
+            } else {
+                if (temp_latlon.x == AC_POLYFENCE_ZONE_INCLUSION) {
+                    _polygon_inclusion |= (1U << num_polygons);
+                }
+                polygon_start[num_polygons++] = num_points;
+            }
+        } else if (num_polygons > 1) {
+            temp_loc.lat = temp_latlon.x;
+            temp_loc.lng = temp_latlon.y;
+            _boundary[num_points++] = location_diff(ekf_origin, temp_loc) * 100.0f;
+        } else {
+            // corners before the first marker
+            zones_valid = false;
+        }
+    }
+    if (zones_valid && num_polygons > 1) {
+        _boundary[num_points++] = _boundary[polygon_start[num_polygons-1]];
+    }
+    polygon_start[num_polygons] = num_points;
+    _boundary_total = _total;
     _boundary_loaded = true;
 
-    // update validity of polygon
-    _boundary_valid = _poly_loader.boundary_valid(_boundary_num_points, _boundary, true);
+    // update validity of polygon and zones.  If the zones are not valid enforce the boundary alone
+    if (!zones_valid || !_poly_loader.polygons_valid(num_points, _boundary, true, num_polygons, polygon_start)) {
+        num_polygons = 1;
+        num_points = _total;
+        _polygon_inclusion = 0;
+        polygon_start[1] = num_points;
+    }
+    _boundary_num_points = num_points;
+    _boundary_valid = _poly_loader.polygons_valid(_boundary_num_points, _boundary, true, num_polygons, polygon_start);
+
+    // create a grid of all edges to speed up breach checks and avoidance
+    _poly_loader.create_grid(_boundary_num_points, _boundary, true, num_polygons, polygon_start);
 
     return true;
 }
+
+/// returns true if location is outside the boundary or an inclusion zone, or inside an exclusion zone
+bool AC_Fence::polygon_breached(const Vector2f& location) const
+{
+    return _poly_loader.polygons_breached(location, _boundary_num_points, _boundary, true, _polygon_inclusion);
+}
@@ -115,8 +115,16 @@ public:
     Vector2f* get_polygon_points(uint16_t& num_points) const;
 
     /// returns true if we've breached the polygon boundary.  simple passthrough to underlying _poly_loader object
+    ///     for the fence's own points this includes the zones following the boundary
     bool boundary_breached(const Vector2f& location, uint16_t num_points, const Vector2f* points) const;
 
+    /// get the edges of the polygon boundary and zones which may be within radius of location.  simple passthrough to underlying _poly_loader object
+    ///     returns false if every edge should be checked
+    bool boundary_edges_near(const Vector2f& location, float radius, uint16_t num_points, const Vector2f* points, AC_PolyFence_loader::EdgeMask &edges) const;
+
+    /// get the index of the start point of an edge identified by its end point.  simple passthrough to underlying _poly_loader object
+    uint16_t boundary_edge_start(uint16_t edge, uint16_t num_points, const Vector2f* points) const;
+
     /// handler for polygon fence messages with GCS
     void handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg);
 
@@ -134,6 +142,12 @@ private:
     /// load polygon points stored in eeprom into boundary array and perform validation.  returns true if load successfully completed
     bool load_polygon_from_eeprom(bool force_reload = false);
 
+    /// save a zone point received from the GCS
+    void handle_zone_point(GCS_MAVLINK &link, const mavlink_fence_point_t &packet);
+
+    /// returns true if location is outside the boundary or an inclusion zone, or inside an exclusion zone
+    bool polygon_breached(const Vector2f& location) const;
+
     // pointers to other objects we depend upon
     const AP_AHRS& _ahrs;
     const AP_InertialNav& _inav;
@@ -168,9 +182,11 @@ private:
 
     // polygon fence variables
     AC_PolyFence_loader _poly_loader;               // helper for loading/saving polygon points
-    Vector2f        *_boundary = nullptr;           // array of boundary points.  Note: point 0 is the return point
-    uint8_t         _boundary_num_points = 0;       // number of points in the boundary array (should equal _total parameter after load has completed)
+    Vector2f        *_boundary = nullptr;           // array of boundary points followed by any zones.  Note: point 0 is the return point
+    uint8_t         _boundary_num_points = 0;       // number of points in the boundary array, including any zones
+    uint8_t         _boundary_total = 0;            // value of the _total parameter when the boundary array was loaded
+    uint32_t        _polygon_inclusion = 0;         // bit mask holding which polygons are inclusion polygons, bit 0 being the boundary
     bool            _boundary_create_attempted = false; // true if we have attempted to create the boundary array
     bool            _boundary_loaded = false;       // true if boundary array has been loaded from eeprom
-    bool            _boundary_valid = false;        // true if boundary forms a closed polygon
+    bool            _boundary_valid = false;        // true if boundary and zones form closed polygons
 };
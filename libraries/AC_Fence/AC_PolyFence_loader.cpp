@@ -3,6 +3,20 @@
 extern const AP_HAL::HAL& hal;
 
 static const StorageAccess fence_storage(StorageManager::StorageFence);
+static const StorageAccess fence_zone_storage(StorageManager::StorageFenceZones);
+
+// the zone storage starts with this header, followed by the zone points
+struct PACKED zone_header {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t num_points;
+};
+
+#define AC_POLYFENCE_ZONE_MAGIC     0x5A4E
+#define AC_POLYFENCE_ZONE_VERSION   1
+#define AC_POLYFENCE_ZONE_POINT_SIZE (2 * sizeof(int16_t))
+#define AC_POLYFENCE_ZONE_MARKER    INT16_MIN   // first int16 of a zone marker's entry; the second is 1 for an inclusion zone
+#define AC_POLYFENCE_ZONE_SCALE     100         // units of a zone corner's offset, in degrees * 1e7
 
 /*
   maximum number of fencepoints
@@ -12,11 +26,23 @@ uint8_t AC_PolyFence_loader::max_points() const
     return MIN(255U, fence_storage.size() / sizeof(Vector2l));
 }
 
-// create buffer to hold copy of eeprom points in RAM
+/*
+  maximum number of zone points
+ */
+uint8_t AC_PolyFence_loader::max_zone_points() const
+{
+    if (fence_zone_storage.size() < sizeof(struct zone_header)) {
+        return 0;
+    }
+    return MIN(255U, (fence_zone_storage.size() - sizeof(struct zone_header)) / AC_POLYFENCE_ZONE_POINT_SIZE);
+}
+
+// create buffer to hold copy of eeprom points, followed by the zones, in RAM
 // returns nullptr if not enough memory can be allocated
 void* AC_PolyFence_loader::create_point_array(uint8_t element_size)
 {
-    uint32_t array_size = max_points() * element_size;
+    // each zone point becomes one point in RAM, the marker's place being taken by the zone's closing point
+    uint32_t array_size = (max_points() + max_zone_points()) * element_size;
     if (hal.util->available_memory() < 100U + array_size) {
         // too risky to enable as we could run out of stack
         return nullptr;
@@ -53,6 +79,101 @@ bool AC_PolyFence_loader::save_point_to_eeprom(uint16_t i, const Vector2l& point
     return true;
 }
 
+// get the number of zone points stored in eeprom
+uint8_t AC_PolyFence_loader::num_zone_points() const
+{
+    struct zone_header header;
+    if (max_zone_points() == 0 || !fence_zone_storage.read_block(&header, 0, sizeof(header))) {
+        return 0;
+    }
+    if (header.magic != AC_POLYFENCE_ZONE_MAGIC || header.version != AC_POLYFENCE_ZONE_VERSION) {
+        // never written, or written by firmware we don't understand
+        return 0;
+    }
+    return MIN(header.num_points, max_zone_points());
+}
+
+// set the number of zone points stored in eeprom, zero removing the zones.  returns true on success
+bool AC_PolyFence_loader::set_num_zone_points(uint8_t count)
+{
+    if (count > max_zone_points()) {
+        return false;
+    }
+    if (count == num_zone_points()) {
+        // avoid rewriting the header for every point uploaded
+        return true;
+    }
+    struct zone_header header;
+    header.magic = AC_POLYFENCE_ZONE_MAGIC;
+    header.version = AC_POLYFENCE_ZONE_VERSION;
+    header.num_points = count;
+    return fence_zone_storage.write_block(0, &header, sizeof(header));
+}
+
+// load zone point from eeprom, returns true on successful load
+//   origin is the boundary's return point, and a zone marker gives AC_POLYFENCE_ZONE_INCLUSION or AC_POLYFENCE_ZONE_EXCLUSION as x
+bool AC_PolyFence_loader::load_zone_point_from_eeprom(uint16_t i, const Vector2l& origin, Vector2l& point)
+{
+    // sanity check index
+    if (i >= num_zone_points()) {
+        return false;
+    }
+
+    const uint16_t ofs = sizeof(struct zone_header) + i * AC_POLYFENCE_ZONE_POINT_SIZE;
+    const int16_t entry[2] { (int16_t)fence_zone_storage.read_uint16(ofs), (int16_t)fence_zone_storage.read_uint16(ofs + sizeof(int16_t)) };
+    point = decode_zone_point(origin, entry);
+    return true;
+}
+
+// save a zone point to eeprom, returns true on successful save
+//   fails if the point is a corner too far from origin to be stored
+bool AC_PolyFence_loader::save_zone_point_to_eeprom(uint16_t i, const Vector2l& origin, const Vector2l& point)
+{
+    // sanity check index
+    if (i >= max_zone_points()) {
+        return false;
+    }
+
+    int16_t entry[2];
+    if (!encode_zone_point(origin, point, entry)) {
+        return false;
+    }
+    const uint16_t ofs = sizeof(struct zone_header) + i * AC_POLYFENCE_ZONE_POINT_SIZE;
+    fence_zone_storage.write_uint16(ofs, entry[0]);
+    fence_zone_storage.write_uint16(ofs + sizeof(int16_t), entry[1]);
+    return true;
+}
+
+// convert a zone point to its compact form in eeprom, returns false if the point can't be stored
+bool AC_PolyFence_loader::encode_zone_point(const Vector2l& origin, const Vector2l& point, int16_t entry[2])
+{
+    if (point.x == AC_POLYFENCE_ZONE_INCLUSION || point.x == AC_POLYFENCE_ZONE_EXCLUSION) {
+        entry[0] = AC_POLYFENCE_ZONE_MARKER;
+        entry[1] = (point.x == AC_POLYFENCE_ZONE_INCLUSION) ? 1 : 0;
+        return true;
+    }
+
+    // offset from origin to the nearest unit, which must leave the marker value free
+    int64_t offset[2] { (int64_t)point.x - origin.x, (int64_t)point.y - origin.y };
+    for (uint8_t k=0; k<2; k++) {
+        offset[k] = (offset[k] + (offset[k] >= 0 ? AC_POLYFENCE_ZONE_SCALE/2 : -AC_POLYFENCE_ZONE_SCALE/2)) / AC_POLYFENCE_ZONE_SCALE;
+        if (offset[k] <= AC_POLYFENCE_ZONE_MARKER || offset[k] > INT16_MAX) {
+            return false;
+        }
+        entry[k] = offset[k];
+    }
+    return true;
+}
+
+// convert a zone point's compact form in eeprom back to a point
+Vector2l AC_PolyFence_loader::decode_zone_point(const Vector2l& origin, const int16_t entry[2])
+{
+    if (entry[0] == AC_POLYFENCE_ZONE_MARKER) {
+        return Vector2l(entry[1] ? AC_POLYFENCE_ZONE_INCLUSION : AC_POLYFENCE_ZONE_EXCLUSION, 0);
+    }
+    return Vector2l(origin.x + entry[0] * AC_POLYFENCE_ZONE_SCALE, origin.y + entry[1] * AC_POLYFENCE_ZONE_SCALE);
+}
+
 // validate array of boundary points (expressed as either floats or long ints)
 //   contains_return_point should be true for plane which stores the return point as the first point in the array
 //   returns true if boundary is valid
@@ -139,6 +260,329 @@ bool AC_PolyFence_loader::boundary_breached(const Vector2f& location, uint16_t n
     // start from 2nd point if boundary contains return point (as first point)
     uint8_t start_num = contains_return_point ? 1 : 0;
 
+    // if create_grid was called for these points the boundary is the first of the polygons found
+    uint32_t inside;
+    if (polygons_containing(location, num_points, points, contains_return_point, inside) > 0) {
+        return (inside & 1U) == 0;
+    }
+
     // check location is within the fence
     return Polygon_outside(location, &points[start_num], num_points-start_num);
 }
+
+// validate array of points holding the boundary followed by any number of zones, each a closed polygon
+//   polygon_start holds the first point of each of the count polygons followed by num_points, the boundary being first
+//   returns true if every polygon is closed and the return point (if any) is within the boundary
+bool AC_PolyFence_loader::polygons_valid(uint16_t num_points, const Vector2f* points, bool contains_return_point, uint8_t count, const uint16_t polygon_start[]) const
+{
+    // exit immediate if no points
+    if (points == nullptr) {
+        return false;
+    }
+
+    // start from 2nd point if boundary contains return point (as first point)
+    uint8_t start_num = contains_return_point ? 1 : 0;
+
+    if (!polygon_starts_valid(num_points, start_num, count, polygon_start)) {
+        return false;
+    }
+
+    // a polygon requires at least 4 point (a triangle and last point equals first)
+    for (uint8_t p=0; p<count; p++) {
+        const uint16_t n = polygon_start[p+1] - polygon_start[p];
+        if (n < 4 || !Polygon_complete(&points[polygon_start[p]], n)) {
+            return false;
+        }
+    }
+
+    // check return point is within the boundary
+    if (contains_return_point && Polygon_outside(points[0], &points[1], polygon_start[1]-1)) {
+        return false;
+    }
+
+    return true;
+}
+
+// create grid of the edges of the boundary and any zones following it so that boundary_breached,
+// polygons_containing and boundary_edges_near only check edges near the location
+//   polygon_start holds the first point of each of the count polygons followed by num_points, the boundary being first
+//   must be called again whenever the points change
+//   returns false if not enough memory could be allocated, in which case every edge is checked
+bool AC_PolyFence_loader::create_grid(uint16_t num_points, const Vector2f* points, bool contains_return_point, uint8_t count, const uint16_t polygon_start[])
+{
+    // free any existing grid
+    free(_grid.row_start);
+    free(_grid.row_edges);
+    free(_grid.cell_start);
+    free(_grid.cell_edges);
+    _grid.row_start = nullptr;
+    _grid.row_edges = nullptr;
+    _grid.cell_start = nullptr;
+    _grid.cell_edges = nullptr;
+    _polygons.points = nullptr;
+
+    // start from 2nd point if boundary contains return point (as first point)
+    const uint8_t start_num = contains_return_point ? 1 : 0;
+    if (points == nullptr || num_points <= start_num || num_points > 256) {
+        return false;
+    }
+
+    // record the boundary and zones
+    if (!polygon_starts_valid(num_points, start_num, count, polygon_start)) {
+        return false;
+    }
+    _polygons.count = count;
+    memset(_polygons.first, 0, sizeof(_polygons.first));
+    for (uint8_t p=0; p<=count; p++) {
+        _polygons.start[p] = polygon_start[p];
+        if (p < count) {
+            _polygons.first[polygon_start[p] / 32] |= (1U << (polygon_start[p] % 32));
+        }
+    }
+    _polygons.num_points = num_points;
+    _polygons.start_num = start_num;
+    _polygons.points = points;
+
+    // bounding box
+    Vector2f min = points[start_num];
+    Vector2f max = points[start_num];
+    for (uint16_t i=start_num+1; i<num_points; i++) {
+        min.x = MIN(min.x, points[i].x);
+        min.y = MIN(min.y, points[i].y);
+        max.x = MAX(max.x, points[i].x);
+        max.y = MAX(max.y, points[i].y);
+    }
+
+    // aim for about one edge per cell
+    const uint16_t num_edges = num_points - start_num;
+    const uint8_t size = constrain_int16(ceilf(sqrtf(num_edges)), 1, AC_POLYFENCE_GRID_SIZE_MAX);
+    _grid.min = min;
+    _grid.cols = size;
+    _grid.rows = size;
+    _grid.cell_size.x = MAX((max.x - min.x) / size, 1.0f);
+    _grid.cell_size.y = MAX((max.y - min.y) / size, 1.0f);
+    const uint16_t num_cells = _grid.cols * _grid.rows;
+
+    // count the entries in each list
+    uint16_t row_count[AC_POLYFENCE_GRID_SIZE_MAX] {};
+    uint16_t row_entries = 0;
+    uint16_t cell_entries = 0;
+    for (uint16_t i=start_num; i<num_points; i++) {
+        uint8_t col_min, col_max, row_min, row_max;
+        grid_edge_cells(points[edge_start(i, num_points, points, contains_return_point)], points[i], col_min, col_max, row_min, row_max);
+        for (uint8_t r=row_min; r<=row_max; r++) {
+            row_count[r]++;
+        }
+        row_entries += row_max - row_min + 1;
+        cell_entries += (col_max - col_min + 1) * (row_max - row_min + 1);
+    }
+
+    // check we have the memory
+    const uint32_t grid_size = (_grid.rows + 1 + num_cells + 1) * sizeof(uint16_t) + row_entries + cell_entries;
+    if (hal.util->available_memory() < 100U + grid_size) {
+        return false;
+    }
+    _grid.row_start = (uint16_t *)calloc(_grid.rows + 1, sizeof(uint16_t));
+    _grid.row_edges = (uint8_t *)calloc(row_entries, sizeof(uint8_t));
+    _grid.cell_start = (uint16_t *)calloc(num_cells + 1, sizeof(uint16_t));
+    _grid.cell_edges = (uint8_t *)calloc(cell_entries, sizeof(uint8_t));
+    if (_grid.row_start == nullptr || _grid.row_edges == nullptr || _grid.cell_start == nullptr || _grid.cell_edges == nullptr) {
+        free(_grid.row_start);
+        free(_grid.row_edges);
+        free(_grid.cell_start);
+        free(_grid.cell_edges);
+        _grid.row_start = nullptr;
+        _grid.row_edges = nullptr;
+        _grid.cell_start = nullptr;
+        _grid.cell_edges = nullptr;
+        return false;
+    }
+
+    // set each list's start to the end of the list.  The lists are then filled working back from the last
+    // edge, moving each start back as we go, so each list is in order of edge and its start ends up in place
+    uint16_t total = 0;
+    for (uint8_t r=0; r<_grid.rows; r++) {
+        total += row_count[r];
+        _grid.row_start[r] = total;
+    }
+    _grid.row_start[_grid.rows] = total;
+    for (uint16_t i=start_num; i<num_points; i++) {
+        uint8_t col_min, col_max, row_min, row_max;
+        grid_edge_cells(points[edge_start(i, num_points, points, contains_return_point)], points[i], col_min, col_max, row_min, row_max);
+        for (uint8_t r=row_min; r<=row_max; r++) {
+            for (uint8_t c=col_min; c<=col_max; c++) {
+                _grid.cell_start[r * _grid.cols + c]++;
+            }
+        }
+    }
+    for (uint16_t c=1; c<num_cells; c++) {
+        _grid.cell_start[c] += _grid.cell_start[c-1];
+    }
+    _grid.cell_start[num_cells] = cell_entries;
+
+    for (uint16_t i=num_points; i>start_num; i--) {
+        const uint8_t edge = i - 1;
+        uint8_t col_min, col_max, row_min, row_max;
+        grid_edge_cells(points[edge_start(edge, num_points, points, contains_return_point)], points[edge], col_min, col_max, row_min, row_max);
+        for (uint8_t r=row_min; r<=row_max; r++) {
+            _grid.row_edges[--_grid.row_start[r]] = edge;
+            for (uint8_t c=col_min; c<=col_max; c++) {
+                _grid.cell_edges[--_grid.cell_start[r * _grid.cols + c]] = edge;
+            }
+        }
+    }
+
+    return true;
+}
+
+// get the polygons containing a location as a bitmask, bit 0 being the boundary and the following bits the zones
+//   returns the number of polygons or zero if create_grid has not been called for these points
+uint8_t AC_PolyFence_loader::polygons_containing(const Vector2f& location, uint16_t num_points, const Vector2f* points, bool contains_return_point, uint32_t &inside) const
+{
+    if (!polygons_match(num_points, points, contains_return_point)) {
+        return 0;
+    }
+    inside = 0;
+
+    // without a grid check every edge of every polygon
+    if (!grid_matches(num_points, points, contains_return_point)) {
+        for (uint8_t p=0; p<_polygons.count; p++) {
+            if (!Polygon_outside(location, &points[_polygons.start[p]], _polygons.start[p+1] - _polygons.start[p])) {
+                inside |= (1U << p);
+            }
+        }
+        return _polygons.count;
+    }
+
+    // only edges crossing the location's row can change the answer (see Polygon_edge_crossed).  The row's
+    // list is in order of edge so we step through the polygons as we go to know which one each edge is in
+    const uint8_t row = grid_row(location.y);
+    uint8_t p = 0;
+    for (uint16_t e = _grid.row_start[row]; e < _grid.row_start[row+1]; e++) {
+        const uint8_t i = _grid.row_edges[e];
+        while (i >= _polygons.start[p+1]) {
+            p++;
+        }
+        const uint16_t j = (i == _polygons.start[p]) ? _polygons.start[p+1]-1 : i-1;
+        if (Polygon_edge_crossed(location, points[i], points[j])) {
+            inside ^= (1U << p);
+        }
+    }
+    return _polygons.count;
+}
+
+// check if a location is outside the boundary or an inclusion zone, or inside an exclusion zone
+//   inclusion is a bitmask of the polygons which are inclusion polygons, bit 0 being the boundary
+//   if create_grid has not been called for these points only the boundary is checked
+//   returns true if the location is breached
+bool AC_PolyFence_loader::polygons_breached(const Vector2f& location, uint16_t num_points, const Vector2f* points, bool contains_return_point, uint32_t inclusion) const
+{
+    uint32_t inside;
+    const uint8_t num_polygons = polygons_containing(location, num_points, points, contains_return_point, inside);
+    if (num_polygons == 0) {
+        return boundary_breached(location, num_points, points, contains_return_point);
+    }
+
+    // the boundary is always an inclusion polygon
+    inclusion |= 1U;
+    if (num_polygons < 32) {
+        inclusion &= (1U << num_polygons) - 1;
+    }
+    return (inside & inclusion) != inclusion || (inside & ~inclusion) != 0;
+}
+
+// get the edges of the boundary and zones which may be within radius of a location, using the grid
+//   returns false if there is no grid for these points, in which case every edge should be checked
+bool AC_PolyFence_loader::boundary_edges_near(const Vector2f& location, float radius, uint16_t num_points, const Vector2f* points, bool contains_return_point, EdgeMask &edges) const
+{
+    if (!grid_matches(num_points, points, contains_return_point)) {
+        return false;
+    }
+
+    // any edge with a point within radius has that point within the square around the location,
+    // and so is listed in one of the cells the square overlaps
+    memset(edges, 0, sizeof(EdgeMask));
+    const uint8_t col_min = grid_col(location.x - radius);
+    const uint8_t col_max = grid_col(location.x + radius);
+    const uint8_t row_min = grid_row(location.y - radius);
+    const uint8_t row_max = grid_row(location.y + radius);
+    for (uint8_t r=row_min; r<=row_max; r++) {
+        for (uint8_t c=col_min; c<=col_max; c++) {
+            const uint16_t cell = r * _grid.cols + c;
+            for (uint16_t e=_grid.cell_start[cell]; e<_grid.cell_start[cell+1]; e++) {
+                const uint8_t edge = _grid.cell_edges[e];
+                edges[edge / 32] |= (1U << (edge % 32));
+            }
+        }
+    }
+    return true;
+}
+
+// get the index of the start point of an edge identified by its end point
+uint16_t AC_PolyFence_loader::edge_start(uint16_t edge, uint16_t num_points, const Vector2f* points, bool contains_return_point) const
+{
+    if (polygons_match(num_points, points, contains_return_point) && edge < num_points) {
+        if ((_polygons.first[edge / 32] & (1U << (edge % 32))) == 0) {
+            return edge - 1;
+        }
+        // the first point of each polygon joins to its last point.  The polygons starting before this one give its index
+        uint8_t p = __builtin_popcount(_polygons.first[edge / 32] & ((1U << (edge % 32)) - 1));
+        for (uint8_t w=0; w<edge / 32; w++) {
+            p += __builtin_popcount(_polygons.first[w]);
+        }
+        return _polygons.start[p+1] - 1;
+    }
+    return (edge == (contains_return_point ? 1 : 0)) ? num_points-1 : edge-1;
+}
+
+// check polygon_start describes polygons of the points after start_num
+bool AC_PolyFence_loader::polygon_starts_valid(uint16_t num_points, uint8_t start_num, uint8_t count, const uint16_t polygon_start[]) const
+{
+    if (polygon_start == nullptr || count == 0 || count > AC_POLYFENCE_POLYGONS_MAX) {
+        return false;
+    }
+    if (polygon_start[0] != start_num || polygon_start[count] != num_points) {
+        return false;
+    }
+    for (uint8_t p=0; p<count; p++) {
+        if (polygon_start[p+1] <= polygon_start[p]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns true if create_grid was called for these points
+bool AC_PolyFence_loader::polygons_match(uint16_t num_points, const Vector2f* points, bool contains_return_point) const
+{
+    return _polygons.points != nullptr &&
+           _polygons.points == points &&
+           _polygons.num_points == num_points &&
+           _polygons.start_num == (contains_return_point ? 1 : 0);
+}
+
+// returns true if the grid was created for these points
+bool AC_PolyFence_loader::grid_matches(uint16_t num_points, const Vector2f* points, bool contains_return_point) const
+{
+    return polygons_match(num_points, points, contains_return_point) && _grid.row_start != nullptr;
+}
+
+// get the grid column or row holding a coordinate, constrained to be within the grid
+uint8_t AC_PolyFence_loader::grid_col(float x) const
+{
+    return constrain_float(floorf((x - _grid.min.x) / _grid.cell_size.x), 0, _grid.cols - 1);
+}
+
+uint8_t AC_PolyFence_loader::grid_row(float y) const
+{
+    return constrain_float(floorf((y - _grid.min.y) / _grid.cell_size.y), 0, _grid.rows - 1);
+}
+
+// get the range of grid cells overlapped by the bounding box of an edge
+void AC_PolyFence_loader::grid_edge_cells(const Vector2f &start, const Vector2f &end, uint8_t &col_min, uint8_t &col_max, uint8_t &row_min, uint8_t &row_max) const
+{
+    col_min = grid_col(MIN(start.x, end.x));
+    col_max = grid_col(MAX(start.x, end.x));
+    row_min = grid_row(MIN(start.y, end.y));
+    row_max = grid_row(MAX(start.y, end.y));
+}
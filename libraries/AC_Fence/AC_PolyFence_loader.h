@@ -3,15 +3,44 @@
 #include <AP_Common/AP_Common.h>
 #include <AP_Math/AP_Math.h>
 
+#define AC_POLYFENCE_GRID_SIZE_MAX  16  // maximum number of rows and columns in the boundary grid
+#define AC_POLYFENCE_POLYGONS_MAX   32  // maximum number of polygons (the boundary and its zones) in an array of points
+
+// a zone marker starts each zone in the points after the boundary.  Over MAVLink its latitude is +100 degrees for an
+// inclusion zone or -100 degrees for an exclusion zone, which can't be mistaken for a corner
+#define AC_POLYFENCE_ZONE_INCLUSION     1000000000  // latitude of an inclusion zone marker in degrees * 1e7
+#define AC_POLYFENCE_ZONE_EXCLUSION    -1000000000  // latitude of an exclusion zone marker in degrees * 1e7
+
+/*
+  The boundary is stored in the fence point storage exactly as before,
+  and FENCE_TOTAL counts only its points, so older firmware still loads
+  and enforces the boundary and just ignores the zones.
+
+  Zones are held in their own StorageFenceZones area (16k boards only)
+  as a header and then one compact entry per point: a zone marker,
+  which gives the type of the zone, then the zone's corners as int16
+  offsets from the boundary's return point in units of 1e-5 degrees
+  (about 1.1m, up to about 36km away).  Each zone is closed
+  implicitly.  Over MAVLink the zone entries follow the boundary, at
+  FENCE_POINT indexes from FENCE_TOTAL, and the count field of each
+  point gives the total including them.
+ */
+
 class AC_PolyFence_loader
 {
 
 public:
 
+    // bitmask of boundary edges, one bit per point.  Each edge is identified by the index of its end point
+    typedef uint32_t EdgeMask[8];
+
     // maximum number of fence points we can store in eeprom
     uint8_t max_points() const;
 
-    // create buffer to hold copy of eeprom points in RAM
+    // maximum number of zone points (markers and corners) we can store in eeprom
+    uint8_t max_zone_points() const;
+
+    // create buffer to hold copy of eeprom points, followed by the zones, in RAM
     // returns nullptr if not enough memory can be allocated
     void* create_point_array(uint8_t element_size);
 
@@ -21,6 +50,24 @@ public:
     // save a fence point to eeprom, returns true on successful save
     bool save_point_to_eeprom(uint16_t i, const Vector2l& point);
 
+    // get the number of zone points stored in eeprom
+    uint8_t num_zone_points() const;
+
+    // set the number of zone points stored in eeprom, zero removing the zones.  returns true on success
+    bool set_num_zone_points(uint8_t count);
+
+    // load zone point from eeprom, returns true on successful load
+    //   origin is the boundary's return point, and a zone marker gives AC_POLYFENCE_ZONE_INCLUSION or AC_POLYFENCE_ZONE_EXCLUSION as x
+    bool load_zone_point_from_eeprom(uint16_t i, const Vector2l& origin, Vector2l& point);
+
+    // save a zone point to eeprom, returns true on successful save
+    //   fails if the point is a corner too far from origin to be stored
+    bool save_zone_point_to_eeprom(uint16_t i, const Vector2l& origin, const Vector2l& point);
+
+    // convert between a zone point and its compact form in eeprom.  encode returns false if the point can't be stored
+    static bool encode_zone_point(const Vector2l& origin, const Vector2l& point, int16_t entry[2]);
+    static Vector2l decode_zone_point(const Vector2l& origin, const int16_t entry[2]);
+
     // validate array of boundary points (expressed as either floats or long ints)
     //   contains_return_point should be true for plane which stores the return point as the first point in the array
     //   returns true if boundary is valid
@@ -33,5 +80,74 @@ public:
     bool boundary_breached(const Vector2l& location, uint16_t num_points, const Vector2l* points, bool contains_return_point) const;
     bool boundary_breached(const Vector2f& location, uint16_t num_points, const Vector2f* points, bool contains_return_point) const;
 
-};
+    // validate array of points holding the boundary followed by any number of zones, each a closed polygon
+    //   polygon_start holds the first point of each of the count polygons followed by num_points, the boundary being first
+    //   returns true if every polygon is closed and the return point (if any) is within the boundary
+    bool polygons_valid(uint16_t num_points, const Vector2f* points, bool contains_return_point, uint8_t count, const uint16_t polygon_start[]) const;
+
+    // create grid of the edges of the boundary and any zones following it so that boundary_breached,
+    // polygons_containing and boundary_edges_near only check edges near the location
+    //   polygon_start holds the first point of each of the count polygons followed by num_points, the boundary being first
+    //   must be called again whenever the points change
+    //   returns false if not enough memory could be allocated, in which case every edge is checked
+    bool create_grid(uint16_t num_points, const Vector2f* points, bool contains_return_point, uint8_t count, const uint16_t polygon_start[]);
 
+    // get the polygons containing a location as a bitmask, bit 0 being the boundary and the following bits the zones
+    //   returns the number of polygons or zero if create_grid has not been called for these points
+    uint8_t polygons_containing(const Vector2f& location, uint16_t num_points, const Vector2f* points, bool contains_return_point, uint32_t &inside) const;
+
+    // check if a location is outside the boundary or an inclusion zone, or inside an exclusion zone
+    //   inclusion is a bitmask of the polygons which are inclusion polygons, bit 0 being the boundary
+    //   if create_grid has not been called for these points only the boundary is checked
+    //   returns true if the location is breached
+    bool polygons_breached(const Vector2f& location, uint16_t num_points, const Vector2f* points, bool contains_return_point, uint32_t inclusion) const;
+
+    // get the edges of the boundary and zones which may be within radius of a location, using the grid
+    //   returns false if there is no grid for these points, in which case every edge should be checked
+    bool boundary_edges_near(const Vector2f& location, float radius, uint16_t num_points, const Vector2f* points, bool contains_return_point, EdgeMask &edges) const;
+
+    // get the index of the start point of an edge identified by its end point
+    uint16_t edge_start(uint16_t edge, uint16_t num_points, const Vector2f* points, bool contains_return_point) const;
+
+private:
+
+    // check polygon_start describes polygons of the points after start_num
+    bool polygon_starts_valid(uint16_t num_points, uint8_t start_num, uint8_t count, const uint16_t polygon_start[]) const;
+
+    // returns true if create_grid was called for these points
+    bool polygons_match(uint16_t num_points, const Vector2f* points, bool contains_return_point) const;
+
+    // returns true if the grid was created for these points
+    bool grid_matches(uint16_t num_points, const Vector2f* points, bool contains_return_point) const;
+
+    // get the grid column or row holding a coordinate, constrained to be within the grid
+    uint8_t grid_col(float x) const;
+    uint8_t grid_row(float y) const;
+
+    // get the range of grid cells overlapped by the bounding box of an edge
+    void grid_edge_cells(const Vector2f &start, const Vector2f &end, uint8_t &col_min, uint8_t &col_max, uint8_t &row_min, uint8_t &row_max) const;
+
+    // polygons found by create_grid
+    struct {
+        const Vector2f *points = nullptr;   // points the polygons were found in
+        uint16_t num_points;
+        uint8_t start_num;                  // index of the first polygon point (1 if the first point is a return point)
+        uint8_t count;
+        uint16_t start[AC_POLYFENCE_POLYGONS_MAX+1];    // first point of each polygon followed by num_points
+        EdgeMask first;                     // first point of each polygon, so edge_start doesn't search for it
+    } _polygons;
+
+    // grid of the polygons' edges.  Each row holds a list of edges which cross its band of y
+    // coordinates (for polygons_containing) and each cell a list of edges which overlap it (for
+    // boundary_edges_near).  Lists are held in order of edge, one after another in a single array
+    struct {
+        Vector2f min;                       // bottom left corner of the polygons' bounding box
+        Vector2f cell_size;
+        uint8_t cols;
+        uint8_t rows;
+        uint16_t *row_start = nullptr;      // position of each row's list in row_edges, rows+1 elements
+        uint8_t *row_edges = nullptr;
+        uint16_t *cell_start = nullptr;     // position of each cell's list in cell_edges, cols*rows+1 elements
+        uint8_t *cell_edges = nullptr;
+    } _grid;
+};
@@ -0,0 +1,94 @@
+/*
+  measure polygon fence checks on a 250 point fence, checking every
+  edge and using the grid of edges: the breach check as done by the
+  fence each loop, and finding the edges near the vehicle as done by
+  polygon avoidance.
+
+  Arg(0) checks every edge, Arg(1) uses the grid.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AC_Fence/AC_PolyFence_loader.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define BENCH_NUM_POINTS 250
+#define BENCH_NUM_LOCATIONS 64
+
+class PolyFenceBench {
+public:
+    PolyFenceBench()
+    {
+        // star shaped fence of 3 to 5km radius, in cm, with a return point
+        uint32_t seed = 1;
+        points[0].zero();
+        const uint16_t edges = BENCH_NUM_POINTS - 2;
+        for (uint16_t i = 0; i < edges; i++) {
+            seed = seed * 1103515245U + 12345U;
+            const float radius = 300000 + ((seed >> 8) % 200000);
+            const float angle = i * M_2PI / edges;
+            points[1 + i] = Vector2f(radius * cosf(angle), radius * sinf(angle));
+        }
+        points[BENCH_NUM_POINTS - 1] = points[1];
+
+        for (uint8_t i = 0; i < BENCH_NUM_LOCATIONS; i++) {
+            seed = seed * 1103515245U + 12345U;
+            locations[i] = Vector2f((int32_t)(seed % 1000000) - 500000, (int32_t)((seed >> 12) % 1000000) - 500000);
+        }
+
+        loader.create_grid(BENCH_NUM_POINTS, points, true);
+    }
+
+    AC_PolyFence_loader loader;
+    Vector2f points[BENCH_NUM_POINTS];
+    Vector2f locations[BENCH_NUM_LOCATIONS];
+};
+
+// created on first use so that the HAL is available for the memory check in create_grid()
+static PolyFenceBench &get_bench()
+{
+    static PolyFenceBench bench;
+    return bench;
+}
+
+static void BM_PolyFenceBreached(benchmark::State& state)
+{
+    const bool use_grid = state.range_x();
+    const PolyFenceBench &bench = get_bench();
+    uint8_t k = 0;
+    while (state.KeepRunning()) {
+        const Vector2f &location = bench.locations[k++ % BENCH_NUM_LOCATIONS];
+        bool breached;
+        if (use_grid) {
+            breached = bench.loader.boundary_breached(location, BENCH_NUM_POINTS, bench.points, true);
+        } else {
+            breached = Polygon_outside(location, &bench.points[1], BENCH_NUM_POINTS - 1);
+        }
+        gbenchmark_escape(&breached);
+    }
+}
+
+static void BM_PolyFenceEdgesNear(benchmark::State& state)
+{
+    const bool use_grid = state.range_x();
+    const PolyFenceBench &bench = get_bench();
+    uint8_t k = 0;
+    while (state.KeepRunning()) {
+        const Vector2f &location = bench.locations[k++ % BENCH_NUM_LOCATIONS];
+        AC_PolyFence_loader::EdgeMask near_edges;
+        const bool have_mask = use_grid && bench.loader.boundary_edges_near(location, 5000, BENCH_NUM_POINTS, bench.points, true, near_edges);
+        float closest = FLT_MAX;
+        for (uint16_t i = 1, j = BENCH_NUM_POINTS - 1; i < BENCH_NUM_POINTS; j = i++) {
+            if (have_mask && (near_edges[i / 32] & (1U << (i % 32))) == 0) {
+                continue;
+            }
+            closest = MIN(closest, (Vector2f::closest_point(location, bench.points[j], bench.points[i]) - location).length());
+        }
+        gbenchmark_escape(&closest);
+    }
+}
+
+BENCHMARK(BM_PolyFenceBreached)->Arg(0)->Arg(1);
+BENCHMARK(BM_PolyFenceEdgesNear)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN()
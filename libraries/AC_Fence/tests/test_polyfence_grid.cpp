@@ -0,0 +1,280 @@
+#include <AP_gtest.h>
+
+#include <AC_Fence/AC_PolyFence_loader.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define TEST_POINTS_MAX 256
+
+static uint32_t test_seed = 1;
+
+static float test_rand(float min, float max)
+{
+    test_seed = test_seed * 1103515245U + 12345U;
+    return min + (max - min) * ((test_seed >> 8) & 0xFFFF) / 65536.0f;
+}
+
+/*
+  fill points with a closed star shaped polygon of edges points around
+  the origin, after a return point if contains_return_point is true.
+  Returns the number of points used
+ */
+static uint16_t make_polygon(Vector2f *points, uint16_t edges, bool contains_return_point, float flatten)
+{
+    const uint16_t start = contains_return_point ? 1 : 0;
+    points[0].zero();
+    for (uint16_t i = 0; i < edges; i++) {
+        const float angle = i * M_2PI / edges;
+        const float radius = test_rand(100, 5000);
+        points[start + i] = Vector2f(radius * cosf(angle), radius * sinf(angle) * flatten);
+    }
+    points[start + edges] = points[start];
+    return start + edges + 1;
+}
+
+static Vector2f test_location(const Vector2f *points, uint16_t start, uint16_t edges, uint16_t k)
+{
+    switch (k % 10) {
+    case 0:
+        // on a vertex
+        return points[start + (k % edges)];
+    case 1:
+        // on the middle of an edge
+        return (points[start + (k % edges)] + points[start + ((k + 1) % edges)]) * 0.5f;
+    default:
+        return Vector2f(test_rand(-6000, 6000), test_rand(-6000, 6000));
+    }
+}
+
+static void check_polygon(AC_PolyFence_loader &loader, uint16_t edges, bool contains_return_point, float flatten)
+{
+    Vector2f points[TEST_POINTS_MAX];
+    const uint16_t start = contains_return_point ? 1 : 0;
+    const uint16_t num_points = make_polygon(points, edges, contains_return_point, flatten);
+
+    const uint16_t polygon_start[] = { start, num_points };
+    ASSERT_TRUE(loader.create_grid(num_points, points, contains_return_point, 1, polygon_start));
+
+    for (uint16_t k = 0; k < 500; k++) {
+        const Vector2f location = test_location(points, start, edges, k);
+
+        // the grid must give exactly the same answer as checking every edge
+        EXPECT_EQ(Polygon_outside(location, &points[start], num_points - start),
+                  loader.boundary_breached(location, num_points, points, contains_return_point));
+
+        // every edge within radius must be returned
+        const float radius = test_rand(0, 2000);
+        AC_PolyFence_loader::EdgeMask near_edges;
+        ASSERT_TRUE(loader.boundary_edges_near(location, radius, num_points, points, contains_return_point, near_edges));
+        for (uint16_t i = start; i < num_points; i++) {
+            const uint16_t j = (i == start) ? num_points - 1 : i - 1;
+            const float distance = (Vector2f::closest_point(location, points[j], points[i]) - location).length();
+            if (distance <= radius) {
+                EXPECT_TRUE(near_edges[i / 32] & (1U << (i % 32)));
+            }
+        }
+    }
+}
+
+TEST(PolyFenceGridTest, MatchesBruteForce)
+{
+    AC_PolyFence_loader loader;
+    const uint16_t edges[] = { 3, 4, 10, 57, 128, 254 };
+    for (uint8_t i = 0; i < ARRAY_SIZE(edges); i++) {
+        check_polygon(loader, edges[i], true, 1.0f);
+        check_polygon(loader, edges[i], false, 1.0f);
+    }
+}
+
+TEST(PolyFenceGridTest, FlatPolygon)
+{
+    // nearly all of the polygon is in a single row of the grid
+    AC_PolyFence_loader loader;
+    check_polygon(loader, 100, true, 0.001f);
+}
+
+TEST(PolyFenceGridTest, OtherPointsNotUsed)
+{
+    AC_PolyFence_loader loader;
+    Vector2f points[TEST_POINTS_MAX];
+    Vector2f other[TEST_POINTS_MAX];
+    const uint16_t num_points = make_polygon(points, 50, true, 1.0f);
+    make_polygon(other, 50, true, 1.0f);
+    const uint16_t polygon_start[] = { 1, num_points };
+    ASSERT_TRUE(loader.create_grid(num_points, points, true, 1, polygon_start));
+
+    // a different set of points falls back to checking every edge
+    AC_PolyFence_loader::EdgeMask near_edges;
+    EXPECT_FALSE(loader.boundary_edges_near(Vector2f(), 100, num_points, other, true, near_edges));
+    for (uint16_t k = 0; k < 100; k++) {
+        const Vector2f location = test_location(other, 1, 50, k);
+        EXPECT_EQ(Polygon_outside(location, &other[1], num_points - 1),
+                  loader.boundary_breached(location, num_points, other, true));
+    }
+}
+
+TEST(PolyFenceGridTest, Zones)
+{
+    // a boundary followed by zones of different sizes, some overlapping each other and the boundary
+    AC_PolyFence_loader loader;
+    Vector2f points[TEST_POINTS_MAX];
+    uint16_t polygon_start[AC_POLYFENCE_POLYGONS_MAX+1];
+    const uint8_t zone_edges[] = { 3, 12, 5, 40, 4, 8, 20 };
+    const uint8_t num_polygons = ARRAY_SIZE(zone_edges) + 1;
+    uint16_t num_points = make_polygon(points, 60, true, 1.0f);
+    for (uint8_t z = 0; z < ARRAY_SIZE(zone_edges); z++) {
+        polygon_start[z+1] = num_points;
+        const Vector2f centre(test_rand(-4000, 4000), test_rand(-4000, 4000));
+        const uint16_t n = make_polygon(&points[num_points], zone_edges[z], false, 0.3f);
+        for (uint16_t i = 0; i < n; i++) {
+            points[num_points + i] = points[num_points + i] * 0.3f + centre;
+        }
+        num_points += n;
+    }
+    polygon_start[0] = 1;
+    polygon_start[num_polygons] = num_points;
+
+    EXPECT_TRUE(loader.polygons_valid(num_points, points, true, num_polygons, polygon_start));
+    EXPECT_FALSE(loader.boundary_valid(num_points, points, true));
+    ASSERT_TRUE(loader.create_grid(num_points, points, true, num_polygons, polygon_start));
+
+    for (uint16_t k = 0; k < 2000; k++) {
+        const Vector2f location = test_location(points, 1, num_points - 1, k);
+
+        uint32_t inside;
+        ASSERT_EQ(num_polygons, loader.polygons_containing(location, num_points, points, true, inside));
+        for (uint8_t p = 0; p < num_polygons; p++) {
+            const bool outside = Polygon_outside(location, &points[polygon_start[p]], polygon_start[p+1] - polygon_start[p]);
+            EXPECT_EQ(outside, (inside & (1U << p)) == 0);
+        }
+
+        // every edge within radius must be returned, and edges never join one polygon to the next
+        const float radius = test_rand(0, 2000);
+        AC_PolyFence_loader::EdgeMask near_edges;
+        ASSERT_TRUE(loader.boundary_edges_near(location, radius, num_points, points, true, near_edges));
+        for (uint8_t p = 0; p < num_polygons; p++) {
+            for (uint16_t i = polygon_start[p]; i < polygon_start[p+1]; i++) {
+                const uint16_t j = loader.edge_start(i, num_points, points, true);
+                EXPECT_EQ((i == polygon_start[p]) ? polygon_start[p+1] - 1 : i - 1, j);
+                const float distance = (Vector2f::closest_point(location, points[j], points[i]) - location).length();
+                if (distance <= radius) {
+                    EXPECT_TRUE(near_edges[i / 32] & (1U << (i % 32)));
+                }
+            }
+        }
+    }
+
+    // a zone left open is not valid
+    polygon_start[num_polygons] = num_points - 1;
+    EXPECT_FALSE(loader.polygons_valid(num_points - 1, points, true, num_polygons, polygon_start));
+}
+
+TEST(PolyFenceGridTest, BoundaryRevisitingFirstPoint)
+{
+    // a boundary passing through its first point part way round is still a single polygon
+    AC_PolyFence_loader loader;
+    const Vector2f points[] = {
+        Vector2f(500, 200),
+        Vector2f(0, 0), Vector2f(1000, 0), Vector2f(1000, 1000), Vector2f(0, 0),
+        Vector2f(-1000, 1000), Vector2f(-1000, 0), Vector2f(0, 0),
+    };
+    const uint16_t num_points = ARRAY_SIZE(points);
+    const uint16_t polygon_start[] = { 1, num_points };
+    EXPECT_TRUE(loader.polygons_valid(num_points, points, true, 1, polygon_start));
+    ASSERT_TRUE(loader.create_grid(num_points, points, true, 1, polygon_start));
+    for (uint16_t k = 0; k < 500; k++) {
+        const Vector2f location(test_rand(-1500, 1500), test_rand(-500, 1500));
+        EXPECT_EQ(Polygon_outside(location, &points[1], num_points - 1),
+                  loader.polygons_breached(location, num_points, points, true, 1));
+    }
+    EXPECT_EQ(num_points - 1, loader.edge_start(1, num_points, points, true));
+    EXPECT_EQ(3, loader.edge_start(4, num_points, points, true));
+}
+
+/*
+  a boundary with an exclusion zone and two overlapping inclusion
+  zones, all squares
+ */
+static uint16_t make_zones(Vector2f *points, uint16_t polygon_start[5])
+{
+    const Vector2f corners[] = { Vector2f(-1, -1), Vector2f(1, -1), Vector2f(1, 1), Vector2f(-1, 1), Vector2f(-1, -1) };
+    const struct {
+        Vector2f centre;
+        float size;
+    } squares[] = {
+        { Vector2f(0, 0), 1000 },       // boundary
+        { Vector2f(-500, -500), 200 },  // exclusion zone
+        { Vector2f(300, 300), 400 },    // inclusion zone
+        { Vector2f(500, 500), 400 },    // inclusion zone
+    };
+    uint16_t num_points = 1;
+    points[0].zero();
+    for (uint8_t p = 0; p < ARRAY_SIZE(squares); p++) {
+        polygon_start[p] = num_points;
+        for (uint8_t i = 0; i < ARRAY_SIZE(corners); i++) {
+            points[num_points++] = squares[p].centre + corners[i] * squares[p].size;
+        }
+    }
+    polygon_start[ARRAY_SIZE(squares)] = num_points;
+    return num_points;
+}
+
+TEST(PolyFenceGridTest, InclusionMask)
+{
+    AC_PolyFence_loader loader;
+    Vector2f points[TEST_POINTS_MAX];
+    uint16_t polygon_start[5];
+    const uint16_t num_points = make_zones(points, polygon_start);
+    ASSERT_TRUE(loader.polygons_valid(num_points, points, true, 4, polygon_start));
+    ASSERT_TRUE(loader.create_grid(num_points, points, true, 4, polygon_start));
+
+    // zones 2 and 3 are inclusion zones, so the vehicle must be inside both of them
+    const uint32_t inclusion = (1U << 2) | (1U << 3);
+    EXPECT_TRUE(loader.polygons_breached(Vector2f(2000, 0), num_points, points, true, inclusion));    // outside the boundary
+    EXPECT_TRUE(loader.polygons_breached(Vector2f(-500, -500), num_points, points, true, inclusion)); // inside the exclusion zone
+    EXPECT_TRUE(loader.polygons_breached(Vector2f(0, 0), num_points, points, true, inclusion));       // inside one inclusion zone
+    EXPECT_FALSE(loader.polygons_breached(Vector2f(400, 400), num_points, points, true, inclusion));  // inside both
+
+    // with every zone an exclusion zone only the boundary has to be kept to
+    EXPECT_FALSE(loader.polygons_breached(Vector2f(-900, 900), num_points, points, true, 0));
+    EXPECT_TRUE(loader.polygons_breached(Vector2f(400, 400), num_points, points, true, 0));
+
+    // the boundary is an inclusion polygon whatever the mask says, and bits for missing zones are ignored
+    EXPECT_TRUE(loader.polygons_breached(Vector2f(2000, 0), num_points, points, true, 0xFFFFFFF2));
+    EXPECT_FALSE(loader.polygons_breached(Vector2f(400, 400), num_points, points, true, 0xFFFFFFFC));
+
+    // polygon starts which don't fit the points are rejected
+    const uint16_t bad_start[] = { 1, 7, 6, num_points };
+    EXPECT_FALSE(loader.polygons_valid(num_points, points, true, 3, bad_start));
+    EXPECT_FALSE(loader.create_grid(num_points, points, true, 3, bad_start));
+}
+
+TEST(PolyFenceGridTest, ZonePointEncoding)
+{
+    const Vector2l origin(-353632610, 1491652300);
+    int16_t entry[2];
+
+    // markers keep their type
+    ASSERT_TRUE(AC_PolyFence_loader::encode_zone_point(origin, Vector2l(AC_POLYFENCE_ZONE_INCLUSION, 0), entry));
+    EXPECT_EQ(AC_POLYFENCE_ZONE_INCLUSION, AC_PolyFence_loader::decode_zone_point(origin, entry).x);
+    ASSERT_TRUE(AC_PolyFence_loader::encode_zone_point(origin, Vector2l(AC_POLYFENCE_ZONE_EXCLUSION, 0), entry));
+    EXPECT_EQ(AC_POLYFENCE_ZONE_EXCLUSION, AC_PolyFence_loader::decode_zone_point(origin, entry).x);
+
+    // corners come back to within half a unit
+    for (uint16_t k = 0; k < 1000; k++) {
+        const Vector2l point(origin.x + (int32_t)test_rand(-3200000, 3200000), origin.y + (int32_t)test_rand(-3200000, 3200000));
+        ASSERT_TRUE(AC_PolyFence_loader::encode_zone_point(origin, point, entry));
+        const Vector2l decoded = AC_PolyFence_loader::decode_zone_point(origin, entry);
+        EXPECT_LE(abs(decoded.x - point.x), 50);
+        EXPECT_LE(abs(decoded.y - point.y), 50);
+        EXPECT_NE(AC_POLYFENCE_ZONE_INCLUSION, decoded.x);
+        EXPECT_NE(AC_POLYFENCE_ZONE_EXCLUSION, decoded.x);
+    }
+
+    // corners too far from the origin can't be stored
+    EXPECT_FALSE(AC_PolyFence_loader::encode_zone_point(origin, Vector2l(origin.x + 3300000, origin.y), entry));
+    EXPECT_FALSE(AC_PolyFence_loader::encode_zone_point(origin, Vector2l(origin.x, origin.y - 3300000), entry));
+    EXPECT_FALSE(AC_PolyFence_loader::encode_zone_point(Vector2l(0, -1800000000), Vector2l(0, 1800000000), entry));
+}
+
+AP_GTEST_MAIN()
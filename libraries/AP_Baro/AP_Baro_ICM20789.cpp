@@ -337,7 +337,7 @@ void AP_Baro_ICM20789::update()
         _sem->give();
 #if 0
         // useful for debugging
-        DataFlash_Class::instance()->Log_Write("ICMB", "TimeUS,Traw,Praw,P,T", "QIIff",
+        DataFlash_Class::instance()->Log_Write_Typed<'Q','I','I','f','f'>("ICMB", "TimeUS,Traw,Praw,P,T",
                                                AP_HAL::micros64(),
                                                dd.Traw, dd.Praw, dd.P, dd.T);
 #endif
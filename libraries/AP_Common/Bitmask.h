@@ -81,6 +81,22 @@ public:
         return true;
     }
 
+    // return the first set bit at or after the given bitnumber, or -1 if there is none
+    int16_t first_set(uint16_t bit=0) const {
+        if (bit >= numbits) {
+            return -1;
+        }
+        uint16_t word = bit/32;
+        uint32_t w = bits[word] & ~((1U << (bit & 0x1f)) - 1);
+        while (w == 0) {
+            if (++word >= numwords) {
+                return -1;
+            }
+            w = bits[word];
+        }
+        return word*32 + __builtin_ctz(w);
+    }
+
     // return number of bits set
     uint16_t count() const {
         uint16_t sum = 0;
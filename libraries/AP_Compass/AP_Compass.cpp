@@ -444,6 +444,12 @@ Compass::Compass(void) :
     _compass_cal_autoreboot(false),
     _cal_complete_requires_reboot(false),
     _cal_has_run(false),
+#if COMPASS_CAL_IO_THREAD
+    _cal_io_registered(false),
+    _cal_io_next(0),
+    _cal_io_failures(0),
+    _cal_io_failures_seen(0),
+#endif
     _backend_count(0),
     _compass_count(0),
     _board_orientation(ROTATION_NONE),
@@ -42,6 +42,12 @@
 #define COMPASS_MAX_INSTANCES 3
 #define COMPASS_MAX_BACKEND   3
 
+// run the compass calibration fits in the IO thread rather than in
+// compass_cal_update(), one step for one compass on each call
+#ifndef COMPASS_CAL_IO_THREAD
+#define COMPASS_CAL_IO_THREAD 1
+#endif
+
 // fwd declaration of AP_AHRS
 class AP_AHRS;
 
@@ -360,6 +366,17 @@ private:
     bool _start_calibration(uint8_t i, bool retry=false, float delay_sec=0.0f);
     bool _start_calibration_mask(uint8_t mask, bool retry=false, bool autosave=false, float delay_sec=0.0f, bool autoreboot=false);
     bool _auto_reboot() { return _compass_cal_autoreboot; }
+#if COMPASS_CAL_IO_THREAD
+    void _calibration_io_update(void);
+    bool _cal_io_registered;
+    // compass to take the next fit step for
+    uint8_t _cal_io_next;
+    // incremented by the IO thread when a calibration fails, and
+    // compared with the count last seen by the main thread, so that
+    // neither thread writes the other's variable
+    uint8_t _cal_io_failures;
+    uint8_t _cal_io_failures_seen;
+#endif
 
     //keep track of which calibrators have been saved
     bool _cal_saved[COMPASS_MAX_INSTANCES];
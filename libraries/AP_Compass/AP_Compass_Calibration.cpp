@@ -12,12 +12,22 @@ Compass::compass_cal_update()
 {
     bool running = false;
 
+#if COMPASS_CAL_IO_THREAD
+    const uint8_t failures = _cal_io_failures;
+    if (failures != _cal_io_failures_seen) {
+        _cal_io_failures_seen = failures;
+        AP_Notify::events.compass_cal_failed = 1;
+    }
+#endif
+
     for (uint8_t i=0; i<COMPASS_MAX_INSTANCES; i++) {
+#if !COMPASS_CAL_IO_THREAD
         bool failure;
         _calibrator[i].update(failure);
         if (failure) {
             AP_Notify::events.compass_cal_failed = 1;
         }
+#endif
 
         if (_calibrator[i].check_for_timeout()) {
             AP_Notify::events.compass_cal_failed = 1;
@@ -42,6 +52,30 @@ Compass::compass_cal_update()
     }
 }
 
+#if COMPASS_CAL_IO_THREAD
+/*
+  run the calibration fits in the IO thread. Each call does one step
+  of the fit for one compass, taking the compasses in turn, so that
+  the other IO processes aren't held up by several steps at once
+ */
+void
+Compass::_calibration_io_update()
+{
+    for (uint8_t n=0; n<COMPASS_MAX_INSTANCES; n++) {
+        const uint8_t i = _cal_io_next;
+        _cal_io_next = (_cal_io_next + 1) % COMPASS_MAX_INSTANCES;
+        bool failure;
+        const bool stepped = _calibrator[i].update(failure);
+        if (failure) {
+            _cal_io_failures++;
+        }
+        if (stepped) {
+            break;
+        }
+    }
+}
+#endif
+
 bool
 Compass::_start_calibration(uint8_t i, bool retry, float delay)
 {
@@ -65,6 +99,13 @@ Compass::_start_calibration(uint8_t i, bool retry, float delay)
     _cal_saved[i] = false;
     _calibrator[i].start(retry, delay, get_offsets_max());
 
+#if COMPASS_CAL_IO_THREAD
+    if (!_cal_io_registered) {
+        hal.scheduler->register_io_process(FUNCTOR_BIND_MEMBER(&Compass::_calibration_io_update, void));
+        _cal_io_registered = true;
+    }
+#endif
+
     // disable compass learning both for calibration and after completion
     _learn.set_and_save(0);
 
@@ -138,12 +179,13 @@ Compass::_accept_calibration(uint8_t i)
     if (_cal_saved[i] || cal_status == COMPASS_CAL_NOT_STARTED) {
         return true;
     } else if (cal_status == COMPASS_CAL_SUCCESS) {
+        Vector3f ofs, diag, offdiag;
+        if (!cal.get_calibration(ofs, diag, offdiag)) {
+            return false;
+        }
         _cal_complete_requires_reboot = true;
         _cal_saved[i] = true;
 
-        Vector3f ofs, diag, offdiag;
-        cal.get_calibration(ofs, diag, offdiag);
-
         set_and_save_offsets(i, ofs);
         set_and_save_diagonals(i,diag);
         set_and_save_offdiagonals(i,offdiag);
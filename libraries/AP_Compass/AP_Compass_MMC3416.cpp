@@ -227,7 +227,7 @@ void AP_Compass_MMC3416::timer()
         }
 
 #if 0
-        DataFlash_Class::instance()->Log_Write("MMO", "TimeUS,Nx,Ny,Nz,Ox,Oy,Oz", "Qffffff",
+        DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f'>("MMO", "TimeUS,Nx,Ny,Nz,Ox,Oy,Oz",
                                                AP_HAL::micros64(),
                                                (double)new_offset.x,
                                                (double)new_offset.y,
@@ -288,7 +288,7 @@ void AP_Compass_MMC3416::timer()
 void AP_Compass_MMC3416::accumulate_field(Vector3f &field)
 {
 #if 0
-    DataFlash_Class::instance()->Log_Write("MMC", "TimeUS,X,Y,Z", "Qfff",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f'>("MMC", "TimeUS,X,Y,Z",
                                            AP_HAL::micros64(),
                                            (double)field.x,
                                            (double)field.y,
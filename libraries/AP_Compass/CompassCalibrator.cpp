@@ -55,6 +55,10 @@
  *
  * The fitting algorithm used is Levenberg-Marquardt. See also:
  * http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm
+ *
+ * The update function may be called from a thread other than the one
+ * calling the other functions, with the state shared between them
+ * protected by a semaphore.
  */
 
 #include "CompassCalibrator.h"
@@ -69,35 +73,61 @@ extern const AP_HAL::HAL& hal;
 
 CompassCalibrator::CompassCalibrator():
 _tolerance(COMPASS_CAL_DEFAULT_TOLERANCE),
-_sample_buffer(nullptr)
+_sample_buffer(nullptr),
+_sem(nullptr)
 {
+    memset(_completion_mask_snapshot, 0, sizeof(_completion_mask_snapshot));
     clear();
 }
 
 void CompassCalibrator::clear() {
+    // there is no semaphore until first started
+    if (_sem != nullptr && !_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
     set_status(COMPASS_CAL_NOT_STARTED);
+    if (_sem != nullptr) {
+        _sem->give();
+    }
 }
 
 void CompassCalibrator::start(bool retry, float delay, uint16_t offset_max) {
     if(running()) {
         return;
     }
+    if (_sem == nullptr) {
+        _sem = hal.util->new_semaphore();
+        if (_sem == nullptr) {
+            return;
+        }
+    }
+    if (!_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
     _offset_max = offset_max;
     _attempt = 1;
     _retry = retry;
     _delay_start_sec = delay;
     _start_time_ms = AP_HAL::millis();
     set_status(COMPASS_CAL_WAITING_TO_START);
+    _sem->give();
 }
 
-void CompassCalibrator::get_calibration(Vector3f &offsets, Vector3f &diagonals, Vector3f &offdiagonals) {
+bool CompassCalibrator::get_calibration(Vector3f &offsets, Vector3f &diagonals, Vector3f &offdiagonals) {
     if (_status != COMPASS_CAL_SUCCESS) {
-        return;
+        return false;
     }
 
+    // the fit is complete, so update() only holds the semaphore long
+    // enough to see that, and the parameters no longer change
+    if (!_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return false;
+    }
     offsets = _params.offset;
     diagonals = _params.diag;
     offdiagonals = _params.offdiag;
+    _sem->give();
+    return true;
 }
 
 float CompassCalibrator::get_completion_percent() const {
@@ -142,16 +172,30 @@ void CompassCalibrator::update_completion_mask()
     }
 }
 
-CompassCalibrator::completion_mask_t& CompassCalibrator::get_completion_mask()
+const CompassCalibrator::completion_mask_t& CompassCalibrator::get_completion_mask()
+{
+    update_snapshot();
+    return _completion_mask_snapshot;
+}
+
+void CompassCalibrator::update_snapshot()
 {
-    return _completion_mask;
+    // without a semaphore update() has never run
+    if (_sem != nullptr && !_sem->take_nonblocking()) {
+        return;
+    }
+    memcpy(_completion_mask_snapshot, _completion_mask, sizeof(_completion_mask_snapshot));
+    if (_sem != nullptr) {
+        _sem->give();
+    }
 }
 
 bool CompassCalibrator::check_for_timeout() {
     uint32_t tnow = AP_HAL::millis();
-    if(running() && tnow - _last_sample_ms > 1000) {
+    if(running() && tnow - _last_sample_ms > 1000 && _sem->take_nonblocking()) {
         _retry = false;
         set_status(COMPASS_CAL_FAILED);
+        _sem->give();
         return true;
     }
     return false;
@@ -160,6 +204,11 @@ bool CompassCalibrator::check_for_timeout() {
 void CompassCalibrator::new_sample(const Vector3f& sample) {
     _last_sample_ms = AP_HAL::millis();
 
+    // drop the sample if the state is in use, such as while fitting
+    if (_sem == nullptr || !_sem->take_nonblocking()) {
+        return;
+    }
+
     if(_status == COMPASS_CAL_WAITING_TO_START) {
         set_status(COMPASS_CAL_RUNNING_STEP_ONE);
     }
@@ -169,13 +218,20 @@ void CompassCalibrator::new_sample(const Vector3f& sample) {
         _sample_buffer[_samples_collected].set(sample);
         _samples_collected++;
     }
+
+    _sem->give();
 }
 
-void CompassCalibrator::update(bool &failure) {
+bool CompassCalibrator::update(bool &failure) {
     failure = false;
 
+    if(_sem == nullptr || !_sem->take_nonblocking()) {
+        return false;
+    }
+
     if(!fitting()) {
-        return;
+        _sem->give();
+        return false;
     }
 
     if(_status == COMPASS_CAL_RUNNING_STEP_ONE) {
@@ -208,6 +264,9 @@ void CompassCalibrator::update(bool &failure) {
             _fit_step++;
         }
     }
+
+    _sem->give();
+    return true;
 }
 
 /////////////////////////////////////////////////////////////
@@ -232,6 +291,7 @@ void CompassCalibrator::initialize_fit() {
     _sphere_lambda = 1.0f;
     _initial_fitness = _fitness;
     _fit_step = 0;
+    _normal_num_params = 0;
 }
 
 void CompassCalibrator::reset_state() {
@@ -482,90 +542,14 @@ void CompassCalibrator::calc_initial_offset()
         _params.offset -= _sample_buffer[k].get();
     }
     _params.offset /= _samples_collected;
+    _normal_num_params = 0;
 }
 
 void CompassCalibrator::run_sphere_fit()
 {
-    if(_sample_buffer == nullptr) {
-        return;
-    }
-
-    const float lma_damping = 10.0f;
-
-    float fitness = _fitness;
-    float fit1, fit2;
-    param_t fit1_params, fit2_params;
-    fit1_params = fit2_params = _params;
-
-    float JTJ[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
-    float JTJ2[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
-    float JTFI[COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
-
-    // Gauss Newton Part common for all kind of extensions including LM
-    for(uint16_t k = 0; k<_samples_collected; k++) {
-        Vector3f sample = _sample_buffer[k].get();
-
-        float sphere_jacob[COMPASS_CAL_NUM_SPHERE_PARAMS];
-
-        calc_sphere_jacob(sample, fit1_params, sphere_jacob);
-
-        for(uint8_t i = 0;i < COMPASS_CAL_NUM_SPHERE_PARAMS; i++) {
-            // compute JTJ
-            for(uint8_t j = 0; j < COMPASS_CAL_NUM_SPHERE_PARAMS; j++) {
-                JTJ[i*COMPASS_CAL_NUM_SPHERE_PARAMS+j] += sphere_jacob[i] * sphere_jacob[j];
-                JTJ2[i*COMPASS_CAL_NUM_SPHERE_PARAMS+j] += sphere_jacob[i] * sphere_jacob[j];   //a backup JTJ for LM
-            }
-            // compute JTFI
-            JTFI[i] += sphere_jacob[i] * calc_residual(sample, fit1_params);
-        }
-    }
-
-
-    //------------------------Levenberg-Marquardt-part-starts-here---------------------------------//
-    //refer: http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm#Choice_of_damping_parameter
-    for(uint8_t i = 0; i < COMPASS_CAL_NUM_SPHERE_PARAMS; i++) {
-        JTJ[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += _sphere_lambda;
-        JTJ2[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += _sphere_lambda/lma_damping;
-    }
-
-    if(!inverse(JTJ, JTJ, 4)) {
-        return;
-    }
-
-    if(!inverse(JTJ2, JTJ2, 4)) {
-        return;
-    }
-
-    for(uint8_t row=0; row < COMPASS_CAL_NUM_SPHERE_PARAMS; row++) {
-        for(uint8_t col=0; col < COMPASS_CAL_NUM_SPHERE_PARAMS; col++) {
-            fit1_params.get_sphere_params()[row] -= JTFI[col] * JTJ[row*COMPASS_CAL_NUM_SPHERE_PARAMS+col];
-            fit2_params.get_sphere_params()[row] -= JTFI[col] * JTJ2[row*COMPASS_CAL_NUM_SPHERE_PARAMS+col];
-        }
-    }
-
-    fit1 = calc_mean_squared_residuals(fit1_params);
-    fit2 = calc_mean_squared_residuals(fit2_params);
-
-    if(fit1 > _fitness && fit2 > _fitness){
-        _sphere_lambda *= lma_damping;
-    } else if(fit2 < _fitness && fit2 < fit1) {
-        _sphere_lambda /= lma_damping;
-        fit1_params = fit2_params;
-        fitness = fit2;
-    } else if(fit1 < _fitness){
-        fitness = fit1;
-    }
-    //--------------------Levenberg-Marquardt-part-ends-here--------------------------------//
-
-    if(!isnan(fitness) && fitness < _fitness) {
-        _fitness = fitness;
-        _params = fit1_params;
-        update_completion_mask();
-    }
+    run_fit(COMPASS_CAL_NUM_SPHERE_PARAMS, _sphere_lambda);
 }
 
-
-
 void CompassCalibrator::calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const{
     const Vector3f &offset = params.offset;
     const Vector3f &diag = params.diag;
@@ -597,63 +581,95 @@ void CompassCalibrator::calc_ellipsoid_jacob(const Vector3f& sample, const param
 
 void CompassCalibrator::run_ellipsoid_fit()
 {
-    if(_sample_buffer == nullptr) {
-        return;
-    }
-
-    const float lma_damping = 10.0f;
-
-
-    float fitness = _fitness;
-    float fit1, fit2;
-    param_t fit1_params, fit2_params;
-    fit1_params = fit2_params = _params;
-
+    run_fit(COMPASS_CAL_NUM_ELLIPSOID_PARAMS, _ellipsoid_lambda);
+}
 
-    float JTJ[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
-    float JTJ2[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
-    float JTFI[COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
+void CompassCalibrator::calc_normal_equations(uint8_t num_params)
+{
+    memset(_JTJ, 0, sizeof(_JTJ));
+    memset(_JTFI, 0, sizeof(_JTFI));
 
     // Gauss Newton Part common for all kind of extensions including LM
     for(uint16_t k = 0; k<_samples_collected; k++) {
         Vector3f sample = _sample_buffer[k].get();
 
-        float ellipsoid_jacob[COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
+        float jacob[COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
 
-        calc_ellipsoid_jacob(sample, fit1_params, ellipsoid_jacob);
+        if (num_params == COMPASS_CAL_NUM_SPHERE_PARAMS) {
+            calc_sphere_jacob(sample, _params, jacob);
+        } else {
+            calc_ellipsoid_jacob(sample, _params, jacob);
+        }
+        const float residual = calc_residual(sample, _params);
 
-        for(uint8_t i = 0;i < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; i++) {
-            // compute JTJ
-            for(uint8_t j = 0; j < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; j++) {
-                JTJ [i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+j] += ellipsoid_jacob[i] * ellipsoid_jacob[j];
-                JTJ2[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+j] += ellipsoid_jacob[i] * ellipsoid_jacob[j];
+        uint8_t n = 0;
+        for(uint8_t i = 0;i < num_params; i++) {
+            // compute JTJ, which is symmetric
+            for(uint8_t j = i; j < num_params; j++) {
+                _JTJ[n++] += jacob[i] * jacob[j];
             }
             // compute JTFI
-            JTFI[i] += ellipsoid_jacob[i] * calc_residual(sample, fit1_params);
+            _JTFI[i] += jacob[i] * residual;
         }
     }
+    _normal_num_params = num_params;
+}
+
+void CompassCalibrator::run_fit(uint8_t num_params, float &lambda)
+{
+    if(_sample_buffer == nullptr) {
+        return;
+    }
 
+    const float lma_damping = 10.0f;
 
+    if (_normal_num_params != num_params) {
+        calc_normal_equations(num_params);
+    }
+
+    float fitness = _fitness;
+    float fit1, fit2;
+    param_t fit1_params, fit2_params;
+    fit1_params = fit2_params = _params;
+    float *fit1_values, *fit2_values;
+    if (num_params == COMPASS_CAL_NUM_SPHERE_PARAMS) {
+        fit1_values = fit1_params.get_sphere_params();
+        fit2_values = fit2_params.get_sphere_params();
+    } else {
+        fit1_values = fit1_params.get_ellipsoid_params();
+        fit2_values = fit2_params.get_ellipsoid_params();
+    }
+
+    float JTJ[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
+    float JTJ2[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS];   //a backup JTJ for LM
+    uint8_t n = 0;
+    for(uint8_t i = 0; i < num_params; i++) {
+        for(uint8_t j = i; j < num_params; j++) {
+            JTJ[i*num_params+j] = JTJ[j*num_params+i] = _JTJ[n];
+            JTJ2[i*num_params+j] = JTJ2[j*num_params+i] = _JTJ[n];
+            n++;
+        }
+    }
 
     //------------------------Levenberg-Marquardt-part-starts-here---------------------------------//
     //refer: http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm#Choice_of_damping_parameter
-    for(uint8_t i = 0; i < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; i++) {
-        JTJ[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += _ellipsoid_lambda;
-        JTJ2[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += _ellipsoid_lambda/lma_damping;
+    for(uint8_t i = 0; i < num_params; i++) {
+        JTJ[i*num_params+i] += lambda;
+        JTJ2[i*num_params+i] += lambda/lma_damping;
     }
 
-    if(!inverse(JTJ, JTJ, 9)) {
+    if(!inverse(JTJ, JTJ, num_params)) {
         return;
     }
 
-    if(!inverse(JTJ2, JTJ2, 9)) {
+    if(!inverse(JTJ2, JTJ2, num_params)) {
         return;
     }
 
-    for(uint8_t row=0; row < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; row++) {
-        for(uint8_t col=0; col < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; col++) {
-            fit1_params.get_ellipsoid_params()[row] -= JTFI[col] * JTJ[row*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+col];
-            fit2_params.get_ellipsoid_params()[row] -= JTFI[col] * JTJ2[row*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+col];
+    for(uint8_t row=0; row < num_params; row++) {
+        for(uint8_t col=0; col < num_params; col++) {
+            fit1_values[row] -= _JTFI[col] * JTJ[row*num_params+col];
+            fit2_values[row] -= _JTFI[col] * JTJ2[row*num_params+col];
         }
     }
 
@@ -661,19 +677,20 @@ void CompassCalibrator::run_ellipsoid_fit()
     fit2 = calc_mean_squared_residuals(fit2_params);
 
     if(fit1 > _fitness && fit2 > _fitness){
-        _ellipsoid_lambda *= lma_damping;
+        lambda *= lma_damping;
     } else if(fit2 < _fitness && fit2 < fit1) {
-        _ellipsoid_lambda /= lma_damping;
+        lambda /= lma_damping;
         fit1_params = fit2_params;
         fitness = fit2;
     } else if(fit1 < _fitness){
         fitness = fit1;
     }
-    //--------------------Levenberg-part-ends-here--------------------------------//
+    //--------------------Levenberg-Marquardt-part-ends-here--------------------------------//
 
-    if(fitness < _fitness) {
+    if(!isnan(fitness) && fitness < _fitness) {
         _fitness = fitness;
         _params = fit1_params;
+        _normal_num_params = 0;
         update_completion_mask();
     }
 }
@@ -1,7 +1,10 @@
+#include <AP_HAL/AP_HAL.h>
 #include <AP_Math/AP_Math.h>
 
 #define COMPASS_CAL_NUM_SPHERE_PARAMS 4
 #define COMPASS_CAL_NUM_ELLIPSOID_PARAMS 9
+// upper triangle of JTJ for the ellipsoid params
+#define COMPASS_CAL_NUM_JTJ_ELEMENTS (COMPASS_CAL_NUM_ELLIPSOID_PARAMS*(COMPASS_CAL_NUM_ELLIPSOID_PARAMS+1)/2)
 #define COMPASS_CAL_NUM_SAMPLES 300
 
 //RMS tolerance
@@ -25,7 +28,8 @@ public:
     void start(bool retry, float delay, uint16_t offset_max);
     void clear();
 
-    void update(bool &failure);
+    // do one step of the fit, returning true if there was one to do
+    bool update(bool &failure);
     void new_sample(const Vector3f &sample);
 
     bool check_for_timeout();
@@ -34,10 +38,12 @@ public:
 
     void set_tolerance(float tolerance) { _tolerance = tolerance; }
 
-    void get_calibration(Vector3f &offsets, Vector3f &diagonals, Vector3f &offdiagonals);
+    // get the result of a successful calibration, returning false if
+    // there isn't one
+    bool get_calibration(Vector3f &offsets, Vector3f &diagonals, Vector3f &offdiagonals);
 
     float get_completion_percent() const;
-    completion_mask_t& get_completion_mask();
+    const completion_mask_t& get_completion_mask();
     enum compass_cal_status_t get_status() const { return _status; }
     float get_fitness() const { return sqrtf(_fitness); }
     uint8_t get_attempt() const { return _attempt; }
@@ -97,6 +103,24 @@ private:
     uint16_t _samples_collected;
     uint16_t _samples_thinned;
 
+    // normal equations of the fit at _params, kept between steps so
+    // they are only calculated when the params change. JTJ holds the
+    // upper triangle
+    float _JTJ[COMPASS_CAL_NUM_JTJ_ELEMENTS];
+    float _JTFI[COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
+    uint8_t _normal_num_params; // zero if not calculated
+
+    // semaphore for access to state shared with the thread running update()
+    AP_HAL::Semaphore *_sem;
+
+    // copy of _completion_mask taken under _sem for
+    // get_completion_mask(), which returns the last copy if update()
+    // holds the semaphore
+    completion_mask_t _completion_mask_snapshot;
+
+    // refresh the snapshot if the semaphore is free
+    void update_snapshot();
+
     bool set_status(compass_cal_status_t status);
 
     // returns true if sample should be added to buffer
@@ -125,6 +149,12 @@ private:
     void calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const;
     void run_ellipsoid_fit();
 
+    // calculate _JTJ and _JTFI for num_params of _params
+    void calc_normal_equations(uint8_t num_params);
+
+    // one Levenberg-Marquardt step of the fit of num_params of _params
+    void run_fit(uint8_t num_params, float &lambda);
+
     /**
      * Update #_completion_mask for the geodesic section of \p v. Corrections
      * are applied to \p v with #_params.
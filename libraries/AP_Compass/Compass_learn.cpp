@@ -99,7 +99,7 @@ void CompassLearn::update(void)
     }
 
     if (sample_available) {
-        DataFlash_Class::instance()->Log_Write("COFS", "TimeUS,OfsX,OfsY,OfsZ,Var,Yaw,WVar,N", "QffffffI",
+        DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f','I'>("COFS", "TimeUS,OfsX,OfsY,OfsZ,Var,Yaw,WVar,N",
                                                AP_HAL::micros64(),
                                                best_offsets.x,
                                                best_offsets.y,
@@ -46,19 +46,22 @@ AP_FlashStorage::AP_FlashStorage(uint8_t *_mem_buffer,
 bool AP_FlashStorage::init(void)
 {
     debug("running init()\n");
-    
-    // start with empty memory buffer
-    memset(mem_buffer, 0, storage_size);
 
     // find state of sectors
     struct sector_header header[2];
 
     // read headers and possibly initialise if bad signature
+    no_checkpoint_sectors = 0;
     for (uint8_t i=0; i<2; i++) {
         if (!flash_read(i, 0, (uint8_t *)&header[i], sizeof(header[i]))) {
             return false;
         }
-        bool bad_header = (header[i].signature != signature);
+        bool bad_header = false;
+        if (header[i].signature == signature_no_checkpoints) {
+            no_checkpoint_sectors |= 1U<<i;
+        } else if (header[i].signature != signature) {
+            bad_header = true;
+        }
         enum SectorState state = (enum SectorState)header[i].state;
         if (state != SECTOR_STATE_AVAILABLE &&
             state != SECTOR_STATE_IN_USE &&
@@ -76,7 +79,14 @@ bool AP_FlashStorage::init(void)
     enum SectorState states[2] {(enum SectorState)header[0].state, (enum SectorState)header[1].state};
     uint8_t first_sector;
 
-    if (states[0] == states[1]) {
+    if (states[0] == SECTOR_STATE_IN_USE && states[1] == SECTOR_STATE_IN_USE &&
+        (no_checkpoint_sectors == 1 || no_checkpoint_sectors == 2)) {
+        // copy from a sector without checkpoints was interrupted
+        // before that sector was marked full, so it still has all the
+        // data
+        first_sector = no_checkpoint_sectors == 1 ? 0 : 1;
+        states[first_sector] = SECTOR_STATE_FULL;
+    } else if (states[0] == states[1]) {
         if (states[0] != SECTOR_STATE_AVAILABLE) {
             return erase_all();
         }
@@ -94,27 +104,42 @@ bool AP_FlashStorage::init(void)
         first_sector = 0;
     }
 
-    // load data from any current sectors
-    for (uint8_t i=0; i<2; i++) {
-        uint8_t sector = (first_sector + i) & 1;
-        if (states[sector] == SECTOR_STATE_IN_USE ||
-            states[sector] == SECTOR_STATE_FULL) {
-            if (!load_sector(sector)) {
-                return erase_all();
-            }
-        }
+    // load data from any current sectors, starting at the latest
+    // checkpoint. If that fails then try again reading everything
+    bool complete;
+    if (!load_sectors(states, first_sector, true, complete) &&
+        !load_sectors(states, first_sector, false, complete)) {
+        return erase_all();
     }
 
+    // find the checkpoints already written in the current sector. If
+    // the data runs past the end of the space for it then the sector
+    // was written without checkpoints, and we can't add any
+    const bool no_checkpoints = (no_checkpoint_sectors & (1U<<current_sector)) != 0;
+    if (no_checkpoints ||
+        !find_checkpoint(current_sector, checkpoint_offset, checkpoints_used)) {
+        checkpoint_offset = sizeof(struct sector_header);
+    }
+    if (no_checkpoints || write_offset > data_end()) {
+        checkpoints_used = num_checkpoints;
+    }
+    checkpoint_size = copy_size();
+
     // clear any write error
     write_error = false;
     reserved_space = 0;
-    
-    // if the first sector is full then write out all data so we can erase it
-    if (states[first_sector] == SECTOR_STATE_FULL) {
+    compacting = false;
+    erase_pending = false;
+
+    // if the first sector is full then write out all data so we can
+    // erase it, unless the current sector already holds all of it
+    if (states[first_sector] == SECTOR_STATE_FULL && !complete) {
         current_sector = first_sector ^ 1;
+        const uint32_t start = write_offset;
         if (!write_all()) {
             return erase_all();
         }
+        write_checkpoint(start);
     }
 
     // erase any sectors marked full
@@ -127,6 +152,13 @@ bool AP_FlashStorage::init(void)
     }
 
     reserved_space = 0;
+
+    // the data in a sector without checkpoints runs to the end of the
+    // sector, so move it to a sector with the current signature
+    if ((no_checkpoint_sectors & (1U<<current_sector)) &&
+        !copy_from_no_checkpoint_sector()) {
+        return erase_all();
+    }
     
     // ready to use
     return true;
@@ -142,15 +174,23 @@ bool AP_FlashStorage::switch_full_sector(void)
     
     // clear any write error
     write_error = false;
-    reserved_space = 0;
-    
-    if (!write_all()) {
-        return false;
+
+    // if the other sector holds data we still need then first write
+    // all data to the space reserved for it in this sector
+    if (reserved_space != 0) {
+        reserved_space = 0;
+        compacting = false;
+        const uint32_t start = write_offset;
+        if (!write_all()) {
+            return false;
+        }
+        write_checkpoint(start);
     }
 
     if (!erase_sector(current_sector ^ 1)) {
         return false;
     }
+    erase_pending = false;
 
     return switch_sectors();
 }
@@ -169,7 +209,7 @@ bool AP_FlashStorage::write(uint16_t offset, uint16_t length)
             n = length;
         }
 
-        if (write_offset > flash_sector_size - (sizeof(struct block_header) + max_write + reserved_space)) {
+        if (write_offset > data_end() - (sizeof(struct block_header) + max_write + reserved_space)) {
             if (!switch_sectors()) {
                 if (!flash_erase_ok()) {
                     return false;
@@ -215,11 +255,198 @@ bool AP_FlashStorage::write(uint16_t offset, uint16_t length)
 }
 
 /*
-  load all data from a flash sector into mem_buffer
+  do a small step of background work. When copying mem_buffer for a
+  checkpoint this writes the next part of it, so each call takes about
+  as long as a normal write
+ */
+bool AP_FlashStorage::background(void)
+{
+    if (write_error) {
+        return false;
+    }
+
+    if (erase_pending && flash_erase_ok()) {
+        if (!erase_sector(current_sector ^ 1)) {
+            return false;
+        }
+        erase_pending = false;
+        return true;
+    }
+
+    if (!compacting) {
+        // start a checkpoint when enough has been written since the
+        // last one, both for the sector and for the size of the copy,
+        // if there is room for it without using the reserved space
+        if (checkpoints_used >= num_checkpoints ||
+            write_offset - checkpoint_offset < data_end() / checkpoint_fraction ||
+            write_offset - checkpoint_offset < checkpoint_copy_ratio * checkpoint_size ||
+            write_offset + reserve_size + reserved_space > data_end()) {
+            return false;
+        }
+        start_compaction();
+    }
+
+    // parts of mem_buffer which are all zero don't need copying
+    while (compact_offset < storage_size && all_zero(compact_offset, max_write)) {
+        compact_offset += max_write;
+    }
+
+    if (compact_offset < storage_size) {
+        if (write_offset > data_end() - (sizeof(struct block_header) + max_write + reserved_space) ||
+            !write(compact_offset, max_write)) {
+            // no room to finish, leave it to switch_full_sector()
+            compacting = false;
+            return false;
+        }
+        compact_offset += max_write;
+        return true;
+    }
+
+    // the copy is complete, anything written before it is not needed
+    compacting = false;
+    if (write_checkpoint(compact_start) && reserved_space != 0) {
+        reserved_space = 0;
+        erase_pending = true;
+    }
+    return true;
+}
+
+/*
+  start copying mem_buffer to the current sector. Any write to
+  mem_buffer while copying is written after the part of the copy it
+  changes or replaces it in the copy, so loading from the start of the
+  copy gives the latest data
+ */
+void AP_FlashStorage::start_compaction(void)
+{
+    compacting = true;
+    compact_offset = 0;
+    compact_start = write_offset;
+}
+
+/*
+  end of the space for data in each sector. This leaves the checkpoints
+  at the end of the sector and an erased block header before them to
+  mark the end of the data
+ */
+uint32_t AP_FlashStorage::data_end(void) const
+{
+    if (no_checkpoint_sectors & (1U<<current_sector)) {
+        // firmware without checkpoints used the whole sector
+        return flash_sector_size;
+    }
+    return flash_sector_size - (num_checkpoints * sizeof(struct checkpoint) + sizeof(struct block_header));
+}
+
+/*
+  load data from the sectors in use into mem_buffer, oldest first. If
+  use_checkpoint is true then start at the latest checkpoint, skipping
+  anything written before it. complete is set to true if the current
+  sector has a checkpoint and so holds all the data
+ */
+bool AP_FlashStorage::load_sectors(const enum SectorState states[2], uint8_t first_sector, bool use_checkpoint, bool &complete)
+{
+    // start with empty memory buffer
+    memset(mem_buffer, 0, storage_size);
+    complete = false;
+
+    uint8_t start = 0;
+    uint32_t start_ofs = sizeof(struct sector_header);
+    bool found = false;
+    for (uint8_t i=0; i<2 && use_checkpoint; i++) {
+        uint8_t sector = (first_sector + i) & 1;
+        uint32_t ofs;
+        uint8_t used;
+        if ((states[sector] == SECTOR_STATE_IN_USE ||
+             states[sector] == SECTOR_STATE_FULL) &&
+            !(no_checkpoint_sectors & (1U<<sector)) &&
+            find_checkpoint(sector, ofs, used)) {
+            start = i;
+            start_ofs = ofs;
+            found = true;
+        }
+    }
+
+    for (uint8_t i=start; i<2; i++) {
+        uint8_t sector = (first_sector + i) & 1;
+        if (states[sector] != SECTOR_STATE_IN_USE &&
+            states[sector] != SECTOR_STATE_FULL) {
+            continue;
+        }
+        if (!load_sector(sector, i == start ? start_ofs : sizeof(struct sector_header))) {
+            return false;
+        }
+        if (i == start && found) {
+            // data written past the end of the space for it means the
+            // checkpoints can't be trusted
+            if (write_offset > data_end()) {
+                return false;
+            }
+            complete = true;
+        } else {
+            complete = false;
+        }
+    }
+    return true;
+}
+
+/*
+  find the latest valid checkpoint in a sector, setting used to the
+  number of checkpoints written in it
  */
-bool AP_FlashStorage::load_sector(uint8_t sector)
+bool AP_FlashStorage::find_checkpoint(uint8_t sector, uint32_t &offset, uint8_t &used)
 {
-    uint32_t ofs = sizeof(sector_header);
+    struct checkpoint checkpoints[num_checkpoints];
+    used = 0;
+    if (!flash_read(sector, flash_sector_size - sizeof(checkpoints), (uint8_t *)checkpoints, sizeof(checkpoints))) {
+        return false;
+    }
+    bool found = false;
+    for (uint8_t i=0; i<num_checkpoints; i++) {
+        const struct checkpoint &c = checkpoints[i];
+        if (c.offset == 0xFFFFFFFF && c.offset_inverted == 0xFFFFFFFF) {
+            continue;
+        }
+        used = i+1;
+        if (c.offset == ~c.offset_inverted &&
+            c.offset >= sizeof(struct sector_header) &&
+            c.offset <= data_end()) {
+            offset = c.offset;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/*
+  write a checkpoint in the current sector for a complete copy of
+  mem_buffer starting at offset
+ */
+bool AP_FlashStorage::write_checkpoint(uint32_t offset)
+{
+    if (checkpoints_used >= num_checkpoints) {
+        return false;
+    }
+    struct checkpoint c;
+    c.offset = offset;
+    c.offset_inverted = ~offset;
+    const uint32_t ofs = flash_sector_size - (num_checkpoints - checkpoints_used) * sizeof(c);
+    checkpoints_used++;
+    if (!flash_write(current_sector, ofs, (const uint8_t *)&c, sizeof(c))) {
+        return false;
+    }
+    debug("checkpoint in sector %u at %u\n", (unsigned)current_sector, (unsigned)offset);
+    checkpoint_offset = offset;
+    checkpoint_size = copy_size();
+    return true;
+}
+
+/*
+  load data from a flash sector into mem_buffer, starting at ofs
+ */
+bool AP_FlashStorage::load_sector(uint8_t sector, uint32_t ofs)
+{
+    current_sector = sector;
     while (ofs < flash_sector_size - sizeof(struct block_header)) {
         struct block_header header;
         if (!flash_read(sector, ofs, (uint8_t *)&header, sizeof(header))) {
@@ -257,6 +484,47 @@ bool AP_FlashStorage::load_sector(uint8_t sector)
     return true;
 }
 
+/*
+  copy all data from the current sector, written by firmware without
+  checkpoints, to the other sector and erase it. The other sector is
+  marked in use before the current one is marked full, so init() can
+  finish the copy if it is interrupted
+ */
+bool AP_FlashStorage::copy_from_no_checkpoint_sector(void)
+{
+    const uint8_t old_sector = current_sector;
+    const uint8_t new_sector = current_sector ^ 1;
+    debug("copying sector %u without checkpoints\n", (unsigned)old_sector);
+
+    // the other sector holds no data, but may have the old signature
+    if ((no_checkpoint_sectors & (1U<<new_sector)) && !erase_sector(new_sector)) {
+        return false;
+    }
+
+    struct sector_header header;
+    header.signature = signature;
+    header.state = SECTOR_STATE_IN_USE;
+    if (!flash_write(new_sector, 0, (const uint8_t *)&header, sizeof(header))) {
+        return false;
+    }
+    header.signature = signature_no_checkpoints;
+    header.state = SECTOR_STATE_FULL;
+    if (!flash_write(old_sector, 0, (const uint8_t *)&header, sizeof(header))) {
+        return false;
+    }
+
+    current_sector = new_sector;
+    write_offset = sizeof(header);
+    checkpoints_used = 0;
+    checkpoint_offset = write_offset;
+    if (!write_all()) {
+        return false;
+    }
+    write_checkpoint(sizeof(header));
+
+    return erase_sector(old_sector);
+}
+
 /*
   erase one sector
  */
@@ -265,6 +533,7 @@ bool AP_FlashStorage::erase_sector(uint8_t sector)
     if (!flash_erase(sector)) {
         return false;
     }
+    no_checkpoint_sectors &= ~(1U<<sector);
 
     struct sector_header header;
     header.signature = signature;
@@ -278,9 +547,15 @@ bool AP_FlashStorage::erase_sector(uint8_t sector)
 bool AP_FlashStorage::erase_all(void)
 {
     write_error = false;
+    reserved_space = 0;
+    compacting = false;
+    erase_pending = false;
 
     current_sector = 0;
     write_offset = sizeof(struct sector_header);
+    checkpoints_used = 0;
+    checkpoint_offset = write_offset;
+    checkpoint_size = copy_size();
     
     if (!erase_sector(0) || !erase_sector(1)) {
         return false;
@@ -310,6 +585,21 @@ bool AP_FlashStorage::write_all(void)
     return true;
 }
 
+/*
+  flash space needed to write all of mem_buffer, skipping the parts
+  which are all zero as write_all() does
+ */
+uint32_t AP_FlashStorage::copy_size(void)
+{
+    uint32_t size = 0;
+    for (uint16_t ofs=0; ofs<storage_size; ofs += max_write) {
+        if (!all_zero(ofs, max_write)) {
+            size += sizeof(struct block_header) + max_write;
+        }
+    }
+    return size;
+}
+
 // return true if all bytes are zero
 bool AP_FlashStorage::all_zero(uint16_t ofs, uint16_t size)
 {
@@ -329,6 +619,10 @@ bool AP_FlashStorage::switch_sectors(void)
         debug("both sectors are full\n");
         return false;
     }
+    if (erase_pending) {
+        // other sector is full of data we don't need, so needs erasing
+        return false;
+    }
 
     struct sector_header header;
     header.signature = signature;
@@ -371,6 +665,12 @@ bool AP_FlashStorage::switch_sectors(void)
     reserved_space = reserve_size;
     
     write_offset = sizeof(header);
+    checkpoints_used = 0;
+    checkpoint_offset = write_offset;
+
+    // copy all data to the new sector in the background, so the full
+    // sector is no longer needed
+    start_compaction();
     return true;    
 }
 
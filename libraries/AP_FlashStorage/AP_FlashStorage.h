@@ -19,12 +19,19 @@
   backend for any HAL. The basic methodology is to use a log based
   storage system over two flash sectors. Key design elements:
 
-  - erase of sectors only called on init, as erase will lock the flash
-    and prevent code execution
+  - erase of sectors only called on init, or when the caller says
+    erasing is OK, as erase will lock the flash and prevent code
+    execution
 
   - write using log based system
 
-  - read requires scan of all log elements. This is expected to be called rarely
+  - read requires scan of log elements. This is expected to be called
+    rarely. Checkpoints at the end of each sector give the offset of
+    the latest complete copy of the data, so the scan can start there
+
+  - after switching sectors all data is copied to the new sector in
+    small steps in the background, so the full sector is no longer
+    needed and can be erased when that is OK
 
   - assumes flash that erases to 0xFF and where writing can only clear
     bits, not set them
@@ -56,6 +63,7 @@ public:
     FUNCTOR_TYPEDEF(FlashRead, bool, uint8_t , uint32_t , uint8_t *, uint16_t );
     
     // caller provided function to erase a flash sector. Only called from init()
+    // or when flash_erase_ok() returns true
     FUNCTOR_TYPEDEF(FlashErase, bool, uint8_t );
 
     // caller provided function to indicate if erasing is allowed
@@ -82,6 +90,11 @@ public:
     // write some data to storage from mem_buffer
     bool write(uint16_t offset, uint16_t length);
 
+    // do a small step of background work, copying part of mem_buffer
+    // for a checkpoint or erasing a sector no longer needed. Should be
+    // called regularly when not writing. Returns true if work was done
+    bool background(void);
+
     // fixed storage size
     static const uint16_t storage_size = block_size * num_blocks;
     
@@ -98,8 +111,31 @@ private:
     uint32_t reserved_space;
     bool write_error;
 
-    // 24 bit signature
-    static const uint32_t signature = 0x51685B;
+    // checkpoints written in the current sector, and offset of the latest
+    uint8_t checkpoints_used;
+    uint32_t checkpoint_offset;
+
+    // flash space taken by a complete copy of mem_buffer
+    uint32_t checkpoint_size;
+
+    // state of copying mem_buffer to the current sector for a checkpoint
+    bool compacting;
+    uint16_t compact_offset;
+    uint32_t compact_start;
+
+    // other sector is full but holds nothing we need, so can be erased
+    bool erase_pending;
+
+    // mask of sectors with signature_no_checkpoints
+    uint8_t no_checkpoint_sectors;
+
+    // 24 bit signature. This changed when checkpoints were added, so
+    // that older firmware, which uses the whole sector for data,
+    // erases storage rather than writing over the checkpoints
+    static const uint32_t signature = 0x51685C;
+
+    // signature of sectors written by firmware without checkpoints
+    static const uint32_t signature_no_checkpoints = 0x51685B;
 
     // 8 bit sector states
     enum SectorState {
@@ -128,11 +164,52 @@ private:
         uint16_t num_blocks_minus_one:3;
     };
 
+    // checkpoint at the end of each sector, giving the offset of a
+    // complete copy of mem_buffer in the sector. Nothing written
+    // before it needs to be read on init()
+    struct checkpoint {
+        uint32_t offset;
+        uint32_t offset_inverted;
+    };
+
+    // number of checkpoints in each sector, written in order
+    static const uint8_t num_checkpoints = 8;
+
+    // a checkpoint is started once this fraction of a sector has been
+    // written since the last one, limiting what is read on init()
+    static const uint8_t checkpoint_fraction = 4;
+
+    // and once this many times the size of the copy has been written,
+    // so that with most of storage in use the copies add little wear.
+    // With full storage that leaves only the copy after each switch
+    static const uint8_t checkpoint_copy_ratio = 8;
+
     // amount of space needed to write full storage
     static const uint32_t reserve_size = (storage_size / max_write) * (sizeof(block_header) + max_write) + max_write;
-        
-    // load data from a sector
-    bool load_sector(uint8_t sector);
+
+    // end of the space for data in a sector
+    uint32_t data_end(void) const;
+
+    // load data from the sectors in use
+    bool load_sectors(const enum SectorState states[2], uint8_t first_sector, bool use_checkpoint, bool &complete);
+
+    // load data from a sector, starting at the given offset
+    bool load_sector(uint8_t sector, uint32_t ofs);
+
+    // find the latest checkpoint in a sector
+    bool find_checkpoint(uint8_t sector, uint32_t &offset, uint8_t &used);
+
+    // write a checkpoint in the current sector
+    bool write_checkpoint(uint32_t offset);
+
+    // start copying mem_buffer to the current sector
+    void start_compaction(void);
+
+    // flash space needed for a complete copy of mem_buffer
+    uint32_t copy_size(void);
+
+    // copy all data from a sector without checkpoints to the other sector
+    bool copy_from_no_checkpoint_sector(void);
 
     // erase a sector and write header
     bool erase_sector(uint8_t sector);
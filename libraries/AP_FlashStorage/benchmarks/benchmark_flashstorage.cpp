@@ -0,0 +1,96 @@
+/*
+  measure init() of flash storage on two simulated 128k flash sectors
+  after a long history of small writes, like parameter saves.
+
+  Arg(0) has the history written without background work, so init()
+  reads all the data in both sectors. Arg(1) has background work done
+  between writes, so init() starts reading at the latest checkpoint.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AP_FlashStorage/AP_FlashStorage.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define BENCH_SECTOR_SIZE (128U * 1024U)
+#define BENCH_HISTORY_WRITES 50000
+
+class FlashStorageBench {
+public:
+    bool flash_write(uint8_t sector, uint32_t offset, const uint8_t *data, uint16_t length)
+    {
+        for (uint16_t i=0; i<length; i++) {
+            flash[sector][offset+i] &= data[i];
+        }
+        return true;
+    }
+
+    bool flash_read(uint8_t sector, uint32_t offset, uint8_t *data, uint16_t length)
+    {
+        memcpy(data, &flash[sector][offset], length);
+        return true;
+    }
+
+    bool flash_erase(uint8_t sector)
+    {
+        memset(flash[sector], 0xFF, BENCH_SECTOR_SIZE);
+        return true;
+    }
+
+    bool flash_erase_ok(void)
+    {
+        return erase_ok;
+    }
+
+    // write the history, keeping a copy of the flash to start each init() from
+    void write_history(bool background)
+    {
+        memset(flash, 0, sizeof(flash));
+        memset(mem_buffer, 0, sizeof(mem_buffer));
+        storage.init();
+        uint32_t seed = 1;
+        for (uint32_t i=0; i<BENCH_HISTORY_WRITES; i++) {
+            seed = seed * 1103515245U + 12345U;
+            const uint16_t length = 1 + (seed >> 8) % 32;
+            const uint16_t offset = (seed >> 16) % (4096 - length);
+            mem_buffer[offset] = i & 0xFF;
+            erase_ok = (i / 1000) % 4 == 0;
+            storage.write(offset, length);
+            if (background) {
+                storage.background();
+            }
+        }
+        memcpy(history, flash, sizeof(flash));
+    }
+
+    uint8_t mem_buffer[AP_FlashStorage::storage_size];
+    uint8_t flash[2][BENCH_SECTOR_SIZE];
+    uint8_t history[2][BENCH_SECTOR_SIZE];
+    bool erase_ok;
+
+    AP_FlashStorage storage{mem_buffer,
+            BENCH_SECTOR_SIZE,
+            FUNCTOR_BIND_MEMBER(&FlashStorageBench::flash_write, bool, uint8_t, uint32_t, const uint8_t *, uint16_t),
+            FUNCTOR_BIND_MEMBER(&FlashStorageBench::flash_read, bool, uint8_t, uint32_t, uint8_t *, uint16_t),
+            FUNCTOR_BIND_MEMBER(&FlashStorageBench::flash_erase, bool, uint8_t),
+            FUNCTOR_BIND_MEMBER(&FlashStorageBench::flash_erase_ok, bool)};
+};
+
+static FlashStorageBench bench;
+
+static void BM_FlashStorageInit(benchmark::State& state)
+{
+    bench.write_history(state.range_x());
+    while (state.KeepRunning()) {
+        // init() may erase a full sector, so start each from the history
+        state.PauseTiming();
+        memcpy(bench.flash, bench.history, sizeof(bench.flash));
+        state.ResumeTiming();
+        bool ok = bench.storage.init();
+        gbenchmark_escape(&ok);
+    }
+}
+
+BENCHMARK(BM_FlashStorageInit)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,272 @@
+#include <AP_gtest.h>
+
+#include <AP_FlashStorage/AP_FlashStorage.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define TEST_SECTOR_SIZE (128U * 1024U)
+
+static uint32_t test_seed = 1;
+
+static uint32_t test_rand(void)
+{
+    test_seed = test_seed * 1103515245U + 12345U;
+    return test_seed >> 8;
+}
+
+/*
+  flash storage on two simulated flash sectors, with a mirror of the
+  data written to it
+ */
+class FlashStorageTest {
+public:
+    bool flash_write(uint8_t sector, uint32_t offset, const uint8_t *data, uint16_t length)
+    {
+        if (sector > 1 || offset + length > TEST_SECTOR_SIZE) {
+            return false;
+        }
+        for (uint16_t i=0; i<length; i++) {
+            flash[sector][offset+i] &= data[i];
+        }
+        return true;
+    }
+
+    bool flash_read(uint8_t sector, uint32_t offset, uint8_t *data, uint16_t length)
+    {
+        if (sector > 1 || offset + length > TEST_SECTOR_SIZE) {
+            return false;
+        }
+        memcpy(data, &flash[sector][offset], length);
+        bytes_read += length;
+        return true;
+    }
+
+    bool flash_erase(uint8_t sector)
+    {
+        if (sector > 1) {
+            return false;
+        }
+        memset(flash[sector], 0xFF, TEST_SECTOR_SIZE);
+        erases++;
+        return true;
+    }
+
+    bool flash_erase_ok(void)
+    {
+        return erase_ok;
+    }
+
+    // write to storage and the mirror, allowing an erase if the write fails
+    void write(uint16_t offset, uint16_t length)
+    {
+        for (uint16_t i=0; i<length; i++) {
+            mem_buffer[offset+i] = mem_mirror[offset+i] = test_rand() & 0xFF;
+        }
+        if (!storage.write(offset, length)) {
+            const bool was_ok = erase_ok;
+            erase_ok = true;
+            EXPECT_TRUE(storage.write(offset, length));
+            erase_ok = was_ok;
+        }
+    }
+
+    // write a history like that of parameter saves, with some background work between writes
+    void write_history(uint32_t count, bool background)
+    {
+        for (uint32_t i=0; i<count; i++) {
+            const uint16_t length = 1 + test_rand() % 32;
+            const uint16_t offset = test_rand() % (4096 - length);
+            write(offset, length);
+            erase_ok = (i / 1000) % 4 == 0;
+            if (background) {
+                storage.background();
+            }
+        }
+    }
+
+    // restart, checking all data is loaded
+    void reboot(void)
+    {
+        memset(mem_buffer, 0, sizeof(mem_buffer));
+        bytes_read = 0;
+        ASSERT_TRUE(storage.init());
+        ASSERT_EQ(0, memcmp(mem_buffer, mem_mirror, sizeof(mem_buffer)));
+    }
+
+    uint8_t mem_buffer[AP_FlashStorage::storage_size];
+    uint8_t mem_mirror[AP_FlashStorage::storage_size];
+    uint8_t flash[2][TEST_SECTOR_SIZE];
+    uint32_t bytes_read;
+    uint32_t erases;
+    bool erase_ok;
+
+    AP_FlashStorage storage{mem_buffer,
+            TEST_SECTOR_SIZE,
+            FUNCTOR_BIND_MEMBER(&FlashStorageTest::flash_write, bool, uint8_t, uint32_t, const uint8_t *, uint16_t),
+            FUNCTOR_BIND_MEMBER(&FlashStorageTest::flash_read, bool, uint8_t, uint32_t, uint8_t *, uint16_t),
+            FUNCTOR_BIND_MEMBER(&FlashStorageTest::flash_erase, bool, uint8_t),
+            FUNCTOR_BIND_MEMBER(&FlashStorageTest::flash_erase_ok, bool)};
+};
+
+static FlashStorageTest test;
+
+static void start_empty(void)
+{
+    memset(test.flash, 0, sizeof(test.flash));
+    memset(test.mem_mirror, 0, sizeof(test.mem_mirror));
+    test.erase_ok = false;
+    test.reboot();
+}
+
+TEST(FlashStorageTest, RebootDuringHistory)
+{
+    start_empty();
+    for (uint16_t i=0; i<100; i++) {
+        test.write_history(test_rand() % 5000, true);
+        // some larger writes, like a mission upload
+        for (uint16_t ofs=8192; ofs<12288; ofs += 64) {
+            test.write(ofs, 64);
+            test.storage.background();
+        }
+        test.reboot();
+    }
+}
+
+TEST(FlashStorageTest, CheckpointsReduceReads)
+{
+    start_empty();
+    test.write_history(100000, true);
+    test.reboot();
+    const uint32_t checkpoint_read = test.bytes_read;
+
+    // clear the checkpoints, so all of both sectors is read
+    for (uint8_t sector=0; sector<2; sector++) {
+        memset(&test.flash[sector][TEST_SECTOR_SIZE-64], 0xFF, 64);
+    }
+    test.reboot();
+    EXPECT_LT(checkpoint_read * 3, test.bytes_read);
+
+    // and continuing on from sectors without checkpoints
+    test.write_history(100000, true);
+    test.reboot();
+}
+
+/*
+  with all of storage in use, as with a full set of parameters and a
+  long mission, the copies made for checkpoints must not add much wear
+ */
+static uint32_t erases_for_history(bool background)
+{
+    start_empty();
+    for (uint16_t ofs=0; ofs<AP_FlashStorage::storage_size; ofs += 64) {
+        test.write(ofs, 64);
+    }
+    test_seed = 1;
+    const uint32_t erases = test.erases;
+    test.write_history(200000, background);
+    test.reboot();
+    return test.erases - erases;
+}
+
+TEST(FlashStorageTest, CheckpointWearFullStorage)
+{
+    const uint32_t erases_without = erases_for_history(false);
+    const uint32_t erases_with = erases_for_history(true);
+    EXPECT_GT(erases_without, 0U);
+    EXPECT_LE(erases_with * 10, erases_without * 11);
+}
+
+TEST(FlashStorageTest, SectorErasedInBackground)
+{
+    // fill the first sector while erasing isn't allowed
+    start_empty();
+    while (test.flash[0][0] != 0xFC) {
+        test.write(test_rand() % 4000, 32);
+    }
+
+    // the data is copied to the new sector, after which the full
+    // sector is erased in the background once erasing is allowed
+    const uint32_t erases = test.erases;
+    while (test.storage.background()) {}
+    EXPECT_EQ(erases, test.erases);
+    test.erase_ok = true;
+    EXPECT_TRUE(test.storage.background());
+    EXPECT_EQ(erases + 1, test.erases);
+    EXPECT_EQ(0xFF, test.flash[0][0]);
+    test.reboot();
+}
+
+// signature of sectors written by firmware without checkpoints
+#define SIGNATURE_NO_CHECKPOINTS 0x51685BU
+
+static uint32_t sector_signature(uint8_t sector)
+{
+    uint32_t header;
+    memcpy(&header, test.flash[sector], sizeof(header));
+    return header >> 8;
+}
+
+static void write_sector_header(uint8_t sector, uint8_t state, uint32_t signature)
+{
+    memset(test.flash[sector], 0xFF, TEST_SECTOR_SIZE);
+    const uint32_t header = state | (signature << 8);
+    memcpy(test.flash[sector], &header, sizeof(header));
+}
+
+/*
+  write a sector as firmware without checkpoints did, with the old
+  signature and blocks of data up to the end of the sector
+ */
+static void write_sector_no_checkpoints(uint8_t sector, uint8_t state, uint16_t max_blocks)
+{
+    write_sector_header(sector, state, SIGNATURE_NO_CHECKPOINTS);
+    uint32_t ofs = 4;
+    for (uint16_t i=0; i<max_blocks && ofs <= TEST_SECTOR_SIZE - (2 + 64); i++) {
+        const uint16_t block_num = (test_rand() % (4096 - 64)) / 8;
+        // state valid, 8 blocks of 8 bytes
+        const uint16_t header = (block_num << 2) | (7U << 13);
+        memcpy(&test.flash[sector][ofs], &header, sizeof(header));
+        for (uint8_t j=0; j<64; j++) {
+            test.flash[sector][ofs+2+j] = test.mem_mirror[block_num*8+j] = test_rand() & 0xFF;
+        }
+        ofs += 2 + 64;
+    }
+}
+
+TEST(FlashStorageTest, UpgradeFromNoCheckpoints)
+{
+    // a full sector with data in the last bytes, as firmware without
+    // checkpoints wrote, followed by the sector in use
+    memset(test.mem_mirror, 0, sizeof(test.mem_mirror));
+    write_sector_no_checkpoints(0, 0xFC, UINT16_MAX);
+    write_sector_no_checkpoints(1, 0xFE, 100);
+    test.erase_ok = false;
+    test.reboot();
+
+    // both sectors now have the current signature
+    EXPECT_NE(SIGNATURE_NO_CHECKPOINTS, sector_signature(0));
+    EXPECT_NE(SIGNATURE_NO_CHECKPOINTS, sector_signature(1));
+    EXPECT_EQ(sector_signature(0), sector_signature(1));
+
+    test.write_history(20000, true);
+    test.reboot();
+}
+
+TEST(FlashStorageTest, UpgradeInterrupted)
+{
+    start_empty();
+    const uint32_t signature = sector_signature(0);
+
+    // interrupted after marking the new sector in use but before
+    // marking the sector without checkpoints full
+    memset(test.mem_mirror, 0, sizeof(test.mem_mirror));
+    write_sector_no_checkpoints(0, 0xFE, 1000);
+    write_sector_header(1, 0xFE, signature);
+    test.reboot();
+    EXPECT_EQ(signature, sector_signature(0));
+
+    test.write_history(20000, true);
+    test.reboot();
+}
+
+AP_GTEST_MAIN()
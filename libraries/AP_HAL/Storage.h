@@ -8,4 +8,17 @@ public:
     virtual void init() = 0;
     virtual void read_block(void *dst, uint16_t src, size_t n) = 0;
     virtual void write_block(uint16_t dst, const void* src, size_t n) = 0;
+
+    // backends which buffer writes flush ranges with a lower priority first
+    virtual void set_flush_priority(uint16_t loc, uint16_t n, uint8_t priority) {}
+
+    // write statistics, for backends which buffer writes
+    struct WriteStats {
+        uint32_t bytes_requested;   // bytes passed to write_block()
+        uint32_t bytes_changed;     // bytes which differed from those already stored
+        uint32_t bytes_flushed;     // bytes written to the device, including any format overhead
+        uint32_t flushes;           // number of writes to the device
+        uint16_t bytes_pending;     // bytes waiting to be written to the device
+    };
+    virtual bool get_write_stats(WriteStats &stats) const { return false; }
 };
@@ -55,6 +55,9 @@
 // enable RAMTROM parameter storage
 #define HAL_WITH_RAMTRON 1
 
+// room for the routes of a companion computer and its components
+#define MAVLINK_MAX_ROUTES 64
+
 #define CCM_RAM_ATTRIBUTE __attribute__((section(".ccm")))
 
 #elif CONFIG_HAL_BOARD_SUBTYPE == HAL_BOARD_SUBTYPE_CHIBIOS_SKYVIPER_V2450
@@ -101,6 +104,9 @@
 // enable RAMTROM parameter storage
 #define HAL_WITH_RAMTRON 1
 
+// room for the routes of a companion computer and its components
+#define MAVLINK_MAX_ROUTES 64
+
 #define CCM_RAM_ATTRIBUTE __attribute__((section(".ram4")))
 #endif
 
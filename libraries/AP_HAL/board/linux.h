@@ -355,3 +355,8 @@
 #define HAL_HAVE_BOARD_VOLTAGE 1
 #define HAL_HAVE_SAFETY_SWITCH 1
 #define HAL_USE_EKF3
+
+// companion computers route for many components, and RAM is plentiful
+#ifndef MAVLINK_MAX_ROUTES
+#define MAVLINK_MAX_ROUTES 64
+#endif
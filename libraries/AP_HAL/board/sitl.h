@@ -21,3 +21,8 @@
 #define HAL_HAVE_BOARD_VOLTAGE 1
 #define HAL_HAVE_SAFETY_SWITCH 1
 #define HAL_USE_EKF3
+
+// allow for the many components of a simulated companion computer
+#ifndef MAVLINK_MAX_ROUTES
+#define MAVLINK_MAX_ROUTES 64
+#endif
@@ -128,6 +128,47 @@ ssize_t SocketAPM::sendto(const void *buf, size_t size, const char *address, uin
     return ::sendto(fd, buf, size, 0, (struct sockaddr *)&sockaddr, sizeof(sockaddr));
 }
 
+/*
+  send a batch of datagrams, one per iovec, to address or to the
+  connected peer if address is nullptr. On Linux this is a single
+  sendmmsg() call. Returns the number of datagrams sent, or -1 if
+  none could be sent
+ */
+int SocketAPM::send_batch(const struct iovec *pkts, uint8_t count, const char *address, uint16_t port)
+{
+    struct sockaddr_in sockaddr;
+    if (address != nullptr) {
+        make_sockaddr(address, port, sockaddr);
+    }
+#ifdef __linux__
+    struct mmsghdr msgs[count];
+    memset(msgs, 0, sizeof(msgs));
+    for (uint8_t i=0; i<count; i++) {
+        msgs[i].msg_hdr.msg_iov = const_cast<struct iovec *>(&pkts[i]);
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (address != nullptr) {
+            msgs[i].msg_hdr.msg_name = &sockaddr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr);
+        }
+    }
+    return ::sendmmsg(fd, msgs, count, 0);
+#else
+    uint8_t i;
+    for (i=0; i<count; i++) {
+        ssize_t ret;
+        if (address != nullptr) {
+            ret = ::sendto(fd, pkts[i].iov_base, pkts[i].iov_len, 0, (struct sockaddr *)&sockaddr, sizeof(sockaddr));
+        } else {
+            ret = ::send(fd, pkts[i].iov_base, pkts[i].iov_len, 0);
+        }
+        if (ret != (ssize_t)pkts[i].iov_len) {
+            break;
+        }
+    }
+    return i > 0 ? i : -1;
+#endif
+}
+
 /*
   receive some data
  */
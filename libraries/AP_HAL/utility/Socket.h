@@ -28,6 +28,7 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 
 class SocketAPM {
 public:
@@ -43,6 +44,7 @@ public:
 
     ssize_t send(const void *pkt, size_t size);
     ssize_t sendto(const void *buf, size_t size, const char *address, uint16_t port);
+    int send_batch(const struct iovec *pkts, uint8_t count, const char *address, uint16_t port);
     ssize_t recv(void *pkt, size_t size, uint32_t timeout_ms);
 
     // return the IP address and port of the last received packet
@@ -0,0 +1,198 @@
+#include <string.h>
+
+#include "StorageDirtyLines.h"
+
+StorageDirtyLines::StorageDirtyLines(uint8_t *_buffer, uint16_t _size, uint8_t _line_shift,
+                                     uint8_t _max_run_lines, AP_HAL::Semaphore &_sem) :
+    buffer(_buffer),
+    size(_size),
+    line_shift(_line_shift),
+    num_lines(_size >> _line_shift),
+    max_run_lines(_max_run_lines),
+    sem(_sem),
+    dirty(_size >> _line_shift),
+    num_priority_ranges(0),
+    line_time_us(0),
+    stats{}
+{
+}
+
+/*
+  copy data into the buffer, marking dirty only the lines holding bytes
+  which have changed so that rewriting unchanged data costs nothing
+*/
+void StorageDirtyLines::write(uint16_t loc, const uint8_t *src, uint16_t n)
+{
+    if (n == 0 || loc >= size-(n-1)) {
+        return;
+    }
+    if (!sem.take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
+    stats.bytes_requested += n;
+
+    while (n > 0) {
+        const uint16_t line = loc >> line_shift;
+        uint16_t count = ((line+1U) << line_shift) - loc;
+        if (count > n) {
+            count = n;
+        }
+        if (memcmp(src, &buffer[loc], count) != 0) {
+            for (uint16_t i=0; i<count; i++) {
+                if (src[i] != buffer[loc+i]) {
+                    stats.bytes_changed++;
+                }
+            }
+            memcpy(&buffer[loc], src, count);
+            dirty.set(line);
+        }
+        src += count;
+        loc += count;
+        n -= count;
+    }
+    sem.give();
+}
+
+/*
+  set the flush priority of a range of the buffer, replacing that of
+  any range it overlaps
+*/
+void StorageDirtyLines::set_flush_priority(uint16_t loc, uint16_t n, uint8_t priority)
+{
+    if (n == 0 || loc >= size-(n-1)) {
+        return;
+    }
+    const uint16_t first_line = loc >> line_shift;
+    const uint16_t end_line = ((loc + n - 1) >> line_shift) + 1;
+
+    if (!sem.take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
+
+    // remove overlapping ranges
+    uint8_t count = 0;
+    for (uint8_t i=0; i<num_priority_ranges; i++) {
+        if (priority_ranges[i].end_line <= first_line || priority_ranges[i].first_line >= end_line) {
+            priority_ranges[count++] = priority_ranges[i];
+        }
+    }
+    num_priority_ranges = count;
+
+    if (num_priority_ranges < STORAGE_PRIORITY_RANGES) {
+        // insert keeping the ranges in order of priority
+        uint8_t i = num_priority_ranges;
+        while (i > 0 && priority_ranges[i-1].priority > priority) {
+            priority_ranges[i] = priority_ranges[i-1];
+            i--;
+        }
+        priority_ranges[i].first_line = first_line;
+        priority_ranges[i].end_line = end_line;
+        priority_ranges[i].priority = priority;
+        num_priority_ranges++;
+    }
+    sem.give();
+}
+
+/*
+  find the next line to write, taking the ranges in order of priority
+  followed by any lines outside them. Called with sem held
+*/
+int16_t StorageDirtyLines::next_dirty_line(void) const
+{
+    for (uint8_t i=0; i<num_priority_ranges; i++) {
+        const int16_t line = dirty.first_set(priority_ranges[i].first_line);
+        if (line >= 0 && line < priority_ranges[i].end_line) {
+            return line;
+        }
+    }
+    return dirty.first_set();
+}
+
+/*
+  get the next dirty line along with any dirty lines following it, up
+  to max_lines, and mark them clean
+*/
+bool StorageDirtyLines::next_run(uint16_t &line, uint16_t &nlines, uint16_t max_lines)
+{
+    if (!sem.take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return false;
+    }
+    const int16_t first = next_dirty_line();
+    if (first < 0) {
+        sem.give();
+        return false;
+    }
+    line = first;
+    nlines = 1;
+    while (nlines < max_lines &&
+           line + nlines < num_lines &&
+           dirty.get(line + nlines)) {
+        nlines++;
+    }
+    for (uint16_t i=0; i<nlines; i++) {
+        dirty.clear(line + i);
+    }
+    sem.give();
+    return true;
+}
+
+/*
+  mark a run dirty again after it failed to write
+*/
+void StorageDirtyLines::mark_dirty(uint16_t line, uint16_t nlines)
+{
+    if (!sem.take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
+    for (uint16_t i=0; i<nlines; i++) {
+        dirty.set(line + i);
+    }
+    sem.give();
+}
+
+/*
+  record that a run was written, filtering the time taken per line
+*/
+void StorageDirtyLines::run_written(uint16_t nlines, uint32_t time_us)
+{
+    const uint32_t us = nlines > 0 ? time_us / nlines : time_us;
+    if (line_time_us == 0) {
+        line_time_us = us;
+    } else {
+        line_time_us = (3 * line_time_us + us) / 4;
+    }
+    if (line_time_us == 0) {
+        line_time_us = 1;
+    }
+    stats.flushes++;
+}
+
+/*
+  the most lines a run can have to be written in time_us
+*/
+uint16_t StorageDirtyLines::lines_in_time(uint32_t time_us) const
+{
+    if (line_time_us == 0) {
+        // no runs written yet
+        return 1;
+    }
+    const uint32_t lines = time_us / line_time_us;
+    if (lines < 1) {
+        return 1;
+    }
+    if (lines > max_run_lines) {
+        return max_run_lines;
+    }
+    return lines;
+}
+
+void StorageDirtyLines::get_stats(AP_HAL::Storage::WriteStats &_stats) const
+{
+    if (!sem.take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        memset(&_stats, 0, sizeof(_stats));
+        return;
+    }
+    _stats = stats;
+    _stats.bytes_pending = dirty.count() << line_shift;
+    sem.give();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Common/Bitmask.h>
+
+// number of ranges which can be given a flush priority
+#define STORAGE_PRIORITY_RANGES 16
+
+/*
+ * Write-behind for storage backends which keep all of storage in a RAM
+ * buffer. Tracks the lines of the buffer which differ from the device
+ * and gives the next run of them to write, taking ranges with a lower
+ * flush priority first. The backend writes each run to its device.
+ *
+ * All methods may be called from any thread; sem protects the dirty
+ * lines, priorities and statistics.
+ */
+class StorageDirtyLines {
+public:
+    StorageDirtyLines(uint8_t *buffer, uint16_t size, uint8_t line_shift,
+                      uint8_t max_run_lines, AP_HAL::Semaphore &sem);
+
+    // copy data into the buffer, marking dirty the lines which change
+    void write(uint16_t loc, const uint8_t *src, uint16_t n);
+
+    // set the flush priority of a range of the buffer, replacing that
+    // of any range it overlaps
+    void set_flush_priority(uint16_t loc, uint16_t n, uint8_t priority);
+
+    // true if no lines are waiting to be written
+    bool empty(void) const { return dirty.empty(); }
+
+    // get the next run of at most max_lines dirty lines and mark them
+    // clean, so that a write() to them while they are written leaves
+    // them dirty to be written again. Returns false if nothing is dirty
+    bool next_run(uint16_t &line, uint16_t &num_lines, uint16_t max_lines);
+
+    // mark a run dirty again after it failed to write
+    void mark_dirty(uint16_t line, uint16_t num_lines);
+
+    // record that a run was written and how long that took
+    void run_written(uint16_t num_lines, uint32_t time_us);
+
+    // the most lines a run can have to be written in time_us, based on
+    // how long previous runs took. At least one
+    uint16_t lines_in_time(uint32_t time_us) const;
+
+    // bytes written to the device, including any format overhead
+    void add_bytes_flushed(uint32_t n) { stats.bytes_flushed += n; }
+
+    void get_stats(AP_HAL::Storage::WriteStats &_stats) const;
+
+private:
+    uint8_t *buffer;
+    const uint16_t size;
+    const uint8_t line_shift;
+    const uint16_t num_lines;
+    const uint8_t max_run_lines;
+    AP_HAL::Semaphore &sem;
+
+    Bitmask dirty;
+
+    // ranges of lines to flush before others, lowest priority first
+    struct {
+        uint16_t first_line;
+        uint16_t end_line;
+        uint8_t priority;
+    } priority_ranges[STORAGE_PRIORITY_RANGES];
+    uint8_t num_priority_ranges;
+
+    // filtered time to write one line, in microseconds
+    uint32_t line_time_us;
+
+    AP_HAL::Storage::WriteStats stats;
+
+    int16_t next_dirty_line(void) const;
+};
@@ -0,0 +1,18 @@
+#include "Stream.h"
+
+/*
+  default bulk read, for ports which only implement reading a byte
+  at a time
+ */
+ssize_t AP_HAL::Stream::read_buffer(uint8_t *buffer, uint16_t count)
+{
+    uint16_t offset = 0;
+    while (offset < count) {
+        const int16_t c = read();
+        if (c == -1) {
+            break;
+        }
+        buffer[offset++] = (uint8_t)c;
+    }
+    return offset;
+}
@@ -3,6 +3,8 @@
 #include <AP_HAL/AP_HAL_Namespace.h>
 #include "Print.h"
 
+#include <sys/types.h>
+
 /* A simple Stream library modeled after the bits we actually use
  * from Arduino Stream */
 
@@ -17,4 +19,10 @@ public:
      * -1 if nothing available, uint8_t value otherwise. */
     virtual int16_t read() = 0;
 
+    /* read up to count bytes into buffer. Returns the number of
+     * bytes read, or -1 if the port can't be read. The default implementation calls
+     * read() for each byte; ports with a receive buffer should
+     * override it to copy out in bulk */
+    virtual ssize_t read_buffer(uint8_t *buffer, uint16_t count);
+
 };
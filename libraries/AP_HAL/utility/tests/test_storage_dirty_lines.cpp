@@ -0,0 +1,189 @@
+#include <AP_gtest.h>
+
+#include <AP_HAL/utility/StorageDirtyLines.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define TEST_STORAGE_SIZE 16384
+#define TEST_LINE_SHIFT 3
+#define TEST_LINE_SIZE (1U<<TEST_LINE_SHIFT)
+#define TEST_RUN_LINES 8
+
+static uint32_t test_seed = 1;
+
+static uint8_t test_rand(void)
+{
+    test_seed = test_seed * 1103515245U + 12345U;
+    return test_seed >> 16;
+}
+
+/*
+  a storage backend buffering writes in RAM, as ChibiStorage does,
+  flushing runs of dirty lines to a simulated device
+ */
+class StorageSim {
+public:
+    StorageSim() {
+        memset(device, 0, sizeof(device));
+        memset(buffer, 0, sizeof(buffer));
+    }
+
+    void write(uint16_t loc, uint16_t n) {
+        for (uint16_t i=0; i<n; i++) {
+            data[i] = test_rand();
+        }
+        dirty.write(loc, data, n);
+    }
+
+    // one tick of the storage thread. Returns false if nothing was dirty
+    bool tick(uint16_t max_lines=TEST_RUN_LINES) {
+        uint16_t line, num_lines;
+        if (!dirty.next_run(line, num_lines, max_lines)) {
+            return false;
+        }
+        last_line = line;
+        last_num_lines = num_lines;
+        memcpy(&device[line*TEST_LINE_SIZE], &buffer[line*TEST_LINE_SIZE], num_lines*TEST_LINE_SIZE);
+        dirty.add_bytes_flushed(num_lines*TEST_LINE_SIZE);
+        dirty.run_written(num_lines, 10*num_lines);
+        return true;
+    }
+
+    // flush everything, returning the number of ticks taken
+    uint32_t flush(void) {
+        uint32_t ticks = 0;
+        while (tick()) {
+            ticks++;
+        }
+        return ticks;
+    }
+
+    uint8_t buffer[TEST_STORAGE_SIZE];
+    uint8_t device[TEST_STORAGE_SIZE];
+    uint8_t data[TEST_STORAGE_SIZE];
+    uint16_t last_line;
+    uint16_t last_num_lines;
+    StorageDirtyLines dirty{buffer, TEST_STORAGE_SIZE, TEST_LINE_SHIFT, TEST_RUN_LINES,
+            *hal.util->new_semaphore()};
+};
+
+TEST(StorageDirtyLinesTest, RunsCoalesced)
+{
+    StorageSim sim;
+
+    // a mission upload is written in runs of adjacent lines
+    sim.write(1280, 2000);
+    const uint32_t ticks = sim.flush();
+    EXPECT_LE(ticks, 2000U / (TEST_LINE_SIZE*TEST_RUN_LINES) + 2);
+    EXPECT_EQ(0, memcmp(sim.device, sim.buffer, sizeof(sim.buffer)));
+
+    AP_HAL::Storage::WriteStats stats;
+    sim.dirty.get_stats(stats);
+    EXPECT_EQ(2000U, stats.bytes_requested);
+    EXPECT_EQ(ticks, stats.flushes);
+    EXPECT_EQ(0U, stats.bytes_pending);
+}
+
+TEST(StorageDirtyLinesTest, UnchangedBytesNotWritten)
+{
+    StorageSim sim;
+    sim.write(100, 64);
+    sim.flush();
+
+    // rewriting the same data leaves nothing to flush
+    sim.dirty.write(100, &sim.buffer[100], 64);
+    EXPECT_TRUE(sim.dirty.empty());
+
+    // changing one byte makes only its line dirty
+    uint8_t b = sim.buffer[130] ^ 0xFF;
+    sim.dirty.write(130, &b, 1);
+    AP_HAL::Storage::WriteStats stats;
+    sim.dirty.get_stats(stats);
+    EXPECT_EQ(TEST_LINE_SIZE, stats.bytes_pending);
+    EXPECT_TRUE(sim.tick());
+    EXPECT_EQ(130U / TEST_LINE_SIZE, sim.last_line);
+    EXPECT_EQ(1U, sim.last_num_lines);
+}
+
+TEST(StorageDirtyLinesTest, PriorityFirst)
+{
+    StorageSim sim;
+    sim.dirty.set_flush_priority(0, 1280, 1);
+    sim.dirty.set_flush_priority(1280, 6000, 3);
+    sim.dirty.set_flush_priority(8064, 64, 0);
+
+    // a parameter and a key written during a mission upload are
+    // flushed before the rest of the mission
+    sim.write(1280, 2000);
+    sim.tick();
+    sim.write(100, 12);
+    sim.write(8070, 1);
+    EXPECT_TRUE(sim.tick());
+    EXPECT_EQ(8064U / TEST_LINE_SIZE, sim.last_line);
+    EXPECT_TRUE(sim.tick());
+    EXPECT_EQ(96U / TEST_LINE_SIZE, sim.last_line);
+    EXPECT_TRUE(sim.tick());
+    EXPECT_LE(1280U / TEST_LINE_SIZE, sim.last_line);
+
+    // replacing the priority of a range
+    sim.flush();
+    sim.dirty.set_flush_priority(1280, 6000, 0);
+    sim.write(100, 1);
+    sim.write(2000, 1);
+    EXPECT_TRUE(sim.tick());
+    EXPECT_EQ(2000U / TEST_LINE_SIZE, sim.last_line);
+}
+
+TEST(StorageDirtyLinesTest, WriteDuringFlush)
+{
+    StorageSim sim;
+    sim.write(0, 64);
+    uint16_t line, num_lines;
+    ASSERT_TRUE(sim.dirty.next_run(line, num_lines, TEST_RUN_LINES));
+    EXPECT_TRUE(sim.dirty.empty());
+
+    // a write to the lines being flushed leaves them dirty
+    sim.write(8, 4);
+    EXPECT_FALSE(sim.dirty.empty());
+
+    // as does a failed write
+    sim.flush();
+    sim.write(0, 64);
+    ASSERT_TRUE(sim.dirty.next_run(line, num_lines, TEST_RUN_LINES));
+    sim.dirty.mark_dirty(line, num_lines);
+    sim.flush();
+    EXPECT_EQ(0, memcmp(sim.device, sim.buffer, sizeof(sim.buffer)));
+}
+
+TEST(StorageDirtyLinesTest, RunsShortenedWhenSlow)
+{
+    StorageSim sim;
+    // nothing known, so one line at a time
+    EXPECT_EQ(1U, sim.dirty.lines_in_time(250));
+
+    sim.dirty.run_written(1, 30);
+    EXPECT_EQ(TEST_RUN_LINES, sim.dirty.lines_in_time(250));
+
+    // slow writes shorten runs, down to one line
+    for (uint8_t i=0; i<20; i++) {
+        sim.dirty.run_written(TEST_RUN_LINES, 8000);
+    }
+    EXPECT_EQ(1U, sim.dirty.lines_in_time(250));
+}
+
+TEST(StorageDirtyLinesTest, RandomWrites)
+{
+    StorageSim sim;
+    for (uint16_t i=0; i<20000; i++) {
+        const uint16_t n = 1 + test_rand() % 32;
+        const uint16_t loc = (test_rand() | (test_rand() << 8)) % (TEST_STORAGE_SIZE - n);
+        sim.write(loc, n);
+        if (i % 2) {
+            sim.tick();
+        }
+    }
+    sim.flush();
+    EXPECT_EQ(0, memcmp(sim.device, sim.buffer, sizeof(sim.buffer)));
+}
+
+AP_GTEST_MAIN()
@@ -18,6 +18,7 @@
 #if CONFIG_HAL_BOARD == HAL_BOARD_CHIBIOS
 
 #include <AP_BoardConfig/AP_BoardConfig.h>
+#include <AP_Math/AP_Math.h>
 
 #include "Storage.h"
 #include "hwdef/common/flash.h"
@@ -33,8 +34,6 @@ void ChibiStorage::_storage_open(void)
         return;
     }
 
-    _dirty_mask.clearall();
-
 #if HAL_WITH_RAMTRON
     if (!fram.init()) {
         return;
@@ -49,23 +48,6 @@ void ChibiStorage::_storage_open(void)
     _initialised = true;
 }
 
-/*
-  mark some lines as dirty. Note that there is no attempt to avoid
-  the race condition between this code and the _timer_tick() code
-  below, which both update _dirty_mask. If we lose the race then the
-  result is that a line is written more than once, but it won't result
-  in a line not being written.
-*/
-void ChibiStorage::_mark_dirty(uint16_t loc, uint16_t length)
-{
-    uint16_t end = loc + length;
-    for (uint16_t line=loc>>CH_STORAGE_LINE_SHIFT;
-         line <= end>>CH_STORAGE_LINE_SHIFT;
-         line++) {
-        _dirty_mask.set(line);
-    }
-}
-
 void ChibiStorage::read_block(void *dst, uint16_t loc, size_t n)
 {
     if (loc >= sizeof(_buffer)-(n-1)) {
@@ -80,41 +62,60 @@ void ChibiStorage::write_block(uint16_t loc, const void *src, size_t n)
     if (loc >= sizeof(_buffer)-(n-1)) {
         return;
     }
-    if (memcmp(src, &_buffer[loc], n) != 0) {
-        _storage_open();
-        memcpy(&_buffer[loc], src, n);
-        _mark_dirty(loc, n);
-    }
+    _storage_open();
+    _dirty.write(loc, (const uint8_t *)src, n);
+}
+
+void ChibiStorage::set_flush_priority(uint16_t loc, uint16_t n, uint8_t priority)
+{
+    _dirty.set_flush_priority(loc, n, priority);
+}
+
+bool ChibiStorage::get_write_stats(WriteStats &stats) const
+{
+    _dirty.get_stats(stats);
+    return true;
 }
 
 void ChibiStorage::_timer_tick(void)
 {
-    if (!_initialised || _dirty_mask.empty()) {
+    if (!_initialised) {
         return;
     }
-
-
-    // write out the first dirty line. We don't write more
-    // than one to keep the latency of this call to a minimum
-    uint16_t i;
-    for (i=0; i<CH_STORAGE_NUM_LINES; i++) {
-        if (_dirty_mask.get(i)) {
-            break;
-        }
+    if (_dirty.empty()) {
+#if !HAL_WITH_RAMTRON
+        // nothing to write, so give the time to flash storage to
+        // prepare checkpoints and erase sectors no longer needed
+        _flash.background();
+#endif
+        return;
     }
-    if (i == CH_STORAGE_NUM_LINES) {
-        // this shouldn't be possible
+
+    // write out the next dirty line along with any dirty lines
+    // following it, as long as they fit in one write that is expected
+    // to take no more than CH_STORAGE_FLUSH_MAX_US. We don't write more
+    // than that to keep the latency of this call to a minimum
+    uint16_t line, num_lines;
+    if (!_dirty.next_run(line, num_lines, _dirty.lines_in_time(CH_STORAGE_FLUSH_MAX_US))) {
         return;
     }
+    const uint32_t start_us = AP_HAL::micros();
 
 #if HAL_WITH_RAMTRON
-    if (fram.write(CH_STORAGE_LINE_SIZE*i, &_buffer[CH_STORAGE_LINE_SIZE*i], CH_STORAGE_LINE_SIZE)) {
-        _dirty_mask.clear(i);
+    const bool ok = fram.write(CH_STORAGE_LINE_SIZE*line, &_buffer[CH_STORAGE_LINE_SIZE*line], CH_STORAGE_LINE_SIZE*num_lines);
+    if (ok) {
+        _dirty.add_bytes_flushed(CH_STORAGE_LINE_SIZE*num_lines);
     }
 #else
     // save to storage backend
-    _flash_write(i);
+    const bool ok = _flash_write(line, num_lines);
 #endif // HAL_WITH_RAMTRON
+
+    if (ok) {
+        _dirty.run_written(num_lines, AP_HAL::micros() - start_us);
+    } else {
+        _dirty.mark_dirty(line, num_lines);
+    }
 }
 
 #if !HAL_WITH_RAMTRON
@@ -133,14 +134,11 @@ void ChibiStorage::_flash_load(void)
 }
 
 /*
-  write one storage line. This also updates _dirty_mask. 
+  write a run of storage lines
 */
-void ChibiStorage::_flash_write(uint16_t line)
+bool ChibiStorage::_flash_write(uint16_t line, uint16_t num_lines)
 {
-    if (_flash.write(line*CH_STORAGE_LINE_SIZE, CH_STORAGE_LINE_SIZE)) {
-        // mark the line clean
-        _dirty_mask.clear(line);
-    }
+    return _flash.write(line*CH_STORAGE_LINE_SIZE, num_lines*CH_STORAGE_LINE_SIZE);
 }
 
 /*
@@ -150,6 +148,10 @@ bool ChibiStorage::_flash_write_data(uint8_t sector, uint32_t offset, const uint
 {
     size_t base_address = stm32_flash_getpageaddr(_flash_page+sector);
     bool ret = stm32_flash_write(base_address+offset, data, length) == length;
+    if (ret) {
+        // includes block headers and sector compaction, giving the true write amplification
+        _dirty.add_bytes_flushed(length);
+    }
     if (!ret && _flash_erase_ok()) {
         // we are getting flash write errors while disarmed. Try
         // re-writing all of flash
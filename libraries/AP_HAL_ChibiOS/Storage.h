@@ -18,7 +18,8 @@
 
 #include <AP_HAL/AP_HAL.h>
 #include "AP_HAL_ChibiOS_Namespace.h"
-#include <AP_Common/Bitmask.h>
+#include "Semaphores.h"
+#include <AP_HAL/utility/StorageDirtyLines.h>
 #include <AP_FlashStorage/AP_FlashStorage.h>
 #include "hwdef/common/flash.h"
 #include <AP_RAMTRON/AP_RAMTRON.h>
@@ -32,11 +33,22 @@
 #define CH_STORAGE_LINE_SIZE (1<<CH_STORAGE_LINE_SHIFT)
 #define CH_STORAGE_NUM_LINES (CH_STORAGE_SIZE/CH_STORAGE_LINE_SIZE)
 
+// adjacent dirty lines are written together, up to the largest block
+// AP_FlashStorage writes with a single header
+#define CH_STORAGE_FLUSH_LINES_MAX (64/CH_STORAGE_LINE_SIZE)
+
+// longest a write of a run of dirty lines should take. Runs are kept
+// shorter than CH_STORAGE_FLUSH_LINES_MAX where writes are slow, so
+// that each tick of the storage thread stays short
+#define CH_STORAGE_FLUSH_MAX_US 250
+
 class ChibiOS::ChibiStorage : public AP_HAL::Storage {
 public:
     void init() {}
     void read_block(void *dst, uint16_t src, size_t n);
     void write_block(uint16_t dst, const void* src, size_t n);
+    void set_flush_priority(uint16_t loc, uint16_t n, uint8_t priority);
+    bool get_write_stats(WriteStats &stats) const;
 
     void _timer_tick(void);
 
@@ -44,9 +56,12 @@ private:
     volatile bool _initialised;
     void _storage_create(void);
     void _storage_open(void);
-    void _mark_dirty(uint16_t loc, uint16_t length);
     uint8_t _buffer[CH_STORAGE_SIZE] __attribute__((aligned(4)));
-    Bitmask _dirty_mask{CH_STORAGE_NUM_LINES};
+
+    // lines of _buffer not yet written, shared with the storage thread
+    Semaphore _dirty_sem;
+    StorageDirtyLines _dirty{_buffer, CH_STORAGE_SIZE, CH_STORAGE_LINE_SHIFT,
+                             CH_STORAGE_FLUSH_LINES_MAX, _dirty_sem};
 
 #if !HAL_WITH_RAMTRON
     bool _flash_write_data(uint8_t sector, uint32_t offset, const uint8_t *data, uint16_t length);
@@ -65,7 +80,7 @@ private:
             FUNCTOR_BIND_MEMBER(&ChibiStorage::_flash_erase_ok, bool)};
     
     void _flash_load(void);
-    void _flash_write(uint16_t line);
+    bool _flash_write(uint16_t line, uint16_t num_lines);
 #else
     AP_RAMTRON fram;
 #endif
@@ -364,6 +364,18 @@ int16_t ChibiUARTDriver::read()
     return byte;
 }
 
+ssize_t ChibiUARTDriver::read_buffer(uint8_t *buffer, uint16_t count)
+{
+    if (_uart_owner_thd != chThdGetSelfX()){
+        return -1;
+    }
+    if (!_initialised) {
+        return -1;
+    }
+
+    return _readbuf.read(buffer, count);
+}
+
 /* Empty implementations of Print virtual methods */
 size_t ChibiUARTDriver::write(uint8_t c)
 {
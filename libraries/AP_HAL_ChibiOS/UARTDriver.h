@@ -40,6 +40,7 @@ public:
     uint32_t available() override;
     uint32_t txspace() override;
     int16_t read() override;
+    ssize_t read_buffer(uint8_t *buffer, uint16_t count) override;
     void _timer_tick(void);
 
 
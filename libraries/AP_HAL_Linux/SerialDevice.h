@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 #include "AP_HAL_Linux.h"
 
@@ -13,6 +14,22 @@ public:
     virtual bool close() = 0;
     virtual ssize_t write(const uint8_t *buf, uint16_t n) = 0;
     virtual ssize_t read(uint8_t *buf, uint16_t n) = 0;
+
+    /*
+      write a batch of packets, each of which is to be kept whole,
+      e.g. as one UDP datagram. Returns the number of packets
+      written, or -1 on error
+     */
+    virtual int write_packets(const struct iovec *pkts, uint8_t count)
+    {
+        uint8_t i;
+        for (i=0; i<count; i++) {
+            if (write((const uint8_t *)pkts[i].iov_base, pkts[i].iov_len) != (ssize_t)pkts[i].iov_len) {
+                break;
+            }
+        }
+        return i > 0 ? i : -1;
+    }
     virtual void set_blocking(bool blocking) = 0;
     virtual void set_speed(uint32_t speed) = 0;
     virtual AP_HAL::UARTDriver::flow_control get_flow_control(void) { return AP_HAL::UARTDriver::FLOW_CONTROL_ENABLE; }
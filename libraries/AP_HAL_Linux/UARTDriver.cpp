@@ -75,6 +75,14 @@ void UARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
                 _device = new ConsoleDevice();
             }
         }
+
+        if (_perf_write_calls_name[0] == 0) {
+            const char *name = device_path?device_path:"console";
+            snprintf(_perf_write_calls_name, sizeof(_perf_write_calls_name), "UART_writes:%s", name);
+            _perf_write_calls = hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, _perf_write_calls_name);
+            snprintf(_perf_write_packets_name, sizeof(_perf_write_packets_name), "UART_pkts:%s", name);
+            _perf_write_packets = hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, _perf_write_packets_name);
+        }
     }
 
     if (!_connected) {
@@ -282,6 +290,15 @@ int16_t UARTDriver::read()
     return byte;
 }
 
+ssize_t UARTDriver::read_buffer(uint8_t *buffer, uint16_t count)
+{
+    if (!_initialised) {
+        return -1;
+    }
+
+    return _readbuf.read(buffer, count);
+}
+
 /* Linux implementations of Print virtual methods */
 size_t UARTDriver::write(uint8_t c)
 {
@@ -350,16 +367,30 @@ int UARTDriver::_read_fd(uint8_t *buf, uint16_t n)
 
 
 /*
-  try to push out one lump of pending bytes
-  return true if progress is made
+  try writing a batch of packets, handling an unresponsive port
  */
-bool UARTDriver::_write_pending_bytes(void)
+int UARTDriver::_write_packets_fd(const struct iovec *pkts, uint8_t count)
 {
-    // write any pending bytes
-    uint32_t available_bytes = _writebuf.available();
-    uint16_t n = available_bytes;
-    int16_t b = _writebuf.peek(0);
-    if (_packetise && n > 0 &&
+    if (!_connected) {
+        _connected = _device->open();
+    }
+    if (!_connected) {
+        return 0;
+    }
+
+    return _device->write_packets(pkts, count);
+}
+
+/*
+  return the length of the packet starting ofs bytes into the write
+  buffer, trying to keep to MAVLink packet boundaries, or 0 if a
+  complete packet isn't available yet
+ */
+uint16_t UARTDriver::_packet_length(uint32_t ofs, uint32_t available_bytes)
+{
+    uint16_t n = available_bytes - ofs;
+    int16_t b = _writebuf.peek(ofs);
+    if (n > 0 &&
         b != MAVLINK_STX_MAVLINK1 && b != MAVLINK_STX) {
         /*
           we have a non-mavlink packet at the start of the
@@ -369,7 +400,7 @@ bool UARTDriver::_write_pending_bytes(void)
         uint16_t limit = n>256?256:n;
         uint16_t i;
         for (i=0; i<limit; i++) {
-            b = _writebuf.peek(i);
+            b = _writebuf.peek(ofs+i);
             if (b == MAVLINK_STX_MAVLINK1 || b == MAVLINK_STX) {
                 n = i;
                 break;
@@ -380,8 +411,8 @@ bool UARTDriver::_write_pending_bytes(void)
             n = limit;
         }
     }
-    b = _writebuf.peek(0);
-    if (_packetise && n > 0 &&
+    b = _writebuf.peek(ofs);
+    if (n > 0 &&
         (b == MAVLINK_STX_MAVLINK1 || b == MAVLINK_STX)) {
         uint8_t min_length = (b == MAVLINK_STX_MAVLINK1)?8:12;
         // this looks like a MAVLink packet - try to write on
@@ -393,10 +424,10 @@ bool UARTDriver::_write_pending_bytes(void)
             // the length of the packet is the 2nd byte, and mavlink
             // packets have a 6 byte header plus 2 byte checksum,
             // giving len+8 bytes
-            int16_t len = _writebuf.peek(1);
+            int16_t len = _writebuf.peek(ofs+1);
             if (b == MAVLINK_STX) {
                 // check for signed packet with extra 13 bytes
-                int16_t incompat_flags = _writebuf.peek(2);
+                int16_t incompat_flags = _writebuf.peek(ofs+2);
                 if (incompat_flags & MAVLINK_IFLAG_SIGNED) {
                     min_length += MAVLINK_SIGNATURE_BLOCK_LEN;
                 }
@@ -411,31 +442,61 @@ bool UARTDriver::_write_pending_bytes(void)
             }
         }
     }
+    return n;
+}
 
-    if (n > 0) {
-        int ret;
+/*
+  try to push out one lump of pending bytes
+  return true if progress is made
+ */
+bool UARTDriver::_write_pending_bytes(void)
+{
+    // write any pending bytes
+    uint32_t available_bytes = _writebuf.available();
 
-        if (_packetise) {
-            // keep as a single UDP packet
-            uint8_t tmpbuf[n];
-            _writebuf.peekbytes(tmpbuf, n);
-            ret = _write_fd(tmpbuf, n);
-            if (ret > 0)
-                _writebuf.advance(ret);
-        } else {
-            ByteBuffer::IoVec vec[2];
-            const auto n_vec = _writebuf.peekiovec(vec, n);
-            for (int i = 0; i < n_vec; i++) {
-                ret = _write_fd(vec[i].data, (uint16_t)vec[i].len);
-                if (ret < 0) {
-                    break;
-                }
-                _writebuf.advance(ret);
+    if (_packetise) {
+        // gather up complete packets so each can be sent as a single
+        // UDP datagram, with as many as possible per system call
+        struct iovec pkts[UART_MAX_PACKETS_PER_WRITE];
+        uint8_t npkts = 0;
+        uint32_t total = 0;
+        while (npkts < UART_MAX_PACKETS_PER_WRITE && total < available_bytes) {
+            const uint16_t len = _packet_length(total, available_bytes);
+            if (len == 0 || total + len > sizeof(_packet_buf)) {
+                break;
+            }
+            pkts[npkts++].iov_len = len;
+            total += len;
+        }
+        if (npkts > 0) {
+            _writebuf.peekbytes(_packet_buf, total);
+            uint32_t ofs = 0;
+            for (uint8_t i=0; i<npkts; i++) {
+                pkts[i].iov_base = &_packet_buf[ofs];
+                ofs += pkts[i].iov_len;
+            }
+            hal.util->perf_count(_perf_write_calls);
+            int ret = _write_packets_fd(pkts, npkts);
+            for (int i=0; i<ret; i++) {
+                _writebuf.advance(pkts[i].iov_len);
+                hal.util->perf_count(_perf_write_packets);
+            }
+        }
+    } else if (available_bytes > 0) {
+        int ret;
+        ByteBuffer::IoVec vec[2];
+        const auto n_vec = _writebuf.peekiovec(vec, available_bytes);
+        for (int i = 0; i < n_vec; i++) {
+            hal.util->perf_count(_perf_write_calls);
+            ret = _write_fd(vec[i].data, (uint16_t)vec[i].len);
+            if (ret < 0) {
+                break;
+            }
+            _writebuf.advance(ret);
 
-                /* We wrote less than we asked for, stop */
-                if ((unsigned)ret != vec[i].len) {
-                    break;
-                }
+            /* We wrote less than we asked for, stop */
+            if ((unsigned)ret != vec[i].len) {
+                break;
             }
         }
     }
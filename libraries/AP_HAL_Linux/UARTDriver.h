@@ -6,6 +6,13 @@
 #include "AP_HAL_Linux.h"
 #include "SerialDevice.h"
 
+// maximum number of packets handed to the device in one write
+#define UART_MAX_PACKETS_PER_WRITE 8
+
+// maximum bytes of packets handed to the device in one write. This
+// holds at least three of the largest MAVLink packets
+#define UART_PACKET_BUFFER_SIZE 1024
+
 namespace Linux {
 
 class UARTDriver : public AP_HAL::UARTDriver {
@@ -29,6 +36,7 @@ public:
     uint32_t available() override;
     uint32_t txspace() override;
     int16_t read() override;
+    ssize_t read_buffer(uint8_t *buffer, uint16_t count) override;
 
     /* Linux implementations of Print virtual methods */
     size_t write(uint8_t c);
@@ -66,6 +74,20 @@ private:
     AP_HAL::OwnPtr<SerialDevice> _parseDevicePath(const char *arg);
     uint64_t _last_write_time;
 
+    uint16_t _packet_length(uint32_t ofs, uint32_t available_bytes);
+    int _write_packets_fd(const struct iovec *pkts, uint8_t count);
+
+    // packets gathered from _writebuf for _write_packets_fd(), as they
+    // may wrap around the end of the ring buffer
+    uint8_t _packet_buf[UART_PACKET_BUFFER_SIZE];
+
+    // number of writes to the device, and of packets written when
+    // packetising
+    AP_HAL::Util::perf_counter_t _perf_write_calls;
+    AP_HAL::Util::perf_counter_t _perf_write_packets;
+    char _perf_write_calls_name[40] {};
+    char _perf_write_packets_name[40] {};
+
 protected:
     const char *device_path;
     volatile bool _initialised;
@@ -33,6 +33,24 @@ ssize_t UDPDevice::write(const uint8_t *buf, uint16_t n)
     return socket.sendto(buf, n, _ip, _port);
 }
 
+/*
+  send one datagram per packet, in a single system call
+ */
+int UDPDevice::write_packets(const struct iovec *pkts, uint8_t count)
+{
+    if (!socket.pollout(0)) {
+        return -1;
+    }
+    if (_connected) {
+        return socket.send_batch(pkts, count, nullptr, 0);
+    }
+    if (_input) {
+        // can't send yet
+        return -1;
+    }
+    return socket.send_batch(pkts, count, _ip, _port);
+}
+
 ssize_t UDPDevice::read(uint8_t *buf, uint16_t n)
 {
     ssize_t ret = socket.recv(buf, n, 0);
@@ -261,6 +261,24 @@ int16_t PX4UARTDriver::read()
     return byte;
 }
 
+/*
+  read up to count bytes from the read buffer
+ */
+ssize_t PX4UARTDriver::read_buffer(uint8_t *buffer, uint16_t count)
+{
+#if UART_CHECK_PID
+    if (_uart_owner_pid != getpid()){
+        return -1;
+    }
+#endif
+    if (!_initialised) {
+        try_initialise();
+        return -1;
+    }
+
+    return _readbuf.read(buffer, count);
+}
+
 /*
    write one byte to the buffer
  */
@@ -49,6 +49,7 @@ public:
     uint32_t available() override;
     uint32_t txspace() override;
     int16_t read() override;
+    ssize_t read_buffer(uint8_t *buffer, uint16_t count) override;
 
     /* Implementations of Print virtual methods */
     size_t write(uint8_t c);
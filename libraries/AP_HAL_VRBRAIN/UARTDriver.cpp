@@ -255,6 +255,22 @@ int16_t VRBRAINUARTDriver::read()
     return byte;
 }
 
+/*
+  read up to count bytes from the read buffer
+ */
+ssize_t VRBRAINUARTDriver::read_buffer(uint8_t *buffer, uint16_t count)
+{
+    if (_uart_owner_pid != getpid()){
+        return -1;
+    }
+    if (!_initialised) {
+        try_initialise();
+        return -1;
+    }
+
+    return _readbuf.read(buffer, count);
+}
+
 /* 
    write one byte to the buffer
  */
@@ -429,6 +429,10 @@ const AP_Param::GroupInfo AP_InertialSensor::var_info[] = {
     // @Description: Gyro notch filter
     // @User: Advanced
     AP_SUBGROUPINFO(_notch_filter, "NOTCH_",  37, AP_InertialSensor, NotchFilterVector3fParam),
+
+    // @Group: LOG_
+    // @Path: ../AP_InertialSensor/BatchSampler.cpp
+    AP_SUBGROUPINFO(batchsampler, "LOG_",  38, AP_InertialSensor, AP_InertialSensor::BatchSampler),
     
     /*
       NOTE: parameter indexes have gaps above. When adding new
@@ -651,6 +655,8 @@ AP_InertialSensor::init(uint16_t sample_rate)
     _sample_period_usec = 1000*1000UL / _sample_rate;
 
     _notch_filter.init(sample_rate);
+
+    batchsampler.init();
     
     // establish the baseline time between samples
     _delta_time = 0;
@@ -1292,6 +1298,8 @@ void AP_InertialSensor::update(void)
 
     // apply notch filter to primary gyro
     _gyro[_primary_gyro] = _notch_filter.apply(_gyro[_primary_gyro]);
+
+    batchsampler.periodic();
     
     _last_update_usec = AP_HAL::micros();
     
@@ -272,6 +272,73 @@ public:
     // return time in microseconds of last update() call
     uint32_t get_last_update_usec(void) const { return _last_update_usec; }
 
+    enum IMU_SENSOR_TYPE {
+        IMU_SENSOR_TYPE_ACCEL = 0,
+        IMU_SENSOR_TYPE_GYRO = 1,
+    };
+
+    /*
+      BatchSampler captures bursts of raw samples from a single sensor
+      at the backend's native rate into a preallocated buffer, then
+      trickles them into the log as ISBH/ISBD messages. Sensors are
+      sampled in turn: all accels and gyros selected by the mask.
+     */
+    class BatchSampler {
+    public:
+        BatchSampler(const AP_InertialSensor &imu) :
+            initialised(false),
+            isbh_sent(false),
+            instance(0),
+            type(IMU_SENSOR_TYPE_ACCEL),
+            _imu(imu) {
+            AP_Param::setup_object_defaults(this, var_info);
+        };
+
+        void init();
+
+        // called by backends for every raw sample; may be called from
+        // a sensor thread
+        void sample(uint8_t instance, IMU_SENSOR_TYPE _type, uint64_t sample_us, const Vector3f &sample);
+
+        // called from the main thread at the main loop rate
+        void periodic();
+
+        // class level parameters
+        static const struct AP_Param::GroupInfo var_info[];
+
+        AP_Int16 _required_count;
+        AP_Int8 _sensor_mask;
+        AP_Int8 push_interval_ms;
+        AP_Int8 msgs_per_push;
+
+    private:
+        void rotate_to_next_sensor();
+        void push_data_to_log();
+
+        void Write_ISBH(DataFlash_Class *dataflash, float sample_rate_hz) const;
+        void Write_ISBD(DataFlash_Class *dataflash) const;
+
+        uint16_t _real_required_count;
+
+        bool initialised : 1;
+        bool isbh_sent : 1;
+        uint8_t instance : 2; // instance we are sampling
+        IMU_SENSOR_TYPE type;
+        uint16_t isb_seqnum;
+        int16_t *data_x = nullptr;
+        int16_t *data_y = nullptr;
+        int16_t *data_z = nullptr;
+        volatile uint16_t data_write_offset; // units: samples
+        uint16_t data_read_offset; // units: samples
+        uint64_t measurement_started_us;
+        uint32_t last_sent_ms;
+
+        // all samples are multiplied by this
+        uint16_t multiplier;
+
+        const AP_InertialSensor &_imu;
+    };
+
 private:
     AP_InertialSensor();
 
@@ -456,6 +523,8 @@ private:
     // threshold for detecting stillness
     AP_Float _still_threshold;
 
+    BatchSampler batchsampler{*this};
+
     /*
       state for HIL support
      */
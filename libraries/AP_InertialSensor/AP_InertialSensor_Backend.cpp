@@ -163,6 +163,8 @@ void AP_InertialSensor_Backend::_notify_new_gyro_raw_sample(uint8_t instance,
     // call gyro_sample hook if any
     AP_Module::call_hook_gyro_sample(instance, dt, gyro);
 
+    _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_GYRO, sample_us?sample_us:AP_HAL::micros64(), gyro);
+
     // push gyros if optical flow present
     if (hal.opticalflow)
         hal.opticalflow->push_gyro(gyro.x, gyro.y, dt);
@@ -203,15 +205,15 @@ void AP_InertialSensor_Backend::_notify_new_gyro_raw_sample(uint8_t instance,
     DataFlash_Class *dataflash = get_dataflash();
     if (dataflash != nullptr) {
         uint64_t now = AP_HAL::micros64();
-        struct log_GYRO pkt = {
-            LOG_PACKET_HEADER_INIT((uint8_t)(LOG_GYR1_MSG+instance)),
-            time_us   : now,
-            sample_us : sample_us?sample_us:now,
-            GyrX      : gyro.x,
-            GyrY      : gyro.y,
-            GyrZ      : gyro.z
-        };
-        dataflash->WriteBlock(&pkt, sizeof(pkt));
+        struct log_GYRO fallback;
+        struct log_GYRO *pkt = dataflash->reserve_block(fallback);
+        LOG_PACKET_HEADER_SET(pkt, (uint8_t)(LOG_GYR1_MSG+instance));
+        pkt->time_us   = now;
+        pkt->sample_us = sample_us?sample_us:now;
+        pkt->GyrX      = gyro.x;
+        pkt->GyrY      = gyro.y;
+        pkt->GyrZ      = gyro.z;
+        dataflash->commit_block(pkt, fallback);
     }
 }
 
@@ -280,6 +282,8 @@ void AP_InertialSensor_Backend::_notify_new_accel_raw_sample(uint8_t instance,
 
     // call accel_sample hook if any
     AP_Module::call_hook_accel_sample(instance, dt, accel, fsync_set);
+
+    _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_ACCEL, sample_us?sample_us:AP_HAL::micros64(), accel);
     
     _imu.calc_vibration_and_clipping(instance, accel, dt);
 
@@ -302,15 +306,15 @@ void AP_InertialSensor_Backend::_notify_new_accel_raw_sample(uint8_t instance,
     DataFlash_Class *dataflash = get_dataflash();
     if (dataflash != nullptr) {
         uint64_t now = AP_HAL::micros64();
-        struct log_ACCEL pkt = {
-            LOG_PACKET_HEADER_INIT((uint8_t)(LOG_ACC1_MSG+instance)),
-            time_us   : now,
-            sample_us : sample_us?sample_us:now,
-            AccX      : accel.x,
-            AccY      : accel.y,
-            AccZ      : accel.z
-        };
-        dataflash->WriteBlock(&pkt, sizeof(pkt));
+        struct log_ACCEL fallback;
+        struct log_ACCEL *pkt = dataflash->reserve_block(fallback);
+        LOG_PACKET_HEADER_SET(pkt, (uint8_t)(LOG_ACC1_MSG+instance));
+        pkt->time_us   = now;
+        pkt->sample_us = sample_us?sample_us:now;
+        pkt->AccX      = accel.x;
+        pkt->AccY      = accel.y;
+        pkt->AccZ      = accel.z;
+        dataflash->commit_block(pkt, fallback);
     }
 }
 
@@ -0,0 +1,261 @@
+#include "AP_InertialSensor.h"
+#include <DataFlash/DataFlash.h>
+
+extern const AP_HAL::HAL& hal;
+
+// Class level parameters
+const AP_Param::GroupInfo AP_InertialSensor::BatchSampler::var_info[] = {
+    // @Param: BAT_CNT
+    // @DisplayName: sample count per batch
+    // @Description: Number of samples to take when logging streams of IMU sensor readings.  Will be rounded down to a multiple of 32.
+    // @User: Advanced
+    // @Increment: 32
+    // @RebootRequired: True
+    AP_GROUPINFO("BAT_CNT",  1, AP_InertialSensor::BatchSampler, _required_count,   1024),
+
+    // @Param: BAT_MASK
+    // @DisplayName: Sensor Bitmask
+    // @Description: Bitmap of which IMUs to log batch data for.  No RAM is allocated unless at least one bit is set.
+    // @User: Advanced
+    // @Values: 0:None,1:First IMU,255:All
+    // @Bitmask: 0:IMU1,1:IMU2,2:IMU3
+    // @RebootRequired: True
+    AP_GROUPINFO("BAT_MASK",  2, AP_InertialSensor::BatchSampler, _sensor_mask,   0),
+
+    // @Param: BAT_LGIN
+    // @DisplayName: logging interval
+    // @Description: Interval between pushing samples to the DataFlash log
+    // @Units: ms
+    // @Increment: 10
+    // @User: Advanced
+    AP_GROUPINFO("BAT_LGIN", 3, AP_InertialSensor::BatchSampler, push_interval_ms,   20),
+
+    // @Param: BAT_LGCT
+    // @DisplayName: logging count
+    // @Description: Number of samples to push to the DataFlash log each push interval
+    // @Increment: 1
+    // @User: Advanced
+    AP_GROUPINFO("BAT_LGCT", 4, AP_InertialSensor::BatchSampler, msgs_per_push,   1),
+
+    AP_GROUPEND
+};
+
+// number of samples carried by each ISBD message
+#define ISBD_SAMPLES_PER_MSG 32
+static_assert(sizeof(log_ISBD::x) == ISBD_SAMPLES_PER_MSG*sizeof(int16_t), "ISBD sample count mismatch");
+
+void AP_InertialSensor::BatchSampler::init()
+{
+    if (_sensor_mask == 0) {
+        return;
+    }
+    if (_required_count <= 0) {
+        return;
+    }
+
+    _real_required_count = _required_count - (_required_count % ISBD_SAMPLES_PER_MSG); // round down to nearest multiple of 32
+    if (_real_required_count == 0) {
+        return;
+    }
+
+    const uint32_t total_allocation = 3*_real_required_count*sizeof(int16_t);
+    hal.console->printf("INS: alloc %u bytes for ISB (free=%u)\n", (unsigned)total_allocation, (unsigned)hal.util->available_memory());
+
+    data_x = (int16_t*)calloc(_real_required_count, sizeof(int16_t));
+    data_y = (int16_t*)calloc(_real_required_count, sizeof(int16_t));
+    data_z = (int16_t*)calloc(_real_required_count, sizeof(int16_t));
+    if (data_x == nullptr || data_y == nullptr || data_z == nullptr) {
+        free(data_x);
+        free(data_y);
+        free(data_z);
+        data_x = nullptr;
+        data_y = nullptr;
+        data_z = nullptr;
+        hal.console->printf("Failed to allocate %u bytes for IMU batch sampling\n", (unsigned)total_allocation);
+        return;
+    }
+
+    // start with the accel of the lowest selected instance
+    type = IMU_SENSOR_TYPE_GYRO;
+    instance = INS_MAX_INSTANCES-1;
+    rotate_to_next_sensor();
+
+    initialised = true;
+}
+
+/*
+  move on to the next sensor/type pair selected by the mask. The
+  write offset is reset last as it is what re-enables sample()
+ */
+void AP_InertialSensor::BatchSampler::rotate_to_next_sensor()
+{
+    if (_sensor_mask == 0) {
+        // should not have been called
+        return;
+    }
+    if ((1U<<instance) > (uint8_t)_sensor_mask) {
+        // should only ever happen if user resets _sensor_mask
+        instance = 0;
+    }
+
+    if (type == IMU_SENSOR_TYPE_ACCEL) {
+        // we have logged accelerometers, now log gyros:
+        type = IMU_SENSOR_TYPE_GYRO;
+        multiplier = 32767 / radians(2000); // +/- 2000 deg/sec
+    } else {
+        // log the next instance of accelerometer
+        type = IMU_SENSOR_TYPE_ACCEL;
+        multiplier = 32767 / (16*GRAVITY_MSS); // +/- 16g
+
+        bool haveinstance = false;
+        for (uint8_t i=instance+1; i<INS_MAX_INSTANCES; i++) {
+            if (_sensor_mask & (1U<<i)) {
+                instance = i;
+                haveinstance = true;
+                break;
+            }
+        }
+        if (!haveinstance) {
+            for (uint8_t i=0; i<=instance; i++) {
+                if (_sensor_mask & (1U<<i)) {
+                    instance = i;
+                    haveinstance = true;
+                    break;
+                }
+            }
+        }
+        if (!haveinstance) {
+            // should not happen!
+            instance = 0;
+            return;
+        }
+    }
+
+    data_read_offset = 0;
+    isb_seqnum++;
+    isbh_sent = false;
+    measurement_started_us = 0;
+    data_write_offset = 0;
+}
+
+void AP_InertialSensor::BatchSampler::periodic()
+{
+    if (!initialised) {
+        return;
+    }
+    push_data_to_log();
+}
+
+/*
+  write out up to msgs_per_push ISBD messages of the completed batch,
+  preceded by a single ISBH describing it
+ */
+void AP_InertialSensor::BatchSampler::push_data_to_log()
+{
+    if (data_write_offset < _real_required_count) {
+        // still collecting data
+        return;
+    }
+    if (data_read_offset >= data_write_offset) {
+        // batch fully written out
+        rotate_to_next_sensor();
+        return;
+    }
+    const uint32_t now = AP_HAL::millis();
+    if (now - last_sent_ms < (uint16_t)push_interval_ms) {
+        // avoid flooding DataFlash's buffer
+        return;
+    }
+    DataFlash_Class *dataflash = DataFlash_Class::instance();
+    if (dataflash == nullptr) {
+        // should not have been called
+        return;
+    }
+    if (!dataflash->logging_started() || dataflash->in_log_download()) {
+        // hold on to the batch until we can write it
+        return;
+    }
+
+    // possibly send isb header:
+    if (!isbh_sent && data_read_offset == 0) {
+        float sample_rate = 0; // avoid warning about uninitialised values
+        switch (type) {
+        case IMU_SENSOR_TYPE_GYRO:
+            sample_rate = _imu._gyro_raw_sample_rates[instance];
+            break;
+        case IMU_SENSOR_TYPE_ACCEL:
+            sample_rate = _imu._accel_raw_sample_rates[instance];
+            break;
+        }
+        Write_ISBH(dataflash, sample_rate);
+        isbh_sent = true;
+    }
+
+    for (uint8_t i=0; i<msgs_per_push && data_read_offset < data_write_offset; i++) {
+        Write_ISBD(dataflash);
+        data_read_offset += ISBD_SAMPLES_PER_MSG;
+    }
+    last_sent_ms = now;
+}
+
+void AP_InertialSensor::BatchSampler::Write_ISBH(DataFlash_Class *dataflash, const float sample_rate_hz) const
+{
+    const struct log_ISBH pkt{
+        LOG_PACKET_HEADER_INIT(LOG_ISBH_MSG),
+        time_us        : AP_HAL::micros64(),
+        seqno          : isb_seqnum,
+        sensor_type    : (uint8_t)type,
+        instance       : instance,
+        multiplier     : multiplier,
+        sample_count   : _real_required_count,
+        sample_us      : measurement_started_us,
+        sample_rate_hz : sample_rate_hz,
+    };
+    dataflash->WriteBlock(&pkt, sizeof(pkt));
+}
+
+void AP_InertialSensor::BatchSampler::Write_ISBD(DataFlash_Class *dataflash) const
+{
+    // the samples are copied straight into the log buffer if possible
+    struct log_ISBD fallback;
+    struct log_ISBD *pkt = dataflash->reserve_block(fallback);
+    LOG_PACKET_HEADER_SET(pkt, LOG_ISBD_MSG);
+    pkt->time_us   = AP_HAL::micros64();
+    pkt->isb_seqno = isb_seqnum;
+    pkt->seqno     = (uint16_t)(data_read_offset/ISBD_SAMPLES_PER_MSG);
+    memcpy(pkt->x, &data_x[data_read_offset], sizeof(pkt->x));
+    memcpy(pkt->y, &data_y[data_read_offset], sizeof(pkt->y));
+    memcpy(pkt->z, &data_z[data_read_offset], sizeof(pkt->z));
+    dataflash->commit_block(pkt, fallback);
+}
+
+/*
+  called from the backends with every raw sample, at the sensor's
+  native rate. Only the single sensor currently being batched is
+  recorded, and only until the buffer is full; periodic() then
+  drains the buffer and re-arms sampling for the next sensor
+ */
+void AP_InertialSensor::BatchSampler::sample(uint8_t _instance, AP_InertialSensor::IMU_SENSOR_TYPE _type, uint64_t sample_us, const Vector3f &_sample)
+{
+    if (!initialised) {
+        return;
+    }
+    if (_type != type) {
+        return;
+    }
+    if (_instance != instance) {
+        return;
+    }
+    if (data_write_offset >= _real_required_count) {
+        return;
+    }
+    if (data_write_offset == 0) {
+        measurement_started_us = sample_us;
+    }
+
+    data_x[data_write_offset] = constrain_float(_sample.x * multiplier, INT16_MIN, INT16_MAX);
+    data_y[data_write_offset] = constrain_float(_sample.y * multiplier, INT16_MIN, INT16_MAX);
+    data_z[data_write_offset] = constrain_float(_sample.z * multiplier, INT16_MIN, INT16_MAX);
+
+    data_write_offset++; // may unblock the reading process
+}
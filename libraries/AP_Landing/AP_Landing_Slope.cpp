@@ -378,12 +378,18 @@ bool AP_Landing::type_slope_is_complete(void) const
 
 void AP_Landing::type_slope_log(void) const
 {
+    // the flag bitfields are logged as raw bytes
+    static_assert(sizeof(flags) == 1 && sizeof(type_slope_flags) == 1, "landing flags must fit in a byte");
+    uint8_t f1, f2;
+    memcpy(&f1, &flags, sizeof(f1));
+    memcpy(&f2, &type_slope_flags, sizeof(f2));
+
     // log to DataFlash
-    DataFlash_Class::instance()->Log_Write("LAND", "TimeUS,stage,f1,f2,slope,slopeInit,altO", "QBBBfff",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','B','B','B','f','f','f'>("LAND", "TimeUS,stage,f1,f2,slope,slopeInit,altO",
                                             AP_HAL::micros64(),
                                             type_slope_stage,
-                                            flags,
-                                            type_slope_flags,
+                                            f1,
+                                            f2,
                                             (double)slope,
                                             (double)initial_slope,
                                             (double)alt_offset);
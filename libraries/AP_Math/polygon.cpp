@@ -24,6 +24,50 @@
  */
 
 
+/*
+ *  Polygon_edge_crossed(): test if a polygon edge crosses the ray from
+ *  P which Polygon_outside() counts crossings of
+ *     Input:   P = a point,
+ *              Vi, Vj = the end points of the edge
+ *     Return:  true if the edge toggles whether P is outside
+ *
+ *  Polygon_outside() is the parity of this over all edges, so a caller
+ *  which knows that only some edges can cross the ray (for example from
+ *  a grid of edges) gets the same answer from those edges alone
+ */
+template <typename T>
+bool Polygon_edge_crossed(const Vector2<T> &P, const Vector2<T> &Vi, const Vector2<T> &Vj)
+{
+    if ((Vi.y > P.y) == (Vj.y > P.y)) {
+        return false;
+    }
+    const int32_t dx1 = P.x - Vi.x;
+    const int32_t dx2 = Vj.x - Vi.x;
+    const int32_t dy1 = P.y - Vi.y;
+    const int32_t dy2 = Vj.y - Vi.y;
+    const int8_t dx1s = (dx1 < 0) ? -1 : 1;
+    const int8_t dx2s = (dx2 < 0) ? -1 : 1;
+    const int8_t dy1s = (dy1 < 0) ? -1 : 1;
+    const int8_t dy2s = (dy2 < 0) ? -1 : 1;
+    const int8_t m1 = dx1s * dy2s;
+    const int8_t m2 = dx2s * dy1s;
+    // we avoid the 64 bit multiplies if we can based on sign checks.
+    if (dy2 < 0) {
+        if (m1 > m2) {
+            return true;
+        } else if (m1 < m2) {
+            return false;
+        }
+        return dx1 * (int64_t)dy2 > dx2 * (int64_t)dy1;
+    }
+    if (m1 < m2) {
+        return true;
+    } else if (m1 > m2) {
+        return false;
+    }
+    return dx1 * (int64_t)dy2 < dx2 * (int64_t)dy1;
+}
+
 /*
  *  Polygon_outside(): test for a point in a polygon
  *     Input:   P = a point,
@@ -40,36 +84,8 @@ bool Polygon_outside(const Vector2<T> &P, const Vector2<T> *V, unsigned n)
     unsigned i, j;
     bool outside = true;
     for (i = 0, j = n-1; i < n; j = i++) {
-        if ((V[i].y > P.y) == (V[j].y > P.y)) {
-            continue;
-        }
-        const int32_t dx1 = P.x - V[i].x;
-        const int32_t dx2 = V[j].x - V[i].x;
-        const int32_t dy1 = P.y - V[i].y;
-        const int32_t dy2 = V[j].y - V[i].y;
-        const int8_t dx1s = (dx1 < 0) ? -1 : 1;
-        const int8_t dx2s = (dx2 < 0) ? -1 : 1;
-        const int8_t dy1s = (dy1 < 0) ? -1 : 1;
-        const int8_t dy2s = (dy2 < 0) ? -1 : 1;
-        const int8_t m1 = dx1s * dy2s;
-        const int8_t m2 = dx2s * dy1s;
-        // we avoid the 64 bit multiplies if we can based on sign checks.
-        if (dy2 < 0) {
-            if (m1 > m2) {
-                outside = !outside;
-            } else if (m1 < m2) {
-                continue;
-            } else if ( dx1 * (int64_t)dy2 > dx2 * (int64_t)dy1 ) {
-                outside = !outside;
-            }
-        } else {
-            if (m1 < m2) {
-                outside = !outside;
-            } else if (m1 > m2) {
-                continue;
-            } else if ( dx1 * (int64_t)dy2 < dx2 * (int64_t)dy1 ) {
-                outside = !outside;
-            }
+        if (Polygon_edge_crossed(P, V[i], V[j])) {
+            outside = !outside;
         }
     }
     return outside;
@@ -89,6 +105,8 @@ bool Polygon_complete(const Vector2<T> *V, unsigned n)
 }
 
 // Necessary to avoid linker errors
+template bool Polygon_edge_crossed<int32_t>(const Vector2l &P, const Vector2l &Vi, const Vector2l &Vj);
+template bool Polygon_edge_crossed<float>(const Vector2f &P, const Vector2f &Vi, const Vector2f &Vj);
 template bool Polygon_outside<int32_t>(const Vector2l &P, const Vector2l *V, unsigned n);
 template bool Polygon_complete<int32_t>(const Vector2l *V, unsigned n);
 template bool Polygon_outside<float>(const Vector2f &P, const Vector2f *V, unsigned n);
@@ -19,6 +19,8 @@
 
 #include "vector2.h"
 
+template <typename T>
+bool        Polygon_edge_crossed(const Vector2<T> &P, const Vector2<T> &Vi, const Vector2<T> &Vj);
 template <typename T>
 bool        Polygon_outside(const Vector2<T> &P, const Vector2<T> *V, unsigned n);
 template <typename T>
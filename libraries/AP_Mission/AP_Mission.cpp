@@ -29,6 +29,15 @@ const AP_Param::GroupInfo AP_Mission::var_info[] = {
     // @User: Advanced
     AP_GROUPINFO("OPTIONS",  2, AP_Mission, _options, AP_MISSION_OPTIONS_DEFAULT),
 
+    // @Param: CACHE
+    // @DisplayName: Mission command cache size
+    // @Description: Maximum number of mission commands kept decoded in memory, which speeds up mission download and finding the next navigation command. Each command uses about 22 bytes, and the cache only grows as large as the loaded mission and is limited to a quarter of free memory, so boards with little RAM get a smaller cache. Zero disables the cache
+    // @Range: 0 1000
+    // @Increment: 1
+    // @RebootRequired: True
+    // @User: Advanced
+    AP_GROUPINFO("CACHE",  3, AP_Mission, _cache_max, AP_MISSION_CACHE_DEFAULT),
+
     AP_GROUPEND
 };
 
@@ -57,6 +66,10 @@ void AP_Mission::init()
     	clear();	
     }
 
+    // keep decoded commands in memory if we can
+    _cache.enabled = true;
+    cache_resize(_cmd_total);
+
     _last_change_time_ms = AP_HAL::millis();
 }
 
@@ -261,6 +274,7 @@ bool AP_Mission::add_cmd(Mission_Command& cmd)
         cmd.index = _cmd_total;
         // increment total number of commands
         _cmd_total.set_and_save(_cmd_total + 1);
+        cache_resize(_cmd_total);
     }
 
     return ret;
@@ -280,6 +294,45 @@ bool AP_Mission::replace_cmd(uint16_t index, Mission_Command& cmd)
     return write_cmd_to_storage(index, cmd);
 }
 
+/// write_cmds - writes count commands to the command list starting at position 'index', replacing
+///     existing commands and adding to the end of the command list as needed.  The commands are
+///     written to storage as one block and the command total is saved once
+///     index must not be beyond the end of the command list
+///     returns true if successfully written, false on failure
+bool AP_Mission::write_cmds(uint16_t index, const Mission_Command *cmds, uint16_t count)
+{
+    // sanity check index and count
+    if (index > (unsigned)_cmd_total || (uint32_t)index + count > num_commands_max()) {
+        return false;
+    }
+
+    // pack the commands in chunks, writing each chunk in one go
+    uint8_t buf[AP_MISSION_EEPROM_COMMAND_SIZE * 16];
+    uint16_t done = 0;
+    while (done < count) {
+        const uint16_t n = MIN(count - done, sizeof(buf) / AP_MISSION_EEPROM_COMMAND_SIZE);
+        for (uint16_t i=0; i<n; i++) {
+            pack_cmd(cmds[done+i], &buf[i * AP_MISSION_EEPROM_COMMAND_SIZE]);
+        }
+        _storage.write_block(4 + ((index + done) * AP_MISSION_EEPROM_COMMAND_SIZE), buf, n * AP_MISSION_EEPROM_COMMAND_SIZE);
+        for (uint16_t i=0; i<n; i++) {
+            cache_invalidate(index + done + i);
+        }
+        done += n;
+    }
+
+    // remember when the mission last changed
+    _last_change_time_ms = AP_HAL::millis();
+
+    // extend the command list if needed
+    if (index + count > (unsigned)_cmd_total) {
+        _cmd_total.set_and_save(index + count);
+        cache_resize(_cmd_total);
+    }
+
+    return true;
+}
+
 /// is_nav_cmd - returns true if the command's id is a "navigation" command, false if "do" or "conditional" command
 bool AP_Mission::is_nav_cmd(const Mission_Command& cmd)
 {
@@ -296,6 +349,14 @@ bool AP_Mission::get_next_nav_cmd(uint16_t start_index, Mission_Command& cmd)
 
     // search until the end of the mission command list
     while(cmd_index < (unsigned)_cmd_total) {
+        // skip straight past "do" commands, get_next_cmd would return them unchanged
+        if (update_next_nav_index()) {
+            cmd_index = _cache.next_nav[cmd_index];
+            if (cmd_index == AP_MISSION_CMD_INDEX_NONE) {
+                return false;
+            }
+        }
+
         // get next command
         if (!get_next_cmd(cmd_index, cmd, false)) {
             // no more commands so return failure
@@ -463,6 +524,9 @@ bool AP_Mission::read_cmd_from_storage(uint16_t index, Mission_Command& cmd) con
         cmd.id = MAV_CMD_NAV_WAYPOINT;
         cmd.p1 = 0;
         cmd.content.location = _ahrs.get_home();
+    }else if (_cache.cmds != nullptr && index < _cache.size && _cache.cmds[index].index == index) {
+        // already decoded
+        cmd = _cache.cmds[index];
     }else{
         // Find out proper location in memory by using the start_byte position + the index
         // we can load a command, we don't process it yet
@@ -482,12 +546,34 @@ bool AP_Mission::read_cmd_from_storage(uint16_t index, Mission_Command& cmd) con
 
         // set command's index to it's position in eeprom
         cmd.index = index;
+
+        // keep the decoded command for next time
+        if (_cache.cmds != nullptr && index < _cache.size) {
+            _cache.cmds[index] = cmd;
+        }
     }
 
     // return success
     return true;
 }
 
+/// pack_cmd - pack a command into its storage format
+///     buf must be AP_MISSION_EEPROM_COMMAND_SIZE bytes
+void AP_Mission::pack_cmd(const Mission_Command& cmd, uint8_t *buf)
+{
+    if (cmd.id < 256) {
+        buf[0] = cmd.id;
+        memcpy(&buf[1], &cmd.p1, 2);
+        memcpy(&buf[3], cmd.content.bytes, 12);
+    } else {
+        // if the command ID is above 256 we store a 0 followed by the 16 bit command ID
+        buf[0] = 0;
+        memcpy(&buf[1], &cmd.id, 2);
+        memcpy(&buf[3], &cmd.p1, 2);
+        memcpy(&buf[5], cmd.content.bytes, 10);
+    }
+}
+
 /// write_cmd_to_storage - write a command to storage
 ///     index is used to calculate the storage location
 ///     true is returned if successful
@@ -501,17 +587,10 @@ bool AP_Mission::write_cmd_to_storage(uint16_t index, Mission_Command& cmd)
     // calculate where in storage the command should be placed
     uint16_t pos_in_storage = 4 + (index * AP_MISSION_EEPROM_COMMAND_SIZE);
 
-    if (cmd.id < 256) {
-        _storage.write_byte(pos_in_storage, cmd.id);
-        _storage.write_uint16(pos_in_storage+1, cmd.p1);
-        _storage.write_block(pos_in_storage+3, cmd.content.bytes, 12);
-    } else {
-        // if the command ID is above 256 we store a 0 followed by the 16 bit command ID
-        _storage.write_byte(pos_in_storage, 0);
-        _storage.write_uint16(pos_in_storage+1, cmd.id);
-        _storage.write_uint16(pos_in_storage+3, cmd.p1);
-        _storage.write_block(pos_in_storage+5, cmd.content.bytes, 10);
-    }
+    uint8_t buf[AP_MISSION_EEPROM_COMMAND_SIZE];
+    pack_cmd(cmd, buf);
+    _storage.write_block(pos_in_storage, buf, sizeof(buf));
+    cache_invalidate(index);
 
     // remember when the mission last changed
     _last_change_time_ms = AP_HAL::millis();
@@ -1609,6 +1688,109 @@ void AP_Mission::increment_jump_times_run(Mission_Command& cmd)
     return;
 }
 
+///
+/// decoded command cache methods
+///
+
+/// cache_resize - grow the decoded command cache to hold total commands, up to MIS_CACHE and
+///     a share of free memory.  The cache is left as it was if it can't be grown
+void AP_Mission::cache_resize(uint16_t total, bool grow_in_steps)
+{
+    if (!_cache.enabled) {
+        return;
+    }
+
+    uint32_t size = total;
+    if (grow_in_steps) {
+        // so a mission added a command at a time doesn't reallocate every time
+        size = (size + AP_MISSION_CACHE_GROW - 1) / AP_MISSION_CACHE_GROW * AP_MISSION_CACHE_GROW;
+    }
+    size = MIN(size, (uint32_t)MAX(_cache_max.get(), 0));
+    size = MIN(size, num_commands_max());
+
+    // boards short of memory get a smaller cache, which holds the start of the mission. The
+    // old arrays are only freed once the new ones are filled
+    const uint32_t free_mem = hal.util->available_memory();
+    if (free_mem <= AP_MISSION_CACHE_MEM_MARGIN) {
+        return;
+    }
+    const uint32_t cmd_size = sizeof(Mission_Command) + sizeof(uint16_t);
+    size = MIN(size, (free_mem - AP_MISSION_CACHE_MEM_MARGIN) / (AP_MISSION_CACHE_MEM_SHARE * cmd_size));
+    if (size <= _cache.size) {
+        return;
+    }
+
+    Mission_Command *cmds = (Mission_Command *)calloc(size, sizeof(Mission_Command));
+    uint16_t *next_nav = (uint16_t *)calloc(size, sizeof(uint16_t));
+    if (cmds == nullptr || next_nav == nullptr) {
+        free(cmds);
+        free(next_nav);
+        return;
+    }
+
+    // keep what has been decoded so far
+    if (_cache.cmds != nullptr) {
+        memcpy(cmds, _cache.cmds, _cache.size * sizeof(Mission_Command));
+        memcpy(next_nav, _cache.next_nav, _cache.size * sizeof(uint16_t));
+    }
+    for (uint16_t i=_cache.size; i<size; i++) {
+        cmds[i].index = AP_MISSION_CMD_INDEX_NONE;
+    }
+
+    free(_cache.cmds);
+    free(_cache.next_nav);
+    _cache.cmds = cmds;
+    _cache.next_nav = next_nav;
+    _cache.size = size;
+    _cache.next_nav_total = AP_MISSION_CMD_INDEX_NONE;
+}
+
+/// cache_invalidate - forget the decoded copy of a command after it has been written to storage
+void AP_Mission::cache_invalidate(uint16_t index)
+{
+    if (_cache.cmds == nullptr) {
+        return;
+    }
+    if (index < _cache.size) {
+        _cache.cmds[index].index = AP_MISSION_CMD_INDEX_NONE;
+    }
+    _cache.next_nav_total = AP_MISSION_CMD_INDEX_NONE;
+}
+
+/// update_next_nav_index - rebuild the next navigation command index if the mission has changed
+///     returns true if _cache.next_nav can be used
+bool AP_Mission::update_next_nav_index() const
+{
+    if (_cache.next_nav == nullptr) {
+        return false;
+    }
+
+    // commands are only added or removed by changing _cmd_total, and written commands invalidate the index
+    const uint16_t total = _cmd_total;
+    if (_cache.next_nav_total == total) {
+        return true;
+    }
+    if (total > _cache.size) {
+        return false;
+    }
+
+    // work back from the end of the mission so each position gets the closest command after it
+    uint16_t next = AP_MISSION_CMD_INDEX_NONE;
+    for (uint16_t i=total; i>0; i--) {
+        Mission_Command cmd;
+        if (!read_cmd_from_storage(i-1, cmd)) {
+            return false;
+        }
+        if (is_nav_cmd(cmd) || cmd.id == MAV_CMD_DO_JUMP) {
+            next = i-1;
+        }
+        _cache.next_nav[i-1] = next;
+    }
+    _cache.next_nav_total = total;
+
+    return true;
+}
+
 // check_eeprom_version - checks version of missions stored in eeprom matches this library
 // command list will be cleared if they do not match
 void AP_Mission::check_eeprom_version()
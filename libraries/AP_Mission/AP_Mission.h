@@ -40,6 +40,18 @@
 #define AP_MISSION_OPTIONS_DEFAULT          0       // Do not clear the mission when rebooting
 #define AP_MISSION_MASK_MISSION_CLEAR       (1<<0)  // If set then Clear the mission on boot
 
+#define AP_MISSION_CACHE_MEM_MARGIN         4096    // free memory which must remain after allocating the decoded command cache
+#define AP_MISSION_CACHE_MEM_SHARE          4       // decoded command cache uses at most 1/4 of free memory
+#define AP_MISSION_CACHE_GROW               16      // decoded command cache grows in steps of this many commands as commands are added
+
+#ifndef AP_MISSION_CACHE_DEFAULT
+#if HAL_MINIMIZE_FEATURES
+#define AP_MISSION_CACHE_DEFAULT            100     // at most 2k of memory for the decoded command cache
+#else
+#define AP_MISSION_CACHE_DEFAULT            1000    // cache whole missions
+#endif
+#endif
+
 /// @class    AP_Mission
 /// @brief    Object managing Mission
 class AP_Mission {
@@ -329,6 +341,10 @@ public:
     /// truncate - truncate any mission items beyond given index
     void truncate(uint16_t index);
 
+    /// reserve - size the decoded command cache for a mission of total commands about to be uploaded,
+    ///     so it is allocated once rather than grown as the commands arrive
+    void reserve(uint16_t total) { cache_resize(total, false); }
+
     /// update - ensures the command queues are loaded with the next command and calls main programs command_init and command_verify functions to progress the mission
     ///     should be called at 10hz or higher
     void update();
@@ -347,6 +363,13 @@ public:
     ///     returns true if successfully replaced, false on failure
     bool replace_cmd(uint16_t index, Mission_Command& cmd);
 
+    /// write_cmds - writes count commands to the command list starting at position 'index', replacing
+    ///     existing commands and adding to the end of the command list as needed.  The commands are
+    ///     written to storage as one block and the command total is saved once
+    ///     index must not be beyond the end of the command list
+    ///     returns true if successfully written, false on failure
+    bool write_cmds(uint16_t index, const Mission_Command *cmds, uint16_t count);
+
     /// is_nav_cmd - returns true if the command's id is a "navigation" command, false if "do" or "conditional" command
     static bool is_nav_cmd(const Mission_Command& cmd);
 
@@ -464,6 +487,13 @@ private:
         _flags.state = MISSION_STOPPED;
         _flags.nav_cmd_loaded = false;
         _flags.do_cmd_loaded = false;
+
+        // decoded command cache is allocated by init
+        _cache.cmds = nullptr;
+        _cache.next_nav = nullptr;
+        _cache.size = 0;
+        _cache.next_nav_total = AP_MISSION_CMD_INDEX_NONE;
+        _cache.enabled = false;
     }
 
 
@@ -510,6 +540,25 @@ private:
     /// increment_jump_times_run - increments the recorded number of times the jump command has been run
     void increment_jump_times_run(Mission_Command& cmd);
 
+    /// pack_cmd - pack a command into its storage format
+    ///     buf must be AP_MISSION_EEPROM_COMMAND_SIZE bytes
+    static void pack_cmd(const Mission_Command& cmd, uint8_t *buf);
+
+    ///
+    /// decoded command cache methods
+    ///
+    /// cache_resize - grow the decoded command cache to hold total commands, up to MIS_CACHE and
+    ///     a share of free memory.  If grow_in_steps is true the size is rounded up so commands added
+    ///     one at a time don't reallocate every time.  The cache is left as it was if it can't be grown
+    void cache_resize(uint16_t total, bool grow_in_steps = true);
+
+    /// cache_invalidate - forget the decoded copy of a command after it has been written to storage
+    void cache_invalidate(uint16_t index);
+
+    /// update_next_nav_index - rebuild the next navigation command index if the mission has changed
+    ///     returns true if _cache.next_nav can be used
+    bool update_next_nav_index() const;
+
     /// check_eeprom_version - checks version of missions stored in eeprom matches this library
     /// command list will be cleared if they do not match
     void check_eeprom_version();
@@ -521,6 +570,7 @@ private:
     AP_Int16                _cmd_total;  // total number of commands in the mission
     AP_Int8                 _restart;   // controls mission starting point when entering Auto mode (either restart from beginning of mission or resume from last command run)
     AP_Int16                _options;    // bitmask options for missions, currently for mission clearing on reboot but can be expanded as required
+    AP_Int16                _cache_max;  // maximum number of commands held in the decoded command cache
 
     // pointer to main program functions
     mission_cmd_fn_t        _cmd_start_fn;  // pointer to function which will be called when a new command is started
@@ -542,4 +592,16 @@ private:
 
     // last time that mission changed
     uint32_t _last_change_time_ms;
+
+    // decoded command cache.  Commands are decoded from storage the first time they are read and
+    // forgotten when they are written.  Entries which do not hold a decoded command have their
+    // index set to AP_MISSION_CMD_INDEX_NONE.  Sized to the mission, up to MIS_CACHE commands, and
+    // limited to a share of free memory
+    mutable struct {
+        Mission_Command *cmds;      // decoded commands, indexed by position in the command list
+        uint16_t *next_nav;         // position of the first navigation or do-jump command at or after each position
+        uint16_t size;              // number of elements in cmds and next_nav
+        uint16_t next_nav_total;    // _cmd_total when next_nav was built, AP_MISSION_CMD_INDEX_NONE if it must be rebuilt
+        bool enabled;               // true once init() has run, so the cache may be allocated
+    } _cache;
 };
@@ -0,0 +1,159 @@
+/*
+  measure mission access on a 700 item survey mission with nested
+  DO_JUMPs, with and without the decoded command cache: reading every
+  command as a GCS mission download does, finding the next navigation
+  command from each position, and running the whole mission.
+
+  Arg(0) uses a mission object which has not been through init() and
+  so decodes every command from storage, Arg(1) one with the cache.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AP_AHRS/AP_AHRS.h>
+#include <AP_Mission/AP_Mission.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+const struct AP_Param::GroupInfo GCS_MAVLINK::var_info[] = {
+    AP_GROUPEND
+};
+GCS_Dummy _gcs;
+
+#define TEST_NUM_COMMANDS 700
+
+class MissionBench {
+public:
+    AP_InertialSensor ins = AP_InertialSensor::create();
+    AP_Baro baro = AP_Baro::create();
+    AP_GPS gps = AP_GPS::create();
+    AP_AHRS_DCM ahrs = AP_AHRS_DCM::create(ins, baro, gps);
+    AP_Mission mission_uncached = AP_Mission::create(ahrs,
+            FUNCTOR_BIND_MEMBER(&MissionBench::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&MissionBench::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&MissionBench::mission_complete, void));
+    AP_Mission mission_cached = AP_Mission::create(ahrs,
+            FUNCTOR_BIND_MEMBER(&MissionBench::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&MissionBench::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&MissionBench::mission_complete, void));
+
+    bool mission_cmd(const AP_Mission::Mission_Command &cmd) { return true; }
+    void mission_complete(void) {}
+
+    void setup(void);
+    AP_Mission &mission(int64_t cached) { return cached ? mission_cached : mission_uncached; }
+    bool done;
+};
+
+static MissionBench bench;
+
+/*
+  a survey: takeoff, then legs of two waypoints with a camera trigger
+  distance change between them, an inner DO_JUMP repeating a block of
+  legs and an outer DO_JUMP repeating the inner loop, then a landing
+  sequence
+ */
+static void make_cmd(uint16_t i, AP_Mission::Mission_Command &cmd)
+{
+    cmd = {};
+    if (i == 0) {
+        // home, read from AHRS rather than storage
+        cmd.id = MAV_CMD_NAV_WAYPOINT;
+    } else if (i == 1) {
+        cmd.id = MAV_CMD_NAV_TAKEOFF;
+        cmd.content.location.alt = 5000;
+    } else if (i == 200) {
+        cmd.id = MAV_CMD_DO_JUMP;
+        cmd.content.jump.target = 100;
+        cmd.content.jump.num_times = 2;
+    } else if (i == 400) {
+        cmd.id = MAV_CMD_DO_JUMP;
+        cmd.content.jump.target = 50;
+        cmd.content.jump.num_times = 1;
+    } else if (i == TEST_NUM_COMMANDS - 2) {
+        cmd.id = MAV_CMD_DO_LAND_START;
+    } else if (i == TEST_NUM_COMMANDS - 1) {
+        cmd.id = MAV_CMD_NAV_LAND;
+    } else if (i % 3 == 0) {
+        cmd.id = MAV_CMD_DO_SET_CAM_TRIGG_DIST;
+        cmd.content.cam_trigg_dist.meters = 20 + (i % 7);
+    } else {
+        cmd.id = MAV_CMD_NAV_WAYPOINT;
+        cmd.content.location.lat = -353632620 + (i / 6) * 2000;
+        cmd.content.location.lng = 1491652300 + ((i % 6) < 3 ? 0 : 30000);
+        cmd.content.location.alt = 5000;
+    }
+}
+
+void MissionBench::setup(void)
+{
+    if (done) {
+        return;
+    }
+    done = true;
+
+    // both objects share the same storage, each needs its own command total
+    mission_cached.init();
+    AP_Mission *missions[] = { &mission_uncached, &mission_cached };
+    for (AP_Mission *m : missions) {
+        m->clear();
+        AP_Mission::Mission_Command cmd;
+        for (uint16_t i=0; i<TEST_NUM_COMMANDS; i++) {
+            make_cmd(i, cmd);
+            m->add_cmd(cmd);
+        }
+    }
+}
+
+/*
+  read every command, as a GCS downloading the mission
+ */
+static void BM_MissionReadAll(benchmark::State& state)
+{
+    bench.setup();
+    AP_Mission &mission = bench.mission(state.range_x());
+    AP_Mission::Mission_Command cmd;
+    while (state.KeepRunning()) {
+        for (uint16_t i=0; i<mission.num_commands(); i++) {
+            mission.read_cmd_from_storage(i, cmd);
+            gbenchmark_escape(&cmd);
+        }
+    }
+}
+
+/*
+  find the next navigation command from every position in the mission
+ */
+static void BM_MissionNextNav(benchmark::State& state)
+{
+    bench.setup();
+    AP_Mission &mission = bench.mission(state.range_x());
+    AP_Mission::Mission_Command cmd;
+    while (state.KeepRunning()) {
+        for (uint16_t i=1; i<mission.num_commands(); i++) {
+            mission.get_next_nav_cmd(i, cmd);
+            gbenchmark_escape(&cmd);
+        }
+    }
+}
+
+/*
+  run the mission from start to end, every command completing at once
+ */
+static void BM_MissionRun(benchmark::State& state)
+{
+    bench.setup();
+    AP_Mission &mission = bench.mission(state.range_x());
+    while (state.KeepRunning()) {
+        mission.start();
+        while (mission.state() == AP_Mission::MISSION_RUNNING) {
+            mission.update();
+        }
+    }
+}
+
+BENCHMARK(BM_MissionReadAll)->Arg(0)->Arg(1);
+BENCHMARK(BM_MissionNextNav)->Arg(0)->Arg(1);
+BENCHMARK(BM_MissionRun)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN()
@@ -24,6 +24,8 @@
 #include "AP_Param.h"
 
 #include <cmath>
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <AP_Common/AP_Common.h>
@@ -62,6 +64,23 @@ uint16_t AP_Param::_num_vars;
 // cached parameter count
 uint16_t AP_Param::_parameter_count;
 
+// name and index lookup tables
+struct AP_Param::lookup_entry *AP_Param::_lookup_entries;
+struct AP_Param::lookup_name *AP_Param::_lookup_names;
+uint16_t AP_Param::_lookup_count;
+uint16_t AP_Param::_lookup_size;
+volatile bool AP_Param::_lookup_valid;
+bool AP_Param::_lookup_enabled = true;
+AP_HAL::Semaphore *AP_Param::_lookup_sem;
+
+// storage offset index
+uint16_t *AP_Param::_offset_index;
+uint16_t AP_Param::_offset_index_size;
+uint16_t AP_Param::_offset_index_count;
+uint16_t AP_Param::_offset_index_end;
+bool AP_Param::_offset_index_valid;
+bool AP_Param::_offset_index_enabled = true;
+
 // storage and naming information about all types that can be saved
 const AP_Param::Info *AP_Param::_var_info;
 
@@ -119,6 +138,11 @@ void AP_Param::erase_all(void)
 
     // add a sentinal directly after the header
     write_sentinal(sizeof(struct EEPROM_header));
+
+    // the offset index is trivially valid for empty storage
+    offset_index_reset();
+    _offset_index_end = sizeof(struct EEPROM_header);
+    _offset_index_valid = true;
 }
 
 /* the 'group_id' of a element of a group is the 18 bit identifier
@@ -308,6 +332,10 @@ bool AP_Param::setup(void)
         erase_all();
     }
 
+    if (_lookup_sem == nullptr) {
+        _lookup_sem = hal.util->new_semaphore();
+    }
+
     return true;
 }
 
@@ -667,12 +695,26 @@ bool AP_Param::is_sentinal(const Param_header &phdr)
 bool AP_Param::scan(const AP_Param::Param_header *target, uint16_t *pofs)
 {
     struct Param_header phdr;
+
+    if (_offset_index_valid && _offset_index_enabled) {
+        const uint16_t mask = _offset_index_size - 1;
+        for (uint16_t i=offset_index_slot(*target), n=0;
+             n < _offset_index_size && _offset_index[i] != 0;
+             i=(i+1) & mask, n++) {
+            _storage.read_block(&phdr, _offset_index[i], sizeof(phdr));
+            if (headers_match(phdr, *target)) {
+                *pofs = _offset_index[i];
+                return true;
+            }
+        }
+        *pofs = _offset_index_end;
+        return false;
+    }
+
     uint16_t ofs = sizeof(AP_Param::EEPROM_header);
     while (ofs < _storage.size()) {
         _storage.read_block(&phdr, ofs, sizeof(phdr));
-        if (phdr.type == target->type &&
-            get_key(phdr) == get_key(*target) &&
-            phdr.group_element == target->group_element) {
+        if (headers_match(phdr, *target)) {
             // found it
             *pofs = ofs;
             return true;
@@ -815,10 +857,10 @@ AP_Param::find_group(const char *name, uint16_t vindex, ptrdiff_t group_offset,
 }
 
 
-// Find a variable by name.
+// Find a variable by name by searching _var_info
 //
 AP_Param *
-AP_Param::find(const char *name, enum ap_var_type *ptype)
+AP_Param::find_linear(const char *name, enum ap_var_type *ptype)
 {
     for (uint16_t i=0; i<_num_vars; i++) {
         uint8_t type = _var_info[i].type;
@@ -850,11 +892,36 @@ AP_Param::find(const char *name, enum ap_var_type *ptype)
     return nullptr;
 }
 
-// Find a variable by index. Note that this is quite slow.
+// Find a variable by name.
+//
+AP_Param *
+AP_Param::find(const char *name, enum ap_var_type *ptype)
+{
+    AP_Param *ap = lookup_find(name, ptype);
+    if (ap != nullptr) {
+        return ap;
+    }
+    return find_linear(name, ptype);
+}
+
+// Find a variable by index. This is a table lookup once the lookup
+// index is built, otherwise quite slow.
 //
 AP_Param *
 AP_Param::find_by_index(uint16_t idx, enum ap_var_type *ptype, ParamToken *token)
 {
+    if (lookup_take()) {
+        AP_Param *ret = nullptr;
+        if (idx < _lookup_count) {
+            const struct lookup_entry &e = _lookup_entries[idx];
+            *token = e.token;
+            *ptype = (enum ap_var_type)e.type;
+            ret = e.ap;
+        }
+        _lookup_sem->give();
+        return ret;
+    }
+
     AP_Param *ap;
     uint16_t count=0;
     for (ap=AP_Param::first(token, ptype);
@@ -866,6 +933,143 @@ AP_Param::find_by_index(uint16_t idx, enum ap_var_type *ptype, ParamToken *token
 }
 
 
+/*
+  hash a parameter name for the lookup index. Names are compared
+  without regard to case so the hash folds case too
+ */
+uint16_t AP_Param::lookup_hash(const char *name)
+{
+    // FNV-1a, folded to 16 bits
+    uint32_t h = 2166136261U;
+    for (uint8_t i=0; i<AP_MAX_NAME_SIZE && name[i]; i++) {
+        h ^= (uint8_t)toupper(name[i]);
+        h *= 16777619U;
+    }
+    return (h >> 16) ^ (h & 0xFFFF);
+}
+
+/*
+  (re)build the lookup index. Called with _lookup_sem held
+ */
+bool AP_Param::lookup_build(void)
+{
+    const uint16_t count = count_parameters();
+    if (count > _lookup_size) {
+        delete[] _lookup_entries;
+        delete[] _lookup_names;
+        _lookup_entries = nullptr;
+        _lookup_names = nullptr;
+        _lookup_size = 0;
+        const uint32_t needed = count * (sizeof(struct lookup_entry) + sizeof(struct lookup_name));
+        if (hal.util->available_memory() < needed + 4096) {
+            return false;
+        }
+        _lookup_entries = new lookup_entry[count];
+        _lookup_names = new lookup_name[count];
+        if (_lookup_entries == nullptr || _lookup_names == nullptr) {
+            delete[] _lookup_entries;
+            delete[] _lookup_names;
+            _lookup_entries = nullptr;
+            _lookup_names = nullptr;
+            return false;
+        }
+        _lookup_size = count;
+    }
+
+    // mark valid before the walk so an invalidation during it is not lost
+    _lookup_valid = true;
+
+    ParamToken token;
+    enum ap_var_type type;
+    uint16_t n = 0;
+    for (AP_Param *ap = first(&token, &type);
+         ap != nullptr && n < _lookup_size;
+         ap = next_scalar(&token, &type)) {
+        char name[AP_MAX_NAME_SIZE+1];
+        ap->copy_name_token(token, name, sizeof(name), true);
+        name[AP_MAX_NAME_SIZE] = 0;
+        _lookup_entries[n].ap = ap;
+        _lookup_entries[n].token = token;
+        _lookup_entries[n].type = type;
+        _lookup_names[n].hash = lookup_hash(name);
+        _lookup_names[n].index = n;
+        n++;
+    }
+    _lookup_count = n;
+    qsort(_lookup_names, n, sizeof(_lookup_names[0]), lookup_name_compare);
+    return true;
+}
+
+/*
+  order lookup names by hash, for qsort()
+ */
+int AP_Param::lookup_name_compare(const void *a, const void *b)
+{
+    const struct lookup_name *na = (const struct lookup_name *)a;
+    const struct lookup_name *nb = (const struct lookup_name *)b;
+    return (int)na->hash - (int)nb->hash;
+}
+
+/*
+  take the lookup semaphore with a valid index, building it if needed.
+  Returns false if the index can't be used, in which case the caller
+  should fall back to walking the parameters. We don't wait long for
+  the semaphore, so the main loop isn't held up while another thread
+  builds the index
+ */
+bool AP_Param::lookup_take(void)
+{
+    if (!_lookup_enabled || _lookup_sem == nullptr) {
+        return false;
+    }
+    if (!_lookup_sem->take(AP_PARAM_LOOKUP_TIMEOUT_MS)) {
+        return false;
+    }
+    if (!_lookup_valid && !lookup_build()) {
+        _lookup_sem->give();
+        return false;
+    }
+    return true;
+}
+
+/*
+  find a scalar parameter by name using the lookup index
+ */
+AP_Param *AP_Param::lookup_find(const char *name, enum ap_var_type *ptype)
+{
+    if (!lookup_take()) {
+        return nullptr;
+    }
+    const uint16_t hash = lookup_hash(name);
+
+    // find the first entry with this hash
+    uint16_t lo = 0, hi = _lookup_count;
+    while (lo < hi) {
+        const uint16_t mid = (lo + hi) / 2;
+        if (_lookup_names[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    AP_Param *ret = nullptr;
+    for (; lo < _lookup_count && _lookup_names[lo].hash == hash; lo++) {
+        const struct lookup_entry &e = _lookup_entries[_lookup_names[lo].index];
+        char ename[AP_MAX_NAME_SIZE+1];
+        e.ap->copy_name_token(e.token, ename, sizeof(ename), true);
+        ename[AP_MAX_NAME_SIZE] = 0;
+        if (strncasecmp(name, ename, AP_MAX_NAME_SIZE) == 0) {
+            *ptype = (enum ap_var_type)e.type;
+            ret = e.ap;
+            break;
+        }
+    }
+    _lookup_sem->give();
+    return ret;
+}
+
+
 /*
   Find a variable by pointer, returning key. This is used for loading pointer variables
 */
@@ -1015,7 +1219,7 @@ bool AP_Param::save(bool force_save)
 
     if (phdr.type == AP_PARAM_INT8 && ginfo != nullptr && (ginfo->flags & AP_PARAM_FLAG_ENABLE)) {
         // clear cached parameter count
-        _parameter_count = 0;
+        invalidate_count();
     }
     
     char name[AP_MAX_NAME_SIZE+1];
@@ -1067,6 +1271,11 @@ bool AP_Param::save(bool force_save)
     eeprom_write_check(ap, ofs+sizeof(phdr), type_size((enum ap_var_type)phdr.type));
     eeprom_write_check(&phdr, ofs, sizeof(phdr));
 
+    if (_offset_index_valid) {
+        _offset_index_end = ofs + sizeof(phdr) + type_size((enum ap_var_type)phdr.type);
+        _offset_index_valid = offset_index_add(phdr, ofs);
+    }
+
     send_parameter(name, (enum ap_var_type)phdr.type, idx);
     return true;
 }
@@ -1276,15 +1485,25 @@ bool AP_Param::load_all(bool check_defaults_file)
 
     reload_defaults_file(check_defaults_file);
 
+    // rebuild the offset index as we go
+    offset_index_reset();
+    bool index_ok = true;
+
     while (ofs < _storage.size()) {
         _storage.read_block(&phdr, ofs, sizeof(phdr));
         // note that this is an || not an && for robustness
         // against power off while adding a variable
         if (is_sentinal(phdr)) {
             // we've reached the sentinal
+            _offset_index_end = ofs;
+            _offset_index_valid = index_ok;
             return true;
         }
 
+        if (index_ok) {
+            index_ok = offset_index_add(phdr, ofs);
+        }
+
         const struct AP_Param::Info *info;
         void *ptr;
 
@@ -1298,9 +1517,92 @@ bool AP_Param::load_all(bool check_defaults_file)
 
     // we didn't find the sentinal
     Debug("no sentinal in load_all");
+    _offset_index_end = 0xFFFF;
+    _offset_index_valid = index_ok;
     return false;
 }
 
+/*
+  return the first slot to probe in the offset index for a header
+ */
+uint16_t AP_Param::offset_index_slot(const Param_header &phdr)
+{
+    const uint32_t v = phdr.type | (get_key(phdr) << 5) | (phdr.group_element << 14);
+    return (v * 2654435761U) >> 16 & (_offset_index_size - 1);
+}
+
+/*
+  allocate the offset index with space for count slots, moving any
+  existing entries across
+ */
+bool AP_Param::offset_index_alloc(uint16_t count)
+{
+    if (hal.util->available_memory() < count * sizeof(uint16_t) + 4096U) {
+        return false;
+    }
+    uint16_t *new_index = new uint16_t[count];
+    if (new_index == nullptr) {
+        return false;
+    }
+    memset(new_index, 0, count * sizeof(uint16_t));
+
+    uint16_t *old_index = _offset_index;
+    const uint16_t old_size = _offset_index_size;
+    _offset_index = new_index;
+    _offset_index_size = count;
+    _offset_index_count = 0;
+    for (uint16_t i=0; i<old_size; i++) {
+        if (old_index[i] != 0) {
+            struct Param_header phdr;
+            _storage.read_block(&phdr, old_index[i], sizeof(phdr));
+            offset_index_add(phdr, old_index[i]);
+        }
+    }
+    delete[] old_index;
+    return true;
+}
+
+/*
+  add the parameter stored at ofs to the offset index. If the header
+  is already present the earlier copy is kept, as scan() would find
+  that one first
+ */
+bool AP_Param::offset_index_add(const Param_header &phdr, uint16_t ofs)
+{
+    if ((_offset_index_count+1U)*4U > _offset_index_size*3U) {
+        // keep the table at most 3/4 full
+        if (_offset_index_size >= 32768U ||
+            !offset_index_alloc(MAX(_offset_index_size*2U, 64U))) {
+            return false;
+        }
+    }
+    const uint16_t mask = _offset_index_size - 1;
+    for (uint16_t i=offset_index_slot(phdr); ; i=(i+1) & mask) {
+        if (_offset_index[i] == 0) {
+            _offset_index[i] = ofs;
+            _offset_index_count++;
+            return true;
+        }
+        struct Param_header phdr2;
+        _storage.read_block(&phdr2, _offset_index[i], sizeof(phdr2));
+        if (headers_match(phdr, phdr2)) {
+            return true;
+        }
+    }
+}
+
+/*
+  empty the offset index, leaving it invalid until rebuilt
+ */
+void AP_Param::offset_index_reset(void)
+{
+    _offset_index_valid = false;
+    _offset_index_count = 0;
+    if (_offset_index != nullptr) {
+        memset(_offset_index, 0, _offset_index_size * sizeof(uint16_t));
+    }
+}
+
 /*
   reload from hal.util defaults file
  */
@@ -1338,7 +1640,7 @@ void AP_Param::load_object_from_eeprom(const void *object_pointer, const struct
     uint16_t key;
 
     // reset cached param counter as we may be loading a dynamic var_info
-    _parameter_count = 0;
+    invalidate_count();
     
     if (!find_key_by_pointer(object_pointer, key)) {
         hal.console->printf("ERROR: Unable to find param pointer\n");
@@ -1356,29 +1658,40 @@ void AP_Param::load_object_from_eeprom(const void *object_pointer, const struct
                 load_object_from_eeprom((void *)(((ptrdiff_t)object_pointer)+new_offset), ginfo);
             }
         }
-        uint16_t ofs = sizeof(AP_Param::EEPROM_header);
-        while (ofs < _storage.size()) {
-            _storage.read_block(&phdr, ofs, sizeof(phdr));
-            // note that this is an || not an && for robustness
-            // against power off while adding a variable
-            if (is_sentinal(phdr)) {
-                // we've reached the sentinal
-                break;
-            }
-            if (get_key(phdr) == key) {
-                const struct AP_Param::Info *info;
-                void *ptr;
-                
-                info = find_by_header(phdr, &ptr);
-                if (info != nullptr) {
-                    if ((ptrdiff_t)ptr == ((ptrdiff_t)object_pointer)+group_info[i].offset) {
+    }
+
+    /*
+      walk the storage once, loading each element of this group from
+      the first copy of it found. Groups have at most 64 elements
+     */
+    uint64_t loaded = 0;
+    uint16_t ofs = sizeof(AP_Param::EEPROM_header);
+    while (ofs < _storage.size()) {
+        _storage.read_block(&phdr, ofs, sizeof(phdr));
+        // note that this is an || not an && for robustness
+        // against power off while adding a variable
+        if (is_sentinal(phdr)) {
+            // we've reached the sentinal
+            break;
+        }
+        if (get_key(phdr) == key) {
+            const struct AP_Param::Info *info;
+            void *ptr;
+
+            info = find_by_header(phdr, &ptr);
+            if (info != nullptr) {
+                for (uint8_t i=0; i<64 && group_info[i].type != AP_PARAM_NONE; i++) {
+                    if (group_info[i].type != AP_PARAM_GROUP &&
+                        !(loaded & (1ULL<<i)) &&
+                        (ptrdiff_t)ptr == ((ptrdiff_t)object_pointer)+group_info[i].offset) {
                         _storage.read_block(ptr, ofs+sizeof(phdr), type_size((enum ap_var_type)phdr.type));
+                        loaded |= (1ULL<<i);
                         break;
                     }
                 }
             }
-            ofs += type_size((enum ap_var_type)phdr.type) + sizeof(phdr);
         }
+        ofs += type_size((enum ap_var_type)phdr.type) + sizeof(phdr);
     }
 }
 
@@ -38,6 +38,14 @@
 #define AP_PARAM_MAX_EMBEDDED_PARAM 8192
 #endif
 
+/*
+  longest wait for the lookup index semaphore in find() and
+  find_by_index() before falling back to a walk of the parameters
+ */
+#ifndef AP_PARAM_LOOKUP_TIMEOUT_MS
+#define AP_PARAM_LOOKUP_TIMEOUT_MS 1
+#endif
+
 /*
   flags for variables in var_info and group tables
  */
@@ -384,11 +392,30 @@ public:
     // count of parameters in tree
     static uint16_t count_parameters(void);
 
-    static void set_hide_disabled_groups(bool value) { _hide_disabled_groups = value; }
+    static void set_hide_disabled_groups(bool value) {
+        _hide_disabled_groups = value;
+        invalidate_count();
+    }
 
     // set frame type flags. Used to unhide frame specific parameters
     static void set_frame_type_flags(uint16_t flags_to_set) {
         _frame_type_flags |= flags_to_set;
+        invalidate_count();
+    }
+
+    // forget the cached parameter count and lookup index; both are
+    // rebuilt when next needed
+    static void invalidate_count(void) {
+        _parameter_count = 0;
+        _lookup_valid = false;
+    }
+
+    // enable or disable use of the lookup index by find() and
+    // find_by_index(), and of the storage offset index. Both are
+    // enabled by default
+    static void set_lookup_index_enabled(bool enable) {
+        _lookup_enabled = enable;
+        _offset_index_enabled = enable;
     }
 
     // check if a given frame type should be included
@@ -552,6 +579,63 @@ private:
     static uint16_t             _parameter_count;
     static const struct Info *  _var_info;
 
+    /*
+      lookup index over the scalar parameters, built on first use.
+      _lookup_entries holds the parameters in the order next_scalar()
+      returns them so find_by_index() is a table lookup, and
+      _lookup_names holds a hash of each name in sorted order so
+      find() is a binary search. Names not in the index (for example
+      whole Vector3f values and hidden parameters) fall back to a
+      search of _var_info
+     */
+    struct lookup_entry {
+        AP_Param *ap;
+        ParamToken token;
+        uint8_t type;
+    };
+    struct lookup_name {
+        uint16_t hash;
+        uint16_t index;
+    };
+    static struct lookup_entry *_lookup_entries;
+    static struct lookup_name * _lookup_names;
+    static uint16_t             _lookup_count;
+    static uint16_t             _lookup_size;
+    static volatile bool        _lookup_valid;
+    static bool                 _lookup_enabled;
+    static AP_HAL::Semaphore *  _lookup_sem;
+
+    static uint16_t             lookup_hash(const char *name);
+    static int                  lookup_name_compare(const void *a, const void *b);
+    static bool                 lookup_build(void);
+    static bool                 lookup_take(void);
+    static AP_Param *           lookup_find(const char *name, enum ap_var_type *ptype);
+    static AP_Param *           find_linear(const char *name, enum ap_var_type *ptype);
+
+    /*
+      index from parameter header to the offset of the parameter in
+      storage, so scan() doesn't have to walk the storage. It is an
+      open addressing hash table of storage offsets, built by
+      load_all() and added to as new parameters are saved. The header
+      at each offset is read back from storage to compare, so an
+      empty slot is 0 (which is the EEPROM header, never a
+      parameter). _offset_index_end is the offset of the sentinal
+     */
+    static uint16_t *           _offset_index;
+    static uint16_t             _offset_index_size; // power of 2
+    static uint16_t             _offset_index_count;
+    static uint16_t             _offset_index_end;
+    static bool                 _offset_index_valid;
+    static bool                 _offset_index_enabled;
+
+    static uint16_t             offset_index_slot(const Param_header &phdr);
+    static bool                 offset_index_alloc(uint16_t count);
+    static bool                 offset_index_add(const Param_header &phdr, uint16_t ofs);
+    static void                 offset_index_reset(void);
+    static bool                 headers_match(const Param_header &a, const Param_header &b) {
+        return a.type == b.type && get_key(a) == get_key(b) && a.group_element == b.group_element;
+    }
+
     /*
       list of overridden values from load_defaults_file()
     */
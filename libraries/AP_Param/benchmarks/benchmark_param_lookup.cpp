@@ -0,0 +1,208 @@
+/*
+  compare parameter lookup by index and by name using the lookup
+  index against walking the parameter tree, on a vehicle with 1000
+  parameters: 100 objects of 10 parameters each, which is roughly the
+  shape of a vehicle's parameter tree.
+
+  BM_FindByIndex* fetch every parameter by index in turn, as a GCS
+  does when it fetches the list by PARAM_REQUEST_READ. BM_FindByName*
+  look up every parameter by name in turn, as for a burst of
+  PARAM_SET.
+
+  The storage benchmarks run with every parameter saved.
+  BM_LoadAllLoadEach* time load_all() followed by load() of every
+  parameter, which bounds the boot time cost of objects loading their
+  own parameters. BM_Save* time saving an existing parameter.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AP_Param/AP_Param.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define BENCH_NUM_OBJECTS 100
+#define BENCH_NUM_PARAMS  10
+
+class BenchObject {
+public:
+    static const struct AP_Param::GroupInfo var_info[];
+    AP_Float p[BENCH_NUM_PARAMS];
+};
+
+#define P(n) AP_GROUPINFO("P" #n, n, BenchObject, p[n], 0)
+
+const AP_Param::GroupInfo BenchObject::var_info[] = {
+    P(0), P(1), P(2), P(3), P(4), P(5), P(6), P(7), P(8), P(9),
+    AP_GROUPEND
+};
+
+static BenchObject objects[BENCH_NUM_OBJECTS];
+
+#define OBJ(n) { AP_PARAM_GROUP, "O" #n "_", n, &objects[n], {group_info : BenchObject::var_info} }
+
+static const AP_Param::Info var_info[] = {
+    OBJ(0), OBJ(1), OBJ(2), OBJ(3), OBJ(4), OBJ(5), OBJ(6), OBJ(7), OBJ(8), OBJ(9),
+    OBJ(10), OBJ(11), OBJ(12), OBJ(13), OBJ(14), OBJ(15), OBJ(16), OBJ(17), OBJ(18), OBJ(19),
+    OBJ(20), OBJ(21), OBJ(22), OBJ(23), OBJ(24), OBJ(25), OBJ(26), OBJ(27), OBJ(28), OBJ(29),
+    OBJ(30), OBJ(31), OBJ(32), OBJ(33), OBJ(34), OBJ(35), OBJ(36), OBJ(37), OBJ(38), OBJ(39),
+    OBJ(40), OBJ(41), OBJ(42), OBJ(43), OBJ(44), OBJ(45), OBJ(46), OBJ(47), OBJ(48), OBJ(49),
+    OBJ(50), OBJ(51), OBJ(52), OBJ(53), OBJ(54), OBJ(55), OBJ(56), OBJ(57), OBJ(58), OBJ(59),
+    OBJ(60), OBJ(61), OBJ(62), OBJ(63), OBJ(64), OBJ(65), OBJ(66), OBJ(67), OBJ(68), OBJ(69),
+    OBJ(70), OBJ(71), OBJ(72), OBJ(73), OBJ(74), OBJ(75), OBJ(76), OBJ(77), OBJ(78), OBJ(79),
+    OBJ(80), OBJ(81), OBJ(82), OBJ(83), OBJ(84), OBJ(85), OBJ(86), OBJ(87), OBJ(88), OBJ(89),
+    OBJ(90), OBJ(91), OBJ(92), OBJ(93), OBJ(94), OBJ(95), OBJ(96), OBJ(97), OBJ(98), OBJ(99),
+    AP_VAREND
+};
+
+static AP_Param param_loader(var_info);
+
+static const uint16_t num_params = BENCH_NUM_OBJECTS * BENCH_NUM_PARAMS;
+static char names[num_params][AP_MAX_NAME_SIZE+1];
+
+static void setup()
+{
+    static bool done;
+    if (done) {
+        return;
+    }
+    done = true;
+    AP_Param::setup();
+    for (uint16_t i=0; i<num_params; i++) {
+        snprintf(names[i], sizeof(names[i]), "O%u_P%u",
+                 (unsigned)(i / BENCH_NUM_PARAMS), (unsigned)(i % BENCH_NUM_PARAMS));
+    }
+}
+
+static void find_by_index(benchmark::State& state)
+{
+    uint16_t idx = 0;
+    while (state.KeepRunning()) {
+        AP_Param::ParamToken token;
+        enum ap_var_type type;
+        AP_Param *ap = AP_Param::find_by_index(idx, &type, &token);
+        gbenchmark_escape(ap);
+        if (++idx == num_params) {
+            idx = 0;
+        }
+    }
+}
+
+static void find_by_name(benchmark::State& state)
+{
+    uint16_t idx = 0;
+    while (state.KeepRunning()) {
+        enum ap_var_type type;
+        AP_Param *ap = AP_Param::find(names[idx], &type);
+        gbenchmark_escape(ap);
+        if (++idx == num_params) {
+            idx = 0;
+        }
+    }
+}
+
+static void BM_FindByIndexWalk(benchmark::State& state)
+{
+    setup();
+    AP_Param::set_lookup_index_enabled(false);
+    find_by_index(state);
+}
+
+static void BM_FindByIndexTable(benchmark::State& state)
+{
+    setup();
+    AP_Param::set_lookup_index_enabled(true);
+    find_by_index(state);
+}
+
+static void BM_FindByNameWalk(benchmark::State& state)
+{
+    setup();
+    AP_Param::set_lookup_index_enabled(false);
+    find_by_name(state);
+}
+
+static void BM_FindByNameTable(benchmark::State& state)
+{
+    setup();
+    AP_Param::set_lookup_index_enabled(true);
+    find_by_name(state);
+}
+
+static void setup_storage()
+{
+    static bool done;
+    setup();
+    if (done) {
+        return;
+    }
+    done = true;
+    AP_Param::erase_all();
+    for (uint16_t i=0; i<BENCH_NUM_OBJECTS; i++) {
+        for (uint16_t j=0; j<BENCH_NUM_PARAMS; j++) {
+            objects[i].p[j].set_and_save(i + j*0.1f);
+        }
+    }
+}
+
+static void load_all_load_each(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        AP_Param::load_all(false);
+        for (uint16_t i=0; i<BENCH_NUM_OBJECTS; i++) {
+            for (uint16_t j=0; j<BENCH_NUM_PARAMS; j++) {
+                objects[i].p[j].load();
+            }
+        }
+    }
+}
+
+static void save_each(benchmark::State& state)
+{
+    uint16_t idx = 0;
+    while (state.KeepRunning()) {
+        AP_Float &p = objects[idx / BENCH_NUM_PARAMS].p[idx % BENCH_NUM_PARAMS];
+        p.set_and_save(p.get() + 1);
+        if (++idx == num_params) {
+            idx = 0;
+        }
+    }
+}
+
+static void BM_LoadAllLoadEachWalk(benchmark::State& state)
+{
+    setup_storage();
+    AP_Param::set_lookup_index_enabled(false);
+    load_all_load_each(state);
+}
+
+static void BM_LoadAllLoadEachIndex(benchmark::State& state)
+{
+    setup_storage();
+    AP_Param::set_lookup_index_enabled(true);
+    load_all_load_each(state);
+}
+
+static void BM_SaveWalk(benchmark::State& state)
+{
+    setup_storage();
+    AP_Param::set_lookup_index_enabled(false);
+    save_each(state);
+}
+
+static void BM_SaveIndex(benchmark::State& state)
+{
+    setup_storage();
+    AP_Param::set_lookup_index_enabled(true);
+    save_each(state);
+}
+
+BENCHMARK(BM_FindByIndexWalk);
+BENCHMARK(BM_FindByIndexTable);
+BENCHMARK(BM_FindByNameWalk);
+BENCHMARK(BM_FindByNameTable);
+BENCHMARK(BM_LoadAllLoadEachWalk);
+BENCHMARK(BM_LoadAllLoadEachIndex);
+BENCHMARK(BM_SaveWalk);
+BENCHMARK(BM_SaveIndex);
+
+BENCHMARK_MAIN()
@@ -26,8 +26,8 @@ const AP_Param::GroupInfo AP_SmartRTL::var_info[] = {
 
     // @Param: POINTS
     // @DisplayName: SmartRTL maximum number of points on path
-    // @Description: SmartRTL maximum number of points on path. Set to 0 to disable SmartRTL.  100 points consumes about 3k of memory.
-    // @Range: 0 500
+    // @Description: SmartRTL maximum number of points on path. Set to 0 to disable SmartRTL.  100 points consumes about 4k of memory.
+    // @Range: 0 5000
     // @User: Advanced
     // @RebootRequired: True
     AP_GROUPINFO("POINTS", 1, AP_SmartRTL, _points_max, SMARTRTL_POINTS_DEFAULT),
@@ -56,6 +56,12 @@ const AP_Param::GroupInfo AP_SmartRTL::var_info[] = {
 *    2. Simplification uses the Ramer-Douglas-Peucker algorithm. See Wikipedia
 *    for a more complete description.
 *
+*    To avoid comparing every pair of segments, pruning keeps a spatial index:
+*    a hashed horizontal grid of cells a few times larger than the pruning
+*    distance, with each segment listed in the cells it covers.  A segment is
+*    then only compared with the segments listed in the cells around it.  If
+*    there is not enough memory for the index every pair is compared instead.
+*
 *    The simplification and pruning algorithms run in the background and do not
 *    alter the path in memory.  Two definitions, SMARTRTL_SIMPLIFY_TIME_US and
 *    SMARTRTL_PRUNING_LOOP_TIME_US are used to limit how long each algorithm will
@@ -123,6 +129,27 @@ void AP_SmartRTL::init()
 
     _path_points_max = _points_max;
 
+    // allocate spatial index, loop detection compares every pair of segments if this fails
+    uint32_t buckets = 1;
+    while (buckets < (uint32_t)_points_max) {
+        buckets <<= 1;
+    }
+    _index.buckets = (uint16_t*)calloc(buckets, sizeof(uint16_t));
+    _index.entries_max = _points_max * SMARTRTL_INDEX_ENTRIES_MULT;
+    _index.entries = (index_entry_t*)calloc(_index.entries_max, sizeof(index_entry_t));
+    _index.checked = (uint16_t*)calloc(_points_max, sizeof(uint16_t));
+    if (_index.buckets == nullptr || _index.entries == nullptr || _index.checked == nullptr) {
+        free(_index.buckets);
+        free(_index.entries);
+        free(_index.checked);
+        _index.buckets = nullptr;
+        _index.entries = nullptr;
+        _index.checked = nullptr;
+    } else {
+        _index.buckets_mask = buckets - 1;
+        index_reset();
+    }
+
     // when running the example sketch, we want the cleanup tasks to run when we tell them to, not in the background (so that they can be timed.)
     if (!_example_mode){
         // register background cleanup to run in IO thread
@@ -531,6 +558,12 @@ void AP_SmartRTL::detect_loops()
     // capture start time
     const uint32_t start_time_us = AP_HAL::micros();
 
+    // use the spatial index if we have one
+    if (_index.buckets != nullptr) {
+        detect_loops_indexed(start_time_us);
+        return;
+    }
+
     // run for defined amount of time
     while (AP_HAL::micros() - start_time_us < SMARTRTL_PRUNING_LOOP_TIME_US) {
 
@@ -563,6 +596,185 @@ void AP_SmartRTL::detect_loops()
     }
 }
 
+/**
+*   Loop detection using the spatial index.  Finds the same loops as the pairwise search in detect_loops, but each
+*   segment is only compared against the segments listed in nearby grid cells.  The index is rebuilt each time
+*   pruning is restarted, which takes one pass over the path and is also limited to SMARTRTL_PRUNING_LOOP_TIME_US.
+*/
+void AP_SmartRTL::detect_loops_indexed(uint32_t start_time_us)
+{
+    // add any segments not yet in the index
+    while (_index.segments_count < _prune.path_points_count - 1) {
+        if (AP_HAL::micros() - start_time_us >= SMARTRTL_PRUNING_LOOP_TIME_US) {
+            return;
+        }
+        index_add_segment(_index.segments_count + 1);
+        _index.segments_count++;
+    }
+
+    // run for defined amount of time
+    while (AP_HAL::micros() - start_time_us < SMARTRTL_PRUNING_LOOP_TIME_US) {
+
+        uint16_t j;
+        dist_point dp;
+        bool searched = true;
+        const bool found = index_find_loop(_prune.i, j, dp, start_time_us, searched);
+        if (!searched) {
+            // out of time, continue with this segment on the next call
+            return;
+        }
+        if (found) {
+            // if there is a loop here, add to loop array
+            if (!add_loop(j, _prune.i-1, dp.midpoint)) {
+                // if the buffer is full, stop trying to prune
+                _prune.complete = true;
+                return;
+            }
+        }
+
+        // reduce outer loop
+        _prune.i--;
+        // complete when outer loop has run out of new points to check
+        if (_prune.i < 4 || _prune.i < _prune.path_points_completed) {
+            _prune.complete = true;
+            _prune.path_points_completed = _prune.path_points_count;
+            return;
+        }
+    }
+}
+
+// find the earliest segment which comes close to segment i, ignoring the segment directly before it
+// returns true and fills in j and dp if found.  searched is set false if the search ran out of time
+bool AP_SmartRTL::index_find_loop(uint16_t i, uint16_t &j, dist_point &dp, uint32_t start_time_us, bool &searched)
+{
+    bool found = false;
+
+    // range of cells which could hold a segment within SMARTRTL_PRUNING_DELTA of this one
+    int32_t x_min, x_max, y_min, y_max;
+    index_cell_range(_path[i-1], _path[i], SMARTRTL_PRUNING_DELTA, x_min, x_max, y_min, y_max);
+
+    // if the segment covers more cells than there are segments to check, check them all
+    const uint32_t x_cells = x_max - x_min + 1;
+    const uint32_t y_cells = y_max - y_min + 1;
+    // this is as slow as the unindexed search, so is limited to SMARTRTL_PRUNING_LOOP_TIME_US in the same
+    // way, with _prune.j holding the segment to resume from on the next call
+    if (x_cells > i || y_cells > i || x_cells * y_cells > i) {
+        for (uint16_t s = MAX(_prune.j, 1); s <= i - 2; s++) {
+            if (AP_HAL::micros() - start_time_us >= SMARTRTL_PRUNING_LOOP_TIME_US) {
+                _prune.j = s;
+                searched = false;
+                return false;
+            }
+            index_check_segment(i, s, found, j, dp);
+            if (found) {
+                _prune.j = 0;
+                return true;
+            }
+        }
+        _prune.j = 0;
+        return false;
+    }
+
+    // check segments in nearby cells
+    for (int32_t x = x_min; x <= x_max; x++) {
+        for (int32_t y = y_min; y <= y_max; y++) {
+            for (uint16_t e = _index.buckets[index_bucket(x, y)]; e != SMARTRTL_INDEX_NONE; e = _index.entries[e].next) {
+                index_check_segment(i, _index.entries[e].segment, found, j, dp);
+            }
+        }
+    }
+
+    // check segments which were too long to add to the grid
+    for (uint16_t e = _index.long_segments; e != SMARTRTL_INDEX_NONE; e = _index.entries[e].next) {
+        index_check_segment(i, _index.entries[e].segment, found, j, dp);
+    }
+
+    return found;
+}
+
+// check segment s as a candidate for index_find_loop
+void AP_SmartRTL::index_check_segment(uint16_t i, uint16_t s, bool &found, uint16_t &j, dist_point &dp)
+{
+    // ignore segments after the one directly before i, and those already checked against i
+    // (a segment may be listed in several cells, and hash buckets may hold several cells)
+    if (s + 2 > i || _index.checked[s] == i) {
+        return;
+    }
+    _index.checked[s] = i;
+
+    // we only need the earliest segment
+    if (found && s >= j) {
+        return;
+    }
+
+    const dist_point seg_dp = segment_segment_dist(_path[i], _path[i-1], _path[s-1], _path[s]);
+    if (seg_dp.distance < SMARTRTL_PRUNING_DELTA) {
+        found = true;
+        j = s;
+        dp = seg_dp;
+    }
+}
+
+// add segment s (from point s-1 to point s) to the spatial index
+void AP_SmartRTL::index_add_segment(uint16_t s)
+{
+    int32_t x_min, x_max, y_min, y_max;
+    index_cell_range(_path[s-1], _path[s], 0.0f, x_min, x_max, y_min, y_max);
+
+    // one entry is kept back for each segment still to be added so that the index can never overflow
+    const uint16_t segments_remaining = _prune.path_points_count - 1 - s;
+    const uint32_t x_cells = x_max - x_min + 1;
+    const uint32_t y_cells = y_max - y_min + 1;
+    if (x_cells > SMARTRTL_INDEX_CELLS_MAX || y_cells > SMARTRTL_INDEX_CELLS_MAX ||
+        x_cells * y_cells > SMARTRTL_INDEX_CELLS_MAX ||
+        _index.entries_count + x_cells * y_cells + segments_remaining > _index.entries_max) {
+        // add to the list of segments checked by every search
+        if (_index.entries_count < _index.entries_max) {
+            _index.entries[_index.entries_count] = {s, _index.long_segments};
+            _index.long_segments = _index.entries_count++;
+        }
+        return;
+    }
+
+    // add to each cell covered by the segment
+    for (int32_t x = x_min; x <= x_max; x++) {
+        for (int32_t y = y_min; y <= y_max; y++) {
+            const uint16_t bucket = index_bucket(x, y);
+            _index.entries[_index.entries_count] = {s, _index.buckets[bucket]};
+            _index.buckets[bucket] = _index.entries_count++;
+        }
+    }
+}
+
+// clear the spatial index
+void AP_SmartRTL::index_reset()
+{
+    if (_index.buckets == nullptr) {
+        return;
+    }
+    memset(_index.buckets, 0xFF, (_index.buckets_mask + 1) * sizeof(uint16_t));
+    memset(_index.checked, 0xFF, _path_points_max * sizeof(uint16_t));
+    _index.entries_count = 0;
+    _index.long_segments = SMARTRTL_INDEX_NONE;
+    _index.segments_count = 0;
+    _index.cell_size = MAX(SMARTRTL_INDEX_CELL_SIZE, 1.0f);
+}
+
+// calculate the range of grid cells covered by the line from p1 to p2, expanded by margin (in meters)
+void AP_SmartRTL::index_cell_range(const Vector3f& p1, const Vector3f& p2, float margin, int32_t &x_min, int32_t &x_max, int32_t &y_min, int32_t &y_max) const
+{
+    x_min = floorf((MIN(p1.x, p2.x) - margin) / _index.cell_size);
+    x_max = floorf((MAX(p1.x, p2.x) + margin) / _index.cell_size);
+    y_min = floorf((MIN(p1.y, p2.y) - margin) / _index.cell_size);
+    y_max = floorf((MAX(p1.y, p2.y) + margin) / _index.cell_size);
+}
+
+// return the hash bucket holding a grid cell
+uint16_t AP_SmartRTL::index_bucket(int32_t x, int32_t y) const
+{
+    return (((uint32_t)x * 73856093U) ^ ((uint32_t)y * 19349663U)) & _index.buckets_mask;
+}
+
 // restart simplify if new points have been added to path
 // path_points_count is _path_points_count but passed in to avoid having to take the semaphore
 void AP_SmartRTL::restart_simplify_if_new_points(uint16_t path_points_count)
@@ -606,6 +818,7 @@ void AP_SmartRTL::restart_pruning(uint16_t path_points_count)
     _prune.i = (path_points_count > 0) ? path_points_count - 1 : 0;
     _prune.j = 0;
     _prune.path_points_count = path_points_count;
+    index_reset();
 }
 
 // reset pruning algorithm so that it will re-check all points in the path
@@ -10,8 +10,8 @@
 
 // definitions and macros
 #define SMARTRTL_ACCURACY_DEFAULT        2.0f   // default _ACCURACY parameter value.  Points will be no closer than this distance (in meters) together.
-#define SMARTRTL_POINTS_DEFAULT          150    // default _POINTS parameter value.  High numbers improve path pruning but use more memory and CPU for cleanup. Memory used will be 20bytes * this number.
-#define SMARTRTL_POINTS_MAX              500    // the absolute maximum number of points this library can support.
+#define SMARTRTL_POINTS_DEFAULT          150    // default _POINTS parameter value.  High numbers improve path pruning but use more memory and CPU for cleanup. Memory used will be 40bytes * this number.
+#define SMARTRTL_POINTS_MAX              5000   // the absolute maximum number of points this library can support.
 #define SMARTRTL_TIMEOUT                 15000  // the time in milliseconds with no points saved to the path (for whatever reason), before SmartRTL is disabled for the flight
 #define SMARTRTL_CLEANUP_POINT_TRIGGER   50     // simplification will trigger when this many points are added to the path
 #define SMARTRTL_CLEANUP_START_MARGIN    10     // routine cleanup algorithms begin when the path array has only this many empty slots remaining
@@ -24,6 +24,10 @@
 #define SMARTRTL_PRUNING_DELTA (_accuracy * 0.99)   // How many meters apart must two points be, such that we can assume that there is no obstacle between them.  must be smaller than _ACCURACY parameter
 #define SMARTRTL_PRUNING_LOOP_BUFFER_LEN_MULT 0.25f // pruning loop buffer size as compared to maximum number of points
 #define SMARTRTL_PRUNING_LOOP_TIME_US    200    // maximum time (in microseconds) that the loop finding algorithm will run before returning
+#define SMARTRTL_INDEX_CELL_SIZE (_accuracy * 4.0f) // size (in meters) of the horizontal grid cells used by the loop finding spatial index
+#define SMARTRTL_INDEX_CELLS_MAX         16     // segments covering more grid cells than this are held on a single list checked by every search
+#define SMARTRTL_INDEX_ENTRIES_MULT      3      // spatial index entries as compared to maximum number of points
+#define SMARTRTL_INDEX_NONE              0xFFFF // marks the end of a spatial index list
 
 class AP_SmartRTL {
 
@@ -78,6 +82,9 @@ public:
     // run background cleanup - should be run regularly from the IO thread
     void run_background_cleanup();
 
+    // set maximum number of points on path, must be called before init (used by example sketches)
+    void set_points_max(uint16_t points_max) { _points_max.set(points_max); }
+
     // parameter var table
     static const struct AP_Param::GroupInfo var_info[];
 
@@ -159,6 +166,30 @@ private:
     // get the closest distance between 2 line segments and the point midway between the closest points
     static dist_point segment_segment_dist(const Vector3f& p1, const Vector3f& p2, const Vector3f& p3, const Vector3f& p4);
 
+    // loop finding using the spatial index, called by detect_loops if the index could be allocated
+    void detect_loops_indexed(uint32_t start_time_us);
+
+    // find the earliest segment which comes close to segment i (from point i-1 to point i), ignoring the
+    // segment directly before it.  returns true and fills in j and dp if found.  searched is set false if
+    // the search ran out of time, in which case it must be called again for the same segment
+    bool index_find_loop(uint16_t i, uint16_t &j, dist_point &dp, uint32_t start_time_us, bool &searched);
+
+    // check segment s as a candidate for index_find_loop, updating j and dp if it is closer than
+    // SMARTRTL_PRUNING_DELTA to segment i and earlier than any candidate already found
+    void index_check_segment(uint16_t i, uint16_t s, bool &found, uint16_t &j, dist_point &dp);
+
+    // add segment s (from point s-1 to point s) to the spatial index
+    void index_add_segment(uint16_t s);
+
+    // clear the spatial index
+    void index_reset();
+
+    // calculate the range of grid cells covered by the line from p1 to p2, expanded by margin (in meters)
+    void index_cell_range(const Vector3f& p1, const Vector3f& p2, float margin, int32_t &x_min, int32_t &x_max, int32_t &y_min, int32_t &y_max) const;
+
+    // return the hash bucket holding a grid cell
+    uint16_t index_bucket(int32_t x, int32_t y) const;
+
     // de-activate SmartRTL, send warning to GCS and log to dataflash
     void deactivate(SRTL_Actions action, const char *reason);
 
@@ -217,12 +248,31 @@ private:
         uint16_t path_points_count;  // copy of _path_points_count taken when the prune algorithm started
         uint16_t path_points_completed; // number of points in that path that have already been checked for loops and should be ignored
         uint16_t i;     // loop search's outer loop index
-        uint16_t j;     // loop search's inner loop index
+        uint16_t j;     // loop search's inner loop index, or where the indexed search resumes checking every segment
         prune_loop_t* loops;// the result of the pruning algorithm
         uint16_t loops_max; // maximum number of elements in the _prunable_loops array
         uint16_t loops_count;   // number of elements in the _prunable_loops array
     } _prune;
 
+    // Spatial index
+    // hashed horizontal grid holding the path segments so that detect_loops only compares a segment against nearby segments.
+    // segment s runs from point s-1 to point s.  Each cell's segments are held as a singly linked list of entries
+    typedef struct {
+        uint16_t segment;   // segment number
+        uint16_t next;      // next entry in the list or SMARTRTL_INDEX_NONE
+    } index_entry_t;
+    struct {
+        uint16_t* buckets;      // first entry in each hash bucket's list
+        uint16_t buckets_mask;  // number of buckets less one (number of buckets is a power of two)
+        index_entry_t* entries;
+        uint16_t entries_max;   // maximum number of elements in the entries array
+        uint16_t entries_count; // number of elements in the entries array
+        uint16_t long_segments; // first entry in the list of segments covering too many cells to be added to the grid
+        uint16_t* checked;      // the segment each segment was last checked against, so segments in several cells are only checked once
+        uint16_t segments_count;// number of segments added to the index, the index holds segments 1 to segments_count
+        float cell_size;        // grid cell size in meters, fixed when the index is reset
+    } _index;
+
     // returns true if the two loops overlap (used within add_loop to determine which loops to keep or throw away)
     bool loops_overlap(const prune_loop_t& loop1, const prune_loop_t& loop2) const;
 };
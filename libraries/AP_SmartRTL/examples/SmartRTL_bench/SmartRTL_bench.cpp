@@ -0,0 +1,120 @@
+/*
+  measure the time taken by SmartRTL's thorough cleanup (simplification
+  and loop pruning) against the length of the path.
+
+  Each path is a wandering flight within a 150m radius of home so that it
+  crosses itself many times, generated from a fixed seed so runs can be
+  compared.
+ */
+#include <AP_AHRS/AP_AHRS.h>
+#include <AP_Baro/AP_Baro.h>
+#include <AP_BoardConfig/AP_BoardConfig.h>
+#include <AP_Compass/AP_Compass.h>
+#include <AP_GPS/AP_GPS.h>
+#include <AP_HAL/AP_HAL.h>
+#include <AP_InertialSensor/AP_InertialSensor.h>
+#include <AP_Math/AP_Math.h>
+#include <AP_NavEKF2/AP_NavEKF2.h>
+#include <AP_NavEKF3/AP_NavEKF3.h>
+#include <AP_RangeFinder/AP_RangeFinder.h>
+#include <AP_SerialManager/AP_SerialManager.h>
+#include <AP_SmartRTL/AP_SmartRTL.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+const struct AP_Param::GroupInfo GCS_MAVLINK::var_info[] = {
+    AP_GROUPEND
+};
+GCS_Dummy _gcs;
+
+// INS and Baro declaration
+static AP_InertialSensor ins = AP_InertialSensor::create();
+static Compass compass = Compass::create();
+static AP_GPS gps = AP_GPS::create();
+static AP_Baro barometer = AP_Baro::create();
+static AP_SerialManager serial_manager = AP_SerialManager::create();
+
+class DummyVehicle {
+public:
+    RangeFinder rangefinder = RangeFinder::create(serial_manager, ROTATION_PITCH_270);
+    NavEKF2 EKF2 = NavEKF2::create(&ahrs, barometer, rangefinder);
+    NavEKF3 EKF3 = NavEKF3::create(&ahrs, barometer, rangefinder);
+    AP_AHRS_NavEKF ahrs = AP_AHRS_NavEKF::create(ins, barometer, gps, EKF2, EKF3,
+                                                 AP_AHRS_NavEKF::FLAG_ALWAYS_USE_EKF);
+};
+
+static DummyVehicle vehicle;
+
+AP_AHRS_NavEKF &ahrs(vehicle.ahrs);
+AP_SmartRTL smart_rtl{ahrs, true};
+AP_BoardConfig board_config = AP_BoardConfig::create();
+
+// path lengths to test
+static const uint16_t path_lengths[] = { 100, 250, 500, 1000, 2000, 4000 };
+
+void setup();
+void loop();
+void create_path(uint16_t num_points);
+
+void setup()
+{
+    hal.console->printf("SmartRTL benchmark\n");
+    board_config.init();
+    smart_rtl.set_points_max(SMARTRTL_POINTS_MAX);
+    smart_rtl.init();
+}
+
+void loop()
+{
+    if (!hal.console->is_initialized()) {
+        return;
+    }
+
+    hal.console->printf("--------------------\n");
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(path_lengths); i++) {
+        create_path(path_lengths[i]);
+        const uint16_t points_before = smart_rtl.get_num_points();
+
+        // delay 5 milliseconds because request_thorough_cleanup uses millisecond timestamps
+        hal.scheduler->delay(5);
+        const uint32_t reference_time = AP_HAL::micros();
+        while (!smart_rtl.request_thorough_cleanup(AP_SmartRTL::THOROUGH_CLEAN_ALL)) {
+            smart_rtl.run_background_cleanup();
+        }
+        const uint32_t run_time = AP_HAL::micros() - reference_time;
+
+        hal.console->printf("points:%u cleaned:%u time:%u us\n",
+                            (unsigned)points_before,
+                            (unsigned)smart_rtl.get_num_points(),
+                            (unsigned)run_time);
+    }
+
+    // delay before next display
+    hal.scheduler->delay(5e3); // 5 seconds
+}
+
+// reset path and fly a wandering path of num_points points (plus home) within 150m of home
+void create_path(uint16_t num_points)
+{
+    smart_rtl.reset_path(true, Vector3f{0.0f, 0.0f, 0.0f});
+
+    uint32_t seed = 1;
+    float heading = 0.0f;
+    Vector3f pos;
+    for (uint16_t i = 0; i < num_points; i++) {
+        // simple linear congruential generator so the path is the same each time
+        seed = seed * 1103515245U + 12345U;
+        heading += (((seed >> 8) & 0xFFFF) / 65536.0f - 0.5f) * 1.2f;
+        if (pos.length() > 150.0f) {
+            heading += M_PI;
+        }
+        pos.x += 3.0f * cosf(heading);
+        pos.y += 3.0f * sinf(heading);
+        pos.z = -10.0f + 3.0f * sinf(i * 0.01f);
+        smart_rtl.update(true, pos);
+    }
+}
+
+AP_HAL_MAIN();
@@ -280,7 +280,7 @@ void SoaringController::update_thermalling()
 #endif
 
         // write log - save the data.
-        DataFlash_Class::instance()->Log_Write("SOAR", "TimeUS,nettorate,dx,dy,x0,x1,x2,x3,lat,lng,alt,dx_w,dy_w", "QfffffffLLfff", 
+        DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f','f','L','L','f','f','f'>("SOAR", "TimeUS,nettorate,dx,dy,x0,x1,x2,x3,lat,lng,alt,dx_w,dy_w", 
                                                AP_HAL::micros64(),
                                                (double)_vario.reading,
                                                (double)dx,
@@ -1061,7 +1061,7 @@ void AP_TECS::update_pitch_throttle(int32_t hgt_dem_cm,
     _update_pitch();
 
     // log to DataFlash
-    DataFlash_Class::instance()->Log_Write("TECS", "TimeUS,h,dh,hdem,dhdem,spdem,sp,dsp,ith,iph,th,ph,dspdem,w,f", "QfffffffffffffB",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f','f','f','f','f','f','f','f','B'>("TECS", "TimeUS,h,dh,hdem,dhdem,spdem,sp,dsp,ith,iph,th,ph,dspdem,w,f",
                                            now,
                                            (double)_height,
                                            (double)_climb_rate,
@@ -1077,7 +1077,7 @@ void AP_TECS::update_pitch_throttle(int32_t hgt_dem_cm,
                                            (double)_TAS_rate_dem,
                                            (double)logging.SKE_weighting,
                                            _flags_byte);
-    DataFlash_Class::instance()->Log_Write("TEC2", "TimeUS,KErr,PErr,EDelta,LF", "Qffff",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f'>("TEC2", "TimeUS,KErr,PErr,EDelta,LF",
                                            now,
                                            (double)logging.SKE_error,
                                            (double)logging.SPE_error,
@@ -44,12 +44,21 @@ const AP_Param::GroupInfo AP_Terrain::var_info[] = {
 
     // @Param: SPACING
     // @DisplayName: Terrain grid spacing
-    // @Description: Distance between terrain grid points in meters. This controls the horizontal resolution of the terrain data that is stored on te SD card and requested from the ground station. If your GCS is using the worldwide SRTM database then a resolution of 100 meters is appropriate. Some parts of the world may have higher resolution data available, such as 30 meter data available in the SRTM database in the USA. The grid spacing also controls how much data is kept in memory during flight. A larger grid spacing will allow for a larger amount of data in memory. A grid spacing of 100 meters results in the vehicle keeping 12 grid squares in memory with each grid square having a size of 2.7 kilometers by 3.2 kilometers. Any additional grid squares are stored on the SD once they are fetched from the GCS and will be demand loaded as needed.
+    // @Description: Distance between terrain grid points in meters. This controls the horizontal resolution of the terrain data that is stored on te SD card and requested from the ground station. If your GCS is using the worldwide SRTM database then a resolution of 100 meters is appropriate. Some parts of the world may have higher resolution data available, such as 30 meter data available in the SRTM database in the USA. The grid spacing also controls how much data is kept in memory during flight. A larger grid spacing will allow for a larger amount of data in memory. A grid spacing of 100 meters results in each grid square in memory (see TERRAIN_CACHE_SZ) having a size of 2.7 kilometers by 3.2 kilometers. Any additional grid squares are stored on the SD once they are fetched from the GCS and will be demand loaded as needed.
     // @Units: m
     // @Increment: 1
     // @User: Advanced
     AP_GROUPINFO("SPACING",   1, AP_Terrain, grid_spacing, 100),
 
+    // @Param: CACHE_SZ
+    // @DisplayName: Terrain cache size
+    // @Description: Number of terrain grid blocks kept in memory. Each block takes about 1.8 kilobytes. A larger cache lets the vehicle fly further on terrain loaded from the SD card or prefetched along the mission before more needs to be read. If there is not enough memory for the requested size a smaller cache is used. Takes effect on reboot.
+    // @Range: 4 128
+    // @Increment: 1
+    // @RebootRequired: True
+    // @User: Advanced
+    AP_GROUPINFO("CACHE_SZ",  2, AP_Terrain, config_cache_size, TERRAIN_GRID_BLOCK_CACHE_SIZE),
+
     AP_GROUPEND
 };
 
@@ -58,7 +67,6 @@ AP_Terrain::AP_Terrain(AP_AHRS &_ahrs, const AP_Mission &_mission, const AP_Rall
     ahrs(_ahrs),
     mission(_mission),
     rally(_rally),
-    disk_io_state(DiskIoIdle),
     fd(-1),
     timer_setup(false),
     file_lat_degrees(0),
@@ -71,7 +79,6 @@ AP_Terrain::AP_Terrain(AP_AHRS &_ahrs, const AP_Mission &_mission, const AP_Rall
 {
     AP_Param::setup_object_defaults(this, var_info);
     memset(&home_loc, 0, sizeof(home_loc));
-    memset(&disk_block, 0, sizeof(disk_block));
     memset(last_request_time_ms, 0, sizeof(last_request_time_ms));
 }
 
@@ -101,13 +108,78 @@ bool AP_Terrain::height_amsl(const Location &loc, float &height, bool corrected)
         return true;
     }
 
-    struct grid_info info;
+    if (!height_memo_lookup(loc, height)) {
+        struct grid_info info;
+
+        calculate_grid_info(loc, info);
+
+        // find the grid
+        const struct grid_cache &gcache = find_grid_cache(info);
 
-    calculate_grid_info(loc, info);
+        if (!grid_height(gcache.grid, info, height)) {
+            return false;
+        }
+        height_memo_store(loc, height, gcache);
+    }
+
+    if (loc.lat == ahrs.get_home().lat &&
+        loc.lng == ahrs.get_home().lng) {
+        // remember home altitude as a special case
+        home_height = height;
+        home_loc = loc;
+    }
 
-    // find the grid
-    const struct grid_block &grid = find_grid_cache(info).grid;
+    // apply correction which assumes home altitude is at terrain altitude
+    if (corrected) {
+        height += (ahrs.get_home().alt * 0.01f) - home_height;
+    }
 
+    return true;
+}
+
+/*
+  find the terrain height in meters above sea level for a set of
+  locations. Returns the number of points with data
+ */
+uint16_t AP_Terrain::height_amsl_many(const Location *locs, float *heights, bool *valid,
+                                      uint16_t count, bool corrected)
+{
+    if (!enable || !allocate()) {
+        memset(valid, 0, count * sizeof(valid[0]));
+        return 0;
+    }
+
+    const float correction = (ahrs.get_home().alt * 0.01f) - home_height;
+    struct grid_info info, prev;
+    const struct grid_block *grid = nullptr;
+    uint16_t num_valid = 0;
+
+    for (uint16_t i=0; i<count; i++) {
+        calculate_grid_info(locs[i], info, grid != nullptr ? &prev : nullptr);
+        if (grid == nullptr ||
+            info.grid_lat != prev.grid_lat ||
+            info.grid_lon != prev.grid_lon) {
+            grid = &find_grid_cache(info).grid;
+        }
+        prev = info;
+
+        valid[i] = grid_height(*grid, info, heights[i]);
+        if (valid[i]) {
+            // apply correction which assumes home altitude is at terrain altitude
+            if (corrected) {
+                heights[i] += correction;
+            }
+            num_valid++;
+        }
+    }
+    return num_valid;
+}
+
+/*
+  interpolate the height at a grid_info within a grid
+ */
+bool AP_Terrain::grid_height(const struct grid_block &grid, const struct grid_info &info, float &height)
+{
     /*
       note that we rely on the one square overlap to ensure these
       calculations don't go past the end of the arrays
@@ -140,20 +212,48 @@ bool AP_Terrain::height_amsl(const Location &loc, float &height, bool corrected)
     float avg  = (1.0f-info.frac_y) * avg1 + info.frac_y * avg2;
 
     height = avg;
+    return true;
+}
 
-    if (loc.lat == ahrs.get_home().lat &&
-        loc.lng == ahrs.get_home().lng) {
-        // remember home altitude as a special case
-        home_height = height;
-        home_loc = loc;
+/*
+  look for a recent height_amsl() result for a location
+ */
+bool AP_Terrain::height_memo_lookup(const Location &loc, float &height)
+{
+    if (height_memo_spacing != grid_spacing) {
+        height_memo_clear();
+        height_memo_spacing = grid_spacing;
     }
-
-    // apply correction which assumes home altitude is at terrain altitude
-    if (corrected) {
-        height += (ahrs.get_home().alt * 0.01f) - home_height;
+    for (uint8_t i=0; i<height_memo_count; i++) {
+        if (height_memo[i].lat == loc.lat &&
+            height_memo[i].lng == loc.lng) {
+            height = height_memo[i].height;
+            // keep the grid in use as find_grid_cache() would, so it
+            // isn't replaced by the prefetcher
+            struct grid_cache &gcache = cache[height_memo[i].cache_idx];
+            gcache.last_access_ms = AP_HAL::millis();
+            gcache.prefetched = false;
+            // a memo hit is a cache hit which skipped the lookup
+            cache_hits++;
+            return true;
+        }
     }
+    return false;
+}
 
-    return true;
+/*
+  remember a height_amsl() result, replacing the oldest
+ */
+void AP_Terrain::height_memo_store(const Location &loc, float height, const struct grid_cache &gcache)
+{
+    height_memo[height_memo_next].lat = loc.lat;
+    height_memo[height_memo_next].lng = loc.lng;
+    height_memo[height_memo_next].height = height;
+    height_memo[height_memo_next].cache_idx = &gcache - cache;
+    height_memo_next = (height_memo_next + 1) % TERRAIN_HEIGHT_MEMO_SIZE;
+    if (height_memo_count < TERRAIN_HEIGHT_MEMO_SIZE) {
+        height_memo_count++;
+    }
 }
 
 
@@ -276,16 +376,26 @@ float AP_Terrain::lookahead(float bearing, float distance, float climb_ratio)
     float climb = 0;
     float lookahead_estimate = 0;
 
-    // check for terrain at grid spacing intervals
+    // check for terrain at grid spacing intervals, looking up a batch
+    // of points at a time
+    Location samples[16];
+    float heights[ARRAY_SIZE(samples)];
+    bool valid[ARRAY_SIZE(samples)];
     while (distance > 0) {
-        location_update(loc, bearing, grid_spacing);
-        climb += climb_ratio * grid_spacing;
-        distance -= grid_spacing;
-        float height;
-        if (height_amsl(loc, height, false)) {
-            float rise = (height - base_height) - climb;
-            if (rise > lookahead_estimate) {
-                lookahead_estimate = rise;
+        uint8_t count = 0;
+        while (distance > 0 && count < ARRAY_SIZE(samples)) {
+            location_update(loc, bearing, grid_spacing);
+            distance -= grid_spacing;
+            samples[count++] = loc;
+        }
+        height_amsl_many(samples, heights, valid, count, false);
+        for (uint8_t i=0; i<count; i++) {
+            climb += climb_ratio * grid_spacing;
+            if (valid[i]) {
+                float rise = (heights[i] - base_height) - climb;
+                if (rise > lookahead_estimate) {
+                    lookahead_estimate = rise;
+                }
             }
         }
     }
@@ -317,6 +427,9 @@ void AP_Terrain::update(void)
         have_current_loc_height = true;
     }
 
+    // load grids ahead of the vehicle
+    prefetch();
+
     // check for pending mission data
     update_mission_data();
 
@@ -376,6 +489,15 @@ void AP_Terrain::log_terrain_data(DataFlash_Class &dataflash)
         loaded         : loaded
     };
     dataflash.WriteBlock(&pkt, sizeof(pkt));
+
+    struct log_TERRAIN_CACHE pkt2 = {
+        LOG_PACKET_HEADER_INIT(LOG_TERRAIN_CACHE_MSG),
+        time_us        : pkt.time_us,
+        size           : cache_size,
+        hits           : cache_hits,
+        misses         : cache_misses
+    };
+    dataflash.WriteBlock(&pkt2, sizeof(pkt2));
 }
 
 /*
@@ -390,13 +512,54 @@ bool AP_Terrain::allocate(void)
     if (cache != nullptr) {
         return true;
     }
-    cache = (struct grid_cache *)calloc(TERRAIN_GRID_BLOCK_CACHE_SIZE, sizeof(cache[0]));
-    if (cache == nullptr) {
+
+    io_queue = (struct disk_io *)calloc(TERRAIN_DISK_IO_QUEUE_SIZE, sizeof(io_queue[0]));
+
+    // fall back to a smaller cache if we can't get the size asked for
+    uint16_t size = constrain_int16(config_cache_size, 4, TERRAIN_GRID_BLOCK_CACHE_MAX);
+    while (io_queue != nullptr && size >= 4) {
+        cache = (struct grid_cache *)calloc(size, sizeof(cache[0]));
+        if (cache != nullptr) {
+            break;
+        }
+        size /= 2;
+    }
+
+    // one to two hash buckets per cache entry
+    uint16_t hash_size = 1;
+    while (hash_size < size) {
+        hash_size <<= 1;
+    }
+    if (cache != nullptr) {
+        cache_hash = (uint8_t *)malloc(hash_size);
+    }
+
+    if (io_queue == nullptr || cache == nullptr || cache_hash == nullptr) {
+        free(io_queue);
+        free(cache);
+        free(cache_hash);
+        io_queue = nullptr;
+        cache = nullptr;
+        cache_hash = nullptr;
         enable.set(0);
         gcs().send_text(MAV_SEVERITY_CRITICAL, "Terrain: Allocation failed");
         return false;
     }
-    cache_size = TERRAIN_GRID_BLOCK_CACHE_SIZE;
+    if (size != config_cache_size) {
+        gcs().send_text(MAV_SEVERITY_WARNING, "Terrain: cache size %u", (unsigned)size);
+    }
+
+    cache_size = size;
+    cache_hash_mask = hash_size - 1;
+    memset(cache_hash, cache_none, hash_size);
+    for (uint8_t i=0; i<cache_size; i++) {
+        cache[i].hash_next = cache_none;
+    }
+    io_queue_size = TERRAIN_DISK_IO_QUEUE_SIZE;
+
+#if AP_TERRAIN_STORE_ENABLED
+    store_open();
+#endif
     return true;
 }
 
@@ -31,6 +31,8 @@
 #include <AP_Mission/AP_Mission.h>
 #include <AP_Rally/AP_Rally.h>
 
+#include "TerrainStore.h"
+
 #define TERRAIN_DEBUG 0
 
 
@@ -52,9 +54,34 @@
 #define TERRAIN_GRID_BLOCK_SIZE_X (TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_X)
 #define TERRAIN_GRID_BLOCK_SIZE_Y (TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_Y)
 
-// number of grid_blocks in the LRU memory cache
+// default number of grid_blocks in the LRU memory cache, set by
+// TERRAIN_CACHE_SZ
 #define TERRAIN_GRID_BLOCK_CACHE_SIZE 12
 
+// largest allowed cache. Cache indexes are uint8_t with 0xFF as none
+#define TERRAIN_GRID_BLOCK_CACHE_MAX 128
+
+// number of grid_blocks that can be queued for disk IO at once
+#ifndef TERRAIN_DISK_IO_QUEUE_SIZE
+#define TERRAIN_DISK_IO_QUEUE_SIZE 4
+#endif
+
+// how far ahead along the velocity vector and the mission to
+// prefetch grid_blocks, in seconds of flight
+#define TERRAIN_PREFETCH_TIME_S 60
+
+// least time since a cache entry was used before the prefetcher may
+// replace it
+#define TERRAIN_PREFETCH_MIN_AGE_MS 10000
+
+// most grid_blocks the prefetcher looks at, and most mission commands
+// it reads from storage, in each prefetch call
+#define TERRAIN_PREFETCH_MAX_BLOCKS 8
+#define TERRAIN_PREFETCH_MAX_COMMANDS 5
+
+// number of recent height_amsl() results to remember
+#define TERRAIN_HEIGHT_MEMO_SIZE 4
+
 // format of grid on disk
 #define TERRAIN_GRID_FORMAT_VERSION 1
 
@@ -122,6 +149,19 @@ public:
      */
     bool height_amsl(const Location &loc, float &height, bool corrected);
 
+    /*
+      find the terrain height in meters above sea level for a set of
+      locations, such as samples along a path. The grid lookup is
+      shared between consecutive points in the same grid block, so
+      for nearby points this is cheaper than a height_amsl() call per
+      point.
+
+      valid[i] is set for each point with data available. Returns the
+      number of points with data
+     */
+    uint16_t height_amsl_many(const Location *locs, float *heights, bool *valid,
+                              uint16_t count, bool corrected);
+
     /* 
        find difference between home terrain height and the terrain
        height at the current location in meters. A positive result
@@ -249,6 +289,12 @@ private:
 
         // the last time access was requested to this block, used for LRU
         uint32_t last_access_ms;
+
+        // next entry in the same hash bucket
+        uint8_t hash_next;
+
+        // true if loaded by the prefetcher and not yet used
+        bool prefetched;
     };
 
     /*
@@ -280,14 +326,42 @@ private:
         uint32_t file_offset;
     };
 
-    // given a location, fill a grid_info structure
-    void calculate_grid_info(const Location &loc, struct grid_info &info) const;
+    // given a location, fill a grid_info structure. If prev is for
+    // the same grid block its SW corner is reused
+    void calculate_grid_info(const Location &loc, struct grid_info &info,
+                             const struct grid_info *prev = nullptr) const;
+
+    // interpolate the height at a grid_info within a grid
+    bool grid_height(const struct grid_block &grid, const struct grid_info &info, float &height);
+
+    // memo of recent height_amsl() results
+    bool height_memo_lookup(const Location &loc, float &height);
+    void height_memo_store(const Location &loc, float height, const struct grid_cache &gcache);
+    void height_memo_clear(void) { height_memo_count = 0; }
 
     /*
       find a grid structure given a grid_info
     */
     struct grid_cache &find_grid_cache(const struct grid_info &info);
 
+    /*
+      cache hash table functions. The cache is hashed on the lat/lon
+      of the SW corner of each grid_block, which together with the
+      grid spacing identifies the degree square and grid index
+     */
+    uint8_t grid_hash(int32_t lat, int32_t lon) const;
+    struct grid_cache *lookup_grid_cache(int32_t lat, int32_t lon, uint16_t spacing);
+    void link_grid_cache(uint8_t idx);
+    void unlink_grid_cache(uint8_t idx);
+    struct grid_cache *replace_grid_cache(const struct grid_info &info, uint32_t min_age_ms);
+
+    /*
+      prefetch grid_blocks ahead of the vehicle
+     */
+    void prefetch(void);
+    bool prefetch_location(const Location &loc);
+    uint8_t prefetch_line(const Location &from, const Location &to, uint8_t max_blocks);
+
     /*
       calculate bit number in grid_block bitmap. This corresponds to a
       bit representing a 4x4 mavlink transmitted block
@@ -319,15 +393,27 @@ private:
     /*
       disk IO functions
      */
-    int16_t find_io_idx(enum GridCacheState state);
+    struct disk_io;
+    int16_t find_io_idx(const struct grid_block &block, enum GridCacheState state);
     uint16_t get_block_crc(struct grid_block &block);
-    void check_disk_read(void);
-    void check_disk_write(void);
+    bool disk_io_pending(const struct grid_block &block) const;
+    bool check_disk_read(struct disk_io &io);
+    bool check_disk_write(struct disk_io &io);
     void io_timer(void);
-    void open_file(void);
-    void seek_offset(void);
-    void write_block(void);
-    void read_block(void);
+    void open_file(struct grid_block &block);
+    void seek_offset(struct grid_block &block);
+    void write_block(struct disk_io &io);
+    void read_block(struct disk_io &io);
+
+#if AP_TERRAIN_STORE_ENABLED
+    /*
+      tile store functions. The store is opened in the main thread
+      when the cache is allocated, then only used by the IO thread
+     */
+    void store_open(void);
+    bool store_read(struct grid_block &block);
+    bool store_write(const struct grid_block &block);
+#endif
 
     /*
       check for missing mission terrain data
@@ -343,6 +429,7 @@ private:
     // parameters
     AP_Int8  enable;
     AP_Int16 grid_spacing; // meters between grid points
+    AP_Int16 config_cache_size; // grid_blocks to keep in memory
 
     // reference to AHRS, so we can ask for our position,
     // heading and speed
@@ -360,7 +447,19 @@ private:
     uint8_t cache_size = 0;
     struct grid_cache *cache = nullptr;
 
-    // a grid_cache block waiting for disk IO
+    // hash buckets for the cache, holding the first cache index in
+    // each bucket
+    static const uint8_t cache_none = 0xFF;
+    uint8_t *cache_hash = nullptr;
+    uint8_t cache_hash_mask;
+
+    // cache statistics, for logging. Hits include height_amsl()
+    // results found in the memo
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+
+    // grid_cache blocks waiting for disk IO. Each slot is owned by
+    // the IO timer while in DiskIoWaitWrite or DiskIoWaitRead
     enum DiskIoState {
         DiskIoIdle      = 0,
         DiskIoWaitWrite = 1,
@@ -368,8 +467,16 @@ private:
         DiskIoDoneRead  = 3,
         DiskIoDoneWrite = 4
     };
-    volatile enum DiskIoState disk_io_state;
-    union grid_io_block disk_block;
+    struct disk_io {
+        union grid_io_block disk_block;
+        volatile enum DiskIoState state;
+        // SW corner of the block, for the main thread to check what
+        // is queued while the IO timer owns disk_block
+        int32_t lat;
+        int32_t lon;
+    };
+    struct disk_io *io_queue = nullptr;
+    uint8_t io_queue_size;
 
     // last time we asked for more grids
     uint32_t last_request_time_ms[MAVLINK_COMM_NUM_BUFFERS];
@@ -396,6 +503,20 @@ private:
     float home_height;
     Location home_loc;
 
+    // the last few height_amsl() results, uncorrected. Many callers
+    // ask for the height at the same location in one loop. Cleared
+    // when a cache entry is replaced, so cache_idx is always the grid
+    // the height came from
+    struct {
+        int32_t lat;
+        int32_t lng;
+        float height;
+        uint8_t cache_idx;
+    } height_memo[TERRAIN_HEIGHT_MEMO_SIZE];
+    uint8_t height_memo_count;
+    uint8_t height_memo_next;
+    uint16_t height_memo_spacing;
+
     // cache the last terrain height (AMSL) of the AHRS current
     // location. This is used for extrapolation when terrain data is
     // temporarily unavailable
@@ -423,8 +544,15 @@ private:
     // grid spacing during rally check
     uint16_t last_rally_spacing;
 
+    // last time the prefetcher ran
+    uint32_t last_prefetch_ms;
+
     char *file_path = nullptr;
 
+#if AP_TERRAIN_STORE_ENABLED
+    TerrainStore store;
+#endif
+
     // status
     enum TerrainStatus system_status = TerrainStatusDisabled;
 };
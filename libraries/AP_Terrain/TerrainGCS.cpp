@@ -259,21 +259,17 @@ void AP_Terrain::handle_terrain_data(mavlink_message_t *msg)
     mavlink_terrain_data_t packet;
     mavlink_msg_terrain_data_decode(msg, &packet);
 
-    uint16_t i;
-    for (i=0; i<cache_size; i++) {
-        if (cache[i].grid.lat == packet.lat && 
-            cache[i].grid.lon == packet.lon && 
-            cache[i].grid.spacing == packet.grid_spacing &&
-            grid_spacing == packet.grid_spacing &&
-            packet.gridbit < 56) {
-            break;
-        }
+    if (enable == 0 || !allocate() ||
+        grid_spacing != packet.grid_spacing ||
+        packet.gridbit >= 56) {
+        return;
     }
-    if (i == cache_size) {
+    struct grid_cache *gcachep = lookup_grid_cache(packet.lat, packet.lon, packet.grid_spacing);
+    if (gcachep == nullptr) {
         // we don't have that grid, ignore data
         return;
     }
-    struct grid_cache &gcache = cache[i];
+    struct grid_cache &gcache = *gcachep;
     struct grid_block &grid = gcache.grid;
     uint8_t idx_x = (packet.gridbit / TERRAIN_GRID_BLOCK_MUL_Y) * TERRAIN_GRID_MAVLINK_SIZE;
     uint8_t idx_y = (packet.gridbit % TERRAIN_GRID_BLOCK_MUL_Y) * TERRAIN_GRID_MAVLINK_SIZE;
@@ -288,6 +284,9 @@ void AP_Terrain::handle_terrain_data(mavlink_message_t *msg)
     
     // mark dirty for disk IO
     gcache.state = GRID_CACHE_DIRTY;
+
+    // heights may have changed
+    height_memo_clear();
     
 #if TERRAIN_DEBUG
     hal.console->printf("Filled bit %u idx_x=%u idx_y=%u\n", 
@@ -36,31 +36,66 @@
 extern const AP_HAL::HAL& hal;
 
 /*
-  check for blocks that need to be read from disk
+  see if a block is already queued for disk IO
  */
-void AP_Terrain::check_disk_read(void)
+bool AP_Terrain::disk_io_pending(const struct grid_block &block) const
 {
+    for (uint8_t i=0; i<io_queue_size; i++) {
+        if (io_queue[i].state != DiskIoIdle &&
+            io_queue[i].lat == block.lat &&
+            io_queue[i].lon == block.lon) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+  check for blocks that need to be read from disk. Blocks needed now
+  are read before prefetched blocks
+ */
+bool AP_Terrain::check_disk_read(struct disk_io &io)
+{
+    int16_t best = -1;
     for (uint16_t i=0; i<cache_size; i++) {
-        if (cache[i].state == GRID_CACHE_DISKWAIT) {
-            disk_block.block = cache[i].grid;
-            disk_io_state = DiskIoWaitRead;
-            return;
+        if (cache[i].state != GRID_CACHE_DISKWAIT ||
+            disk_io_pending(cache[i].grid)) {
+            continue;
         }
-    }    
+        if (best == -1 ||
+            (cache[best].prefetched && !cache[i].prefetched)) {
+            best = i;
+        }
+        if (!cache[best].prefetched) {
+            break;
+        }
+    }
+    if (best == -1) {
+        return false;
+    }
+    io.disk_block.block = cache[best].grid;
+    io.lat = cache[best].grid.lat;
+    io.lon = cache[best].grid.lon;
+    io.state = DiskIoWaitRead;
+    return true;
 }
 
 /*
   check for blocks that need to be written to disk
  */
-void AP_Terrain::check_disk_write(void)
+bool AP_Terrain::check_disk_write(struct disk_io &io)
 {
     for (uint16_t i=0; i<cache_size; i++) {
-        if (cache[i].state == GRID_CACHE_DIRTY) {
-            disk_block.block = cache[i].grid;
-            disk_io_state = DiskIoWaitWrite;
-            return;
+        if (cache[i].state == GRID_CACHE_DIRTY &&
+            !disk_io_pending(cache[i].grid)) {
+            io.disk_block.block = cache[i].grid;
+            io.lat = cache[i].grid.lat;
+            io.lon = cache[i].grid.lon;
+            io.state = DiskIoWaitWrite;
+            return true;
         }
-    }    
+    }
+    return false;
 }
 
 /*
@@ -77,72 +112,92 @@ void AP_Terrain::schedule_disk_io(void)
         hal.scheduler->register_io_process(FUNCTOR_BIND_MEMBER(&AP_Terrain::io_timer, void));
     }
 
-    switch (disk_io_state) {
-    case DiskIoIdle:
-        // look for a block that needs reading or writing
-        check_disk_read();
-        if (disk_io_state == DiskIoIdle) {
-            // still idle, check for writes
-            check_disk_write();            
-        }
-        break;
-        
-    case DiskIoDoneRead: {
-        // a read has completed
-        int16_t cache_idx = find_io_idx(GRID_CACHE_DISKWAIT);
-        if (cache_idx != -1) {
-            if (disk_block.block.bitmap != 0) {
-                // when bitmap is zero we read an empty block
-                cache[cache_idx].grid = disk_block.block;
+    // first collect completed IO
+    for (uint8_t i=0; i<io_queue_size; i++) {
+        struct disk_io &io = io_queue[i];
+        const struct grid_block &block = io.disk_block.block;
+        switch (io.state) {
+        case DiskIoDoneRead: {
+            // a read has completed
+            int16_t cache_idx = find_io_idx(block, GRID_CACHE_DISKWAIT);
+            if (cache_idx != -1) {
+                if (block.bitmap != 0) {
+                    // when bitmap is zero we read an empty block
+                    cache[cache_idx].grid = block;
+                    height_memo_clear();
+                }
+                cache[cache_idx].state = GRID_CACHE_VALID;
+                if (!cache[cache_idx].prefetched) {
+                    cache[cache_idx].last_access_ms = AP_HAL::millis();
+                }
             }
-            cache[cache_idx].state = GRID_CACHE_VALID;
-            cache[cache_idx].last_access_ms = AP_HAL::millis();
+            io.state = DiskIoIdle;
+            break;
         }
-        disk_io_state = DiskIoIdle;
-        break;
-    }
 
-    case DiskIoDoneWrite: {
-        // a write has completed
-        int16_t cache_idx = find_io_idx(GRID_CACHE_DIRTY);
-        if (cache_idx != -1) {
-            if (cache[cache_idx].grid.bitmap == disk_block.block.bitmap) {
-                // only mark valid if more grids haven't been added
-                cache[cache_idx].state = GRID_CACHE_VALID;
+        case DiskIoDoneWrite: {
+            // a write has completed
+            int16_t cache_idx = find_io_idx(block, GRID_CACHE_DIRTY);
+            if (cache_idx != -1) {
+                if (cache[cache_idx].grid.bitmap == block.bitmap) {
+                    // only mark valid if more grids haven't been added
+                    cache[cache_idx].state = GRID_CACHE_VALID;
+                }
             }
+            io.state = DiskIoIdle;
+            break;
+        }
+
+        case DiskIoIdle:
+        case DiskIoWaitWrite:
+        case DiskIoWaitRead:
+            break;
         }
-        disk_io_state = DiskIoIdle;
-        break;
     }
-        
-    case DiskIoWaitWrite:
-    case DiskIoWaitRead:
-        // waiting for io_timer()
-        break;
+
+    // then fill idle slots, looking for a block that needs reading
+    // or writing. Reads go first as they are what the vehicle is
+    // waiting for
+    bool more_reads = true;
+    bool more_writes = true;
+    for (uint8_t i=0; i<io_queue_size && (more_reads || more_writes); i++) {
+        struct disk_io &io = io_queue[i];
+        if (io.state != DiskIoIdle) {
+            // waiting for io_timer()
+            continue;
+        }
+        if (more_reads) {
+            more_reads = check_disk_read(io);
+        }
+        if (io.state == DiskIoIdle && more_writes) {
+            // still idle, check for writes
+            more_writes = check_disk_write(io);
+        }
     }
 }
 
 
 /********************************************************
 All the functions below this point run in the IO timer context, which
-is a separate thread. The code uses the state machine controlled by
-disk_io_state to manage who has access to the structures and to
-prevent race conditions.
+is a separate thread. The code uses the state machine of each disk_io
+slot to manage who has access to the structures and to prevent race
+conditions.
 
-The IO timer context owns the data when disk_io_state is
-DiskIoWaitWrite or DiskIoWaitRead. The main thread owns the data when
-disk_io_state is DiskIoIdle, DiskIoDoneWrite or DiskIoDoneRead
+The IO timer context owns a disk_io slot when its state is
+DiskIoWaitWrite or DiskIoWaitRead. The main thread owns the slot when
+its state is DiskIoIdle, DiskIoDoneWrite or DiskIoDoneRead. The cache
+itself is only ever touched by the main thread
 
-All file operations are done by the IO thread.
+All file operations are done by the IO thread, as is all access to the
+tile store after it is opened.
 *********************************************************/
 
 
 /*
-  open the current degree file
+  open the degree file for a block
  */
-void AP_Terrain::open_file(void)
+void AP_Terrain::open_file(struct grid_block &block)
 {
-    struct grid_block &block = disk_block.block;
     if (fd != -1 && 
         block.lat_degrees == file_lat_degrees &&
         block.lon_degrees == file_lon_degrees) {
@@ -211,11 +266,10 @@ void AP_Terrain::open_file(void)
 }
 
 /*
-  seek to the right offset for disk_block
+  seek to the right offset for a block
  */
-void AP_Terrain::seek_offset(void)
+void AP_Terrain::seek_offset(struct grid_block &block)
 {
-    struct grid_block &block = disk_block.block;
     // work out how many longitude blocks there are at this latitude
     Location loc1, loc2;
     loc1.lat = block.lat_degrees*10*1000*1000L;
@@ -242,11 +296,12 @@ void AP_Terrain::seek_offset(void)
 }
 
 /*
-  write out disk_block
+  write out a queued block
  */
-void AP_Terrain::write_block(void)
+void AP_Terrain::write_block(struct disk_io &io)
 {
-    seek_offset();
+    union grid_io_block &disk_block = io.disk_block;
+    seek_offset(disk_block.block);
     if (io_failure) {
         return;
     }
@@ -271,15 +326,16 @@ void AP_Terrain::write_block(void)
                (unsigned long long)disk_block.block.bitmap);
 #endif
     }
-    disk_io_state = DiskIoDoneWrite;
+    io.state = DiskIoDoneWrite;
 }
 
 /*
-  read in disk_block
+  read in a queued block
  */
-void AP_Terrain::read_block(void)
+void AP_Terrain::read_block(struct disk_io &io)
 {
-    seek_offset();
+    union grid_io_block &disk_block = io.disk_block;
+    seek_offset(disk_block.block);
     if (io_failure) {
         return;
     }
@@ -315,8 +371,73 @@ void AP_Terrain::read_block(void)
                (unsigned long long)disk_block.block.bitmap);
 #endif
     }
-    disk_io_state = DiskIoDoneRead;
+    io.state = DiskIoDoneRead;
+}
+
+#if AP_TERRAIN_STORE_ENABLED
+/*
+  open the tile store, creating it if needed. On any failure the
+  store is left closed and the per-degree files are used. Called from
+  allocate(), before the IO timer is registered
+ */
+void AP_Terrain::store_open(void)
+{
+    const char* terrain_dir = hal.util->get_custom_terrain_directory();
+    if (terrain_dir == nullptr) {
+        terrain_dir = HAL_BOARD_TERRAIN_DIRECTORY;
+    }
+    if (!store.open(terrain_dir, sizeof(union grid_io_block), TERRAIN_STORE_MAX_BLOCKS)) {
+        gcs().send_text(MAV_SEVERITY_WARNING, "Terrain: store unavailable");
+        return;
+    }
+    hal.console->printf("Terrain: store has %u blocks\n", (unsigned)store.num_blocks());
+}
+
+/*
+  fill in a grid block from the tile store. Returns false if the
+  store doesn't have it
+ */
+bool AP_Terrain::store_read(struct grid_block &block)
+{
+    const TerrainStore::Key key { block.lat_degrees, block.lon_degrees,
+                                  block.grid_idx_x, block.grid_idx_y, block.spacing };
+    union grid_io_block stored;
+    if (!store.read(key, &stored)) {
+        return false;
+    }
+    if (stored.block.bitmap == 0 ||
+        stored.block.version != TERRAIN_GRID_FORMAT_VERSION ||
+        stored.block.crc != get_block_crc(stored.block) ||
+        stored.block.spacing != block.spacing ||
+        stored.block.lat_degrees != block.lat_degrees ||
+        stored.block.lon_degrees != block.lon_degrees ||
+        stored.block.grid_idx_x != block.grid_idx_x ||
+        stored.block.grid_idx_y != block.grid_idx_y) {
+        return false;
+    }
+    // the SW corner may differ in the last digit from an offline
+    // calculation, so keep ours
+    stored.block.lat = block.lat;
+    stored.block.lon = block.lon;
+    block = stored.block;
+    return true;
+}
+
+/*
+  write a grid block to the tile store. Returns false if the store is
+  full or not open
+ */
+bool AP_Terrain::store_write(const struct grid_block &block)
+{
+    const TerrainStore::Key key { block.lat_degrees, block.lon_degrees,
+                                  block.grid_idx_x, block.grid_idx_y, block.spacing };
+    union grid_io_block stored;
+    memset(&stored, 0, sizeof(stored));
+    stored.block = block;
+    stored.block.crc = get_block_crc(stored.block);
+    return store.write(key, &stored);
 }
+#endif // AP_TERRAIN_STORE_ENABLED
 
 /*
   timer called to do disk IO
@@ -329,30 +450,52 @@ void AP_Terrain::io_timer(void)
         return;
     }
 
-    switch (disk_io_state) {
-    case DiskIoIdle:
-    case DiskIoDoneRead:
-    case DiskIoDoneWrite:
-        // nothing to do
-        break;
-        
-    case DiskIoWaitWrite:
-        // need to write out the block
-        open_file();
-        if (fd == -1) {
-            return;
-        }
-        write_block();
-        break;
-
-    case DiskIoWaitRead:
-        // need to read in the block
-        open_file();
-        if (fd == -1) {
-            return;
+    for (uint8_t i=0; i<io_queue_size; i++) {
+        struct disk_io &io = io_queue[i];
+        switch (io.state) {
+        case DiskIoIdle:
+        case DiskIoDoneRead:
+        case DiskIoDoneWrite:
+            // nothing to do
+            break;
+
+        case DiskIoWaitWrite:
+#if AP_TERRAIN_STORE_ENABLED
+            // new data goes to the tile store when there is room
+            if (store_write(io.disk_block.block)) {
+                io.state = DiskIoDoneWrite;
+                break;
+            }
+#endif
+            // need to write out the block
+            open_file(io.disk_block.block);
+            if (fd == -1) {
+                return;
+            }
+            write_block(io);
+            break;
+
+        case DiskIoWaitRead:
+#if AP_TERRAIN_STORE_ENABLED
+            if (store_read(io.disk_block.block)) {
+                io.state = DiskIoDoneRead;
+                break;
+            }
+#endif
+            // need to read in the block
+            open_file(io.disk_block.block);
+            if (fd == -1) {
+                return;
+            }
+            read_block(io);
+#if AP_TERRAIN_STORE_ENABLED
+            if (io.disk_block.block.bitmap != 0) {
+                // import into the tile store
+                store_write(io.disk_block.block);
+            }
+#endif
+            break;
         }
-        read_block();
-        break;
     }
 }
 
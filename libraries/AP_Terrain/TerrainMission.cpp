@@ -157,4 +157,121 @@ void AP_Terrain::update_rally_data(void)
     }
 }
 
+/*
+  make sure a grid_block is in the cache, loading it if there is an
+  entry that has not been used recently. Returns true if the block is
+  in the cache
+ */
+bool AP_Terrain::prefetch_location(const Location &loc)
+{
+    struct grid_info info;
+    calculate_grid_info(loc, info);
+
+    struct grid_cache *grid = lookup_grid_cache(info.grid_lat, info.grid_lon, grid_spacing);
+    if (grid == nullptr) {
+        grid = replace_grid_cache(info, TERRAIN_PREFETCH_MIN_AGE_MS);
+        if (grid == nullptr) {
+            // everything in the cache is in use
+            return false;
+        }
+        grid->prefetched = true;
+    } else if (grid->prefetched) {
+        // keep it till we get there
+        grid->last_access_ms = AP_HAL::millis();
+    }
+    return true;
+}
+
+/*
+  prefetch the grid_blocks along a line, up to max_blocks of
+  them. Returns the number of blocks used
+ */
+uint8_t AP_Terrain::prefetch_line(const Location &from, const Location &to, uint8_t max_blocks)
+{
+    // step at half the smaller block dimension so no block along the
+    // line is missed
+    const float step = 0.5f * TERRAIN_GRID_BLOCK_SPACING_X * grid_spacing;
+    const float distance = get_distance(from, to);
+    const float bearing = get_bearing_cd(from, to) * 0.01f;
+
+    uint8_t count = 0;
+    int32_t last_lat = 0, last_lon = 0;
+    Location loc = from;
+    for (float d = 0; d <= distance + step && count < max_blocks; d += step) {
+        struct grid_info info;
+        calculate_grid_info(loc, info);
+        if (count == 0 || info.grid_lat != last_lat || info.grid_lon != last_lon) {
+            if (!prefetch_location(loc)) {
+                break;
+            }
+            last_lat = info.grid_lat;
+            last_lon = info.grid_lon;
+            count++;
+        }
+        if (d + step > distance) {
+            loc = to;
+        } else {
+            location_update(loc, bearing, step);
+        }
+    }
+    return count;
+}
+
+/*
+  prefetch grid_blocks ahead of the vehicle, along the velocity vector
+  and along the next legs of the mission, so that data on the SD card
+  is in memory before we get there
+ */
+void AP_Terrain::prefetch(void)
+{
+    if (!enable || !allocate() || grid_spacing <= 0) {
+        return;
+    }
+
+    // update() is called at 10Hz, but 1Hz is plenty for looking ahead
+    uint32_t now = AP_HAL::millis();
+    if (now - last_prefetch_ms < 1000) {
+        return;
+    }
+    last_prefetch_ms = now;
+
+    Location loc;
+    if (!ahrs.get_position(loc)) {
+        return;
+    }
+
+    // keep at least half the cache for the blocks around the vehicle,
+    // and bound the work done in one call
+    uint8_t budget = MIN(cache_size / 2, TERRAIN_PREFETCH_MAX_BLOCKS);
+
+    Vector3f vel;
+    if (ahrs.get_velocity_NED(vel) && norm(vel.x, vel.y) > 1) {
+        Location ahead = loc;
+        location_offset(ahead, vel.x * TERRAIN_PREFETCH_TIME_S, vel.y * TERRAIN_PREFETCH_TIME_S);
+        budget -= prefetch_line(loc, ahead, budget);
+    }
+
+    if (mission.state() != AP_Mission::MISSION_RUNNING) {
+        return;
+    }
+
+    // follow the mission in storage order from the current
+    // waypoint. Jumps are not followed. Only read a few commands, to
+    // prevent too much CPU usage
+    uint16_t index = mission.get_current_nav_index();
+    AP_Mission::Mission_Command cmd = mission.get_current_nav_cmd();
+    Location from = loc;
+    for (uint8_t i=0; i<TERRAIN_PREFETCH_MAX_COMMANDS && budget > 0; i++) {
+        if (AP_Mission::is_nav_cmd(cmd) &&
+            (cmd.content.location.lat != 0 || cmd.content.location.lng != 0)) {
+            budget -= prefetch_line(from, cmd.content.location, budget);
+            from = cmd.content.location;
+        }
+        index++;
+        if (!mission.read_cmd_from_storage(index, cmd)) {
+            break;
+        }
+    }
+}
+
 #endif // AP_TERRAIN_AVAILABLE
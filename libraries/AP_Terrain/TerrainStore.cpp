@@ -0,0 +1,270 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+  memory mapped tile store for terrain data on Linux and SITL
+
+  All grid blocks are kept in one file, TERRAIN.PAK in the terrain
+  directory, found through a hash index at the start of the file.
+  Blocks not in the store are still read from the per-degree files,
+  and copied into the store when found there. The store can be filled
+  offline from SRTM data with tools/terrain_pack.py
+ */
+
+#include "TerrainStore.h"
+
+#if AP_TERRAIN_STORE_ENABLED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+  open the store, creating it if needed. On any failure the store is
+  left closed
+ */
+bool TerrainStore::open(const char *dir, uint16_t block_size, uint32_t max_blocks)
+{
+    if (is_open()) {
+        return true;
+    }
+    char *path = nullptr;
+    if (asprintf(&path, "%s/" TERRAIN_STORE_FILE, dir) <= 0) {
+        return false;
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        free(path);
+        return false;
+    }
+    fd = ::open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+    free(path);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct header h;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        goto failed;
+    }
+    if (st.st_size == 0) {
+        // a new store. The file is sparse, so takes no space till
+        // blocks are written
+        h.magic = TERRAIN_STORE_MAGIC;
+        h.version = TERRAIN_STORE_VERSION;
+        h.block_size = block_size;
+        h.index_slots = 2*max_blocks;
+        h.max_blocks = max_blocks;
+        h.num_blocks = 0;
+    } else if (::pread(fd, &h, sizeof(h), 0) != sizeof(h)) {
+        goto failed;
+    }
+    if (h.magic != TERRAIN_STORE_MAGIC ||
+        h.version != TERRAIN_STORE_VERSION ||
+        h.block_size != block_size ||
+        h.index_slots == 0 ||
+        (h.index_slots & (h.index_slots-1)) != 0 ||
+        h.max_blocks > h.index_slots ||
+        h.num_blocks > h.max_blocks) {
+        goto failed;
+    }
+
+    {
+        const size_t index_size = h.index_slots * sizeof(struct index_entry);
+        index_map_size = TERRAIN_STORE_PAGE_SIZE +
+            ((index_size + TERRAIN_STORE_PAGE_SIZE - 1) & ~(TERRAIN_STORE_PAGE_SIZE - 1));
+        blocks_map_size = h.max_blocks * (size_t)block_size;
+        const size_t file_size = index_map_size + blocks_map_size;
+        if (st.st_size == 0) {
+            if (ftruncate(fd, file_size) != 0 ||
+                ::pwrite(fd, &h, sizeof(h), 0) != sizeof(h) ||
+                fsync(fd) != 0) {
+                goto failed;
+            }
+        } else if ((size_t)st.st_size != file_size) {
+            goto failed;
+        }
+
+        // the header and index are read in now, and locked where we
+        // are allowed, so that a lookup never waits on the disk
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+        void *p = mmap(nullptr, index_map_size, PROT_READ|PROT_WRITE, flags, fd, 0);
+        if (p == MAP_FAILED) {
+            goto failed;
+        }
+        index_map = (uint8_t *)p;
+        mlock(index_map, index_map_size);
+
+        p = mmap(nullptr, blocks_map_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, index_map_size);
+        if (p == MAP_FAILED) {
+            munmap(index_map, index_map_size);
+            index_map = nullptr;
+            goto failed;
+        }
+        blocks_map = (uint8_t *)p;
+        hdr = (struct header *)index_map;
+        index = (struct index_entry *)&index_map[TERRAIN_STORE_PAGE_SIZE];
+    }
+    return true;
+
+failed:
+    ::close(fd);
+    fd = -1;
+    return false;
+}
+
+void TerrainStore::close(void)
+{
+    if (!is_open()) {
+        return;
+    }
+    msync(index_map, index_map_size, MS_SYNC);
+    msync(blocks_map, blocks_map_size, MS_SYNC);
+    munlock(index_map, index_map_size);
+    munmap(index_map, index_map_size);
+    munmap(blocks_map, blocks_map_size);
+    ::close(fd);
+    index_map = nullptr;
+    blocks_map = nullptr;
+    hdr = nullptr;
+    index = nullptr;
+    fd = -1;
+}
+
+/*
+  find the index entry for a key, or the empty slot it would go in.
+  Returns nullptr if neither is found
+ */
+TerrainStore::index_entry *TerrainStore::find(const Key &k) const
+{
+    if (!is_open() || k.spacing == 0) {
+        return nullptr;
+    }
+
+    // FNV-1a over the key fields, as in terrain_pack.py
+    const uint8_t key[] = {
+        (uint8_t)k.lat_degrees,
+        (uint8_t)(k.lon_degrees & 0xFF), (uint8_t)((uint16_t)k.lon_degrees >> 8),
+        (uint8_t)(k.grid_idx_x & 0xFF), (uint8_t)(k.grid_idx_x >> 8),
+        (uint8_t)(k.grid_idx_y & 0xFF), (uint8_t)(k.grid_idx_y >> 8),
+        (uint8_t)(k.spacing & 0xFF), (uint8_t)(k.spacing >> 8),
+    };
+    uint32_t h = 2166136261U;
+    for (uint8_t i=0; i<sizeof(key); i++) {
+        h = (h ^ key[i]) * 16777619U;
+    }
+
+    const uint32_t mask = hdr->index_slots - 1;
+    for (uint32_t n=0; n<=mask; n++) {
+        struct index_entry &e = index[(h + n) & mask];
+        if (e.spacing == 0) {
+            return &e;
+        }
+        if (e.spacing == k.spacing &&
+            e.lat_degrees == k.lat_degrees &&
+            e.lon_degrees == k.lon_degrees &&
+            e.grid_idx_x == k.grid_idx_x &&
+            e.grid_idx_y == k.grid_idx_y) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+uint8_t *TerrainStore::block_data(uint32_t block) const
+{
+    return &blocks_map[block * (size_t)hdr->block_size];
+}
+
+/*
+  write a range of the mapping back to the file, waiting for it
+ */
+bool TerrainStore::sync(const void *p, size_t len)
+{
+    const uintptr_t start = (uintptr_t)p & ~(uintptr_t)(TERRAIN_STORE_PAGE_SIZE - 1);
+    const uintptr_t end = (uintptr_t)p + len;
+    return msync((void *)start, end - start, MS_SYNC) == 0;
+}
+
+/*
+  copy a block out of the store. Returns false if the store doesn't
+  have it
+ */
+bool TerrainStore::read(const Key &key, void *data) const
+{
+    const struct index_entry *e = find(key);
+    if (e == nullptr || e->spacing == 0 || e->block >= hdr->num_blocks) {
+        return false;
+    }
+    memcpy(data, block_data(e->block), hdr->block_size);
+    return true;
+}
+
+/*
+  copy a block into the store. A new block is committed in three
+  steps, each synced before the next, so that after a crash the index
+  never points at a block which wasn't written: the block is first
+  reserved in the header, then written, then added to the index
+ */
+bool TerrainStore::write(const Key &key, const void *data)
+{
+    struct index_entry *e = find(key);
+    if (e == nullptr) {
+        return false;
+    }
+    if (e->spacing != 0) {
+        // replace the block in place. The caller's checks on what it
+        // reads back catch a block left half written
+        if (e->block >= hdr->num_blocks) {
+            return false;
+        }
+        uint8_t *b = block_data(e->block);
+        memcpy(b, data, hdr->block_size);
+        return sync(b, hdr->block_size);
+    }
+
+    if (hdr->num_blocks >= hdr->max_blocks) {
+        return false;
+    }
+    const uint32_t block = hdr->num_blocks++;
+    if (!sync(hdr, sizeof(*hdr))) {
+        return false;
+    }
+
+    uint8_t *b = block_data(block);
+    memcpy(b, data, hdr->block_size);
+    if (!sync(b, hdr->block_size)) {
+        return false;
+    }
+
+    e->lat_degrees = key.lat_degrees;
+    e->lon_degrees = key.lon_degrees;
+    e->grid_idx_x = key.grid_idx_x;
+    e->grid_idx_y = key.grid_idx_y;
+    e->block = block;
+    // spacing last, as it marks the entry as used
+    e->spacing = key.spacing;
+    return sync(e, sizeof(*e));
+}
+
+#endif // AP_TERRAIN_STORE_ENABLED
@@ -0,0 +1,117 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <AP_Common/AP_Common.h>
+#include <AP_HAL/AP_HAL_Boards.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// on Linux and SITL grid blocks are kept in a single memory mapped
+// tile store, with the per-degree files only used to import blocks
+#ifndef AP_TERRAIN_STORE_ENABLED
+#define AP_TERRAIN_STORE_ENABLED (CONFIG_HAL_BOARD == HAL_BOARD_SITL || CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
+// tile store format. See libraries/AP_Terrain/tools/terrain_pack.py
+#define TERRAIN_STORE_FILE "TERRAIN.PAK"
+#define TERRAIN_STORE_MAGIC 0x4B505441 // "ATPK"
+#define TERRAIN_STORE_VERSION 1
+#define TERRAIN_STORE_PAGE_SIZE 4096
+
+// number of grid blocks in a newly created tile store, 64MB
+#ifndef TERRAIN_STORE_MAX_BLOCKS
+#define TERRAIN_STORE_MAX_BLOCKS 32768
+#endif
+
+#if AP_TERRAIN_STORE_ENABLED
+
+/*
+  a memory mapped file of fixed size blocks found through a hash index
+  of their grid position. The store knows nothing of what is in a
+  block, so callers check a block read back is the one they wanted.
+
+  The header and index are mapped separately from the blocks and
+  loaded when the store is opened, so finding a block never waits for
+  the disk. Reading or writing a block may, so is for the IO thread.
+ */
+class TerrainStore {
+public:
+    // the grid position a block is stored under
+    struct Key {
+        int8_t lat_degrees;
+        int16_t lon_degrees;
+        uint16_t grid_idx_x;
+        uint16_t grid_idx_y;
+        uint16_t spacing;
+    };
+
+    ~TerrainStore() { close(); }
+
+    // open TERRAIN.PAK in dir, creating it with room for max_blocks
+    // blocks if it doesn't exist. Fails if an existing file has a
+    // different block size or is damaged
+    bool open(const char *dir, uint16_t block_size, uint32_t max_blocks);
+    void close(void);
+    bool is_open(void) const { return hdr != nullptr; }
+
+    uint32_t num_blocks(void) const { return hdr ? hdr->num_blocks : 0; }
+
+    // copy a block out of the store. Returns false if it isn't there
+    bool read(const Key &key, void *data) const;
+
+    // copy a block into the store, adding it if needed. Returns false
+    // if the store is full or not open
+    bool write(const Key &key, const void *data);
+
+private:
+    /*
+      the file is a header page, an open addressed hash index of
+      index_entry, padded to a page, then the blocks
+     */
+    struct PACKED header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t block_size;
+        uint32_t index_slots;   // power of two
+        uint32_t max_blocks;
+        uint32_t num_blocks;
+    };
+    struct PACKED index_entry {
+        uint16_t spacing;       // zero for an empty slot
+        int16_t lon_degrees;
+        int8_t lat_degrees;
+        uint8_t pad1;
+        uint16_t grid_idx_x;
+        uint16_t grid_idx_y;
+        uint16_t pad2;
+        uint32_t block;         // block number in the data area
+    };
+
+    int fd = -1;
+    uint8_t *index_map = nullptr;
+    size_t index_map_size;
+    uint8_t *blocks_map = nullptr;
+    size_t blocks_map_size;
+    struct header *hdr = nullptr;
+    struct index_entry *index = nullptr;
+
+    struct index_entry *find(const Key &key) const;
+    uint8_t *block_data(uint32_t block) const;
+    static bool sync(const void *p, size_t len);
+};
+
+#endif // AP_TERRAIN_STORE_ENABLED
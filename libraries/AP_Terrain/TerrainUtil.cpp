@@ -64,7 +64,8 @@ bool AP_Terrain::check_bitmap(const struct grid_block &grid, uint8_t idx_x, uint
   given a location, calculate the 32x28 grid SW corner, plus the
   grid indices
 */
-void AP_Terrain::calculate_grid_info(const Location &loc, struct grid_info &info) const
+void AP_Terrain::calculate_grid_info(const Location &loc, struct grid_info &info,
+                                     const struct grid_info *prev) const
 {
     // grids start on integer degrees. This makes storing terrain data
     // on the SD card a bit easier
@@ -97,12 +98,22 @@ void AP_Terrain::calculate_grid_info(const Location &loc, struct grid_info &info
     info.frac_x = (offset.x - idx_x * grid_spacing) / grid_spacing;
     info.frac_y = (offset.y - idx_y * grid_spacing) / grid_spacing;
 
-    // calculate lat/lon of SW corner of 32*28 grid_block
-    location_offset(ref, 
-                    info.grid_idx_x * TERRAIN_GRID_BLOCK_SPACING_X * (float)grid_spacing,
-                    info.grid_idx_y * TERRAIN_GRID_BLOCK_SPACING_Y * (float)grid_spacing);
-    info.grid_lat = ref.lat;
-    info.grid_lon = ref.lng;
+    if (prev != nullptr &&
+        prev->lat_degrees == info.lat_degrees &&
+        prev->lon_degrees == info.lon_degrees &&
+        prev->grid_idx_x == info.grid_idx_x &&
+        prev->grid_idx_y == info.grid_idx_y) {
+        // same grid_block as last time
+        info.grid_lat = prev->grid_lat;
+        info.grid_lon = prev->grid_lon;
+    } else {
+        // calculate lat/lon of SW corner of 32*28 grid_block
+        location_offset(ref,
+                        info.grid_idx_x * TERRAIN_GRID_BLOCK_SPACING_X * (float)grid_spacing,
+                        info.grid_idx_y * TERRAIN_GRID_BLOCK_SPACING_Y * (float)grid_spacing);
+        info.grid_lat = ref.lat;
+        info.grid_lon = ref.lng;
+    }
 
     ASSERT_RANGE(info.idx_x,0,TERRAIN_GRID_BLOCK_SPACING_X-1);
     ASSERT_RANGE(info.idx_y,0,TERRAIN_GRID_BLOCK_SPACING_Y-1);
@@ -112,27 +123,88 @@ void AP_Terrain::calculate_grid_info(const Location &loc, struct grid_info &info
 
 
 /*
-  find a grid structure given a grid_info
+  hash the SW corner of a grid_block to a cache_hash bucket
  */
-AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info)
+uint8_t AP_Terrain::grid_hash(int32_t lat, int32_t lon) const
 {
-    uint16_t oldest_i = 0;
+    uint32_t h = (uint32_t)lat * 0x9E3779B1U;
+    h ^= (uint32_t)lon + 0x7F4A7C15U + (h<<6) + (h>>2);
+    return (h ^ (h>>16)) & cache_hash_mask;
+}
 
-    // see if we have that grid
-    for (uint16_t i=0; i<cache_size; i++) {
-        if (cache[i].grid.lat == info.grid_lat && 
-            cache[i].grid.lon == info.grid_lon &&
-            cache[i].grid.spacing == grid_spacing) {
-            cache[i].last_access_ms = AP_HAL::millis();
-            return cache[i];
+/*
+  find an existing cache entry, or nullptr
+ */
+AP_Terrain::grid_cache *AP_Terrain::lookup_grid_cache(int32_t lat, int32_t lon, uint16_t spacing)
+{
+    for (uint8_t i = cache_hash[grid_hash(lat, lon)]; i != cache_none; i = cache[i].hash_next) {
+        const struct grid_block &grid = cache[i].grid;
+        if (grid.lat == lat &&
+            grid.lon == lon &&
+            grid.spacing == spacing) {
+            return &cache[i];
         }
-        if (cache[i].last_access_ms < cache[oldest_i].last_access_ms) {
-            oldest_i = i;
+    }
+    return nullptr;
+}
+
+/*
+  add a cache entry to its hash bucket
+ */
+void AP_Terrain::link_grid_cache(uint8_t idx)
+{
+    uint8_t &head = cache_hash[grid_hash(cache[idx].grid.lat, cache[idx].grid.lon)];
+    cache[idx].hash_next = head;
+    head = idx;
+}
+
+/*
+  remove a cache entry from its hash bucket
+ */
+void AP_Terrain::unlink_grid_cache(uint8_t idx)
+{
+    uint8_t *p = &cache_hash[grid_hash(cache[idx].grid.lat, cache[idx].grid.lon)];
+    while (*p != cache_none) {
+        if (*p == idx) {
+            *p = cache[idx].hash_next;
+            break;
         }
+        p = &cache[*p].hash_next;
     }
+    cache[idx].hash_next = cache_none;
+}
 
-    // Not found. Use the oldest grid and make it this grid,
-    // initially unpopulated
+/*
+  replace the least recently used cache entry with a new unpopulated
+  grid, waiting for disk read. Entries with unwritten data are only
+  replaced if there is nothing else. Returns nullptr if every entry
+  was used in the last min_age_ms
+ */
+AP_Terrain::grid_cache *AP_Terrain::replace_grid_cache(const struct grid_info &info, uint32_t min_age_ms)
+{
+    const uint32_t now = AP_HAL::millis();
+    int16_t oldest_i = -1;
+    int16_t oldest_dirty_i = -1;
+    for (uint8_t i=0; i<cache_size; i++) {
+        int16_t &oldest = cache[i].state == GRID_CACHE_DIRTY ? oldest_dirty_i : oldest_i;
+        if (oldest == -1 || cache[i].last_access_ms < cache[oldest].last_access_ms) {
+            oldest = i;
+        }
+    }
+    if (oldest_i == -1) {
+        oldest_i = oldest_dirty_i;
+    }
+    if (min_age_ms != 0 &&
+        cache[oldest_i].state != GRID_CACHE_INVALID &&
+        now - cache[oldest_i].last_access_ms < min_age_ms) {
+        return nullptr;
+    }
+
+    // make it this grid, initially unpopulated
+    if (cache[oldest_i].state != GRID_CACHE_INVALID) {
+        unlink_grid_cache(oldest_i);
+    }
+    height_memo_clear();
     struct grid_cache &grid = cache[oldest_i];
     memset(&grid, 0, sizeof(grid));
 
@@ -144,34 +216,54 @@ AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info
     grid.grid.lat_degrees = info.lat_degrees;
     grid.grid.lon_degrees = info.lon_degrees;
     grid.grid.version = TERRAIN_GRID_FORMAT_VERSION;
-    grid.last_access_ms = AP_HAL::millis();
+    grid.last_access_ms = now;
 
     // mark as waiting for disk read
     grid.state = GRID_CACHE_DISKWAIT;
+    link_grid_cache(oldest_i);
+
+    return &grid;
+}
 
-    return grid;
+/*
+  find a grid structure given a grid_info
+ */
+AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info)
+{
+    // see if we have that grid
+    struct grid_cache *grid = lookup_grid_cache(info.grid_lat, info.grid_lon, grid_spacing);
+    if (grid != nullptr) {
+        cache_hits++;
+        grid->last_access_ms = AP_HAL::millis();
+        grid->prefetched = false;
+        return *grid;
+    }
+
+    // Not found. Use the oldest grid
+    cache_misses++;
+    return *replace_grid_cache(info, 0);
 }
 
 /*
-  find cache index of disk_block
+  find cache index of a block that has been through disk IO
  */
-int16_t AP_Terrain::find_io_idx(enum GridCacheState state)
+int16_t AP_Terrain::find_io_idx(const struct grid_block &block, enum GridCacheState state)
 {
     // try first with given state
-    for (uint16_t i=0; i<cache_size; i++) {
-        if (disk_block.block.lat == cache[i].grid.lat &&
-            disk_block.block.lon == cache[i].grid.lon && 
+    for (uint8_t i = cache_hash[grid_hash(block.lat, block.lon)]; i != cache_none; i = cache[i].hash_next) {
+        if (block.lat == cache[i].grid.lat &&
+            block.lon == cache[i].grid.lon &&
             cache[i].state == state) {
             return i;
         }
-    }    
+    }
     // then any state
-    for (uint16_t i=0; i<cache_size; i++) {
-        if (disk_block.block.lat == cache[i].grid.lat &&
-            disk_block.block.lon == cache[i].grid.lon) {
+    for (uint8_t i = cache_hash[grid_hash(block.lat, block.lon)]; i != cache_none; i = cache[i].hash_next) {
+        if (block.lat == cache[i].grid.lat &&
+            block.lon == cache[i].grid.lon) {
             return i;
         }
-    }    
+    }
     return -1;
 }
 
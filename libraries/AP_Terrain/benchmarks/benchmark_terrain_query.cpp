@@ -0,0 +1,171 @@
+/*
+  measure the per-query cost of AP_Terrain::height_amsl(), for a
+  location asked for repeatedly in one loop (answered from the memo of
+  recent results) and for a stream of distinct nearby locations, and
+  compare a lookahead() style batch of points along a line looked up
+  one at a time against height_amsl_many().
+
+  The grid_block under the test locations is filled with
+  TERRAIN_DATA messages before timing, so every query finds data.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AP_AHRS/AP_AHRS.h>
+#include <AP_Mission/AP_Mission.h>
+#include <AP_Rally/AP_Rally.h>
+#include <AP_Terrain/AP_Terrain.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+const struct AP_Param::GroupInfo GCS_MAVLINK::var_info[] = {
+    AP_GROUPEND
+};
+GCS_Dummy _gcs;
+
+class TerrainBench {
+public:
+    AP_InertialSensor ins = AP_InertialSensor::create();
+    AP_Baro baro = AP_Baro::create();
+    AP_GPS gps = AP_GPS::create();
+    AP_AHRS_DCM ahrs = AP_AHRS_DCM::create(ins, baro, gps);
+    AP_Mission mission = AP_Mission::create(ahrs,
+            FUNCTOR_BIND_MEMBER(&TerrainBench::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&TerrainBench::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&TerrainBench::mission_complete, void));
+    AP_Rally rally = AP_Rally::create(ahrs);
+    AP_Terrain terrain = AP_Terrain::create(ahrs, mission, rally);
+
+    bool mission_cmd(const AP_Mission::Mission_Command &cmd) { return true; }
+    void mission_complete(void) {}
+
+    void setup(void);
+    Location base;
+};
+
+static TerrainBench bench;
+
+#define TEST_SPACING 100
+
+/*
+  fill the grid_block holding base with data, as a GCS would
+ */
+void TerrainBench::setup(void)
+{
+    if (base.lat != 0) {
+        return;
+    }
+    base.lat = -353632620;
+    base.lng = 1491652300;
+
+    // ask once, so the grid_block is in the cache
+    float height;
+    terrain.height_amsl(base, height, false);
+
+    // SW corner of the grid_block, as AP_Terrain::calculate_grid_info()
+    Location ref {};
+    ref.lat = ((base.lat<0?(base.lat-9999999L):base.lat) / (10*1000*1000L)) * 10*1000*1000L;
+    ref.lng = ((base.lng<0?(base.lng-9999999L):base.lng) / (10*1000*1000L)) * 10*1000*1000L;
+    const Vector2f offset = location_diff(ref, base);
+    const uint16_t grid_idx_x = uint32_t(offset.x / TEST_SPACING) / TERRAIN_GRID_BLOCK_SPACING_X;
+    const uint16_t grid_idx_y = uint32_t(offset.y / TEST_SPACING) / TERRAIN_GRID_BLOCK_SPACING_Y;
+    location_offset(ref,
+                    grid_idx_x * TERRAIN_GRID_BLOCK_SPACING_X * (float)TEST_SPACING,
+                    grid_idx_y * TERRAIN_GRID_BLOCK_SPACING_Y * (float)TEST_SPACING);
+
+    // move base to near the SW corner, leaving room for the points
+    // used below
+    base = ref;
+    location_offset(base, 250, 250);
+
+    for (uint8_t gridbit=0; gridbit<TERRAIN_GRID_BLOCK_MUL_X*TERRAIN_GRID_BLOCK_MUL_Y; gridbit++) {
+        int16_t data[16];
+        for (uint8_t i=0; i<16; i++) {
+            data[i] = 500 + gridbit*3 + i;
+        }
+        mavlink_message_t msg;
+        mavlink_msg_terrain_data_pack(1, 1, &msg, ref.lat, ref.lng, TEST_SPACING, gridbit, data);
+        terrain.handle_terrain_data(&msg);
+    }
+}
+
+/*
+  the same location asked for repeatedly
+ */
+static void BM_TerrainHeightSame(benchmark::State& state)
+{
+    bench.setup();
+    float height;
+    while (state.KeepRunning()) {
+        bench.terrain.height_amsl(bench.base, height, false);
+        gbenchmark_escape(&height);
+    }
+}
+
+/*
+  a different location each time, all in one grid_block
+ */
+static void BM_TerrainHeightMoving(benchmark::State& state)
+{
+    bench.setup();
+    Location locs[64];
+    for (uint8_t i=0; i<ARRAY_SIZE(locs); i++) {
+        locs[i] = bench.base;
+        location_offset(locs[i], (i % 8) * 230.0f, (i / 8) * 270.0f);
+    }
+    float height;
+    uint8_t i = 0;
+    while (state.KeepRunning()) {
+        bench.terrain.height_amsl(locs[i], height, false);
+        gbenchmark_escape(&height);
+        i = (i + 1) % ARRAY_SIZE(locs);
+    }
+}
+
+/*
+  points at grid spacing along a line, as used by lookahead()
+ */
+static void line_points(Location *locs, uint8_t count)
+{
+    Location loc = bench.base;
+    for (uint8_t i=0; i<count; i++) {
+        location_update(loc, 30, TEST_SPACING);
+        locs[i] = loc;
+    }
+}
+
+static void BM_TerrainHeightLine(benchmark::State& state)
+{
+    bench.setup();
+    Location locs[16];
+    float heights[ARRAY_SIZE(locs)];
+    const uint8_t count = state.range_x();
+    line_points(locs, count);
+    while (state.KeepRunning()) {
+        for (uint8_t i=0; i<count; i++) {
+            bench.terrain.height_amsl(locs[i], heights[i], false);
+        }
+        gbenchmark_escape(heights);
+    }
+}
+
+static void BM_TerrainHeightMany(benchmark::State& state)
+{
+    bench.setup();
+    Location locs[16];
+    float heights[ARRAY_SIZE(locs)];
+    bool valid[ARRAY_SIZE(locs)];
+    const uint8_t count = state.range_x();
+    line_points(locs, count);
+    while (state.KeepRunning()) {
+        bench.terrain.height_amsl_many(locs, heights, valid, count, false);
+        gbenchmark_escape(heights);
+    }
+}
+
+BENCHMARK(BM_TerrainHeightSame);
+BENCHMARK(BM_TerrainHeightMoving);
+BENCHMARK(BM_TerrainHeightLine)->Arg(4)->Arg(16);
+BENCHMARK(BM_TerrainHeightMany)->Arg(4)->Arg(16);
+
+BENCHMARK_MAIN()
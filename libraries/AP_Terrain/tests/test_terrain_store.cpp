@@ -0,0 +1,145 @@
+#include <AP_gtest.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Terrain/TerrainStore.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#if AP_TERRAIN_STORE_ENABLED
+
+#define TEST_BLOCK_SIZE 2048
+#define TEST_MAX_BLOCKS 64
+
+/*
+  a tile store in a fresh temporary directory
+ */
+class TerrainStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        strcpy(dir, "/tmp/terrain_store_XXXXXX");
+        ASSERT_NE(nullptr, mkdtemp(dir));
+        snprintf(path, sizeof(path), "%s/" TERRAIN_STORE_FILE, dir);
+    }
+
+    void TearDown() override {
+        store.close();
+        unlink(path);
+        rmdir(dir);
+    }
+
+    static TerrainStore::Key key(uint16_t n) {
+        const TerrainStore::Key k { -35, 149, uint16_t(n / 8), uint16_t(n % 8), 100 };
+        return k;
+    }
+
+    static void fill(uint8_t *data, uint16_t n) {
+        for (uint16_t i=0; i<TEST_BLOCK_SIZE; i++) {
+            data[i] = uint8_t(n * 7 + i);
+        }
+    }
+
+    char dir[32];
+    char path[64];
+    TerrainStore store;
+};
+
+TEST_F(TerrainStoreTest, RoundTrip)
+{
+    ASSERT_TRUE(store.open(dir, TEST_BLOCK_SIZE, TEST_MAX_BLOCKS));
+    EXPECT_EQ(0U, store.num_blocks());
+
+    uint8_t data[TEST_BLOCK_SIZE];
+    uint8_t back[TEST_BLOCK_SIZE];
+    for (uint16_t n=0; n<10; n++) {
+        fill(data, n);
+        ASSERT_TRUE(store.write(key(n), data));
+    }
+    EXPECT_EQ(10U, store.num_blocks());
+    for (uint16_t n=0; n<10; n++) {
+        fill(data, n);
+        ASSERT_TRUE(store.read(key(n), back));
+        EXPECT_EQ(0, memcmp(data, back, sizeof(data)));
+    }
+
+    // a block not written
+    EXPECT_FALSE(store.read(key(10), back));
+    TerrainStore::Key k = key(0);
+    k.spacing = 30;
+    EXPECT_FALSE(store.read(k, back));
+
+    // rewriting a block replaces it without using another
+    fill(data, 99);
+    ASSERT_TRUE(store.write(key(3), data));
+    EXPECT_EQ(10U, store.num_blocks());
+    ASSERT_TRUE(store.read(key(3), back));
+    EXPECT_EQ(0, memcmp(data, back, sizeof(data)));
+}
+
+TEST_F(TerrainStoreTest, Reopen)
+{
+    uint8_t data[TEST_BLOCK_SIZE];
+    uint8_t back[TEST_BLOCK_SIZE];
+    ASSERT_TRUE(store.open(dir, TEST_BLOCK_SIZE, TEST_MAX_BLOCKS));
+    for (uint16_t n=0; n<20; n++) {
+        fill(data, n);
+        ASSERT_TRUE(store.write(key(n), data));
+    }
+    store.close();
+    EXPECT_FALSE(store.read(key(0), back));
+
+    // max_blocks only applies to a new store
+    ASSERT_TRUE(store.open(dir, TEST_BLOCK_SIZE, 8));
+    EXPECT_EQ(20U, store.num_blocks());
+    for (uint16_t n=0; n<20; n++) {
+        fill(data, n);
+        ASSERT_TRUE(store.read(key(n), back));
+        EXPECT_EQ(0, memcmp(data, back, sizeof(data)));
+    }
+    fill(data, 20);
+    EXPECT_TRUE(store.write(key(20), data));
+    store.close();
+
+    // a different block size is refused
+    EXPECT_FALSE(store.open(dir, TEST_BLOCK_SIZE/2, TEST_MAX_BLOCKS));
+    EXPECT_FALSE(store.is_open());
+}
+
+TEST_F(TerrainStoreTest, Full)
+{
+    uint8_t data[TEST_BLOCK_SIZE];
+    ASSERT_TRUE(store.open(dir, TEST_BLOCK_SIZE, TEST_MAX_BLOCKS));
+    for (uint16_t n=0; n<TEST_MAX_BLOCKS; n++) {
+        fill(data, n);
+        ASSERT_TRUE(store.write(key(n), data));
+    }
+    EXPECT_FALSE(store.write(key(TEST_MAX_BLOCKS), data));
+
+    // blocks already in the store can still be updated
+    EXPECT_TRUE(store.write(key(0), data));
+    EXPECT_EQ(uint32_t(TEST_MAX_BLOCKS), store.num_blocks());
+}
+
+TEST_F(TerrainStoreTest, DamagedFileRefused)
+{
+    ASSERT_TRUE(store.open(dir, TEST_BLOCK_SIZE, TEST_MAX_BLOCKS));
+    store.close();
+
+    // a truncated file
+    ASSERT_EQ(0, truncate(path, 8192));
+    EXPECT_FALSE(store.open(dir, TEST_BLOCK_SIZE, TEST_MAX_BLOCKS));
+
+    // a file which isn't a store
+    FILE *f = fopen(path, "w");
+    ASSERT_NE(nullptr, f);
+    fputs("not a tile store, but long enough to have a header", f);
+    fclose(f);
+    EXPECT_FALSE(store.open(dir, TEST_BLOCK_SIZE, TEST_MAX_BLOCKS));
+}
+
+#endif // AP_TERRAIN_STORE_ENABLED
+
+AP_GTEST_MAIN()
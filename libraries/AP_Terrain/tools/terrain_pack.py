@@ -0,0 +1,293 @@
+#!/usr/bin/env python
+'''
+create or add to a terrain tile store (TERRAIN.PAK) for Linux and SITL
+boards, from SRTM .hgt files or from existing per-degree .DAT files
+
+Example, to fill a 20km square around CMAC at 100m spacing:
+
+  terrain_pack.py --srtm ~/srtm --area=-35.45,149.05,-35.27,149.27 terrain/TERRAIN.PAK
+
+The format matches the tile store in libraries/AP_Terrain/TerrainStore.cpp
+and the grid_block structure in AP_Terrain.h
+'''
+
+import os, sys, struct, math, glob
+
+import argparse
+
+STORE_MAGIC = 0x4B505441
+STORE_VERSION = 1
+PAGE_SIZE = 4096
+IO_BLOCK_SIZE = 2048
+HEADER_FORMAT = '<IHHIII'
+INDEX_FORMAT = '<HhbBHHHI'
+INDEX_SIZE = struct.calcsize(INDEX_FORMAT)
+
+# grid_block layout
+GRID_FORMAT_VERSION = 1
+GRID_MAVLINK_SIZE = 4
+GRID_BLOCK_MUL_X = 7
+GRID_BLOCK_MUL_Y = 8
+GRID_BLOCK_SPACING_X = (GRID_BLOCK_MUL_X-1)*GRID_MAVLINK_SIZE
+GRID_BLOCK_SPACING_Y = (GRID_BLOCK_MUL_Y-1)*GRID_MAVLINK_SIZE
+GRID_BLOCK_SIZE_X = GRID_MAVLINK_SIZE*GRID_BLOCK_MUL_X
+GRID_BLOCK_SIZE_Y = GRID_MAVLINK_SIZE*GRID_BLOCK_MUL_Y
+BLOCK_HEADER_FORMAT = '<QiiHHH'
+BLOCK_TRAILER_FORMAT = '<HHhb'
+BLOCK_SIZE = (struct.calcsize(BLOCK_HEADER_FORMAT) +
+              2*GRID_BLOCK_SIZE_X*GRID_BLOCK_SIZE_Y +
+              struct.calcsize(BLOCK_TRAILER_FORMAT))
+BITMAP_FULL = (1 << (GRID_BLOCK_MUL_X*GRID_BLOCK_MUL_Y)) - 1
+
+LOCATION_SCALING_FACTOR = 0.011131884502145034
+LOCATION_SCALING_FACTOR_INV = 89.83204953368922
+
+def crc16_ccitt(buf, crc=0):
+    '''crc16_ccitt as in AP_Math'''
+    for b in bytearray(buf):
+        crc ^= b << 8
+        for i in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+def longitude_scale(lat):
+    scale = math.cos(lat * 1.0e-7 * math.pi / 180.0)
+    return min(max(scale, 0.01), 1.0)
+
+def location_offset(lat, lon, ofs_north, ofs_east):
+    '''offset a lat/lon in 1e7 degrees by meters, as in AP_Math'''
+    dlat = int(ofs_north * LOCATION_SCALING_FACTOR_INV)
+    dlng = int((ofs_east * LOCATION_SCALING_FACTOR_INV) / longitude_scale(lat))
+    return (lat + dlat, lon + dlng)
+
+def pack_block(lat, lon, spacing, heights, grid_idx_x, grid_idx_y, lat_degrees, lon_degrees, bitmap):
+    '''pack a grid_block, with its crc'''
+    def pack(crc):
+        return (struct.pack(BLOCK_HEADER_FORMAT, bitmap, lat, lon, crc, GRID_FORMAT_VERSION, spacing) +
+                struct.pack('<%uh' % len(heights), *heights) +
+                struct.pack(BLOCK_TRAILER_FORMAT, grid_idx_x, grid_idx_y, lon_degrees, lat_degrees))
+    return pack(crc16_ccitt(pack(0)))
+
+def unpack_block(data):
+    '''unpack the key fields of a grid_block, or None if it is not valid'''
+    if len(data) < BLOCK_SIZE:
+        return None
+    (bitmap, lat, lon, crc, version, spacing) = struct.unpack_from(BLOCK_HEADER_FORMAT, data, 0)
+    (grid_idx_x, grid_idx_y, lon_degrees, lat_degrees) = struct.unpack_from(
+        BLOCK_TRAILER_FORMAT, data, BLOCK_SIZE - struct.calcsize(BLOCK_TRAILER_FORMAT))
+    if bitmap == 0 or version != GRID_FORMAT_VERSION or spacing == 0:
+        return None
+    zeroed = bytearray(data[:BLOCK_SIZE])
+    zeroed[16:18] = b'\0\0'
+    if crc16_ccitt(zeroed) != crc:
+        return None
+    return (lat_degrees, lon_degrees, grid_idx_x, grid_idx_y, spacing)
+
+class TileStore(object):
+    '''a TERRAIN.PAK file'''
+    def __init__(self, filename, max_blocks):
+        self.f = None
+        if not os.path.exists(filename) or os.path.getsize(filename) == 0:
+            self.index_slots = 2*max_blocks
+            self.max_blocks = max_blocks
+            self.num_blocks = 0
+            self.setup_layout()
+            self.f = open(filename, 'w+b')
+            self.f.truncate(self.size)
+            self.write_header()
+        else:
+            self.f = open(filename, 'r+b')
+            (magic, version, block_size, self.index_slots,
+             self.max_blocks, self.num_blocks) = struct.unpack(HEADER_FORMAT, self.f.read(struct.calcsize(HEADER_FORMAT)))
+            if magic != STORE_MAGIC or version != STORE_VERSION or block_size != IO_BLOCK_SIZE:
+                raise RuntimeError("%s is not a terrain store" % filename)
+            self.setup_layout()
+        self.f.seek(PAGE_SIZE)
+        self.index = bytearray(self.f.read(self.index_slots * INDEX_SIZE))
+
+    def setup_layout(self):
+        index_size = self.index_slots * INDEX_SIZE
+        self.blocks_ofs = PAGE_SIZE + ((index_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+        self.size = self.blocks_ofs + self.max_blocks * IO_BLOCK_SIZE
+
+    def write_header(self):
+        self.f.seek(0)
+        self.f.write(struct.pack(HEADER_FORMAT, STORE_MAGIC, STORE_VERSION, IO_BLOCK_SIZE,
+                                 self.index_slots, self.max_blocks, self.num_blocks))
+
+    def find(self, key):
+        '''find the index slot for a key, as TerrainStore::find() in TerrainStore.cpp'''
+        (lat_degrees, lon_degrees, grid_idx_x, grid_idx_y, spacing) = key
+        h = 2166136261
+        for b in bytearray(struct.pack('<bhHHH', lat_degrees, lon_degrees, grid_idx_x, grid_idx_y, spacing)):
+            h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+        mask = self.index_slots - 1
+        for n in range(self.index_slots):
+            slot = (h + n) & mask
+            e = struct.unpack_from(INDEX_FORMAT, self.index, slot*INDEX_SIZE)
+            if e[0] == 0:
+                return (slot, None)
+            if e[0] == spacing and e[2] == lat_degrees and e[1] == lon_degrees and e[4] == grid_idx_x and e[5] == grid_idx_y:
+                return (slot, e[7])
+        return (None, None)
+
+    def add(self, key, data):
+        '''add or replace a block. Returns False if the store is full'''
+        (slot, block) = self.find(key)
+        if slot is None:
+            return False
+        if block is None:
+            if self.num_blocks >= self.max_blocks:
+                return False
+            block = self.num_blocks
+            self.num_blocks += 1
+            (lat_degrees, lon_degrees, grid_idx_x, grid_idx_y, spacing) = key
+            struct.pack_into(INDEX_FORMAT, self.index, slot*INDEX_SIZE,
+                             spacing, lon_degrees, lat_degrees, 0, grid_idx_x, grid_idx_y, 0, block)
+        self.f.seek(self.blocks_ofs + block * IO_BLOCK_SIZE)
+        self.f.write(data + b'\0' * (IO_BLOCK_SIZE - len(data)))
+        return True
+
+    def close(self):
+        self.f.seek(PAGE_SIZE)
+        self.f.write(self.index)
+        self.write_header()
+        self.f.close()
+
+class SRTM(object):
+    '''heights from a directory of SRTM .hgt files'''
+    def __init__(self, directory):
+        self.directory = directory
+        self.tiles = {}
+        self.voids = 0
+
+    def tile(self, lat_degrees, lon_degrees):
+        key = (lat_degrees, lon_degrees)
+        if key not in self.tiles:
+            name = "%c%02u%c%03u.hgt" % ('S' if lat_degrees < 0 else 'N', abs(lat_degrees),
+                                         'W' if lon_degrees < 0 else 'E', abs(lon_degrees))
+            path = os.path.join(self.directory, name)
+            if not os.path.exists(path):
+                raise RuntimeError("missing SRTM tile %s" % path)
+            data = open(path, 'rb').read()
+            n = int(math.sqrt(len(data) // 2))
+            self.tiles[key] = (n, struct.unpack('>%uh' % (n*n), data))
+        return self.tiles[key]
+
+    def height(self, lat, lon):
+        '''bilinear interpolated height in meters at lat/lon in degrees'''
+        lat_degrees = int(math.floor(lat))
+        lon_degrees = int(math.floor(lon))
+        (n, h) = self.tile(lat_degrees, lon_degrees)
+        # rows run north to south
+        y = (lat_degrees + 1 - lat) * (n-1)
+        x = (lon - lon_degrees) * (n-1)
+        r = min(int(y), n-2)
+        c = min(int(x), n-2)
+        fy = y - r
+        fx = x - c
+        h00 = h[r*n+c]
+        h01 = h[r*n+c+1]
+        h10 = h[(r+1)*n+c]
+        h11 = h[(r+1)*n+c+1]
+        if -32768 in (h00, h01, h10, h11):
+            self.voids += 1
+            return max(0, h00, h01, h10, h11)
+        return (h00*(1-fx)*(1-fy) + h01*fx*(1-fy) +
+                h10*(1-fx)*fy + h11*fx*fy)
+
+def srtm_blocks(srtm, area, spacing):
+    '''generate keys and packed blocks covering an area'''
+    (lat1, lon1, lat2, lon2) = area
+    for lat_degrees in range(int(math.floor(lat1)), int(math.floor(lat2))+1):
+        for lon_degrees in range(int(math.floor(lon1)), int(math.floor(lon2))+1):
+            ref_lat = lat_degrees * 10*1000*1000
+            ref_lon = lon_degrees * 10*1000*1000
+            # block index ranges covering the area in this degree
+            # square, with one block of margin east/west for the
+            # varying longitude scale
+            north1 = (max(lat1, lat_degrees) - lat_degrees) * 1.0e7 * LOCATION_SCALING_FACTOR
+            north2 = (min(lat2, lat_degrees+1) - lat_degrees) * 1.0e7 * LOCATION_SCALING_FACTOR
+            scale = longitude_scale(ref_lat)
+            east1 = (max(lon1, lon_degrees) - lon_degrees) * 1.0e7 * LOCATION_SCALING_FACTOR * scale
+            east2 = (min(lon2, lon_degrees+1) - lon_degrees) * 1.0e7 * LOCATION_SCALING_FACTOR * scale
+            gx1 = int(north1 // (GRID_BLOCK_SPACING_X*spacing))
+            gx2 = int(north2 // (GRID_BLOCK_SPACING_X*spacing))
+            gy1 = max(0, int(east1 // (GRID_BLOCK_SPACING_Y*spacing)) - 1)
+            gy2 = int(east2 // (GRID_BLOCK_SPACING_Y*spacing)) + 1
+            for gx in range(gx1, gx2+1):
+                for gy in range(gy1, gy2+1):
+                    (lat, lon) = location_offset(ref_lat, ref_lon,
+                                                 gx*GRID_BLOCK_SPACING_X*spacing,
+                                                 gy*GRID_BLOCK_SPACING_Y*spacing)
+                    heights = []
+                    for x in range(GRID_BLOCK_SIZE_X):
+                        for y in range(GRID_BLOCK_SIZE_Y):
+                            (plat, plon) = location_offset(lat, lon, x*spacing, y*spacing)
+                            heights.append(int(round(srtm.height(plat*1.0e-7, plon*1.0e-7))))
+                    key = (lat_degrees, lon_degrees, gx, gy, spacing)
+                    yield (key, pack_block(lat, lon, spacing, heights, gx, gy,
+                                           lat_degrees, lon_degrees, BITMAP_FULL))
+
+def dat_blocks(directory):
+    '''generate keys and blocks from per-degree .DAT files'''
+    for path in sorted(glob.glob(os.path.join(directory, '[NS]*[EW]*.DAT'))):
+        f = open(path, 'rb')
+        while True:
+            data = f.read(IO_BLOCK_SIZE)
+            if len(data) < IO_BLOCK_SIZE:
+                break
+            key = unpack_block(data)
+            if key is not None:
+                yield (key, data[:BLOCK_SIZE])
+        f.close()
+
+parser = argparse.ArgumentParser(description='fill a terrain tile store')
+parser.add_argument('--srtm', default=None, help='directory of SRTM .hgt files')
+parser.add_argument('--area', default=None, help='area to fill from SRTM, as lat1,lon1,lat2,lon2')
+parser.add_argument('--spacing', type=int, default=100, help='grid spacing in meters (TERRAIN_SPACING)')
+parser.add_argument('--dat', default=None, help='directory of .DAT files to import')
+parser.add_argument('--max-blocks', type=int, default=32768, help='capacity of a new store')
+parser.add_argument('store', help='tile store to create or add to')
+args = parser.parse_args()
+
+if args.srtm is None and args.dat is None:
+    print("Please give --srtm and --area, or --dat")
+    sys.exit(1)
+
+store = TileStore(args.store, args.max_blocks)
+added = 0
+full = False
+
+sources = []
+if args.dat is not None:
+    sources.append(dat_blocks(args.dat))
+if args.srtm is not None:
+    if args.area is None:
+        print("--srtm needs --area")
+        sys.exit(1)
+    area = [float(v) for v in args.area.split(',')]
+    if len(area) != 4:
+        print("--area is lat1,lon1,lat2,lon2")
+        sys.exit(1)
+    area = (min(area[0], area[2]), min(area[1], area[3]), max(area[0], area[2]), max(area[1], area[3]))
+    srtm = SRTM(args.srtm)
+    sources.append(srtm_blocks(srtm, area, args.spacing))
+
+for source in sources:
+    for (key, data) in source:
+        if not store.add(key, data):
+            full = True
+            break
+        added += 1
+    if full:
+        break
+
+store.close()
+print("Added %u blocks, store has %u of %u" % (added, store.num_blocks, store.max_blocks))
+if full:
+    print("Store is full")
+    sys.exit(1)
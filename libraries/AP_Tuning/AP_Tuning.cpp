@@ -225,7 +225,7 @@ void AP_Tuning::check_input(uint8_t flightmode)
  */
 void AP_Tuning::Log_Write_Parameter_Tuning(float value)
 {
-    DataFlash_Class::instance()->Log_Write("PTUN", "TimeUS,Set,Parm,Value,CenterValue", "QBBff",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','B','B','f','f'>("PTUN", "TimeUS,Set,Parm,Value,CenterValue",
                                            AP_HAL::micros64(),
                                            parmset,
                                            current_parm,
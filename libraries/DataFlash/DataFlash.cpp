@@ -10,6 +10,14 @@ DataFlash_Class *DataFlash_Class::_instance;
 
 extern const AP_HAL::HAL& hal;
 
+// check at compile time that the length of each common message
+// matches its format string, and that each field has a label
+static constexpr struct LogStructure common_log_structures[] = {
+    LOG_COMMON_STRUCTURES
+};
+static_assert(log_structures_valid(common_log_structures, ARRAY_SIZE(common_log_structures)),
+              "LOG_COMMON_STRUCTURES msg_len or labels do not match format");
+
 const AP_Param::GroupInfo DataFlash_Class::var_info[] = {
     // @Param: _BACKEND_TYPE
     // @DisplayName: DataFlash Backend Storage type
@@ -45,6 +53,14 @@ const AP_Param::GroupInfo DataFlash_Class::var_info[] = {
     // @User: Standard
     AP_GROUPINFO("_FILE_DSRMROT",  4, DataFlash_Class, _params.file_disarm_rot,       0),
 
+    // @Param: _FILE_INDEX
+    // @DisplayName: DataFlash File index interval
+    // @Description: Interval between time entries in the index file written alongside each log. The index lets a GCS download only the part of a log covering a time range, and lets Replay seek without parsing the whole log. Set to 0 to disable writing the index.
+    // @Units: ms
+    // @Range: 0 10000
+    // @User: Advanced
+    AP_GROUPINFO("_FILE_INDEX",  5, DataFlash_Class, _params.file_index_ms,       1000),
+
     AP_GROUPEND
 };
 
@@ -376,6 +392,27 @@ void DataFlash_Class::WritePrioritisedBlock(const void *pBuffer, uint16_t size,
     FOR_EACH_BACKEND(WritePrioritisedBlock(pBuffer, size, is_critical));
 }
 
+/*
+  in-place writes are only done when there is a single backend; with
+  more than one the message has to be copied to each anyway
+ */
+void *DataFlash_Class::reserve_block_ptr(uint16_t size, bool is_critical)
+{
+    if (_next_backend != 1) {
+        return nullptr;
+    }
+    return backends[0]->reserve_block(size, is_critical);
+}
+
+void DataFlash_Class::commit_block_ptr(void *pBuffer, bool reserved, uint16_t size, bool is_critical)
+{
+    if (reserved) {
+        backends[0]->commit_block(pBuffer, size);
+        return;
+    }
+    WritePrioritisedBlock(pBuffer, size, is_critical);
+}
+
 // change me to "DoTimeConsumingPreparations"?
 void DataFlash_Class::EraseAll() {
     FOR_EACH_BACKEND(EraseAll());
@@ -423,6 +460,13 @@ int16_t DataFlash_Class::get_log_data(uint16_t log_num, uint16_t page, uint32_t
     }
     return backends[0]->get_log_data(log_num, page, offset, len, data);
 }
+bool DataFlash_Class::get_log_offsets_for_time(uint16_t log_num, uint64_t start_us, uint64_t end_us,
+                                               uint32_t &startup_end, uint32_t &start_ofs, uint32_t &end_ofs) {
+    if (_next_backend == 0) {
+        return false;
+    }
+    return backends[0]->get_log_offsets_for_time(log_num, start_us, end_us, startup_end, start_ofs, end_ofs);
+}
 uint16_t DataFlash_Class::get_num_logs(void) {
     if (_next_backend == 0) {
         return 0;
@@ -572,6 +616,19 @@ void DataFlash_Class::Log_Write(const char *name, const char *labels, const char
 }
 
 
+void DataFlash_Class::Log_Write_Block_for_fmt(struct log_write_fmt *f, const void *pBuffer, const uint16_t size)
+{
+    for (uint8_t i=0; i<_next_backend; i++) {
+        if (!(f->sent_mask & (1U<<i))) {
+            if (!backends[i]->Log_Write_Emit_FMT(f->msg_type)) {
+                continue;
+            }
+            f->sent_mask |= (1U<<i);
+        }
+        backends[i]->WriteBlock(pBuffer, size);
+    }
+}
+
 DataFlash_Class::log_write_fmt *DataFlash_Class::msg_fmt_for_name(const char *name, const char *labels, const char *fmt)
 {
     struct log_write_fmt *f;
@@ -693,6 +750,7 @@ int16_t DataFlash_Class::Log_Write_calc_msg_len(const char *fmt) const
         case 'M' : len += sizeof(uint8_t); break;
         case 'N' : len += sizeof(char[16]); break;
         case 'Z' : len += sizeof(char[64]); break;
+        case 'a' : len += sizeof(int16_t[32]); break;
         case 'q' : len += sizeof(int64_t); break;
         case 'Q' : len += sizeof(uint64_t); break;
         default: return -1;
@@ -18,6 +18,7 @@
 #include <AP_RPM/AP_RPM.h>
 #include <AP_RangeFinder/AP_RangeFinder.h>
 #include <DataFlash/LogStructure.h>
+#include <DataFlash/LogFormat.h>
 #include <AP_Motors/AP_Motors.h>
 #include <AP_Rally/AP_Rally.h>
 #include <AP_Beacon/AP_Beacon.h>
@@ -32,6 +33,13 @@
 
 class DataFlash_Backend;
 
+// MAVLink COMMAND_LONG used by a GCS to fetch the part of a log
+// covering a time range.  param1 is the log id (as in LOG_REQUEST_DATA),
+// param2 and param3 the start and end of the range in seconds since
+// boot.  The log header followed by the range are then sent as
+// LOG_DATA messages.  This lives in the ArduPilot-specific command range.
+#define DATAFLASH_MAV_CMD_LOG_REQUEST_TIME_RANGE 42700
+
 enum DataFlash_Backend_Type {
     DATAFLASH_BACKEND_NONE = 0,
     DATAFLASH_BACKEND_FILE = 1,
@@ -80,6 +88,30 @@ public:
     /* Write an *important* block of data at current offset */
     void WriteCriticalBlock(const void *pBuffer, uint16_t size);
 
+    /*
+      build a message in place in the backend's write buffer.  Returns
+      a pointer into the buffer, or &fallback if the message can't be
+      built in place (more than one backend, buffer busy or wrapping),
+      in which case it is built in fallback and copied as usual by
+      commit_block().  The message must be filled in and committed
+      straight away:
+
+        struct log_FOO fallback;
+        struct log_FOO *pkt = DataFlash->reserve_block(fallback);
+        LOG_PACKET_HEADER_SET(pkt, LOG_FOO_MSG);
+        pkt->time_us = ...;
+        DataFlash->commit_block(pkt, fallback);
+     */
+    template <typename T>
+    T *reserve_block(T &fallback, bool is_critical=false) {
+        void *ret = reserve_block_ptr(sizeof(T), is_critical);
+        return ret != nullptr ? (T *)ret : &fallback;
+    }
+    template <typename T>
+    void commit_block(T *pkt, const T &fallback, bool is_critical=false) {
+        commit_block_ptr(pkt, pkt != &fallback, sizeof(T), is_critical);
+    }
+
     // high level interface
     uint16_t find_last_log() const;
     void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page);
@@ -150,6 +182,28 @@ public:
 
     void Log_Write(const char *name, const char *labels, const char *fmt, ...);
 
+    /*
+      typed variant of Log_Write.  The format is given as template
+      arguments, so the format string and message length are worked
+      out at compile time, the number of values is checked against
+      the format at compile time and the values are copied straight
+      into the message without parsing the format, e.g.:
+        Log_Write_Typed<'Q','f','B'>("TEST", "TimeUS,Val,Flag", AP_HAL::micros64(), val, flag);
+     */
+    template <char... F, typename... Args>
+    void Log_Write_Typed(const char *name, const char *labels, const Args&... args) {
+        typedef DataFlash_Format::log_format<F...> format;
+        struct log_write_fmt *f = msg_fmt_for_name(name, labels, format::fmt);
+        if (f == nullptr) {
+            // unable to map name to a messagetype
+            internal_error();
+            return;
+        }
+        uint8_t buffer[format::msg_len];
+        DataFlash_Format::pack<F...>(buffer, f->msg_type, args...);
+        Log_Write_Block_for_fmt(f, buffer, sizeof(buffer));
+    }
+
     // This structure provides information on the internal member data of a PID for logging purposes
     struct PID_Info {
         float desired;
@@ -193,6 +247,7 @@ public:
         AP_Int8 file_disarm_rot;
         AP_Int8 log_disarmed;
         AP_Int8 log_replay;
+        AP_Int16 file_index_ms;
     } _params;
 
     const struct LogStructure *structure(uint16_t num) const;
@@ -208,6 +263,7 @@ public:
     bool vehicle_is_armed() const { return _armed; }
 
     void handle_log_send(class GCS_MAVLINK &);
+    MAV_RESULT handle_log_request_time_range(class GCS_MAVLINK &, const mavlink_command_long_t &packet);
     bool in_log_download() const { return _in_log_download; }
 
 protected:
@@ -232,6 +288,9 @@ private:
 
     void internal_error() const;
 
+    void *reserve_block_ptr(uint16_t size, bool is_critical);
+    void commit_block_ptr(void *pBuffer, bool reserved, uint16_t size, bool is_critical);
+
     /*
      * support for dynamic Log_Write; user-supplies name, format,
      * labels and values in a single function call.
@@ -252,6 +311,10 @@ private:
 
     // return (possibly allocating) a log_write_fmt for a name
     struct log_write_fmt *msg_fmt_for_name(const char *name, const char *labels, const char *fmt);
+
+    // write a serialised message to each backend, emitting its FMT
+    // message first if need be
+    void Log_Write_Block_for_fmt(struct log_write_fmt *f, const void *pBuffer, uint16_t size);
     
     // returns true if msg_type is associated with a message
     bool msg_type_in_use(uint8_t msg_type) const;
@@ -276,6 +339,7 @@ private:
 #endif
 
     void Log_Write_Baro_instance(AP_Baro &baro, uint64_t time_us, uint8_t baro_instance, enum LogMessages type);
+    void Log_Write_IMU_instance(const AP_InertialSensor &ins, uint64_t time_us, uint8_t imu_instance, enum LogMessages type);
 
     void backend_starting_new_log(const DataFlash_Backend *backend);
 
@@ -324,6 +388,11 @@ private:
     // start page of log data
     uint16_t _log_data_page;
 
+    // second range of log data to send once the current one is
+    // complete (used for time range requests)
+    uint32_t _log_data_next_offset = 0;
+    uint32_t _log_data_next_remaining = 0;
+
     int8_t _log_sending_chan = -1;
 
     bool should_handle_log_message();
@@ -339,6 +408,8 @@ private:
     void get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc);
 
     int16_t get_log_data(uint16_t log_num, uint16_t page, uint32_t offset, uint16_t len, uint8_t *data);
+    bool get_log_offsets_for_time(uint16_t log_num, uint64_t start_us, uint64_t end_us,
+                                  uint32_t &startup_end, uint32_t &start_ofs, uint32_t &end_ofs);
 
     /* end support for retrieving logs via mavlink: */
 
@@ -41,6 +41,7 @@ void DataFlash_Backend::periodic_tasks()
     uint32_t now = AP_HAL::millis();
     if (now - _last_periodic_1Hz > 1000) {
         periodic_1Hz(now);
+        Log_Write_Storage_Stats();
         _last_periodic_1Hz = now;
     }
     if (now - _last_periodic_10Hz > 100) {
@@ -243,6 +244,10 @@ bool DataFlash_Backend::Log_Write(const uint8_t msg_type, va_list arg_list, bool
         case 'Z':
             charlen = 64;
             break;
+        case 'a':
+            // int16_t[32] passed as a pointer
+            charlen = sizeof(int16_t[32]);
+            break;
         case 'q': {
             int64_t tmp = va_arg(arg_list, int64_t);
             memcpy(&buffer[offset], &tmp, sizeof(int64_t));
@@ -297,6 +302,20 @@ bool DataFlash_Backend::WritePrioritisedBlock(const void *pBuffer, uint16_t size
     return _WritePrioritisedBlock(pBuffer, size, is_critical);
 }
 
+void *DataFlash_Backend::reserve_block(uint16_t size, bool is_critical)
+{
+    if (!ShouldLog()) {
+        return nullptr;
+    }
+    if (StartNewLogOK()) {
+        start_new_log();
+    }
+    if (!WritesOK()) {
+        return nullptr;
+    }
+    return _reserve_block(size, is_critical);
+}
+
 bool DataFlash_Backend::ShouldLog() const
 {
     if (!_front.WritesEnabled()) {
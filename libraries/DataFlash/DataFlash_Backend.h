@@ -37,12 +37,30 @@ public:
 
     bool WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool is_critical);
 
+    /*
+      zero-copy write support.  reserve_block() returns a pointer to
+      size contiguous bytes in the backend's write buffer, or nullptr
+      if the block can't be built in place (backend doesn't support
+      it, not enough space, the space wraps, buffer busy...), in
+      which case the caller should fall back to WritePrioritisedBlock.
+      A non-null reservation must be completed with commit_block() as
+      soon as the caller has filled in the block; no other writes to
+      the backend succeed in the meantime.
+     */
+    void *reserve_block(uint16_t size, bool is_critical);
+    virtual void commit_block(void *pBuffer, uint16_t size) { }
+
     // high level interface
     virtual uint16_t find_last_log() = 0;
     virtual void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page) = 0;
     virtual void get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc) = 0;
     virtual int16_t get_log_data(uint16_t log_num, uint16_t page, uint32_t offset, uint16_t len, uint8_t *data) = 0;
     virtual uint16_t get_num_logs() = 0;
+    // find the byte ranges of a log needed to decode the messages
+    // written between start_us and end_us.  Returns false if the
+    // backend has no index for the log
+    virtual bool get_log_offsets_for_time(uint16_t log_num, uint64_t start_us, uint64_t end_us,
+                                          uint32_t &startup_end, uint32_t &start_ofs, uint32_t &end_ofs) { return false; }
     virtual void LogReadProcess(const uint16_t list_entry,
                                 uint16_t start_page, uint16_t end_page,
                                 print_mode_fn printMode,
@@ -95,6 +113,7 @@ public:
     bool Log_Write_Mission_Cmd(const AP_Mission &mission,
                                const AP_Mission::Mission_Command &cmd);
     bool Log_Write_Mode(uint8_t mode, uint8_t reason = 0);
+    void Log_Write_Storage_Stats(void);
     bool Log_Write_Parameter(const char *name, float value);
     bool Log_Write_Parameter(const AP_Param *ap,
                              const AP_Param::ParamToken &token,
@@ -159,6 +178,7 @@ protected:
     virtual void start_new_log_reset_variables();
 
     virtual bool _WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool is_critical) = 0;
+    virtual void *_reserve_block(uint16_t size, bool is_critical) { return nullptr; }
 
     bool _initialised;
 
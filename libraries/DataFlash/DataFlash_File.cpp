@@ -46,7 +46,6 @@
 
 extern const AP_HAL::HAL& hal;
 
-#define MAX_LOG_FILES 500U
 #define DATAFLASH_PAGE_SIZE 1024UL
 
 /*
@@ -64,6 +63,15 @@ DataFlash_File::DataFlash_File(DataFlash_Class &front,
     _open_error(false),
     _log_directory(log_directory),
     _cached_oldest_log(0),
+    _catalogue(nullptr),
+    _catalogue_valid(false),
+    _catalogue_generation(0),
+    _catalogue_last_log(0),
+    _catalogue_oldest_log(0),
+    _catalogue_num_logs(0),
+    _catalogue_writing_log(0),
+    _catalogue_build_ms(0),
+    _prep_minspace_pending(false),
     _writebuf(0),
 #if defined(CONFIG_ARCH_BOARD_PX4FMU_V1)
     // V1 gets IO errors with larger than 512 byte writes
@@ -84,6 +92,9 @@ DataFlash_File::DataFlash_File(DataFlash_Class &front,
     _writebuf_chunk(4096),
 #endif
     _last_write_time(0),
+    _index_fd(-1),
+    _index_queue(64),
+    _index_batch_valid(false),
     _perf_write(hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, "DF_write")),
     _perf_fsync(hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, "DF_fsync")),
     _perf_errors(hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, "DF_errors")),
@@ -110,6 +121,11 @@ void DataFlash_File::Init()
         AP_HAL::panic("Failed to create DataFlash_File write_fd_semaphore");
         return;
     }
+    catalogue_semaphore = hal.util->new_semaphore();
+    if (catalogue_semaphore == nullptr) {
+        AP_HAL::panic("Failed to create DataFlash_File catalogue_semaphore");
+        return;
+    }
 
 #if CONFIG_HAL_BOARD == HAL_BOARD_PX4 || CONFIG_HAL_BOARD == HAL_BOARD_VRBRAIN || CONFIG_HAL_BOARD == HAL_BOARD_SITL || CONFIG_HAL_BOARD == HAL_BOARD_LINUX
     // try to cope with an existing lowercase log directory
@@ -174,6 +190,16 @@ void DataFlash_File::Init()
 
     hal.console->printf("DataFlash_File: buffer size=%u\n", (unsigned)bufsize);
 
+#if !DATAFLASH_FILE_MINIMAL
+    // without the catalogue we fall back to scanning the log
+    // directory, so only take the memory if it can be spared
+    const uint32_t catalogue_size = MAX_LOG_FILES * sizeof(struct log_catalogue_entry);
+    if (hal.util->available_memory() >= catalogue_size + DATAFLASH_FILE_CATALOGUE_MEM_MARGIN) {
+        _catalogue = (struct log_catalogue_entry *)calloc(MAX_LOG_FILES, sizeof(struct log_catalogue_entry));
+    }
+#endif
+    memset(_catalogue_exists, 0, sizeof(_catalogue_exists));
+
     _initialised = true;
     hal.scheduler->register_io_process(FUNCTOR_BIND_MEMBER(&DataFlash_File::_io_timer, void));
 }
@@ -199,6 +225,11 @@ bool DataFlash_File::file_exists(const char *filename) const
 
 bool DataFlash_File::log_exists(const uint16_t lognum) const
 {
+    if (catalogue_take()) {
+        const bool ret = catalogue_exists(lognum);
+        catalogue_semaphore->give();
+        return ret;
+    }
     char *filename = _log_file_name(lognum);
     if (filename == nullptr) {
         return false; // ?!
@@ -231,6 +262,10 @@ void DataFlash_File::periodic_1Hz(const uint32_t now)
 
 void DataFlash_File::periodic_fullrate(const uint32_t now)
 {
+    // blocks written from here on are a new batch for the index. A
+    // block written from another thread meanwhile at worst takes one
+    // more timestamp, or shares the last one
+    _index_batch_valid = false;
     DataFlash_Backend::push_log_blocks();
 }
 
@@ -308,8 +343,20 @@ uint16_t DataFlash_File::find_oldest_log()
 #if DATAFLASH_FILE_MINIMAL
     return 0;
 #else
-    if (_cached_oldest_log != 0) {
-        return _cached_oldest_log;
+    if (catalogue_take()) {
+        const uint16_t ret = _catalogue_oldest_log;
+        catalogue_semaphore->give();
+        return ret;
+    }
+    if (!catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return 0;
+    }
+    const uint16_t cached_oldest_log = _cached_oldest_log;
+    // a log created or removed while we scan makes the result stale
+    const uint16_t generation = _catalogue_generation;
+    catalogue_semaphore->give();
+    if (cached_oldest_log != 0) {
+        return cached_oldest_log;
     }
 
     uint16_t last_log_num = find_last_log();
@@ -364,23 +411,30 @@ uint16_t DataFlash_File::find_oldest_log()
         }
     }
     closedir(d);
-    _cached_oldest_log = current_oldest_log;
+    if (catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        if (generation == _catalogue_generation) {
+            _cached_oldest_log = current_oldest_log;
+        }
+        catalogue_semaphore->give();
+    }
 
     return current_oldest_log;
 #endif
 }
 
 #if !DATAFLASH_FILE_MINIMAL
-void DataFlash_File::Prep_MinSpace()
+/*
+  remove old logs until min_avail_space_percent is free.  Returns
+  false if it stopped early because the vehicle was armed
+ */
+bool DataFlash_File::Prep_MinSpace()
 {
     const uint16_t first_log_to_remove = find_oldest_log();
     if (first_log_to_remove == 0) {
         // no files to remove
-        return;
+        return true;
     }
 
-    _cached_oldest_log = 0;
-
     uint16_t log_to_remove = first_log_to_remove;
 
     uint16_t count = 0;
@@ -393,43 +447,89 @@ void DataFlash_File::Prep_MinSpace()
         if (avail >= min_avail_space_percent) {
             break;
         }
+        if (hal.util->get_soft_armed()) {
+            // we may be running on the IO thread; stop if the vehicle
+            // is armed in the meantime
+            return false;
+        }
         if (count++ > MAX_LOG_FILES+10) {
             // *way* too many deletions going on here.  Possible internal error.
             internal_error();
             break;
         }
+        if (!log_exists(log_to_remove)) {
+            // nothing to remove
+            log_to_remove++;
+            if (log_to_remove > MAX_LOG_FILES) {
+                log_to_remove = 1;
+            }
+            continue;
+        }
         char *filename_to_remove = _log_file_name(log_to_remove);
         if (filename_to_remove == nullptr) {
             internal_error();
             break;
         }
-        if (file_exists(filename_to_remove)) {
-            hal.console->printf("Removing (%s) for minimum-space requirements (%.2f%% < %.0f%%)\n",
-                                filename_to_remove, (double)avail, (double)min_avail_space_percent);
-            if (unlink(filename_to_remove) == -1) {
-                hal.console->printf("Failed to remove %s: %s\n", filename_to_remove, strerror(errno));
-                free(filename_to_remove);
-                if (errno == ENOENT) {
-                    // corruption - should always have a continuous
-                    // sequence of files...  however, there may be still
-                    // files out there, so keep going.
-                } else {
-                    internal_error();
-                    break;
-                }
+        // hold the semaphore so start_new_log() can't open this log
+        // between the check and the unlink
+        if (!catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+            free(filename_to_remove);
+            internal_error();
+            break;
+        }
+        if (log_to_remove == _catalogue_writing_log) {
+            // it is the log we are writing to
+            catalogue_semaphore->give();
+            free(filename_to_remove);
+            log_to_remove++;
+            if (log_to_remove > MAX_LOG_FILES) {
+                log_to_remove = 1;
+            }
+            continue;
+        }
+        hal.console->printf("Removing (%s) for minimum-space requirements (%.2f%% < %.0f%%)\n",
+                            filename_to_remove, (double)avail, (double)min_avail_space_percent);
+        char *index_to_remove = _log_index_file_name(log_to_remove);
+        if (index_to_remove != nullptr) {
+            // the index may legitimately not exist
+            unlink(index_to_remove);
+            free(index_to_remove);
+        }
+        if (unlink(filename_to_remove) == -1) {
+            const int saved_errno = errno;
+            catalogue_semaphore->give();
+            hal.console->printf("Failed to remove %s: %s\n", filename_to_remove, strerror(saved_errno));
+            free(filename_to_remove);
+            if (saved_errno == ENOENT) {
+                // corruption - should always have a continuous
+                // sequence of files...  however, there may be still
+                // files out there, so keep going.
+                catalogue_update(log_to_remove, false, 0);
             } else {
-                free(filename_to_remove);
+                internal_error();
+                break;
             }
+        } else {
+            catalogue_set(log_to_remove, false, 0);
+            catalogue_semaphore->give();
+            free(filename_to_remove);
         }
         log_to_remove++;
         if (log_to_remove > MAX_LOG_FILES) {
             log_to_remove = 1;
         }
     } while (log_to_remove != first_log_to_remove);
+    return true;
 }
 #endif
 
 void DataFlash_File::Prep() {
+    if (_catalogue != nullptr) {
+        // the IO thread will remove old logs once it has catalogued
+        // them, so we don't hold up boot
+        _prep_minspace_pending = true;
+        return;
+    }
     if (!NeedPrep()) {
         return;
     }
@@ -516,6 +616,22 @@ char *DataFlash_File::_lastlog_file_name(void) const
     return buf;
 }
 
+/*
+  return path name of the index sidecar for a log.  This follows
+  whichever naming (short or long) the log itself uses.
+  Note: Caller must free.
+ */
+char *DataFlash_File::_log_index_file_name(const uint16_t log_num) const
+{
+    char *buf = _log_file_name(log_num);
+    if (buf == nullptr) {
+        return nullptr;
+    }
+    // replace the trailing "BIN" with "IDX"
+    memcpy(&buf[strlen(buf)-3], "IDX", 3);
+    return buf;
+}
+
 
 // remove all log files
 void DataFlash_File::EraseAll()
@@ -531,6 +647,11 @@ void DataFlash_File::EraseAll()
         }
         unlink(fname);
         free(fname);
+        fname = _log_index_file_name(log_num);
+        if (fname != nullptr) {
+            unlink(fname);
+            free(fname);
+        }
     }
     char *fname = _lastlog_file_name();
     if (fname != nullptr) {
@@ -538,7 +659,7 @@ void DataFlash_File::EraseAll()
         free(fname);
     }
 #endif
-    _cached_oldest_log = 0;
+    catalogue_invalidate();
 
     if (was_logging) {
         start_new_log();
@@ -562,6 +683,10 @@ bool DataFlash_File::StartNewLogOK() const
     if (_open_error) {
         return false;
     }
+    if (_prep_minspace_pending && !hal.util->get_soft_armed()) {
+        // wait for the IO thread to make room for the log
+        return false;
+    }
     return DataFlash_Backend::StartNewLogOK();
 }
 
@@ -576,7 +701,24 @@ bool DataFlash_File::_WritePrioritisedBlock(const void *pBuffer, uint16_t size,
     if (!semaphore->take(1)) {
         return false;
     }
-        
+
+    if (!_write_space_ok(size, is_critical, true)) {
+        semaphore->give();
+        return false;
+    }
+
+    _writebuf.write((uint8_t*)pBuffer, size);
+    _block_written(pBuffer, size);
+    semaphore->give();
+    return true;
+}
+
+/*
+  check there is room in _writebuf for a block.  Called with
+  semaphore held.  Drops are only counted if count_drops is set
+ */
+bool DataFlash_File::_write_space_ok(const uint16_t size, const bool is_critical, const bool count_drops)
+{
     uint32_t space = _writebuf.space();
 
     if (_writing_startup_messages &&
@@ -587,30 +729,74 @@ bool DataFlash_File::_WritePrioritisedBlock(const void *pBuffer, uint16_t size,
         // things:
         if (space < non_messagewriter_message_reserved_space()) {
             // this message isn't dropped, it will be sent again...
-            semaphore->give();
             return false;
         }
     } else {
         // we reserve some amount of space for critical messages:
         if (!is_critical && space < critical_message_reserved_space()) {
-            _dropped++;
-            semaphore->give();
+            if (count_drops) {
+                _dropped++;
+            }
             return false;
         }
     }
 
     // if no room for entire message - drop it:
     if (space < size) {
-        hal.util->perf_count(_perf_overruns);
-        _dropped++;
-        semaphore->give();
+        if (count_drops) {
+            hal.util->perf_count(_perf_overruns);
+            _dropped++;
+        }
         return false;
     }
+    return true;
+}
 
-    _writebuf.write((uint8_t*)pBuffer, size);
+/*
+  account for a block which has been added to _writebuf.  Called
+  with semaphore held
+ */
+void DataFlash_File::_block_written(const void *pBuffer, const uint16_t size)
+{
+    index_note_block(pBuffer, size);
+    _index_stream_offset += size;
     df_stats_gather(size);
+}
+
+/*
+  reserve space to build a block in place in _writebuf.  Only the
+  common case of a contiguous region is handled here; anything else
+  returns nullptr and the caller goes through _WritePrioritisedBlock,
+  which also takes care of counting drops.  On success the semaphore
+  is held until commit_block()
+ */
+void *DataFlash_File::_reserve_block(const uint16_t size, const bool is_critical)
+{
+    if (!_startup_messagewriter->fmt_done() || _writing_startup_messages) {
+        // leave startup message sequencing to the normal path
+        return nullptr;
+    }
+    if (!semaphore->take_nonblocking()) {
+        return nullptr;
+    }
+    if (!_write_space_ok(size, is_critical, false)) {
+        semaphore->give();
+        return nullptr;
+    }
+    ByteBuffer::IoVec vec[2];
+    if (_writebuf.reserve(vec, size) != 1 || vec[0].len != size) {
+        // the region wraps
+        semaphore->give();
+        return nullptr;
+    }
+    return vec[0].data;
+}
+
+void DataFlash_File::commit_block(void *pBuffer, const uint16_t size)
+{
+    _writebuf.commit(size);
+    _block_written(pBuffer, size);
     semaphore->give();
-    return true;
 }
 
 /*
@@ -635,6 +821,19 @@ bool DataFlash_File::ReadBlock(void *pkt, uint16_t size)
   find the highest log number
  */
 uint16_t DataFlash_File::find_last_log()
+{
+    if (catalogue_take()) {
+        const uint16_t ret = _catalogue_last_log;
+        catalogue_semaphore->give();
+        return ret;
+    }
+    return _read_lastlog();
+}
+
+/*
+  read the last log number from lastlog.txt
+ */
+uint16_t DataFlash_File::_read_lastlog() const
 {
     unsigned ret = 0;
     char *fname = _lastlog_file_name();
@@ -663,6 +862,11 @@ uint32_t DataFlash_File::_get_log_size(const uint16_t log_num) const
 #if DATAFLASH_FILE_MINIMAL
     return 1;
 #else
+    if (catalogue_take()) {
+        const uint32_t ret = catalogue_exists(log_num) ? _catalogue[log_num-1].size : 0;
+        catalogue_semaphore->give();
+        return ret;
+    }
     char *fname = _log_file_name(log_num);
     if (fname == nullptr) {
         return 0;
@@ -683,6 +887,11 @@ uint32_t DataFlash_File::_get_log_time(const uint16_t log_num) const
 #if DATAFLASH_FILE_MINIMAL
     return 0;
 #else
+    if (catalogue_take()) {
+        const uint32_t ret = catalogue_exists(log_num) ? _catalogue[log_num-1].time_utc : 0;
+        catalogue_semaphore->give();
+        return ret;
+    }
     char *fname = _log_file_name(log_num);
     if (fname == nullptr) {
         return 0;
@@ -842,6 +1051,11 @@ void DataFlash_File::get_log_info(const uint16_t list_entry, uint32_t &size, uin
  */
 uint16_t DataFlash_File::get_num_logs()
 {
+    if (catalogue_take()) {
+        const uint16_t ret = _catalogue_num_logs;
+        catalogue_semaphore->give();
+        return ret;
+    }
     uint16_t ret = 0;
     uint16_t high = find_last_log();
     uint16_t i;
@@ -869,11 +1083,31 @@ void DataFlash_File::stop_logging(void)
 {
     // best-case effort to avoid annoying the IO thread
     const bool have_sem = write_fd_semaphore->take(1);
+    struct stat st {};
     if (_write_fd != -1) {
         int fd = _write_fd;
         _write_fd = -1;
+        if (fstat(fd, &st) != 0) {
+            st.st_mtime = 0;
+        }
+        ::close(fd);
+    }
+    if (_index_fd != -1) {
+        index_flush(AP_HAL::millis(), true);
+        int fd = _index_fd;
+        _index_fd = -1;
         ::close(fd);
     }
+    if (catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        if (_catalogue_valid && _catalogue_writing_log != 0) {
+            _catalogue[_catalogue_writing_log-1].size = _write_offset;
+            if (st.st_mtime != 0) {
+                _catalogue[_catalogue_writing_log-1].time_utc = st.st_mtime;
+            }
+        }
+        _catalogue_writing_log = 0;
+        catalogue_semaphore->give();
+    }
     if (have_sem) {
         write_fd_semaphore->give();
     } else {
@@ -910,6 +1144,11 @@ uint16_t DataFlash_File::start_new_log(void)
     }
 
     if (disk_space_avail() < _free_space_min_avail) {
+        if (_prep_minspace_pending && !hal.util->get_soft_armed()) {
+            // the IO thread is still removing old logs; try again
+            // once it has finished
+            return 0xffff;
+        }
         hal.console->printf("Out of space for logging\n");
         _open_error = true;
         return 0xffff;
@@ -932,17 +1171,29 @@ uint16_t DataFlash_File::start_new_log(void)
         _open_error = true;
         return 0xFFFF;
     }
+    // claim the log before creating it so Prep_MinSpace() on the IO
+    // thread won't remove it
+    if (!catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        write_fd_semaphore->give();
+        free(fname);
+        _open_error = true;
+        return 0xFFFF;
+    }
+    _catalogue_writing_log = log_num;
+    catalogue_semaphore->give();
 #if HAL_OS_POSIX_IO
     _write_fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0666);
 #else
     //TODO add support for mode flags
     _write_fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC);
 #endif
-    _cached_oldest_log = 0;
-
     if (_write_fd == -1) {
         _initialised = false;
         _open_error = true;
+        if (catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+            _catalogue_writing_log = 0;
+            catalogue_semaphore->give();
+        }
         write_fd_semaphore->give();
         int saved_errno = errno;
         ::printf("Log open fail for %s - %s\n",
@@ -952,9 +1203,16 @@ uint16_t DataFlash_File::start_new_log(void)
         free(fname);
         return 0xFFFF;
     }
-    free(fname);
     _write_offset = 0;
     _writebuf.clear();
+    index_open(fname);
+    free(fname);
+    // use the file's own timestamp, as the directory scan does
+    struct stat st;
+    if (fstat(_write_fd, &st) != 0) {
+        st.st_mtime = 0;
+    }
+    catalogue_update(log_num, true, st.st_mtime);
     write_fd_semaphore->give();
 
     // now update lastlog.txt with the new log number
@@ -1168,6 +1426,13 @@ void DataFlash_File::_io_timer(void)
 {
     uint32_t tnow = AP_HAL::millis();
     _io_timer_heartbeat = tnow;
+
+    // start a new index batch here too, for vehicles and tools which
+    // never call periodic_tasks()
+    _index_batch_valid = false;
+
+    catalogue_io_timer(tnow);
+
     if (_write_fd == -1 || !_initialised || _open_error) {
         return;
     }
@@ -1236,6 +1501,15 @@ void DataFlash_File::_io_timer(void)
     } else {
         _write_offset += nwritten;
         _writebuf.advance(nwritten);
+        // if we miss the semaphore the size is caught up on the next
+        // write, or when the log is closed
+        if (_catalogue_valid && catalogue_semaphore->take_nonblocking()) {
+            if (_catalogue_valid && _catalogue_writing_log != 0) {
+                _catalogue[_catalogue_writing_log-1].size = _write_offset;
+            }
+            catalogue_semaphore->give();
+        }
+        index_flush(tnow);
         /*
           the best strategy for minimizing corruption on microSD cards
           seems to be to write in 4k chunks and fsync the file on each
@@ -1256,6 +1530,441 @@ void DataFlash_File::_io_timer(void)
     hal.util->perf_end(_perf_write);
 }
 
+/*
+  log catalogue maintenance, called from the IO thread.  Carries out
+  any pending removal of old logs, then builds the catalogue if need
+  be
+ */
+void DataFlash_File::catalogue_io_timer(const uint32_t tnow)
+{
+    if (_catalogue == nullptr) {
+        return;
+    }
+#if !DATAFLASH_FILE_MINIMAL
+    // this doesn't wait for the catalogue, as the build may keep
+    // failing; without it the log directory is scanned instead
+    if (_prep_minspace_pending && !hal.util->get_soft_armed()) {
+        last_io_operation = "Prep_MinSpace";
+        // if arming interrupts the removal it is resumed once we
+        // disarm
+        if (!NeedPrep() || Prep_MinSpace()) {
+            _prep_minspace_pending = false;
+        }
+        last_io_operation = "";
+    }
+#endif
+    if (!_catalogue_valid) {
+        if (_catalogue_build_ms != 0 && tnow - _catalogue_build_ms < 1000) {
+            // don't hammer the card if the directory can't be read
+            return;
+        }
+        _catalogue_build_ms = tnow;
+        last_io_operation = "catalogue_build";
+        catalogue_build();
+        last_io_operation = "";
+    }
+}
+
+/*
+  scan _log_directory once and record the number, size and
+  modification time of each log.  Runs on the IO thread
+ */
+void DataFlash_File::catalogue_build()
+{
+#if !DATAFLASH_FILE_MINIMAL
+    if (!catalogue_semaphore->take(1)) {
+        return;
+    }
+    if (_catalogue_valid) {
+        catalogue_semaphore->give();
+        return;
+    }
+    const uint16_t generation = _catalogue_generation;
+    catalogue_semaphore->give();
+
+    // readers check _catalogue_valid under the semaphore, and only
+    // this thread makes it valid, so nobody reads the entries while
+    // we fill them in
+    memset(_catalogue, 0, MAX_LOG_FILES * sizeof(_catalogue[0]));
+    memset(_catalogue_exists, 0, sizeof(_catalogue_exists));
+
+    DIR *d = opendir(_log_directory);
+    if (d == nullptr) {
+        return;
+    }
+    for (struct dirent *de=readdir(d); de; de=readdir(d)) {
+        uint8_t length = strlen(de->d_name);
+        if (length < 5) {
+            // not long enough for \d+[.]BIN
+            continue;
+        }
+        if (strncmp(&de->d_name[length-4], ".BIN", 4)) {
+            // doesn't end in .BIN
+            continue;
+        }
+        const uint16_t thisnum = strtoul(de->d_name, nullptr, 10);
+        if (thisnum == 0 || thisnum > MAX_LOG_FILES) {
+            continue;
+        }
+        char *fname = nullptr;
+        if (asprintf(&fname, "%s/%s", _log_directory, de->d_name) == -1) {
+            continue;
+        }
+        struct stat st;
+        if (::stat(fname, &st) == 0) {
+            _catalogue[thisnum-1].size = st.st_size;
+            _catalogue[thisnum-1].time_utc = st.st_mtime;
+            _catalogue_exists[(thisnum-1)/8] |= 1U<<((thisnum-1)%8);
+        }
+        free(fname);
+    }
+    closedir(d);
+
+    const uint16_t last_log = _read_lastlog();
+
+    if (!catalogue_semaphore->take(1)) {
+        return;
+    }
+    if (generation == _catalogue_generation) {
+        _catalogue_last_log = last_log;
+        if (_catalogue_writing_log != 0) {
+            _catalogue[_catalogue_writing_log-1].size = _write_offset;
+        }
+        catalogue_recount();
+        _catalogue_valid = true;
+        _catalogue_build_ms = 0;
+    }
+    // otherwise a log was created or removed while we were scanning;
+    // scan again
+    catalogue_semaphore->give();
+#endif
+}
+
+bool DataFlash_File::catalogue_exists(const uint16_t log_num) const
+{
+    if (log_num == 0 || log_num > MAX_LOG_FILES) {
+        return false;
+    }
+    return (_catalogue_exists[(log_num-1)/8] & (1U<<((log_num-1)%8))) != 0;
+}
+
+/*
+  recalculate the oldest log and number of logs using the same rules
+  as find_oldest_log() and get_num_logs().  Called with
+  catalogue_semaphore held
+ */
+void DataFlash_File::catalogue_recount()
+{
+    _catalogue_oldest_log = 0;
+    _catalogue_num_logs = 0;
+    const uint16_t last_log = _catalogue_last_log;
+    if (last_log == 0) {
+        return;
+    }
+
+    // logs numbered above the last log were written before it
+    for (uint16_t i=last_log+1; i<=MAX_LOG_FILES; i++) {
+        if (catalogue_exists(i)) {
+            _catalogue_oldest_log = i;
+            break;
+        }
+    }
+    if (_catalogue_oldest_log == 0) {
+        for (uint16_t i=1; i<=last_log; i++) {
+            if (catalogue_exists(i)) {
+                _catalogue_oldest_log = i;
+                break;
+            }
+        }
+    }
+
+    // log numbers must be consecutive, possibly wrapping
+    uint16_t i;
+    for (i=last_log; i>0; i--) {
+        if (!catalogue_exists(i)) {
+            break;
+        }
+        _catalogue_num_logs++;
+    }
+    if (i == 0) {
+        for (i=MAX_LOG_FILES; i>last_log; i--) {
+            if (!catalogue_exists(i)) {
+                break;
+            }
+            _catalogue_num_logs++;
+        }
+    }
+}
+
+/*
+  take catalogue_semaphore if the catalogue is valid.  Returns false,
+  without the semaphore, if the caller should scan the directory
+  instead
+ */
+bool DataFlash_File::catalogue_take() const
+{
+    if (_catalogue == nullptr || !_catalogue_valid) {
+        return false;
+    }
+    if (!catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return false;
+    }
+    if (!_catalogue_valid) {
+        catalogue_semaphore->give();
+        return false;
+    }
+    return true;
+}
+
+/*
+  record the creation or removal of a log.  Creation also makes the
+  log the last log.  If the catalogue is still being built the build
+  is restarted so it can't miss the change
+ */
+void DataFlash_File::catalogue_update(const uint16_t log_num, const bool exists, const uint32_t time_utc)
+{
+    if (!catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
+    catalogue_set(log_num, exists, time_utc);
+    catalogue_semaphore->give();
+}
+
+/*
+  catalogue_update() with catalogue_semaphore already held
+ */
+void DataFlash_File::catalogue_set(const uint16_t log_num, const bool exists, const uint32_t time_utc)
+{
+    _cached_oldest_log = 0;
+    _catalogue_generation++;
+    if (_catalogue == nullptr || log_num == 0 || log_num > MAX_LOG_FILES) {
+        return;
+    }
+    if (_catalogue_valid) {
+        const uint8_t bit = 1U<<((log_num-1)%8);
+        if (exists) {
+            _catalogue_exists[(log_num-1)/8] |= bit;
+            _catalogue[log_num-1].size = 0;
+            _catalogue[log_num-1].time_utc = time_utc;
+            _catalogue_last_log = log_num;
+        } else {
+            _catalogue_exists[(log_num-1)/8] &= ~bit;
+        }
+        catalogue_recount();
+    }
+}
+
+/*
+  discard the catalogue and the cached oldest log; the IO thread will
+  rebuild the catalogue
+ */
+void DataFlash_File::catalogue_invalidate()
+{
+    if (!catalogue_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        return;
+    }
+    _cached_oldest_log = 0;
+    _catalogue_valid = false;
+    _catalogue_generation++;
+    _catalogue_build_ms = 0;
+    catalogue_semaphore->give();
+}
+
+/*
+  open the index sidecar for a log which has just been opened for
+  writing.  Called with write_fd_semaphore held.
+ */
+void DataFlash_File::index_open(const char *log_fname)
+{
+    _index_queue.clear();
+    _index_stream_offset = 0;
+    _index_last_time_us = 0;
+    _index_startup_done = false;
+    memset(_index_seen_types, 0, sizeof(_index_seen_types));
+
+    if (_front._params.file_index_ms <= 0) {
+        return;
+    }
+
+    char *fname = strdup(log_fname);
+    if (fname == nullptr) {
+        return;
+    }
+    memcpy(&fname[strlen(fname)-3], "IDX", 3);
+#if HAL_OS_POSIX_IO
+    _index_fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0666);
+#else
+    _index_fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC);
+#endif
+    free(fname);
+    if (_index_fd == -1) {
+        // not fatal; the log is still usable without an index
+        return;
+    }
+
+    const struct log_index_header hdr {
+        magic       : LOG_INDEX_MAGIC,
+        version     : LOG_INDEX_VERSION,
+        interval_ms : (uint16_t)_front._params.file_index_ms,
+    };
+    if (::write(_index_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        ::close(_index_fd);
+        _index_fd = -1;
+    }
+}
+
+/*
+  generate index entries for a block which has just been placed into
+  _writebuf at _index_stream_offset.  Called with semaphore held.
+ */
+void DataFlash_File::index_note_block(const void *pBuffer, const uint16_t size)
+{
+    if (_index_fd == -1 || size < LOG_PACKET_HEADER_LEN) {
+        return;
+    }
+    const uint8_t *buf = (const uint8_t *)pBuffer;
+    if (buf[0] != HEAD_BYTE1 || buf[1] != HEAD_BYTE2) {
+        return;
+    }
+    const uint8_t msg_type = buf[2];
+
+    // the blocks written in one pass of the main loop share one
+    // timestamp, which is well within the index interval
+    if (!_index_batch_valid) {
+        _index_batch_us = AP_HAL::micros64();
+        _index_batch_valid = true;
+    }
+    const uint64_t now_us = _index_batch_us;
+
+    if (!_index_startup_done && _startup_messagewriter->finished()) {
+        _index_startup_done = true;
+        index_push(LOG_INDEX_STARTUP_END, 0, now_us);
+    }
+
+    const uint8_t mask = 1U << (msg_type % 8);
+    if (!(_index_seen_types[msg_type / 8] & mask)) {
+        // if the queue is full we will try again with the next
+        // message of this type
+        if (_index_queue.push(log_index_entry{LOG_INDEX_FIRST_MSG, msg_type, _index_stream_offset, now_us})) {
+            _index_seen_types[msg_type / 8] |= mask;
+        }
+    }
+
+    if (now_us - _index_last_time_us >= _front._params.file_index_ms * 1000ULL) {
+        _index_last_time_us = now_us;
+        index_push(LOG_INDEX_TIME, 0, now_us);
+    }
+}
+
+void DataFlash_File::index_push(const uint8_t type, const uint8_t msg_type, const uint64_t time_us)
+{
+    // a dropped time entry only makes the index coarser
+    _index_queue.push(log_index_entry{type, msg_type, _index_stream_offset, time_us});
+}
+
+/*
+  write queued index entries out to the sidecar.  Called from the IO
+  thread with write_fd_semaphore held, or when closing the log.
+ */
+void DataFlash_File::index_flush(const uint32_t tnow, const bool force)
+{
+    if (_index_fd == -1 || _index_queue.empty()) {
+        return;
+    }
+    if (!force &&
+        _index_queue.available() < 16 &&
+        tnow - _index_last_write_ms < 1000) {
+        return;
+    }
+    _index_last_write_ms = tnow;
+
+    struct log_index_entry entries[16];
+    while (!_index_queue.empty()) {
+        uint8_t n = 0;
+        while (n < ARRAY_SIZE(entries) && _index_queue.pop(entries[n])) {
+            n++;
+        }
+        const ssize_t len = n * sizeof(entries[0]);
+        last_io_operation = "index";
+        if (::write(_index_fd, entries, len) != len) {
+            ::close(_index_fd);
+            _index_fd = -1;
+            break;
+        }
+    }
+    last_io_operation = "";
+}
+
+/*
+  use the index sidecar of a log to find the byte offsets bracketing
+  a time range.  startup_end is the end of the startup messages which
+  a reader needs to decode anything after it.
+ */
+bool DataFlash_File::get_log_offsets_for_time(const uint16_t list_entry, const uint64_t start_us, const uint64_t end_us,
+                                              uint32_t &startup_end, uint32_t &start_ofs, uint32_t &end_ofs)
+{
+    if (!_initialised || _open_error) {
+        return false;
+    }
+    const uint16_t log_num = _log_num_from_list_entry(list_entry);
+    if (log_num == 0) {
+        return false;
+    }
+    char *fname = _log_index_file_name(log_num);
+    if (fname == nullptr) {
+        return false;
+    }
+    int fd = ::open(fname, O_RDONLY|O_CLOEXEC);
+    free(fname);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct log_index_header hdr;
+    if (::read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        hdr.magic != LOG_INDEX_MAGIC ||
+        hdr.version != LOG_INDEX_VERSION) {
+        ::close(fd);
+        return false;
+    }
+
+    startup_end = 0;
+    start_ofs = 0;
+    bool have_end = false;
+
+    struct log_index_entry entries[16];
+    ssize_t nread;
+    while (!have_end && (nread = ::read(fd, entries, sizeof(entries))) > 0) {
+        const uint8_t n = nread / sizeof(entries[0]);
+        for (uint8_t i=0; i<n; i++) {
+            const struct log_index_entry &e = entries[i];
+            if (e.type == LOG_INDEX_STARTUP_END) {
+                startup_end = e.offset;
+            } else if (e.type == LOG_INDEX_TIME) {
+                if (e.time_us <= start_us) {
+                    start_ofs = e.offset;
+                } else if (e.time_us > end_us) {
+                    end_ofs = e.offset;
+                    have_end = true;
+                    break;
+                }
+            }
+        }
+    }
+    ::close(fd);
+
+    if (!have_end) {
+        end_ofs = _get_log_size(log_num);
+    }
+    if (start_ofs < startup_end) {
+        start_ofs = startup_end;
+    }
+    if (end_ofs < start_ofs) {
+        end_ofs = start_ofs;
+    }
+    return true;
+}
+
 // this sensor is enabled if we should be logging at the moment
 bool DataFlash_File::logging_enabled() const
 {
@@ -10,6 +10,7 @@
 
 #include <AP_HAL/utility/RingBuffer.h>
 #include "DataFlash_Backend.h"
+#include "LogIndex.h"
 
 #if CONFIG_HAL_BOARD == HAL_BOARD_QURT
 /*
@@ -23,6 +24,13 @@
 #define DATAFLASH_FILE_MINIMAL 0
 #endif
 
+#define MAX_LOG_FILES 500U
+
+// free memory which must remain after allocating the log catalogue
+#ifndef DATAFLASH_FILE_CATALOGUE_MEM_MARGIN
+#define DATAFLASH_FILE_CATALOGUE_MEM_MARGIN 16384
+#endif
+
 class DataFlash_File : public DataFlash_Backend
 {
 public:
@@ -44,6 +52,7 @@ public:
 
     /* Write a block of data at current offset */
     bool _WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool is_critical) override;
+    void commit_block(void *pBuffer, uint16_t size) override;
     uint32_t bufferspace_available() override;
 
     // high level interface
@@ -51,6 +60,8 @@ public:
     void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page) override;
     void get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc) override;
     int16_t get_log_data(uint16_t log_num, uint16_t page, uint32_t offset, uint16_t len, uint8_t *data) override;
+    bool get_log_offsets_for_time(uint16_t log_num, uint64_t start_us, uint64_t end_us,
+                                  uint32_t &startup_end, uint32_t &start_ofs, uint32_t &end_ofs) override;
     uint16_t get_num_logs() override;
     uint16_t start_new_log(void) override;
     void LogReadProcess(const uint16_t log_num,
@@ -81,6 +92,7 @@ protected:
 
     bool WritesOK() const override;
     bool StartNewLogOK() const override;
+    void *_reserve_block(uint16_t size, bool is_critical) override;
 
 private:
     int _write_fd;
@@ -95,8 +107,49 @@ private:
     bool io_thread_alive() const;
     uint8_t io_thread_warning_decimation_counter;
 
+    // protected by catalogue_semaphore, as both the main and IO
+    // threads look for the oldest log
     uint16_t _cached_oldest_log;
 
+    /*
+      in-memory catalogue of the logs in _log_directory so that
+      start_new_log() and the GCS log list don't have to scan the
+      directory.  It is built once by the IO thread and then updated
+      as logs are created, written and removed.  Until it is valid
+      the directory-scanning code is used instead.
+     */
+    struct log_catalogue_entry {
+        uint32_t size;
+        uint32_t time_utc;
+    };
+    struct log_catalogue_entry *_catalogue; // indexed by log_num-1
+    uint8_t _catalogue_exists[(MAX_LOG_FILES+7)/8];
+    volatile bool _catalogue_valid;
+    // incremented on every change to the set of logs; a build which
+    // overlaps a change is discarded
+    uint16_t _catalogue_generation;
+    uint16_t _catalogue_last_log;
+    uint16_t _catalogue_oldest_log;
+    uint16_t _catalogue_num_logs;
+    // log currently open for writing, 0 if none
+    uint16_t _catalogue_writing_log;
+    uint32_t _catalogue_build_ms;
+    // Prep_MinSpace to be run by the IO thread; stays set until
+    // enough space has been freed:
+    volatile bool _prep_minspace_pending;
+    // catalogue_semaphore mediates all access to the catalogue,
+    // _cached_oldest_log and _catalogue_writing_log
+    AP_HAL::Semaphore *catalogue_semaphore;
+
+    void catalogue_io_timer(uint32_t tnow);
+    void catalogue_build();
+    void catalogue_recount();
+    bool catalogue_exists(uint16_t log_num) const;
+    bool catalogue_take() const;
+    void catalogue_set(uint16_t log_num, bool exists, uint32_t time_utc);
+    void catalogue_update(uint16_t log_num, bool exists, uint32_t time_utc);
+    void catalogue_invalidate();
+
     /*
       read a block
     */
@@ -105,7 +158,7 @@ private:
     uint16_t _log_num_from_list_entry(const uint16_t list_entry);
 
     // possibly time-consuming preparations handling
-    void Prep_MinSpace();
+    bool Prep_MinSpace();
     uint16_t find_oldest_log();
     int64_t disk_space_avail();
     int64_t disk_space();
@@ -130,6 +183,8 @@ private:
     char *_log_file_name_long(const uint16_t log_num) const;
     char *_log_file_name_short(const uint16_t log_num) const;
     char *_lastlog_file_name() const;
+    uint16_t _read_lastlog() const;
+    char *_log_index_file_name(const uint16_t log_num) const;
     uint32_t _get_log_size(const uint16_t log_num) const;
     uint32_t _get_log_time(const uint16_t log_num) const;
 
@@ -137,6 +192,32 @@ private:
 
     void _io_timer(void);
 
+    bool _write_space_ok(uint16_t size, bool is_critical, bool count_drops);
+    void _block_written(const void *pBuffer, uint16_t size);
+
+    /*
+      log index sidecar support.  Index entries are generated on the
+      write path (with semaphore held) and written to the .IDX file
+      from the IO thread.
+     */
+    int _index_fd;
+    // number of bytes accepted into _writebuf since the log was opened:
+    uint32_t _index_stream_offset;
+    uint64_t _index_last_time_us;
+    uint32_t _index_last_write_ms;
+    bool _index_startup_done;
+    uint8_t _index_seen_types[32];
+    ObjectBuffer<struct log_index_entry> _index_queue;
+    // time of the blocks written since the last periodic_fullrate()
+    // or IO timer tick, taken when the first of them is written:
+    uint64_t _index_batch_us;
+    bool _index_batch_valid;
+
+    void index_open(const char *log_fname);
+    void index_note_block(const void *pBuffer, uint16_t size);
+    void index_push(uint8_t type, uint8_t msg_type, uint64_t time_us);
+    void index_flush(uint32_t tnow, bool force=false);
+
     uint32_t critical_message_reserved_space() const {
         // possibly make this a proportional to buffer size?
         uint32_t ret = 1024;
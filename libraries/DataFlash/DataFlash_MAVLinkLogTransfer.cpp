@@ -76,6 +76,7 @@ void DataFlash_Class::handle_log_request_list(GCS_MAVLINK &link, mavlink_message
 
     _log_listing = false;
     _log_sending = false;
+    _log_data_next_remaining = 0;
 
     _log_num_logs = get_num_logs();
     if (_log_num_logs == 0) {
@@ -138,6 +139,7 @@ void DataFlash_Class::handle_log_request_data(GCS_MAVLINK &link, mavlink_message
         get_log_boundaries(packet.id, _log_data_page, end);
     }
 
+    _log_data_next_remaining = 0;
     _log_data_offset = packet.ofs;
     if (_log_data_offset >= _log_data_size) {
         _log_data_remaining = 0;
@@ -153,6 +155,65 @@ void DataFlash_Class::handle_log_request_data(GCS_MAVLINK &link, mavlink_message
     handle_log_send(link);
 }
 
+/**
+   handle request for the part of a log covering a time range.  The
+   log's startup messages are sent first so the GCS can decode the
+   range, followed by the range itself.
+ */
+MAV_RESULT DataFlash_Class::handle_log_request_time_range(GCS_MAVLINK &link, const mavlink_command_long_t &packet)
+{
+    if (!should_handle_log_message()) {
+        return MAV_RESULT_TEMPORARILY_REJECTED;
+    }
+    if (_log_sending_chan >= 0) {
+        link.send_text(MAV_SEVERITY_INFO, "Log download in progress");
+        return MAV_RESULT_TEMPORARILY_REJECTED;
+    }
+
+    const uint16_t log_id = (uint16_t)packet.param1;
+    if (log_id > get_num_logs() || log_id < 1) {
+        return MAV_RESULT_FAILED;
+    }
+    if (packet.param2 < 0 || packet.param3 < packet.param2) {
+        return MAV_RESULT_FAILED;
+    }
+    const uint64_t start_us = (uint64_t)(packet.param2 * 1.0e6);
+    const uint64_t end_us = (uint64_t)(packet.param3 * 1.0e6);
+
+    uint32_t startup_end, start_ofs, end_ofs;
+    if (!get_log_offsets_for_time(log_id, start_us, end_us, startup_end, start_ofs, end_ofs)) {
+        // no index for this log
+        return MAV_RESULT_UNSUPPORTED;
+    }
+
+    _in_log_download = true;
+    _log_listing = false;
+
+    uint32_t time_utc, size;
+    get_log_info(log_id, size, time_utc);
+    _log_num_data = log_id;
+    _log_data_size = size;
+    uint16_t end;
+    get_log_boundaries(log_id, _log_data_page, end);
+
+    _log_data_offset = 0;
+    if (start_ofs <= startup_end) {
+        // the range runs straight on from the startup messages
+        _log_data_remaining = end_ofs;
+        _log_data_next_remaining = 0;
+    } else {
+        _log_data_remaining = startup_end;
+        _log_data_next_offset = start_ofs;
+        _log_data_next_remaining = end_ofs - start_ofs;
+    }
+    _log_sending = true;
+    _log_sending_chan = link.get_chan();
+
+    handle_log_send(link);
+
+    return MAV_RESULT_ACCEPTED;
+}
+
 /**
    handle request to erase log data
  */
@@ -174,6 +235,7 @@ void DataFlash_Class::handle_log_request_end(GCS_MAVLINK &link, mavlink_message_
     _in_log_download = false;
     _log_sending = false;
     _log_sending_chan = -1;
+    _log_data_next_remaining = 0;
 }
 
 /**
@@ -286,8 +348,15 @@ bool DataFlash_Class::handle_log_send_data(GCS_MAVLINK &link)
     _log_data_offset += len;
     _log_data_remaining -= len;
     if (ret < 90 || _log_data_remaining == 0) {
-        _log_sending = false;
-        _log_sending_chan = -1;
+        if (_log_data_remaining == 0 && _log_data_next_remaining != 0) {
+            // move on to the second part of a time range request
+            _log_data_offset = _log_data_next_offset;
+            _log_data_remaining = _log_data_next_remaining;
+            _log_data_next_remaining = 0;
+        } else {
+            _log_sending = false;
+            _log_sending_chan = -1;
+        }
     }
     return true;
 }
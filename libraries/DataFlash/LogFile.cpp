@@ -180,6 +180,17 @@ void DataFlash_Backend::_print_log_entry(uint8_t msg_type,
             ofs += 1;
             break;
         }
+        case 'a': {
+            int16_t v[32];
+            memcpy(&v, &pkt[ofs], sizeof(v));
+            port->printf("[");
+            for (uint8_t j=0; j<ARRAY_SIZE(v); j++) {
+                port->printf("%s%d", j?",":"", (int)v[j]);
+            }
+            port->printf("]");
+            ofs += sizeof(v);
+            break;
+        }
         default:
             ofs = msg_len;
             break;
@@ -402,76 +413,46 @@ void DataFlash_Class::Log_Write_Baro(AP_Baro &baro, uint64_t time_us)
 }
 
 // Write an raw accel/gyro data packet
+void DataFlash_Class::Log_Write_IMU_instance(const AP_InertialSensor &ins, const uint64_t time_us, const uint8_t imu_instance, const enum LogMessages type)
+{
+    const Vector3f &gyro = ins.get_gyro(imu_instance);
+    const Vector3f &accel = ins.get_accel(imu_instance);
+    // built in place in the write buffer where possible
+    struct log_IMU fallback;
+    struct log_IMU *pkt = reserve_block(fallback);
+    LOG_PACKET_HEADER_SET(pkt, type);
+    pkt->time_us      = time_us;
+    pkt->gyro_x       = gyro.x;
+    pkt->gyro_y       = gyro.y;
+    pkt->gyro_z       = gyro.z;
+    pkt->accel_x      = accel.x;
+    pkt->accel_y      = accel.y;
+    pkt->accel_z      = accel.z;
+    pkt->gyro_error   = ins.get_gyro_error_count(imu_instance);
+    pkt->accel_error  = ins.get_accel_error_count(imu_instance);
+    pkt->temperature  = ins.get_temperature(imu_instance);
+    pkt->gyro_health  = (uint8_t)ins.get_gyro_health(imu_instance);
+    pkt->accel_health = (uint8_t)ins.get_accel_health(imu_instance);
+    pkt->gyro_rate    = ins.get_gyro_rate_hz(imu_instance);
+    pkt->accel_rate   = ins.get_accel_rate_hz(imu_instance);
+    commit_block(pkt, fallback);
+}
+
 void DataFlash_Class::Log_Write_IMU(const AP_InertialSensor &ins)
 {
     uint64_t time_us = AP_HAL::micros64();
-    const Vector3f &gyro = ins.get_gyro(0);
-    const Vector3f &accel = ins.get_accel(0);
-    struct log_IMU pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_IMU_MSG),
-        time_us : time_us,
-        gyro_x  : gyro.x,
-        gyro_y  : gyro.y,
-        gyro_z  : gyro.z,
-        accel_x : accel.x,
-        accel_y : accel.y,
-        accel_z : accel.z,
-        gyro_error  : ins.get_gyro_error_count(0),
-        accel_error : ins.get_accel_error_count(0),
-        temperature : ins.get_temperature(0),
-        gyro_health : (uint8_t)ins.get_gyro_health(0),
-        accel_health : (uint8_t)ins.get_accel_health(0),
-        gyro_rate : ins.get_gyro_rate_hz(0),
-        accel_rate : ins.get_accel_rate_hz(0),
-    };
-    WriteBlock(&pkt, sizeof(pkt));
+
+    Log_Write_IMU_instance(ins, time_us, 0, LOG_IMU_MSG);
     if (ins.get_gyro_count() < 2 && ins.get_accel_count() < 2) {
         return;
     }
 
-    const Vector3f &gyro2 = ins.get_gyro(1);
-    const Vector3f &accel2 = ins.get_accel(1);
-    struct log_IMU pkt2 = {
-        LOG_PACKET_HEADER_INIT(LOG_IMU2_MSG),
-        time_us : time_us,
-        gyro_x  : gyro2.x,
-        gyro_y  : gyro2.y,
-        gyro_z  : gyro2.z,
-        accel_x : accel2.x,
-        accel_y : accel2.y,
-        accel_z : accel2.z,
-        gyro_error  : ins.get_gyro_error_count(1),
-        accel_error : ins.get_accel_error_count(1),
-        temperature : ins.get_temperature(1),
-        gyro_health : (uint8_t)ins.get_gyro_health(1),
-        accel_health : (uint8_t)ins.get_accel_health(1),
-        gyro_rate : ins.get_gyro_rate_hz(1),
-        accel_rate : ins.get_accel_rate_hz(1),
-    };
-    WriteBlock(&pkt2, sizeof(pkt2));
+    Log_Write_IMU_instance(ins, time_us, 1, LOG_IMU2_MSG);
     if (ins.get_gyro_count() < 3 && ins.get_accel_count() < 3) {
         return;
     }
-    const Vector3f &gyro3 = ins.get_gyro(2);
-    const Vector3f &accel3 = ins.get_accel(2);
-    struct log_IMU pkt3 = {
-        LOG_PACKET_HEADER_INIT(LOG_IMU3_MSG),
-        time_us : time_us,
-        gyro_x  : gyro3.x,
-        gyro_y  : gyro3.y,
-        gyro_z  : gyro3.z,
-        accel_x : accel3.x,
-        accel_y : accel3.y,
-        accel_z : accel3.z,
-        gyro_error  : ins.get_gyro_error_count(2),
-        accel_error : ins.get_accel_error_count(2),
-        temperature : ins.get_temperature(2),
-        gyro_health : (uint8_t)ins.get_gyro_health(2),
-        accel_health : (uint8_t)ins.get_accel_health(2),
-        gyro_rate : ins.get_gyro_rate_hz(2),
-        accel_rate : ins.get_accel_rate_hz(2),
-    };
-    WriteBlock(&pkt3, sizeof(pkt3));
+
+    Log_Write_IMU_instance(ins, time_us, 2, LOG_IMU3_MSG);
 }
 
 // Write an accel/gyro delta time data packet
@@ -1699,6 +1680,25 @@ void DataFlash_Class::Log_Write_Compass(const Compass &compass, uint64_t time_us
     }
 }
 
+// Write the write statistics of the storage backend, if it keeps them
+void DataFlash_Backend::Log_Write_Storage_Stats(void)
+{
+    AP_HAL::Storage::WriteStats stats;
+    if (!hal.storage->get_write_stats(stats)) {
+        return;
+    }
+    struct log_STOR pkt = {
+        LOG_PACKET_HEADER_INIT(LOG_STORAGE_MSG),
+        time_us         : AP_HAL::micros64(),
+        bytes_requested : stats.bytes_requested,
+        bytes_changed   : stats.bytes_changed,
+        bytes_flushed   : stats.bytes_flushed,
+        flushes         : stats.flushes,
+        bytes_pending   : stats.bytes_pending
+    };
+    WriteBlock(&pkt, sizeof(pkt));
+}
+
 // Write a mode packet.
 bool DataFlash_Backend::Log_Write_Mode(uint8_t mode, uint8_t reason)
 {
@@ -0,0 +1,178 @@
+/*
+  compile-time support for DataFlash message formats.
+
+  A message format is a sequence of format characters (see the
+  comment above struct LogStructure in LogStructure.h).  The helpers
+  here let the compiler, rather than the code running on the vehicle,
+  work out message lengths and serialise fields:
+
+   - log_fmt_msg_len("QffB") is a constexpr giving the length of a
+     message including the packet header, so LogStructure tables and
+     their log_* structures can be checked with static_assert.  The
+     log_* structures are still written by hand; the check ties each
+     to its format by length and number of labels only, so a field of
+     the wrong type but the same size is not caught
+
+   - DataFlash_Format::log_format<'Q','f','f','B'> carries the format
+     string and message length as compile-time constants, and
+     DataFlash_Format::pack() serialises a matching set of values
+     straight into a message buffer without parsing the format
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "LogStructure.h"
+
+/*
+  length in bytes of a single field, or 0xFF for an unknown format
+  character (which will then fail any length check)
+ */
+static constexpr uint8_t log_fmt_field_len(const char c)
+{
+    return
+        (c == 'b' || c == 'B' || c == 'M') ? 1 :
+        (c == 'h' || c == 'H' || c == 'c' || c == 'C') ? 2 :
+        (c == 'i' || c == 'I' || c == 'e' || c == 'E' || c == 'L' || c == 'f' || c == 'n') ? 4 :
+        (c == 'd' || c == 'q' || c == 'Q') ? 8 :
+        (c == 'N') ? 16 :
+        (c == 'Z' || c == 'a') ? 64 :
+        0xFF;
+}
+
+// total length of the fields described by fmt
+static constexpr uint16_t log_fmt_fields_len(const char *fmt)
+{
+    return *fmt == '\0' ? 0 : log_fmt_field_len(*fmt) + log_fmt_fields_len(fmt+1);
+}
+
+// length of a message described by fmt, including the packet header
+static constexpr uint16_t log_fmt_msg_len(const char *fmt)
+{
+    return LOG_PACKET_HEADER_LEN + log_fmt_fields_len(fmt);
+}
+
+// number of fields described by fmt
+static constexpr uint8_t log_fmt_fields_count(const char *fmt)
+{
+    return *fmt == '\0' ? 0 : 1 + log_fmt_fields_count(fmt+1);
+}
+
+// number of comma separated labels
+static constexpr uint8_t log_labels_count(const char *labels)
+{
+    return *labels == '\0' ? 1 : (*labels == ',' ? 1 : 0) + log_labels_count(labels+1);
+}
+
+// true if every entry in a LogStructure table has a msg_len which
+// matches its format string, and a label for each field
+static constexpr bool log_structures_valid(const struct LogStructure *s, const uint16_t num_types)
+{
+    return num_types == 0 ||
+        (s->msg_len == log_fmt_msg_len(s->format) &&
+         log_labels_count(s->labels) == log_fmt_fields_count(s->format) &&
+         log_structures_valid(s+1, num_types-1));
+}
+
+namespace DataFlash_Format {
+
+/*
+  per-format-character field description: the C type used to pass a
+  value and how it is stored in the message
+ */
+template <char c> struct field;
+
+template <typename T, char c>
+struct scalar_field {
+    typedef T type;
+    static const uint8_t size = sizeof(T);
+    static_assert(sizeof(T) == log_fmt_field_len(c), "field size mismatch");
+    template <typename V>
+    static uint8_t *pack(uint8_t *p, const V &v) {
+        const T tmp = v;
+        memcpy(p, &tmp, sizeof(tmp));
+        return p + sizeof(tmp);
+    }
+};
+
+template <uint8_t len, char c>
+struct char_field {
+    static const uint8_t size = len;
+    static_assert(len == log_fmt_field_len(c), "field size mismatch");
+    static uint8_t *pack(uint8_t *p, const char *v) {
+        // same semantics as the strncpy() used by Log_Write()
+        strncpy((char *)p, v, len);
+        return p + len;
+    }
+};
+
+template <> struct field<'b'> : scalar_field<int8_t,   'b'> {};
+template <> struct field<'B'> : scalar_field<uint8_t,  'B'> {};
+template <> struct field<'M'> : scalar_field<uint8_t,  'M'> {};
+template <> struct field<'h'> : scalar_field<int16_t,  'h'> {};
+template <> struct field<'c'> : scalar_field<int16_t,  'c'> {};
+template <> struct field<'H'> : scalar_field<uint16_t, 'H'> {};
+template <> struct field<'C'> : scalar_field<uint16_t, 'C'> {};
+template <> struct field<'i'> : scalar_field<int32_t,  'i'> {};
+template <> struct field<'e'> : scalar_field<int32_t,  'e'> {};
+template <> struct field<'L'> : scalar_field<int32_t,  'L'> {};
+template <> struct field<'I'> : scalar_field<uint32_t, 'I'> {};
+template <> struct field<'E'> : scalar_field<uint32_t, 'E'> {};
+template <> struct field<'f'> : scalar_field<float,    'f'> {};
+template <> struct field<'d'> : scalar_field<double,   'd'> {};
+template <> struct field<'q'> : scalar_field<int64_t,  'q'> {};
+template <> struct field<'Q'> : scalar_field<uint64_t, 'Q'> {};
+template <> struct field<'n'> : char_field<4,  'n'> {};
+template <> struct field<'N'> : char_field<16, 'N'> {};
+template <> struct field<'Z'> : char_field<64, 'Z'> {};
+
+template <> struct field<'a'> {
+    static const uint8_t size = sizeof(int16_t[32]);
+    static uint8_t *pack(uint8_t *p, const int16_t *v) {
+        memcpy(p, v, size);
+        return p + size;
+    }
+};
+
+// sum of field sizes for a list of format characters
+template <char... F> struct fields_len;
+template <> struct fields_len<> {
+    static const uint16_t value = 0;
+};
+template <char c, char... F> struct fields_len<c, F...> {
+    static const uint16_t value = field<c>::size + fields_len<F...>::value;
+};
+
+/*
+  a message format known at compile time
+ */
+template <char... F>
+struct log_format {
+    static const char fmt[sizeof...(F)+1];
+    static const uint16_t msg_len = LOG_PACKET_HEADER_LEN + fields_len<F...>::value;
+    static_assert(sizeof...(F) < sizeof(((struct LogStructure *)nullptr)->format), "too many fields");
+    static_assert(msg_len <= 255, "message too long");
+};
+template <char... F>
+const char log_format<F...>::fmt[sizeof...(F)+1] = { F..., '\0' };
+
+/*
+  serialise values for the format F into buf, which must be
+  log_format<F...>::msg_len bytes long.  The number of values must
+  match the number of fields
+ */
+template <char... F, typename... Args>
+inline void pack(uint8_t *buf, const uint8_t msg_type, const Args&... args)
+{
+    static_assert(sizeof...(F) == sizeof...(Args), "number of values does not match format");
+    buf[0] = HEAD_BYTE1;
+    buf[1] = HEAD_BYTE2;
+    buf[2] = msg_type;
+    uint8_t *p = &buf[LOG_PACKET_HEADER_LEN];
+    // expand in order; the array is just there to sequence the calls
+    const uint8_t *dummy[] = { (p = field<F>::pack(p, args))... };
+    (void)dummy;
+}
+
+} // namespace DataFlash_Format
@@ -0,0 +1,43 @@
+/*
+  on-disk format of the index sidecar written next to each
+  DataFlash_File log.  For log NN.BIN the index lives in NN.IDX and
+  consists of a log_index_header followed by a stream of
+  log_index_entry records in the order they were generated.
+
+  The index lets a reader find the byte offset of a point in time
+  without parsing the log from the start:
+   - LOG_INDEX_TIME entries are emitted every LOG_FILE_INDEX
+     milliseconds and map boot time to the offset of the first
+     message written at or after that time
+   - LOG_INDEX_FIRST_MSG entries record the offset of the first
+     message of each type in the log
+   - a single LOG_INDEX_STARTUP_END entry records where the startup
+     messages (FMT, PARM, mission etc) end; a reader seeking into the
+     log needs everything before that offset to decode it
+ */
+#pragma once
+
+#include <AP_Common/AP_Common.h>
+#include <stdint.h>
+
+#define LOG_INDEX_MAGIC   0x58494644 // "DFIX"
+#define LOG_INDEX_VERSION 1
+
+enum LogIndexEntryType {
+    LOG_INDEX_TIME        = 'T',
+    LOG_INDEX_FIRST_MSG   = 'M',
+    LOG_INDEX_STARTUP_END = 'S',
+};
+
+struct PACKED log_index_header {
+    uint32_t magic;
+    uint8_t  version;
+    uint16_t interval_ms;
+};
+
+struct PACKED log_index_entry {
+    uint8_t  type;      // LogIndexEntryType
+    uint8_t  msg_type;  // only valid for LOG_INDEX_FIRST_MSG
+    uint32_t offset;    // byte offset into the .BIN file
+    uint64_t time_us;   // AP_HAL::micros64() when the message was queued
+};
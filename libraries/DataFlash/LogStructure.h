@@ -6,6 +6,8 @@
  */
 #define LOG_PACKET_HEADER	       uint8_t head1, head2, msgid;
 #define LOG_PACKET_HEADER_INIT(id) head1 : HEAD_BYTE1, head2 : HEAD_BYTE2, msgid : id
+// for messages filled in place rather than built with an initialiser
+#define LOG_PACKET_HEADER_SET(pkt, id) do { (pkt)->head1 = HEAD_BYTE1; (pkt)->head2 = HEAD_BYTE2; (pkt)->msgid = (id); } while (0)
 #define LOG_PACKET_HEADER_LEN 3 // bytes required for LOG_PACKET_HEADER
 
 // once the logging code is all converted we will remove these from
@@ -53,6 +55,17 @@ struct PACKED log_DSF {
     uint32_t buf_space_avg;
 };
 
+// write statistics of storage backends which buffer writes
+struct PACKED log_STOR {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint32_t bytes_requested;
+    uint32_t bytes_changed;
+    uint32_t bytes_flushed;
+    uint32_t flushes;
+    uint16_t bytes_pending;
+};
+
 struct PACKED log_GPS {
     LOG_PACKET_HEADER;
     uint64_t time_us;
@@ -612,6 +625,17 @@ struct PACKED log_TERRAIN {
     uint16_t loaded;
 };
 
+/*
+  terrain cache statistics
+ */
+struct PACKED log_TERRAIN_CACHE {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint8_t size;
+    uint32_t hits;
+    uint32_t misses;
+};
+
 /*
   UBlox logging
  */
@@ -899,6 +923,31 @@ struct PACKED log_SRTL {
     float D;
 };
 
+// header for a batch of IMU samples; followed by ISBD messages
+// carrying the sample data
+struct PACKED log_ISBH {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint16_t seqno;
+    uint8_t  sensor_type; // 0 for accel, 1 for gyro
+    uint8_t  instance;
+    uint16_t multiplier;
+    uint16_t sample_count;
+    uint64_t sample_us;
+    float    sample_rate_hz;
+};
+
+// 32 samples per axis, scaled by the multiplier in the ISBH
+struct PACKED log_ISBD {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint16_t isb_seqno;
+    uint16_t seqno; // seqno within isb_seqno
+    int16_t x[32];
+    int16_t y[32];
+    int16_t z[32];
+};
+
 // #endif // SBP_HW_LOGGING
 
 #define ACC_LABELS "TimeUS,SampleUS,AccX,AccY,AccZ"
@@ -1096,6 +1145,8 @@ Format characters in the format string for binary log messages
       "XKV2","Qffffffffffff","TimeUS,V12,V13,V14,V15,V16,V17,V18,V19,V20,V21,V22,V23" }, \
     { LOG_TERRAIN_MSG, sizeof(log_TERRAIN), \
       "TERR","QBLLHffHH","TimeUS,Status,Lat,Lng,Spacing,TerrH,CHeight,Pending,Loaded" }, \
+    { LOG_TERRAIN_CACHE_MSG, sizeof(log_TERRAIN_CACHE), \
+      "TERC","QBII","TimeUS,Size,Hits,Misses" }, \
     { LOG_GPS_UBX1_MSG, sizeof(log_Ubx1), \
       "UBX1", "QBHBBH",  "TimeUS,Instance,noisePerMS,jamInd,aPower,agcCnt" }, \
     { LOG_GPS_UBX2_MSG, sizeof(log_Ubx2), \
@@ -1172,6 +1223,8 @@ Format characters in the format string for binary log messages
       "ORGN","QBLLe","TimeUS,Type,Lat,Lng,Alt" }, \
     { LOG_DF_FILE_STATS, sizeof(log_DSF), \
       "DSF", "QIBHIIII", "TimeUS,Dp,IErr,Blk,Bytes,FMn,FMx,FAv" }, \
+    { LOG_STORAGE_MSG, sizeof(log_STOR), \
+      "STOR", "QIIIIH", "TimeUS,Req,Chg,Wr,NWr,Pend" }, \
     { LOG_RPM_MSG, sizeof(log_RPM), \
       "RPM",  "Qff", "TimeUS,rpm1,rpm2" }, \
     { LOG_GIMBAL1_MSG, sizeof(log_Gimbal1), \
@@ -1185,7 +1238,11 @@ Format characters in the format string for binary log messages
     { LOG_RALLY_MSG, sizeof(log_Rally), \
       "RALY", "QBBLLh", "TimeUS,Tot,Seq,Lat,Lng,Alt" }, \
     { LOG_VISUALODOM_MSG, sizeof(log_VisualOdom), \
-      "VISO", "Qffffffff", "TimeUS,dt,AngDX,AngDY,AngDZ,PosDX,PosDY,PosDZ,conf" }
+      "VISO", "Qffffffff", "TimeUS,dt,AngDX,AngDY,AngDZ,PosDX,PosDY,PosDZ,conf" }, \
+    { LOG_ISBH_MSG, sizeof(log_ISBH), \
+      "ISBH", "QHBBHHQf", "TimeUS,N,type,instance,mul,smp_cnt,SampleUS,smp_rate" }, \
+    { LOG_ISBD_MSG, sizeof(log_ISBD), \
+      "ISBD", "QHHaaa", "TimeUS,N,seqno,x,y,z" }
 
 // #if SBP_HW_LOGGING
 #define LOG_SBP_STRUCTURES \
@@ -1327,6 +1384,10 @@ enum LogMessages {
     LOG_PROXIMITY_MSG,
     LOG_DF_FILE_STATS,
     LOG_SRTL_MSG,
+    LOG_ISBH_MSG,
+    LOG_ISBD_MSG,
+    LOG_TERRAIN_CACHE_MSG,
+    LOG_STORAGE_MSG,
 };
 
 enum LogOriginType {
@@ -0,0 +1,251 @@
+/*
+  compare the per-message cost of the varargs Log_Write() path, which
+  parses the format string for every message, with the typed path
+  which serialises using a format known at compile time.
+
+  Both paths end in the same backend WriteBlock(); the name to
+  message type lookup done by the frontend is common to both and is
+  not measured.
+
+  Also compare, at the level of DataFlash_File's write buffer,
+  building a message on the stack and copying it in with write()
+  against building it in place with reserve()/commit().
+ */
+#include <AP_gbenchmark.h>
+
+#include <DataFlash/DataFlash.h>
+#include <DataFlash/DataFlash_Backend.h>
+#include <DataFlash/DFMessageWriter.h>
+#include <AP_HAL/utility/RingBuffer.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  a backend which discards everything written to it
+ */
+class DataFlash_Null : public DataFlash_Backend
+{
+public:
+    DataFlash_Null(DataFlash_Class &front, DFMessageWriter_DFLogStart *writer) :
+        DataFlash_Backend(front, writer) {}
+
+    bool CardInserted(void) const override { return true; }
+    void EraseAll() override {}
+    bool NeedPrep() override { return false; }
+    void Prep() override {}
+    uint16_t find_last_log() override { return 0; }
+    void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page) override {}
+    void get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc) override {}
+    int16_t get_log_data(uint16_t log_num, uint16_t page, uint32_t offset, uint16_t len, uint8_t *data) override { return 0; }
+    uint16_t get_num_logs() override { return 0; }
+    void LogReadProcess(const uint16_t list_entry,
+                        uint16_t start_page, uint16_t end_page,
+                        print_mode_fn printMode,
+                        AP_HAL::BetterStream *port) override {}
+    void DumpPageInfo(AP_HAL::BetterStream *port) override {}
+    void ShowDeviceInfo(AP_HAL::BetterStream *port) override {}
+    void ListAvailableLogs(AP_HAL::BetterStream *port) override {}
+    bool logging_started(void) const override { return true; }
+    uint32_t bufferspace_available() override { return 65535; }
+    uint16_t start_new_log(void) override { return 1; }
+    void stop_logging(void) override {}
+    bool logging_enabled() const override { return true; }
+    bool logging_failed() const override { return false; }
+
+protected:
+    bool WritesOK() const override { return true; }
+    bool ReadBlock(void *pkt, uint16_t size) override { return false; }
+    bool _WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool is_critical) override {
+        gbenchmark_escape((void *)pBuffer);
+        return true;
+    }
+};
+
+static AP_Int32 log_bitmask;
+static DataFlash_Class dataflash = DataFlash_Class::create("benchmark", log_bitmask);
+static DataFlash_Null backend(dataflash, new DFMessageWriter_DFLogStart("benchmark"));
+
+#define BENCH_LABELS "TimeUS,h,dh,hdem,dhdem,spdem,sp,dsp,ith,iph,th,ph,dspdem,w,f"
+#define BENCH_FMT    "QfffffffffffffB"
+
+// message types are allocated downwards from 254 in order of first use
+static const uint8_t msg_type_varargs = 254;
+static const uint8_t msg_type_typed = 253;
+
+static bool log_write_varargs(uint8_t msg_type, ...)
+{
+    va_list arg_list;
+    va_start(arg_list, msg_type);
+    const bool ret = backend.Log_Write(msg_type, arg_list);
+    va_end(arg_list);
+    return ret;
+}
+
+static void register_formats()
+{
+    // with no backends this only allocates the message types
+    dataflash.Log_Write("BVAR", BENCH_LABELS, BENCH_FMT,
+                        (uint64_t)0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
+                        0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0);
+    dataflash.Log_Write_Typed<'Q','f','f','f','f','f','f','f','f','f','f','f','f','f','B'>(
+        "BTYP", BENCH_LABELS,
+        (uint64_t)0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0);
+}
+
+static void BM_LogWriteVarargs(benchmark::State& state)
+{
+    register_formats();
+    uint64_t now = 0;
+    float h = 1.5f;
+    uint8_t flags = 3;
+
+    while (state.KeepRunning()) {
+        bool ret = log_write_varargs(msg_type_varargs,
+                                     now++,
+                                     (double)h, (double)h, (double)h, (double)h,
+                                     (double)h, (double)h, (double)h, (double)h,
+                                     (double)h, (double)h, (double)h, (double)h,
+                                     (double)h,
+                                     flags);
+        gbenchmark_escape(&ret);
+    }
+}
+
+static void BM_LogWriteTyped(benchmark::State& state)
+{
+    register_formats();
+    uint64_t now = 0;
+    float h = 1.5f;
+    uint8_t flags = 3;
+
+    while (state.KeepRunning()) {
+        typedef DataFlash_Format::log_format<'Q','f','f','f','f','f','f','f','f','f','f','f','f','f','B'> format;
+        uint8_t buffer[format::msg_len];
+        DataFlash_Format::pack<'Q','f','f','f','f','f','f','f','f','f','f','f','f','f','B'>(
+            buffer, msg_type_typed,
+            now++,
+            h, h, h, h,
+            h, h, h, h,
+            h, h, h, h,
+            h,
+            flags);
+        bool ret = backend.WriteBlock(buffer, sizeof(buffer));
+        gbenchmark_escape(&ret);
+    }
+}
+
+/*
+  write buffer the size of DataFlash_File's default.  It is drained
+  every iteration so that the write position walks around the buffer
+  and the in-place path hits the wrap fallback as it would in use
+ */
+static ByteBuffer writebuf(16*1024);
+
+static void fill_imu(struct log_IMU *pkt, const uint64_t now, const float h)
+{
+    LOG_PACKET_HEADER_SET(pkt, LOG_IMU_MSG);
+    pkt->time_us      = now;
+    pkt->gyro_x       = h;
+    pkt->gyro_y       = h;
+    pkt->gyro_z       = h;
+    pkt->accel_x      = h;
+    pkt->accel_y      = h;
+    pkt->accel_z      = h;
+    pkt->gyro_error   = 0;
+    pkt->accel_error  = 0;
+    pkt->temperature  = h;
+    pkt->gyro_health  = 1;
+    pkt->accel_health = 1;
+    pkt->gyro_rate    = 1000;
+    pkt->accel_rate   = 1000;
+}
+
+static void BM_BufferWriteCopy(benchmark::State& state)
+{
+    uint64_t now = 0;
+    float h = 1.5f;
+
+    while (state.KeepRunning()) {
+        struct log_IMU pkt;
+        fill_imu(&pkt, now++, h);
+        writebuf.write((const uint8_t *)&pkt, sizeof(pkt));
+        writebuf.advance(sizeof(pkt));
+    }
+}
+
+static void BM_BufferWriteInPlace(benchmark::State& state)
+{
+    uint64_t now = 0;
+    float h = 1.5f;
+
+    while (state.KeepRunning()) {
+        ByteBuffer::IoVec vec[2];
+        if (writebuf.reserve(vec, sizeof(struct log_IMU)) == 1) {
+            fill_imu((struct log_IMU *)vec[0].data, now++, h);
+            writebuf.commit(sizeof(struct log_IMU));
+        } else {
+            struct log_IMU pkt;
+            fill_imu(&pkt, now++, h);
+            writebuf.write((const uint8_t *)&pkt, sizeof(pkt));
+        }
+        writebuf.advance(sizeof(struct log_IMU));
+    }
+}
+
+static int16_t samples[3][32];
+
+static void BM_BufferWriteCopyISBD(benchmark::State& state)
+{
+    uint64_t now = 0;
+
+    while (state.KeepRunning()) {
+        struct log_ISBD pkt;
+        LOG_PACKET_HEADER_SET(&pkt, LOG_ISBD_MSG);
+        pkt.time_us = now++;
+        pkt.isb_seqno = 1;
+        pkt.seqno = 2;
+        memcpy(pkt.x, samples[0], sizeof(pkt.x));
+        memcpy(pkt.y, samples[1], sizeof(pkt.y));
+        memcpy(pkt.z, samples[2], sizeof(pkt.z));
+        writebuf.write((const uint8_t *)&pkt, sizeof(pkt));
+        writebuf.advance(sizeof(pkt));
+    }
+}
+
+static void BM_BufferWriteInPlaceISBD(benchmark::State& state)
+{
+    uint64_t now = 0;
+
+    while (state.KeepRunning()) {
+        ByteBuffer::IoVec vec[2];
+        struct log_ISBD fallback;
+        struct log_ISBD *pkt = &fallback;
+        const bool in_place = writebuf.reserve(vec, sizeof(fallback)) == 1;
+        if (in_place) {
+            pkt = (struct log_ISBD *)vec[0].data;
+        }
+        LOG_PACKET_HEADER_SET(pkt, LOG_ISBD_MSG);
+        pkt->time_us = now++;
+        pkt->isb_seqno = 1;
+        pkt->seqno = 2;
+        memcpy(pkt->x, samples[0], sizeof(pkt->x));
+        memcpy(pkt->y, samples[1], sizeof(pkt->y));
+        memcpy(pkt->z, samples[2], sizeof(pkt->z));
+        if (in_place) {
+            writebuf.commit(sizeof(fallback));
+        } else {
+            writebuf.write((const uint8_t *)&fallback, sizeof(fallback));
+        }
+        writebuf.advance(sizeof(fallback));
+    }
+}
+
+BENCHMARK(BM_LogWriteVarargs);
+BENCHMARK(BM_LogWriteTyped);
+BENCHMARK(BM_BufferWriteCopy);
+BENCHMARK(BM_BufferWriteInPlace);
+BENCHMARK(BM_BufferWriteCopyISBD);
+BENCHMARK(BM_BufferWriteInPlaceISBD);
+
+BENCHMARK_MAIN()
@@ -11,6 +11,7 @@
 #include <AP_BattMonitor/AP_BattMonitor.h>
 #include <stdint.h>
 #include "MAVLink_routing.h"
+#include "MissionUploadWindow.h"
 #include <AP_SerialManager/AP_SerialManager.h>
 #include <AP_Mount/AP_Mount.h>
 #include <AP_Avoidance/AP_Avoidance.h>
@@ -27,6 +28,10 @@
 #define CHECK_PAYLOAD_SIZE(id) if (comm_get_txspace(chan) < packet_overhead()+MAVLINK_MSG_ID_ ## id ## _LEN) return false
 #define CHECK_PAYLOAD_SIZE2(id) if (!HAVE_PAYLOAD_SPACE(chan, id)) return false
 
+// size of the buffer received bytes are read into by update(); this
+// must be able to hold at least one complete frame
+#define GCS_MAVLINK_RX_BLOCK_SIZE 512
+
 //  GCS Message ID's
 /// NOTE: to ensure we never block on sending MAVLink messages
 /// please keep each MSG_ to a single MAVLink message. If need be
@@ -98,6 +103,15 @@ public:
     void        send_message(enum ap_message id);
     void        send_text(MAV_SEVERITY severity, const char *fmt, ...);
     virtual void        data_stream_send(void) = 0;
+    // bracket a batch of sends so they are written out together
+    void        send_begin();
+    void        send_end();
+    // send the vehicle's streams and any messages with an interval set
+    void        scheduled_send();
+    // bracket a pass of scheduled_send() over all channels, enabling
+    // sharing of encoded messages between channels if requested
+    static void message_cache_start(bool enable);
+    static void message_cache_stop(void);
     void        queued_param_send();
     void        queued_waypoint_send();
     void        set_snoop(void (*_msg_snoop)(const mavlink_message_t* msg)) {
@@ -260,6 +274,9 @@ protected:
     void handle_mission_count(AP_Mission &mission, mavlink_message_t *msg);
     void handle_mission_write_partial_list(AP_Mission &mission, mavlink_message_t *msg);
     bool handle_mission_item(mavlink_message_t *msg, AP_Mission &mission);
+    void mission_upload_start(uint16_t start, uint16_t last);
+    bool mission_upload_stage(AP_Mission &mission, uint16_t seq, const AP_Mission::Mission_Command &cmd);
+    bool mission_upload_commit(AP_Mission &mission);
 
     void handle_common_param_message(mavlink_message_t *msg);
     void handle_param_set(mavlink_message_t *msg);
@@ -303,6 +320,8 @@ protected:
     MAV_RESULT handle_command_camera(const mavlink_command_long_t &packet);
     MAV_RESULT handle_command_do_send_banner(const mavlink_command_long_t &packet);
     MAV_RESULT handle_command_do_set_mode(const mavlink_command_long_t &packet);
+    MAV_RESULT handle_command_set_message_interval(const mavlink_command_long_t &packet);
+    MAV_RESULT handle_command_get_message_interval(const mavlink_command_long_t &packet);
 
     // vehicle-overridable message send function
     virtual bool try_send_message(enum ap_message id);
@@ -362,6 +381,15 @@ private:
     uint32_t        waypoint_timelast_request; // milliseconds
     const uint16_t  waypoint_receive_timeout = 8000; // milliseconds
 
+    // windowed mission upload. Items from waypoint_window.start() up to
+    // MISSION_UPLOAD_WINDOW ahead are requested without waiting for
+    // each reply, and held in waypoint_stage until written to storage.
+    // waypoint_request_i is the first item not yet received
+    AP_Mission::Mission_Command *waypoint_stage;
+    MissionUploadWindow waypoint_window;    // items held in waypoint_stage
+    uint16_t        waypoint_request_next;  // next sequence number to request
+    bool            waypoint_windowed;      // upload is using the window
+
     // number of 50Hz ticks until we next send this stream
     uint8_t         stream_ticks[NUM_STREAMS];
 
@@ -371,8 +399,20 @@ private:
     // perf counters
     AP_HAL::Util::perf_counter_t _perf_packet;
     AP_HAL::Util::perf_counter_t _perf_update;
+    AP_HAL::Util::perf_counter_t _perf_send;
     char _perf_packet_name[16];
     char _perf_update_name[16];
+    char _perf_send_name[16];
+
+    // buffer for blocks of received bytes, allocated in init(). Bytes
+    // from _rx_buf_ofs up to _rx_buf_len are yet to be parsed
+    uint8_t *_rx_buf = nullptr;
+    uint16_t _rx_buf_len = 0;
+    uint16_t _rx_buf_ofs = 0;
+    // true while update() is parsing _rx_buf
+    bool _rx_buf_busy = false;
+    void receive_blocks(uint32_t tstart_us, uint32_t max_time_us);
+    void receive_bytes(uint32_t tstart_us, uint32_t max_time_us);
 
     // deferred message handling.  We size the deferred_message
     // ringbuffer so we can defer every message type
@@ -380,6 +420,66 @@ private:
     uint8_t next_deferred_message;
     uint8_t num_deferred_messages;
 
+    /*
+      messages given an interval with MAV_CMD_SET_MESSAGE_INTERVAL
+      are taken out of their stream and sent from a min-heap ordered
+      on the time each is next due.  The heap is allocated on first
+      use
+     */
+    struct interval_entry {
+        uint32_t due_ms;
+        uint32_t interval_ms;
+        enum ap_message id;
+    };
+    interval_entry *_interval_heap;
+    uint8_t _interval_heap_len;
+    // messages the streams must not send; either scheduled or disabled
+    uint64_t _interval_override_mask;
+    // stream messages held back by the transmit budget, sent once
+    // there is room for them
+    uint64_t _stream_deferred_mask;
+    // true while the vehicle's data_stream_send() is running
+    bool _sending_streams;
+    // stream whose messages data_stream_send() is sending, NUM_STREAMS if none
+    uint8_t _stream_current;
+    // the stream each message was last sent from on this channel plus
+    // one, zero if it hasn't been sent from a stream
+    uint8_t _message_stream[MSG_LAST] {};
+    // bytes used by the last send of each message on this channel, as
+    // some send more than one MAVLink message
+    uint16_t _message_bytes[MSG_LAST] {};
+
+    // transmit link measurement, used to budget lower priority messages
+    uint16_t _txspace_max;
+    uint16_t _txspace_after_send;
+    uint32_t _txspace_after_send_ms;
+    float _link_rate; // bytes per second, zero until measured
+
+    bool interval_heap_before(uint8_t a, uint8_t b) const;
+    void interval_heap_swap(uint8_t a, uint8_t b);
+    void interval_heap_sift_up(uint8_t i);
+    void interval_heap_sift_down(uint8_t i);
+    void interval_heap_push(uint32_t due_ms, uint32_t interval_ms, enum ap_message id);
+    void interval_heap_remove(enum ap_message id);
+    void update_link_rate(uint32_t now_ms);
+    uint16_t link_reserve(uint16_t reserve_ms) const;
+    bool interval_budget_ok(enum ap_message id) const;
+    bool stream_message_allowed(enum ap_message id);
+    void send_interval_messages(uint32_t now_ms);
+    void send_stream_deferred(void);
+    int32_t stream_interval_us(enum ap_message id);
+    bool try_send_message_sized(enum ap_message id);
+
+    /*
+      payloads of stream messages encoded during the current pass of
+      the streams, shared between channels
+     */
+    struct message_cache_entry;
+    static message_cache_entry *_message_cache;
+    static uint32_t _message_cache_pass;
+    static bool _message_cache_active;
+    bool try_send_message_cached(enum ap_message id);
+
     // time when we missed sending a parameter for GCS
     static uint32_t reserve_param_space_start_ms;
     
@@ -424,6 +524,57 @@ private:
     
     // send an async parameter reply
     void send_parameter_reply(void);
+
+    /*
+      MAVLink FTP server with one read-only file, holding all the
+      parameters packed by name prefix. The file is generated as it
+      is read, from AP_Param::first() and next_scalar()
+     */
+    struct param_pack {
+        AP_Param *vp;                       // next parameter to pack
+        AP_Param::ParamToken token;
+        enum ap_var_type type;
+        uint16_t index;                     // number of parameters packed
+        uint32_t ofs;                       // file offset of entry[entry_ofs]
+        uint8_t entry[6 + AP_MAX_NAME_SIZE]; // header or current entry
+        uint8_t entry_len;
+        uint8_t entry_ofs;
+        char last_name[AP_MAX_NAME_SIZE+1];
+    };
+    // position of an entry start, so reads before the current
+    // position don't have to start again from the first parameter
+    struct param_pack_checkpoint {
+        AP_Param *vp;
+        AP_Param::ParamToken token;
+        enum ap_var_type type;
+        uint16_t index;
+        uint32_t ofs;
+        char last_name[AP_MAX_NAME_SIZE+1];
+    };
+    struct {
+        bool open;
+        uint8_t session;
+        uint8_t sysid;
+        uint8_t compid;
+        uint16_t num_params;
+        uint32_t file_size;                 // exact if size_known, else an upper bound
+        bool size_known;
+        uint16_t size_num_params;           // num_params when the size was found
+        uint32_t last_request_ms;
+        bool burst;
+        uint16_t burst_seq;
+        uint32_t burst_offset;
+        struct param_pack pack;
+        struct param_pack_checkpoint *checkpoints;
+        uint8_t num_checkpoints;
+    } ftp;
+    void handle_file_transfer_protocol(const mavlink_message_t *msg);
+    void send_ftp_reply(const uint8_t *payload);
+    void send_ftp_burst(void);
+    void param_pack_restart(void);
+    void param_pack_seek(uint32_t offset);
+    bool param_pack_next_entry(void);
+    uint16_t param_pack_read(uint32_t offset, uint8_t *buf, uint16_t len);
     
     
     // a vehicle can optionally snoop on messages for other systems
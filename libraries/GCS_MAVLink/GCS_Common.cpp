@@ -68,6 +68,16 @@ GCS_MAVLINK::init(AP_HAL::UARTDriver *port, mavlink_channel_t mav_chan)
 
     snprintf(_perf_update_name, sizeof(_perf_update_name), "GCS_Update_%u", chan);
     _perf_update = hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, _perf_update_name);
+
+    snprintf(_perf_send_name, sizeof(_perf_send_name), "GCS_Send_%u", chan);
+    _perf_send = hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, _perf_send_name);
+
+    comm_init_tx(chan);
+
+    if (_rx_buf == nullptr) {
+        // without it received bytes are parsed one at a time
+        _rx_buf = new uint8_t[GCS_MAVLINK_RX_BLOCK_SIZE];
+    }
 }
 
 
@@ -158,6 +168,23 @@ GCS_MAVLINK::setup_uart(const AP_SerialManager& serial_manager, AP_SerialManager
 void
 GCS_MAVLINK::queued_waypoint_send()
 {
+    if (initialised && waypoint_receiving && waypoint_windowed) {
+        // request the items in the window we don't already have
+        const uint16_t end = MIN(waypoint_window.start() + MISSION_UPLOAD_WINDOW, waypoint_request_last);
+        while (waypoint_request_next < end && HAVE_PAYLOAD_SPACE(chan, MISSION_REQUEST)) {
+            const uint16_t seq = waypoint_request_next++;
+            if (waypoint_window.received(seq)) {
+                continue;
+            }
+            mavlink_msg_mission_request_send(
+                chan,
+                waypoint_dest_sysid,
+                waypoint_dest_compid,
+                seq,
+                MAV_MISSION_TYPE_MISSION);
+        }
+        return;
+    }
     if (initialised &&
         waypoint_receiving &&
         waypoint_request_i <= waypoint_request_last) {
@@ -361,6 +388,7 @@ void GCS_MAVLINK::handle_mission_request_list(AP_Mission &mission, mavlink_messa
 
     // set variables to help handle the expected sending of commands to the GCS
     waypoint_receiving = false;             // record that we are sending commands (i.e. not receiving)
+    waypoint_windowed = false;
     waypoint_dest_sysid = msg->sysid;       // record system id of GCS who has requested the commands
     waypoint_dest_compid = msg->compid;     // record component id of GCS who has requested the commands
 }
@@ -509,12 +537,82 @@ void GCS_MAVLINK::handle_mission_count(AP_Mission &mission, mavlink_message_t *m
     // new mission arriving, truncate mission to be the same length
     mission.truncate(packet.count);
 
+    // size the command cache for the whole mission now, rather than
+    // growing it as commands arrive
+    mission.reserve(packet.count);
+
     // set variables to help handle the expected receiving of commands from the GCS
     waypoint_timelast_receive = AP_HAL::millis();    // set time we last received commands to now
     waypoint_receiving = true;              // record that we expect to receive commands
     waypoint_request_i = 0;                 // reset the next expected command number to zero
     waypoint_request_last = packet.count;   // record how many commands we expect to receive
     waypoint_timelast_request = 0;          // set time we last requested commands to zero
+    waypoint_dest_sysid = msg->sysid;       // record system id of GCS who is sending the commands
+    waypoint_dest_compid = msg->compid;     // record component id of GCS who is sending the commands
+    mission_upload_start(0, packet.count);
+}
+
+/*
+  start a windowed mission upload of items start to last-1, if we
+  have the memory for the staging buffer. Otherwise items are requested
+  and written one at a time
+ */
+void GCS_MAVLINK::mission_upload_start(uint16_t start, uint16_t last)
+{
+    waypoint_windowed = false;
+    if (waypoint_stage == nullptr) {
+        const uint32_t needed = MISSION_UPLOAD_WINDOW * sizeof(AP_Mission::Mission_Command);
+        if (hal.util->available_memory() < needed + 4096) {
+            return;
+        }
+        waypoint_stage = new AP_Mission::Mission_Command[MISSION_UPLOAD_WINDOW];
+        if (waypoint_stage == nullptr) {
+            return;
+        }
+    }
+    waypoint_window.reset(start);
+    waypoint_request_next = start;
+    waypoint_windowed = last > start;
+}
+
+/*
+  stage a received mission item, writing the received items to
+  storage once half a window of them is contiguous or the upload is
+  complete. Returns false if writing to storage failed
+ */
+bool GCS_MAVLINK::mission_upload_stage(AP_Mission &mission, uint16_t seq, const AP_Mission::Mission_Command &cmd)
+{
+    waypoint_stage[seq - waypoint_window.start()] = cmd;
+    waypoint_window.set_received(seq);
+
+    // move past the items we now have
+    waypoint_request_i = waypoint_window.first_missing(waypoint_request_i, waypoint_request_last);
+
+    if (waypoint_request_i - waypoint_window.start() >= MISSION_UPLOAD_WINDOW/2 ||
+        waypoint_request_i >= waypoint_request_last) {
+        return mission_upload_commit(mission);
+    }
+    return true;
+}
+
+/*
+  write the contiguous staged items to storage, and slide the window
+  past them
+ */
+bool GCS_MAVLINK::mission_upload_commit(AP_Mission &mission)
+{
+    const uint16_t count = waypoint_request_i - waypoint_window.start();
+    if (count == 0) {
+        return true;
+    }
+    if (!mission.write_cmds(waypoint_window.start(), waypoint_stage, count)) {
+        return false;
+    }
+    // keep any items received beyond a gap
+    memmove(&waypoint_stage[0], &waypoint_stage[count],
+            (MISSION_UPLOAD_WINDOW - count) * sizeof(waypoint_stage[0]));
+    waypoint_window.advance(count);
+    return true;
 }
 
 /*
@@ -560,6 +658,9 @@ void GCS_MAVLINK::handle_mission_write_partial_list(AP_Mission &mission, mavlink
     waypoint_receiving   = true;
     waypoint_request_i   = packet.start_index;
     waypoint_request_last= packet.end_index;
+    waypoint_dest_sysid  = msg->sysid;
+    waypoint_dest_compid = msg->compid;
+    mission_upload_start(packet.start_index, packet.end_index);
 }
 
 
@@ -681,7 +782,17 @@ bool GCS_MAVLINK::handle_mission_item(mavlink_message_t *msg, AP_Mission &missio
     }
 
     // check if this is the requested waypoint
-    if (seq != waypoint_request_i) {
+    if (waypoint_windowed) {
+        if (seq < waypoint_request_i || waypoint_window.received(seq)) {
+            // a repeat of an item we already have, after a re-request
+            return false;
+        }
+        if (!waypoint_window.contains(seq) ||
+            seq >= waypoint_request_last) {
+            result = MAV_MISSION_INVALID_SEQUENCE;
+            goto mission_ack;
+        }
+    } else if (seq != waypoint_request_i) {
         result = MAV_MISSION_INVALID_SEQUENCE;
         goto mission_ack;
     }
@@ -694,8 +805,14 @@ bool GCS_MAVLINK::handle_mission_item(mavlink_message_t *msg, AP_Mission &missio
         }
     }
     
-    // if command index is within the existing list, replace the command
-    if (seq < mission.num_commands()) {
+    if (waypoint_windowed) {
+        // stage the command, writing it to storage with its neighbours
+        if (!mission_upload_stage(mission, seq, cmd)) {
+            result = MAV_MISSION_ERROR;
+            goto mission_ack;
+        }
+    } else if (seq < mission.num_commands()) {
+        // if command index is within the existing list, replace the command
         if (mission.replace_cmd(seq,cmd)) {
             result = MAV_MISSION_ACCEPTED;
         }else{
@@ -718,7 +835,9 @@ bool GCS_MAVLINK::handle_mission_item(mavlink_message_t *msg, AP_Mission &missio
     
     // update waypoint receiving state machine
     waypoint_timelast_receive = AP_HAL::millis();
-    waypoint_request_i++;
+    if (!waypoint_windowed) {
+        waypoint_request_i++;
+    }
     
     if (waypoint_request_i >= waypoint_request_last) {
         mavlink_msg_mission_ack_send_buf(
@@ -731,6 +850,7 @@ bool GCS_MAVLINK::handle_mission_item(mavlink_message_t *msg, AP_Mission &missio
         
         send_text(MAV_SEVERITY_INFO,"Flight plan received");
         waypoint_receiving = false;
+        waypoint_windowed = false;
         mission_is_complete = true;
         // XXX ignores waypoint radius for individual waypoints, can
         // only set WP_RADIUS parameter
@@ -761,7 +881,7 @@ mission_ack:
 void GCS_MAVLINK::push_deferred_messages()
 {
     while (num_deferred_messages != 0) {
-        if (!try_send_message(deferred_messages[next_deferred_message])) {
+        if (!try_send_message_sized(deferred_messages[next_deferred_message])) {
             break;
         }
         next_deferred_message++;
@@ -782,6 +902,10 @@ void GCS_MAVLINK::send_message(enum ap_message id)
 {
     uint8_t i, nextid;
 
+    if (_sending_streams && !stream_message_allowed(id)) {
+        return;
+    }
+
     if (id == MSG_HEARTBEAT) {
         save_signing_timestamp(false);
     }
@@ -791,7 +915,7 @@ void GCS_MAVLINK::send_message(enum ap_message id)
 
     // if there are no deferred messages, attempt to send straight away:
     if (num_deferred_messages == 0) {
-        if (try_send_message(id)) {
+        if (try_send_message_sized(id)) {
             // yay, we sent it!
             return;
         }
@@ -851,34 +975,67 @@ void GCS_MAVLINK::packetReceived(const mavlink_status_t &status,
     }
 }
 
-void
-GCS_MAVLINK::update(uint32_t max_time_us)
+/*
+  process received bytes. These are read from the port in blocks and
+  handed to the block parser. Anything not parsed, either an
+  incomplete frame at the end of a block or frames left when we run
+  out of time, is kept in the buffer for the next update
+ */
+void GCS_MAVLINK::receive_blocks(uint32_t tstart_us, uint32_t max_time_us)
 {
-    // receive new packets
+    static_assert(GCS_MAVLINK_RX_BLOCK_SIZE > MAVLINK_MAX_PACKET_LEN, "rx block too small");
     mavlink_message_t msg;
     mavlink_status_t status;
-    uint32_t tstart_us = AP_HAL::micros();
-
-    hal.util->perf_begin(_perf_update);
-
     status.packet_rx_drop_count = 0;
 
-    // process received bytes
     uint16_t nbytes = comm_get_available(chan);
-    for (uint16_t i=0; i<nbytes; i++)
-    {
-        uint8_t c = comm_receive_ch(chan);
+    while (true) {
+        while (comm_parse_block(chan, _rx_buf, _rx_buf_len, _rx_buf_ofs, &msg, &status)) {
+            hal.util->perf_begin(_perf_packet);
+            packetReceived(status, msg);
+            hal.util->perf_end(_perf_packet);
+
+            // make sure we don't spend too much time parsing mavlink messages
+            if (AP_HAL::micros() - tstart_us > max_time_us) {
+                return;
+            }
+        }
 
+        // keep the incomplete frame at the start of the buffer
+        _rx_buf_len -= _rx_buf_ofs;
+        memmove(_rx_buf, &_rx_buf[_rx_buf_ofs], _rx_buf_len);
+        _rx_buf_ofs = 0;
+
+        if (nbytes == 0) {
+            break;
+        }
+        const uint16_t nread = comm_receive_buffer(chan, &_rx_buf[_rx_buf_len], (uint16_t)MIN(nbytes, GCS_MAVLINK_RX_BLOCK_SIZE-_rx_buf_len));
+        if (nread == 0) {
+            break;
+        }
+        nbytes -= nread;
+        _rx_buf_len += nread;
+    }
+}
+
+/*
+  process received bytes one at a time
+ */
+void GCS_MAVLINK::receive_bytes(uint32_t tstart_us, uint32_t max_time_us)
+{
+    mavlink_message_t msg;
+    mavlink_status_t status;
+    status.packet_rx_drop_count = 0;
+
+    const uint16_t nbytes = comm_get_available(chan);
+    for (uint16_t i=0; i<nbytes; i++) {
         bool parsed_packet = false;
-        
-        // Try to get a new message
-        if (mavlink_parse_char(chan, c, &msg, &status)) {
+        if (mavlink_parse_char(chan, comm_receive_ch(chan), &msg, &status)) {
             hal.util->perf_begin(_perf_packet);
             packetReceived(status, msg);
             hal.util->perf_end(_perf_packet);
             parsed_packet = true;
         }
-
         if (parsed_packet || i % 100 == 0) {
             // make sure we don't spend too much time parsing mavlink messages
             if (AP_HAL::micros() - tstart_us > max_time_us) {
@@ -886,6 +1043,26 @@ GCS_MAVLINK::update(uint32_t max_time_us)
             }
         }
     }
+}
+
+void
+GCS_MAVLINK::update(uint32_t max_time_us)
+{
+    // receive new packets
+    uint32_t tstart_us = AP_HAL::micros();
+
+    hal.util->perf_begin(_perf_update);
+
+    if (_rx_buf == nullptr) {
+        receive_bytes(tstart_us, max_time_us);
+    } else if (!_rx_buf_busy) {
+        // if we have been called again while handling a message from
+        // _rx_buf, for example from a delay callback, then receiving
+        // now would handle later bytes before those still in _rx_buf
+        _rx_buf_busy = true;
+        receive_blocks(tstart_us, max_time_us);
+        _rx_buf_busy = false;
+    }
 
     if (!waypoint_receiving) {
         hal.util->perf_end(_perf_update);    
@@ -898,9 +1075,20 @@ GCS_MAVLINK::update(uint32_t max_time_us)
     // stop waypoint receiving if timeout
     if (waypoint_receiving && (tnow - waypoint_timelast_receive) > wp_recv_time+waypoint_receive_timeout) {
         waypoint_receiving = false;
+        if (waypoint_windowed) {
+            // keep the items received up to the first gap, as we
+            // would have if they had been written as they arrived
+            AP_Mission *mission = get_mission();
+            if (mission != nullptr) {
+                mission_upload_commit(*mission);
+            }
+            waypoint_windowed = false;
+        }
     } else if (waypoint_receiving &&
                (tnow - waypoint_timelast_request) > wp_recv_time) {
         waypoint_timelast_request = tnow;
+        // re-request the items in the window we are missing
+        waypoint_request_next = waypoint_request_i;
         send_message(MSG_NEXT_WAYPOINT);
     }
 
@@ -1231,11 +1419,30 @@ void GCS::send_message(enum ap_message id)
     }
 }
 
+/*
+  the messages sent by each of retry_deferred() and
+  data_stream_send() on a channel are collected and written to the
+  port together
+ */
+void GCS_MAVLINK::send_begin()
+{
+    hal.util->perf_begin(_perf_send);
+    comm_cork(chan);
+}
+
+void GCS_MAVLINK::send_end()
+{
+    comm_uncork(chan);
+    hal.util->perf_end(_perf_send);
+}
+
 void GCS::retry_deferred()
 {
     for (uint8_t i=0; i<num_gcs(); i++) {
         if (chan(i).initialised) {
+            chan(i).send_begin();
             chan(i).retry_deferred();
+            chan(i).send_end();
         }
     }
     service_statustext();
@@ -1243,11 +1450,23 @@ void GCS::retry_deferred()
 
 void GCS::data_stream_send()
 {
+    uint8_t active = 0;
     for (uint8_t i=0; i<num_gcs(); i++) {
         if (chan(i).initialised) {
-            chan(i).data_stream_send();
+            active++;
         }
     }
+    // with several channels, messages encoded for one channel are
+    // re-used by the others in the same pass
+    GCS_MAVLINK::message_cache_start(active > 1);
+    for (uint8_t i=0; i<num_gcs(); i++) {
+        if (chan(i).initialised) {
+            chan(i).send_begin();
+            chan(i).scheduled_send();
+            chan(i).send_end();
+        }
+    }
+    GCS_MAVLINK::message_cache_stop();
 }
 
 void GCS::update(void)
@@ -1953,6 +2172,10 @@ void GCS_MAVLINK::handle_common_message(mavlink_message_t *msg)
         handle_serial_control(msg);
         break;
 
+    case MAVLINK_MSG_ID_FILE_TRANSFER_PROTOCOL:
+        handle_file_transfer_protocol(msg);
+        break;
+
     case MAVLINK_MSG_ID_GPS_RTCM_DATA:
         /* fall through */
     case MAVLINK_MSG_ID_GPS_INPUT:
@@ -2172,6 +2395,14 @@ MAV_RESULT GCS_MAVLINK::handle_command_long_message(mavlink_command_long_t &pack
         break;
     }
 
+    case MAV_CMD_SET_MESSAGE_INTERVAL:
+        result = handle_command_set_message_interval(packet);
+        break;
+
+    case MAV_CMD_GET_MESSAGE_INTERVAL:
+        result = handle_command_get_message_interval(packet);
+        break;
+
     case MAV_CMD_PREFLIGHT_SET_SENSOR_OFFSETS: {
         result = handle_command_preflight_set_sensor_offsets(packet);
         break;
@@ -2192,6 +2423,10 @@ MAV_RESULT GCS_MAVLINK::handle_command_long_message(mavlink_command_long_t &pack
         result = handle_flight_termination(packet);
         break;
 
+    case DATAFLASH_MAV_CMD_LOG_REQUEST_TIME_RANGE:
+        result = DataFlash_Class::instance()->handle_log_request_time_range(*this, packet);
+        break;
+
     default:
         result = MAV_RESULT_UNSUPPORTED;
         break;
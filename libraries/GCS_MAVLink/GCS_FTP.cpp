@@ -0,0 +1,439 @@
+/*
+   GCS MAVLink functions related to MAVLink FTP
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  A minimal read-only MAVLink FTP server, used to let a GCS fetch all
+  parameters as one packed file instead of a PARAM_VALUE message per
+  parameter.
+
+  The only file is @PARAM/param.pck. It starts with a header of three
+  uint16_t: the magic 0x671b, the number of parameters in the file and
+  the total number of parameters. Each parameter follows as:
+
+    uint8_t  type         ap_var_type in the low 4 bits
+    uint8_t  name_lens    low 4 bits: length of the prefix shared with
+                          the previous name, high 4 bits: length of
+                          the rest of the name, less one
+    char     name[]       the rest of the name
+    value                1, 2 or 4 bytes, little endian, by type
+
+  Parameters are in AP_Param::first()/next_scalar() order, the same
+  order as PARAM_VALUE indexes. The file is generated as it is read,
+  so a sequential read costs one step of the parameter walk per
+  parameter. The position is saved every 1/FTP_PARAM_CHECKPOINTS of
+  the parameters, so a read before the current position (such as a
+  retry of a lost burst packet) walks from the nearest checkpoint
+  rather than from the first parameter.
+
+  The exact size is only known once the file has been read to the
+  end. Until then the size given when the file is opened is an upper
+  bound, and a read past the real end gets an EOF NAK.
+ */
+
+#include "GCS.h"
+
+extern const AP_HAL::HAL& hal;
+
+#define FTP_PARAM_FILE "@PARAM/param.pck"
+#define FTP_PARAM_MAGIC 0x671b
+
+// close a session not used for this long
+#define FTP_SESSION_TIMEOUT_MS 10000
+
+// number of saved positions in the parameter file
+#define FTP_PARAM_CHECKPOINTS 8
+
+#define FTP_PARAM_HEADER_LEN 6
+// largest entry: type, name lengths, name and a 4 byte value
+#define FTP_PARAM_ENTRY_MAX (2 + AP_MAX_NAME_SIZE + 4)
+
+// layout of the FILE_TRANSFER_PROTOCOL payload
+#define FTP_SEQ             0
+#define FTP_SESSION         2
+#define FTP_OPCODE          3
+#define FTP_SIZE            4
+#define FTP_REQ_OPCODE      5
+#define FTP_BURST_COMPLETE  6
+#define FTP_OFFSET          8
+#define FTP_DATA            12
+#define FTP_DATA_MAX        (MAVLINK_MSG_FILE_TRANSFER_PROTOCOL_FIELD_PAYLOAD_LEN - FTP_DATA)
+
+enum ftp_opcode {
+    FTP_OP_NONE             = 0,
+    FTP_OP_TERMINATE        = 1,
+    FTP_OP_RESET_SESSIONS   = 2,
+    FTP_OP_OPEN_FILE_RO     = 4,
+    FTP_OP_READ_FILE        = 5,
+    FTP_OP_BURST_READ_FILE  = 15,
+    FTP_OP_ACK              = 128,
+    FTP_OP_NAK              = 129,
+};
+
+enum ftp_error {
+    FTP_ERR_FAIL            = 1,
+    FTP_ERR_INVALID_SESSION = 4,
+    FTP_ERR_EOF             = 6,
+    FTP_ERR_UNKNOWN_COMMAND = 7,
+    FTP_ERR_FILE_NOT_FOUND  = 10,
+};
+
+static uint8_t param_value_size(enum ap_var_type type)
+{
+    switch (type) {
+    case AP_PARAM_INT8:
+        return 1;
+    case AP_PARAM_INT16:
+        return 2;
+    case AP_PARAM_INT32:
+    case AP_PARAM_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/*
+  start generating the file from the beginning
+ */
+void GCS_MAVLINK::param_pack_restart(void)
+{
+    struct param_pack &pack = ftp.pack;
+    const uint16_t header[3] = { FTP_PARAM_MAGIC, ftp.num_params, ftp.num_params };
+    static_assert(sizeof(header) == FTP_PARAM_HEADER_LEN, "header size");
+    memcpy(pack.entry, header, sizeof(header));
+    pack.entry_len = sizeof(header);
+    pack.entry_ofs = 0;
+    pack.ofs = 0;
+    pack.index = 0;
+    pack.last_name[0] = 0;
+    pack.vp = AP_Param::first(&pack.token, &pack.type);
+}
+
+/*
+  move to the nearest saved position at or before offset, if it is
+  nearer than the current position
+ */
+void GCS_MAVLINK::param_pack_seek(uint32_t offset)
+{
+    struct param_pack &pack = ftp.pack;
+    uint8_t i = ftp.num_checkpoints;
+    while (i > 0 && ftp.checkpoints[i-1].ofs > offset) {
+        i--;
+    }
+    if (i == 0) {
+        if (offset < pack.ofs) {
+            param_pack_restart();
+        }
+        return;
+    }
+    const struct param_pack_checkpoint &c = ftp.checkpoints[i-1];
+    if (offset >= pack.ofs && c.ofs <= pack.ofs) {
+        // carrying on from here is no further
+        return;
+    }
+    pack.vp = c.vp;
+    pack.token = c.token;
+    pack.type = c.type;
+    pack.index = c.index;
+    pack.ofs = c.ofs;
+    pack.entry_len = 0;
+    pack.entry_ofs = 0;
+    memcpy(pack.last_name, c.last_name, sizeof(pack.last_name));
+}
+
+/*
+  pack the next parameter into the entry buffer. Returns false at the
+  end of the file
+ */
+bool GCS_MAVLINK::param_pack_next_entry(void)
+{
+    struct param_pack &pack = ftp.pack;
+
+    // save the position every 1/FTP_PARAM_CHECKPOINTS of the parameters
+    if (ftp.checkpoints != nullptr &&
+        ftp.num_checkpoints < FTP_PARAM_CHECKPOINTS &&
+        pack.vp != nullptr &&
+        pack.index >= (ftp.num_checkpoints+1) * (uint32_t)ftp.num_params / (FTP_PARAM_CHECKPOINTS+1)) {
+        struct param_pack_checkpoint &c = ftp.checkpoints[ftp.num_checkpoints++];
+        c.vp = pack.vp;
+        c.token = pack.token;
+        c.type = pack.type;
+        c.index = pack.index;
+        c.ofs = pack.ofs;
+        memcpy(c.last_name, pack.last_name, sizeof(c.last_name));
+    }
+
+    while (pack.vp != nullptr) {
+        AP_Param *vp = pack.vp;
+        const enum ap_var_type type = pack.type;
+        const AP_Param::ParamToken token = pack.token;
+        pack.vp = AP_Param::next_scalar(&pack.token, &pack.type);
+        pack.index++;
+
+        const uint8_t value_size = param_value_size(type);
+        if (value_size == 0) {
+            continue;
+        }
+        char name[AP_MAX_NAME_SIZE+1];
+        vp->copy_name_token(token, name, sizeof(name), true);
+        name[AP_MAX_NAME_SIZE] = 0;
+        const uint8_t name_len = strlen(name);
+        if (name_len == 0) {
+            continue;
+        }
+
+        uint8_t common = 0;
+        while (common < name_len-1 && common < 15 && name[common] == pack.last_name[common]) {
+            common++;
+        }
+        const uint8_t suffix_len = name_len - common;
+
+        uint8_t *p = pack.entry;
+        *p++ = type;
+        *p++ = common | ((suffix_len-1) << 4);
+        memcpy(p, &name[common], suffix_len);
+        p += suffix_len;
+        switch (type) {
+        case AP_PARAM_INT8: {
+            const int8_t v = ((AP_Int8 *)vp)->get();
+            memcpy(p, &v, 1);
+            break;
+        }
+        case AP_PARAM_INT16: {
+            const int16_t v = ((AP_Int16 *)vp)->get();
+            memcpy(p, &v, 2);
+            break;
+        }
+        case AP_PARAM_INT32: {
+            const int32_t v = ((AP_Int32 *)vp)->get();
+            memcpy(p, &v, 4);
+            break;
+        }
+        default: {
+            const float v = ((AP_Float *)vp)->get();
+            memcpy(p, &v, 4);
+            break;
+        }
+        }
+        p += value_size;
+
+        pack.entry_len = p - pack.entry;
+        pack.entry_ofs = 0;
+        memcpy(pack.last_name, name, name_len+1);
+        return true;
+    }
+
+    // at the end of the file, so now we know its size
+    ftp.file_size = pack.ofs;
+    ftp.size_known = true;
+    ftp.size_num_params = ftp.num_params;
+    return false;
+}
+
+/*
+  read from the file. Sequential reads carry on from where the last
+  read ended, anything else starts from the nearest saved position
+ */
+uint16_t GCS_MAVLINK::param_pack_read(uint32_t offset, uint8_t *buf, uint16_t len)
+{
+    struct param_pack &pack = ftp.pack;
+    param_pack_seek(offset);
+    // skip to the offset
+    while (pack.ofs < offset) {
+        if (pack.entry_ofs == pack.entry_len && !param_pack_next_entry()) {
+            return 0;
+        }
+        const uint32_t n = MIN(offset - pack.ofs, (uint32_t)(pack.entry_len - pack.entry_ofs));
+        pack.entry_ofs += n;
+        pack.ofs += n;
+    }
+    uint16_t done = 0;
+    while (done < len) {
+        if (pack.entry_ofs == pack.entry_len && !param_pack_next_entry()) {
+            break;
+        }
+        const uint16_t n = MIN(len - done, pack.entry_len - pack.entry_ofs);
+        memcpy(&buf[done], &pack.entry[pack.entry_ofs], n);
+        pack.entry_ofs += n;
+        pack.ofs += n;
+        done += n;
+    }
+    return done;
+}
+
+void GCS_MAVLINK::send_ftp_reply(const uint8_t *payload)
+{
+    if (!HAVE_PAYLOAD_SPACE(chan, FILE_TRANSFER_PROTOCOL)) {
+        // the GCS will retry
+        return;
+    }
+    mavlink_msg_file_transfer_protocol_send(chan, 0, ftp.sysid, ftp.compid, payload);
+}
+
+/*
+  handle a FILE_TRANSFER_PROTOCOL request
+ */
+void GCS_MAVLINK::handle_file_transfer_protocol(const mavlink_message_t *msg)
+{
+    mavlink_file_transfer_protocol_t packet;
+    mavlink_msg_file_transfer_protocol_decode(msg, &packet);
+    if (packet.target_system != mavlink_system.sysid) {
+        return;
+    }
+    const uint8_t *req = packet.payload;
+
+    uint8_t reply[MAVLINK_MSG_FILE_TRANSFER_PROTOCOL_FIELD_PAYLOAD_LEN] {};
+    uint16_t seq;
+    memcpy(&seq, &req[FTP_SEQ], 2);
+    seq++;
+    memcpy(&reply[FTP_SEQ], &seq, 2);
+    reply[FTP_SESSION] = req[FTP_SESSION];
+    reply[FTP_OPCODE] = FTP_OP_ACK;
+    reply[FTP_REQ_OPCODE] = req[FTP_OPCODE];
+    memcpy(&reply[FTP_OFFSET], &req[FTP_OFFSET], 4);
+
+    uint32_t offset;
+    memcpy(&offset, &req[FTP_OFFSET], 4);
+
+    ftp.sysid = msg->sysid;
+    ftp.compid = msg->compid;
+    ftp.last_request_ms = AP_HAL::millis();
+
+    uint8_t error = 0;
+    switch (req[FTP_OPCODE]) {
+    case FTP_OP_NONE:
+        break;
+
+    case FTP_OP_TERMINATE:
+    case FTP_OP_RESET_SESSIONS:
+        ftp.open = false;
+        ftp.burst = false;
+        break;
+
+    case FTP_OP_OPEN_FILE_RO: {
+        const uint8_t len = MIN(req[FTP_SIZE], FTP_DATA_MAX);
+        if (len != strlen(FTP_PARAM_FILE) ||
+            strncmp((const char *)&req[FTP_DATA], FTP_PARAM_FILE, len) != 0) {
+            error = FTP_ERR_FILE_NOT_FOUND;
+            break;
+        }
+        ftp.num_params = AP_Param::count_parameters();
+        if (!ftp.size_known || ftp.size_num_params != ftp.num_params) {
+            // the size is found when a read reaches the end of the file
+            ftp.size_known = false;
+            ftp.file_size = FTP_PARAM_HEADER_LEN + ftp.num_params * (uint32_t)FTP_PARAM_ENTRY_MAX;
+        }
+        if (ftp.checkpoints == nullptr &&
+            hal.util->available_memory() > FTP_PARAM_CHECKPOINTS * sizeof(struct param_pack_checkpoint) + 4096) {
+            ftp.checkpoints = new param_pack_checkpoint[FTP_PARAM_CHECKPOINTS];
+        }
+        ftp.num_checkpoints = 0;
+        param_pack_restart();
+        ftp.open = true;
+        ftp.burst = false;
+        ftp.session++;
+        reply[FTP_SESSION] = ftp.session;
+        reply[FTP_SIZE] = sizeof(ftp.file_size);
+        memcpy(&reply[FTP_DATA], &ftp.file_size, sizeof(ftp.file_size));
+        break;
+    }
+
+    case FTP_OP_READ_FILE:
+        if (!ftp.open || req[FTP_SESSION] != ftp.session) {
+            error = FTP_ERR_INVALID_SESSION;
+            break;
+        }
+        if (offset >= ftp.file_size) {
+            error = FTP_ERR_EOF;
+            break;
+        }
+        reply[FTP_SIZE] = param_pack_read(offset, &reply[FTP_DATA], MIN(req[FTP_SIZE], FTP_DATA_MAX));
+        if (reply[FTP_SIZE] == 0) {
+            // past the end, which was not known when the file was opened
+            error = FTP_ERR_EOF;
+        }
+        break;
+
+    case FTP_OP_BURST_READ_FILE:
+        if (!ftp.open || req[FTP_SESSION] != ftp.session) {
+            error = FTP_ERR_INVALID_SESSION;
+            break;
+        }
+        if (offset >= ftp.file_size) {
+            error = FTP_ERR_EOF;
+            break;
+        }
+        // the data is sent with the parameter stream
+        ftp.burst = true;
+        ftp.burst_seq = seq;
+        ftp.burst_offset = offset;
+        return;
+
+    default:
+        error = FTP_ERR_UNKNOWN_COMMAND;
+        break;
+    }
+
+    if (error != 0) {
+        reply[FTP_OPCODE] = FTP_OP_NAK;
+        reply[FTP_SIZE] = 1;
+        reply[FTP_DATA] = error;
+    }
+    send_ftp_reply(reply);
+}
+
+/*
+  send the next packets of a burst read, called from the parameter
+  stream
+ */
+void GCS_MAVLINK::send_ftp_burst(void)
+{
+    if (!ftp.burst) {
+        return;
+    }
+    if (!ftp.open || AP_HAL::millis() - ftp.last_request_ms > FTP_SESSION_TIMEOUT_MS) {
+        ftp.open = false;
+        ftp.burst = false;
+        return;
+    }
+
+    // without flow control keep to one packet per call, as the
+    // parameter stream does
+    uint8_t count = have_flow_control() ? 8 : 1;
+    const uint32_t tstart = AP_HAL::micros();
+    while (count-- && HAVE_PAYLOAD_SPACE(chan, FILE_TRANSFER_PROTOCOL)) {
+        uint8_t reply[MAVLINK_MSG_FILE_TRANSFER_PROTOCOL_FIELD_PAYLOAD_LEN] {};
+        memcpy(&reply[FTP_SEQ], &ftp.burst_seq, 2);
+        reply[FTP_SESSION] = ftp.session;
+        reply[FTP_OPCODE] = FTP_OP_ACK;
+        reply[FTP_REQ_OPCODE] = FTP_OP_BURST_READ_FILE;
+        memcpy(&reply[FTP_OFFSET], &ftp.burst_offset, 4);
+        const uint16_t n = param_pack_read(ftp.burst_offset, &reply[FTP_DATA], FTP_DATA_MAX);
+        reply[FTP_SIZE] = n;
+        ftp.burst_offset += n;
+        if (n == 0 || ftp.burst_offset >= ftp.file_size) {
+            reply[FTP_BURST_COMPLETE] = 1;
+            ftp.burst = false;
+        }
+        mavlink_msg_file_transfer_protocol_send(chan, 0, ftp.sysid, ftp.compid, reply);
+        ftp.burst_seq++;
+        if (!ftp.burst || AP_HAL::micros() - tstart > 1000) {
+            // don't use more than 1ms per call
+            break;
+        }
+    }
+}
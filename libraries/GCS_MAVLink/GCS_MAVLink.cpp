@@ -26,6 +26,8 @@ This provides some support code and variables for MAVLink enabled sketches
 #include <AP_GPS/AP_GPS.h>
 #include <AP_HAL/AP_HAL.h>
 
+#include <stdio.h>
+
 
 #ifdef MAVLINK_SEPARATE_HELPERS
 // Shut up warnings about missing declarations; TODO: should be fixed on
@@ -36,6 +38,8 @@ This provides some support code and variables for MAVLink enabled sketches
 #pragma GCC diagnostic pop
 #endif
 
+extern const AP_HAL::HAL& hal;
+
 AP_HAL::UARTDriver	*mavlink_comm_port[MAVLINK_COMM_NUM_BUFFERS];
 
 mavlink_system_t mavlink_system = {7,1};
@@ -43,6 +47,34 @@ mavlink_system_t mavlink_system = {7,1};
 // mask of serial ports disabled to allow for SERIAL_CONTROL
 static uint8_t mavlink_locked_mask;
 
+// size of each channel's transmit coalescing buffer
+#define COMM_TX_BUFFER_SIZE 512
+
+static_assert(COMM_TX_BUFFER_SIZE >= MAVLINK_MAX_PACKET_LEN, "tx buffer too small");
+
+// per-channel transmit coalescing state
+static struct comm_tx {
+    uint8_t *buf;
+    uint16_t len;
+    // corked by comm_cork():
+    bool corked;
+    // collecting the pieces of a single message:
+    bool in_message;
+    // number of writes so far of the current message
+    uint8_t msg_writes;
+    // payload capture by comm_capture_begin():
+    uint8_t *capture_buf;
+    uint8_t capture_size;
+    uint8_t capture_len;
+    uint8_t capture_msgs;
+    bool capture_ok;
+    uint32_t capture_msgid;
+    AP_HAL::Util::perf_counter_t perf_msgs;
+    AP_HAL::Util::perf_counter_t perf_writes;
+    char perf_msgs_name[16];
+    char perf_writes_name[16];
+} comm_tx[MAVLINK_COMM_NUM_BUFFERS];
+
 // routing table
 MAVLink_routing GCS_MAVLINK::routing;
 
@@ -99,6 +131,26 @@ uint8_t comm_receive_ch(mavlink_channel_t chan)
     return (uint8_t)mavlink_comm_port[chan]->read();
 }
 
+/// Read up to len bytes from the nominated MAVLink channel
+///
+/// @param chan		Channel to receive on
+/// @param buf		Buffer to read into
+/// @param len		Size of buf
+/// @returns		Number of bytes read
+///
+uint16_t comm_receive_buffer(mavlink_channel_t chan, uint8_t *buf, uint16_t len)
+{
+    if (!valid_channel(chan)) {
+        return 0;
+    }
+
+    const ssize_t ret = mavlink_comm_port[chan]->read_buffer(buf, len);
+    if (ret < 0) {
+        return 0;
+    }
+    return (uint16_t)ret;
+}
+
 /// Check for available transmit space on the nominated MAVLink channel
 ///
 /// @param chan		Channel to check
@@ -112,6 +164,11 @@ uint16_t comm_get_txspace(mavlink_channel_t chan)
         return 0;
     }
 	int16_t ret = mavlink_comm_port[chan]->txspace();
+    // allow for bytes waiting to be written. Only the main thread
+    // uses the transmit buffer
+    if (hal.scheduler->in_main_thread()) {
+        ret -= comm_tx[chan].len;
+    }
 	if (ret < 0) {
 		ret = 0;
 	}
@@ -137,6 +194,76 @@ uint16_t comm_get_available(mavlink_channel_t chan)
     return (uint16_t)bytes;
 }
 
+/*
+  write out any bytes collected for a channel
+ */
+static void comm_tx_flush(mavlink_channel_t chan)
+{
+    struct comm_tx &tx = comm_tx[chan];
+    if (tx.len == 0) {
+        return;
+    }
+    mavlink_comm_port[chan]->write(tx.buf, tx.len);
+    hal.util->perf_count(tx.perf_writes);
+    tx.len = 0;
+}
+
+/*
+  note the message ID and payload of a message being captured. The
+  MAVLink library writes each message as header, payload, checksum
+  and signature
+ */
+static void comm_capture(struct comm_tx &tx, const uint8_t *buf, uint8_t len)
+{
+    if (tx.msg_writes == 0) {
+        tx.capture_msgs++;
+        tx.capture_ok = false;
+        if (len >= MAVLINK_NUM_HEADER_BYTES && buf[0] == MAVLINK_STX) {
+            tx.capture_msgid = buf[7] | (buf[8]<<8) | ((uint32_t)buf[9]<<16);
+        } else if (len >= MAVLINK_CORE_HEADER_MAVLINK1_LEN+1 && buf[0] == MAVLINK_STX_MAVLINK1) {
+            tx.capture_msgid = buf[5];
+        } else {
+            return;
+        }
+        tx.capture_len = buf[1];
+        // a fully trimmed payload has no payload write
+        tx.capture_ok = (tx.capture_len == 0);
+    } else if (tx.msg_writes == 1 && len > 0 && len == tx.capture_len && len <= tx.capture_size) {
+        memcpy(tx.capture_buf, buf, len);
+        tx.capture_ok = true;
+    }
+}
+
+void comm_capture_begin(mavlink_channel_t chan, uint8_t *buf, uint8_t size)
+{
+    if (!valid_channel(chan) || !hal.scheduler->in_main_thread()) {
+        return;
+    }
+    struct comm_tx &tx = comm_tx[chan];
+    tx.capture_buf = buf;
+    tx.capture_size = size;
+    tx.capture_msgs = 0;
+    tx.capture_ok = false;
+}
+
+bool comm_capture_end(mavlink_channel_t chan, uint32_t &msgid, uint8_t &len)
+{
+    if (!valid_channel(chan) || !hal.scheduler->in_main_thread()) {
+        return false;
+    }
+    struct comm_tx &tx = comm_tx[chan];
+    if (tx.capture_buf == nullptr) {
+        return false;
+    }
+    tx.capture_buf = nullptr;
+    if (tx.capture_msgs != 1 || !tx.capture_ok) {
+        return false;
+    }
+    msgid = tx.capture_msgid;
+    len = tx.capture_len;
+    return true;
+}
+
 /*
   send a buffer out a MAVLink channel
  */
@@ -145,10 +272,105 @@ void comm_send_buffer(mavlink_channel_t chan, const uint8_t *buf, uint8_t len)
     if (!valid_channel(chan)) {
         return;
     }
+    struct comm_tx &tx = comm_tx[chan];
+    if (tx.capture_buf != nullptr && hal.scheduler->in_main_thread()) {
+        comm_capture(tx, buf, len);
+        tx.msg_writes++;
+    }
+    if ((tx.corked || tx.in_message) && hal.scheduler->in_main_thread()) {
+        if (tx.len + len > COMM_TX_BUFFER_SIZE) {
+            comm_tx_flush(chan);
+        }
+        memcpy(&tx.buf[tx.len], buf, len);
+        tx.len += len;
+        return;
+    }
     mavlink_comm_port[chan]->write(buf, len);
+    if (tx.buf != nullptr) {
+        hal.util->perf_count(tx.perf_writes);
+    }
 }
 
-extern const AP_HAL::HAL& hal;
+/*
+  setup transmit coalescing for a channel. Until this is called
+  messages are written straight to the port
+ */
+void comm_init_tx(mavlink_channel_t chan)
+{
+    if (!valid_channel(chan)) {
+        return;
+    }
+    struct comm_tx &tx = comm_tx[chan];
+    if (tx.buf != nullptr) {
+        return;
+    }
+    tx.buf = new uint8_t[COMM_TX_BUFFER_SIZE];
+
+    snprintf(tx.perf_msgs_name, sizeof(tx.perf_msgs_name), "GCS_TxMsgs_%u", chan);
+    tx.perf_msgs = hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, tx.perf_msgs_name);
+
+    snprintf(tx.perf_writes_name, sizeof(tx.perf_writes_name), "GCS_TxWrite_%u", chan);
+    tx.perf_writes = hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, tx.perf_writes_name);
+}
+
+void comm_cork(mavlink_channel_t chan)
+{
+    if (!valid_channel(chan) || comm_tx[chan].buf == nullptr ||
+        !hal.scheduler->in_main_thread()) {
+        return;
+    }
+    comm_tx[chan].corked = true;
+}
+
+void comm_uncork(mavlink_channel_t chan)
+{
+    if (!valid_channel(chan) || !comm_tx[chan].corked ||
+        !hal.scheduler->in_main_thread()) {
+        return;
+    }
+    comm_tx_flush(chan);
+    comm_tx[chan].corked = false;
+}
+
+/*
+  called by the MAVLink library at the start and end of sending each
+  message. Only messages sent from the main thread are collected in
+  the transmit buffer; those from other threads go straight to the
+  port, so they can't split or flush a message the main thread is
+  part way through
+ */
+void comm_send_begin(mavlink_channel_t chan)
+{
+    if (!valid_channel(chan)) {
+        return;
+    }
+    struct comm_tx &tx = comm_tx[chan];
+    if (hal.scheduler->in_main_thread()) {
+        tx.msg_writes = 0;
+    }
+    if (tx.buf == nullptr) {
+        return;
+    }
+    hal.util->perf_count(tx.perf_msgs);
+    if (hal.scheduler->in_main_thread()) {
+        tx.in_message = true;
+    }
+}
+
+void comm_send_end(mavlink_channel_t chan)
+{
+    if (!valid_channel(chan)) {
+        return;
+    }
+    struct comm_tx &tx = comm_tx[chan];
+    if (!tx.in_message || !hal.scheduler->in_main_thread()) {
+        return;
+    }
+    tx.in_message = false;
+    if (!tx.corked) {
+        comm_tx_flush(chan);
+    }
+}
 
 /*
   return true if the MAVLink parser is idle, so there is no partly parsed
@@ -159,3 +381,126 @@ bool comm_is_idle(mavlink_channel_t chan)
 	mavlink_status_t *status = mavlink_get_channel_status(chan);
 	return status == nullptr || status->parse_state <= MAVLINK_PARSE_STATE_IDLE;
 }
+
+/*
+  block-oriented MAVLink parser. Frames which lie wholly within the
+  block are found by scanning for a start of frame byte and checking
+  the CRC over the contiguous frame, then copied out in one go, rather
+  than running every byte through the mavlink_parse_char() state
+  machine.
+
+  Anything the fast path doesn't handle - a frame started in an
+  earlier block, frames with incompatibility flags (including signed
+  frames), channels with signing enabled, and bad CRCs - is fed
+  through mavlink_parse_char() instead, so the channel's parse state
+  and error counts come out just as if every byte had gone through
+  it.
+ */
+bool comm_parse_block(mavlink_channel_t chan, const uint8_t *buf, const uint16_t len, uint16_t &ofs,
+                      mavlink_message_t *msg, mavlink_status_t *status)
+{
+    mavlink_status_t *chan_status = mavlink_get_channel_status(chan);
+    mavlink_message_t *rxmsg = mavlink_get_channel_buffer(chan);
+
+    while (ofs < len) {
+        if (chan_status->parse_state > MAVLINK_PARSE_STATE_IDLE) {
+            // part way through a frame
+            if (mavlink_parse_char(chan, buf[ofs++], msg, status)) {
+                return true;
+            }
+            continue;
+        }
+
+        // skip to the next start of frame
+        const uint8_t *p = &buf[ofs];
+        const uint8_t *end = &buf[len];
+        while (p < end && *p != MAVLINK_STX && *p != MAVLINK_STX_MAVLINK1) {
+            p++;
+        }
+        ofs = p - buf;
+        if (p == end) {
+            return false;
+        }
+
+        const bool mavlink1 = (*p == MAVLINK_STX_MAVLINK1);
+        const uint8_t header_len = 1 + (mavlink1 ? MAVLINK_CORE_HEADER_MAVLINK1_LEN : MAVLINK_CORE_HEADER_LEN);
+        const uint16_t avail = len - ofs;
+        if (avail < header_len) {
+            return false;
+        }
+        const uint8_t payload_len = p[1];
+        const uint8_t incompat_flags = mavlink1 ? 0 : p[2];
+        const uint16_t frame_len = header_len + payload_len + MAVLINK_NUM_CHECKSUM_BYTES +
+            ((incompat_flags & MAVLINK_IFLAG_SIGNED) ? MAVLINK_SIGNATURE_BLOCK_LEN : 0);
+        if (avail < frame_len) {
+            return false;
+        }
+
+        if (incompat_flags != 0 || chan_status->signing != nullptr) {
+            // leave this frame to mavlink_parse_char()
+            mavlink_parse_char(chan, buf[ofs++], msg, status);
+            continue;
+        }
+
+        const uint32_t msgid = mavlink1 ? p[5] : (p[7] | (p[8]<<8) | ((uint32_t)p[9]<<16));
+        const mavlink_msg_entry_t *e = mavlink_get_msg_entry(msgid);
+        uint16_t crc;
+        crc_init(&crc);
+        crc_accumulate_buffer(&crc, (const char *)&p[1], header_len - 1 + payload_len);
+        crc_accumulate(e ? e->crc_extra : 0, &crc);
+        const uint8_t *ck = &p[header_len + payload_len];
+        if (ck[0] != (crc & 0xFF) || ck[1] != (crc >> 8)) {
+            // let mavlink_parse_char() deal with the bad CRC
+            mavlink_parse_char(chan, buf[ofs++], msg, status);
+            continue;
+        }
+
+        // fill in the channel buffer and status as mavlink_parse_char() would
+        rxmsg->magic = p[0];
+        rxmsg->len = payload_len;
+        if (mavlink1) {
+            rxmsg->incompat_flags = 0;
+            rxmsg->compat_flags = 0;
+            rxmsg->seq = p[2];
+            rxmsg->sysid = p[3];
+            rxmsg->compid = p[4];
+            chan_status->flags |= MAVLINK_STATUS_FLAG_IN_MAVLINK1;
+        } else {
+            rxmsg->incompat_flags = incompat_flags;
+            rxmsg->compat_flags = p[3];
+            rxmsg->seq = p[4];
+            rxmsg->sysid = p[5];
+            rxmsg->compid = p[6];
+            chan_status->flags &= ~MAVLINK_STATUS_FLAG_IN_MAVLINK1;
+        }
+        rxmsg->msgid = msgid;
+        memcpy(_MAV_PAYLOAD_NON_CONST(rxmsg), &p[header_len], payload_len);
+        // zero-fill so that truncated MAVLink2 payloads decode correctly
+        memset(&_MAV_PAYLOAD_NON_CONST(rxmsg)[payload_len], 0, MAVLINK_MAX_PAYLOAD_LEN - payload_len);
+        rxmsg->checksum = crc;
+        rxmsg->ck[0] = ck[0];
+        rxmsg->ck[1] = ck[1];
+
+        chan_status->msg_received = MAVLINK_FRAMING_OK;
+        chan_status->parse_state = MAVLINK_PARSE_STATE_IDLE;
+        chan_status->packet_idx = payload_len;
+        chan_status->current_rx_seq = rxmsg->seq;
+        if (chan_status->packet_rx_success_count == 0) {
+            chan_status->packet_rx_drop_count = 0;
+        }
+        chan_status->packet_rx_success_count++;
+
+        memcpy(msg, rxmsg, sizeof(*msg));
+        status->parse_state = chan_status->parse_state;
+        status->packet_idx = chan_status->packet_idx;
+        status->current_rx_seq = chan_status->current_rx_seq+1;
+        status->packet_rx_success_count = chan_status->packet_rx_success_count;
+        status->packet_rx_drop_count = chan_status->parse_error;
+        status->flags = chan_status->flags;
+        chan_status->parse_error = 0;
+
+        ofs += frame_len;
+        return true;
+    }
+    return false;
+}
@@ -11,6 +11,9 @@
 #define MAVLINK_SEPARATE_HELPERS
 
 #define MAVLINK_SEND_UART_BYTES(chan, buf, len) comm_send_buffer(chan, buf, len)
+// the pieces of each message are collected and written in one go
+#define MAVLINK_START_UART_SEND(chan, size) comm_send_begin(chan)
+#define MAVLINK_END_UART_SEND(chan, size) comm_send_end(chan)
 
 // allow five telemetry ports
 #define MAVLINK_COMM_NUM_BUFFERS 5
@@ -22,6 +25,9 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-align"
 
+// our own SHA-256 for signing, in place of the generated one
+#include "MAVLink_sha256.h"
+
 #include "include/mavlink/v2.0/ardupilotmega/version.h"
 
 #define MAVLINK_MAX_PAYLOAD_LEN 255
@@ -60,6 +66,27 @@ static inline void comm_send_ch(mavlink_channel_t chan, uint8_t chr)
 
 void comm_send_buffer(mavlink_channel_t chan, const uint8_t *buf, uint8_t len);
 
+/*
+  transmit coalescing. While a channel is corked, messages sent on it
+  from the main thread are collected in a buffer and written to the
+  port in as few writes as possible, when the buffer fills or the
+  channel is uncorked. comm_get_txspace() allows for collected bytes
+ */
+void comm_init_tx(mavlink_channel_t chan);
+void comm_cork(mavlink_channel_t chan);
+void comm_uncork(mavlink_channel_t chan);
+void comm_send_begin(mavlink_channel_t chan);
+void comm_send_end(mavlink_channel_t chan);
+
+/*
+  capture the payload of the MAVLink message sent on a channel from
+  the main thread between comm_capture_begin() and comm_capture_end().
+  comm_capture_end() returns true with the message ID and payload
+  length if exactly one message was sent and its payload fitted in buf
+ */
+void comm_capture_begin(mavlink_channel_t chan, uint8_t *buf, uint8_t size);
+bool comm_capture_end(mavlink_channel_t chan, uint32_t &msgid, uint8_t &len);
+
 /// Read a byte from the nominated MAVLink channel
 ///
 /// @param chan		Channel to receive on
@@ -67,6 +94,15 @@ void comm_send_buffer(mavlink_channel_t chan, const uint8_t *buf, uint8_t len);
 ///
 uint8_t comm_receive_ch(mavlink_channel_t chan);
 
+/// Read up to len bytes from the nominated MAVLink channel
+///
+/// @param chan		Channel to receive on
+/// @param buf		Buffer to read into
+/// @param len		Size of buf
+/// @returns		Number of bytes read
+///
+uint16_t comm_receive_buffer(mavlink_channel_t chan, uint8_t *buf, uint16_t len);
+
 /// Check for available data on the nominated MAVLink channel
 ///
 /// @param chan		Channel to check
@@ -89,6 +125,17 @@ bool comm_is_idle(mavlink_channel_t chan);
 #define MAVLINK_USE_CONVENIENCE_FUNCTIONS
 #include "include/mavlink/v2.0/ardupilotmega/mavlink.h"
 
+/*
+  parse the next MAVLink message out of a block of received bytes,
+  starting at buf[ofs]. Returns true with msg and status filled in
+  and ofs moved past the message if one was found. Returns false
+  once no more messages can be found, with ofs either at len or at
+  the start of an incomplete frame at the end of the block, which
+  should be passed in again with more data appended
+ */
+bool comm_parse_block(mavlink_channel_t chan, const uint8_t *buf, uint16_t len, uint16_t &ofs,
+                      mavlink_message_t *msg, mavlink_status_t *status);
+
 // return a MAVLink variable type given a AP_Param type
 uint8_t mav_var_type(enum ap_var_type t);
 
@@ -0,0 +1,168 @@
+/*
+   GCS MAVLink functions related to sharing encoded messages between
+   channels
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GCS.h"
+
+extern const AP_HAL::HAL& hal;
+
+// largest payload held in the message cache
+#define GCS_MESSAGE_CACHE_PAYLOAD_MAX 64
+
+struct GCS_MAVLINK::message_cache_entry {
+    uint32_t pass;
+    uint8_t payload[GCS_MESSAGE_CACHE_PAYLOAD_MAX];
+};
+
+GCS_MAVLINK::message_cache_entry *GCS_MAVLINK::_message_cache;
+uint32_t GCS_MAVLINK::_message_cache_pass;
+bool GCS_MAVLINK::_message_cache_active;
+
+struct message_cache_info {
+    enum ap_message id;
+    uint32_t mavlink_id;
+    uint8_t len;
+    uint8_t min_len;
+    uint8_t crc_extra;
+};
+
+#define CACHE_MSG(msgid, apid) { apid, MAVLINK_MSG_ID_ ## msgid, MAVLINK_MSG_ID_ ## msgid ## _LEN, MAVLINK_MSG_ID_ ## msgid ## _MIN_LEN, MAVLINK_MSG_ID_ ## msgid ## _CRC }
+
+/*
+  stream messages whose content does not depend on the channel they
+  are sent on. A message is only cached if sending it produced exactly
+  one MAVLink message, so ap_messages which send several (such as
+  MSG_EXTENDED_STATUS1 on most vehicles) are generated for each
+  channel as before. MSG_RADIO_IN is not cached as it sends a
+  different message on MAVLink1 channels
+ */
+static const struct message_cache_info message_cache_messages[] = {
+    CACHE_MSG(ATTITUDE,                 MSG_ATTITUDE),
+    CACHE_MSG(GLOBAL_POSITION_INT,      MSG_LOCATION),
+    CACHE_MSG(LOCAL_POSITION_NED,       MSG_LOCAL_POSITION),
+    CACHE_MSG(VFR_HUD,                  MSG_VFR_HUD),
+    CACHE_MSG(SYS_STATUS,               MSG_EXTENDED_STATUS1),
+    CACHE_MSG(MEMINFO,                  MSG_EXTENDED_STATUS2),
+    CACHE_MSG(NAV_CONTROLLER_OUTPUT,    MSG_NAV_CONTROLLER_OUTPUT),
+    CACHE_MSG(MISSION_CURRENT,          MSG_CURRENT_WAYPOINT),
+    CACHE_MSG(SERVO_OUTPUT_RAW,         MSG_SERVO_OUTPUT_RAW),
+    CACHE_MSG(RAW_IMU,                  MSG_RAW_IMU1),
+    CACHE_MSG(SCALED_PRESSURE,          MSG_RAW_IMU2),
+    CACHE_MSG(SENSOR_OFFSETS,           MSG_RAW_IMU3),
+    CACHE_MSG(GPS_RAW_INT,              MSG_GPS_RAW),
+    CACHE_MSG(SYSTEM_TIME,              MSG_SYSTEM_TIME),
+    CACHE_MSG(AHRS,                     MSG_AHRS),
+    CACHE_MSG(HWSTATUS,                 MSG_HWSTATUS),
+    CACHE_MSG(WIND,                     MSG_WIND),
+    CACHE_MSG(RANGEFINDER,              MSG_RANGEFINDER),
+    CACHE_MSG(BATTERY2,                 MSG_BATTERY2),
+    CACHE_MSG(EKF_STATUS_REPORT,        MSG_EKF_STATUS_REPORT),
+    CACHE_MSG(VIBRATION,                MSG_VIBRATION),
+    CACHE_MSG(RPM,                      MSG_RPM),
+    CACHE_MSG(AOA_SSA,                  MSG_AOA_SSA),
+};
+
+static int8_t message_cache_slot(enum ap_message id)
+{
+    for (uint8_t i=0; i<ARRAY_SIZE(message_cache_messages); i++) {
+        if (message_cache_messages[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+  start a pass of the streams. Each pass has an empty cache; it is
+  only used when more than one channel is sending streams
+ */
+void GCS_MAVLINK::message_cache_start(bool enable)
+{
+    _message_cache_active = false;
+    if (!enable) {
+        return;
+    }
+    if (_message_cache == nullptr) {
+        _message_cache = new message_cache_entry[ARRAY_SIZE(message_cache_messages)]();
+        if (_message_cache == nullptr) {
+            return;
+        }
+    }
+    _message_cache_pass++;
+    if (_message_cache_pass == 0) {
+        // entries start with a pass of zero, which must never match
+        _message_cache_pass = 1;
+    }
+    _message_cache_active = true;
+}
+
+void GCS_MAVLINK::message_cache_stop(void)
+{
+    _message_cache_active = false;
+}
+
+/*
+  try to send a message, using a payload encoded for another channel
+  earlier in this pass if there is one. Otherwise the vehicle sends
+  the message and its payload is captured for the channels after us.
+  The cached payload is re-framed with this channel's sequence
+  number, signature and checksum
+ */
+bool GCS_MAVLINK::try_send_message_cached(enum ap_message id)
+{
+    if (!_message_cache_active) {
+        return try_send_message(id);
+    }
+    const int8_t slot = message_cache_slot(id);
+    if (slot < 0) {
+        return try_send_message(id);
+    }
+    const struct message_cache_info &m = message_cache_messages[slot];
+    message_cache_entry &e = _message_cache[slot];
+    if (m.len > sizeof(e.payload)) {
+        return try_send_message(id);
+    }
+
+    if (e.pass == _message_cache_pass) {
+        if (comm_get_txspace(chan) < packet_overhead() + m.len) {
+            return false;
+        }
+        _mav_finalize_message_chan_send(chan, m.mavlink_id, (const char *)e.payload,
+                                        m.min_len, m.len, m.crc_extra);
+        return true;
+    }
+
+    const mavlink_status_t *status = mavlink_get_channel_status(chan);
+    if (status == nullptr || (status->flags & MAVLINK_STATUS_FLAG_OUT_MAVLINK1)) {
+        // a MAVLink1 payload has no extension fields, so only
+        // payloads from MAVLink2 channels are shared
+        return try_send_message(id);
+    }
+
+    comm_capture_begin(chan, e.payload, sizeof(e.payload));
+    const bool ret = try_send_message(id);
+    uint32_t msgid;
+    uint8_t len;
+    if (comm_capture_end(chan, msgid, len) && ret &&
+        msgid == m.mavlink_id && len <= m.len) {
+        // MAVLink2 trims trailing zeros from the payload; put them
+        // back so the full payload can be sent on other channels
+        memset(&e.payload[len], 0, m.len - len);
+        e.pass = _message_cache_pass;
+    }
+    return ret;
+}
@@ -0,0 +1,469 @@
+/*
+   GCS MAVLink functions related to per-message send intervals
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GCS.h"
+
+extern const AP_HAL::HAL& hal;
+
+static_assert(MSG_LAST <= 64, "ap_message must fit in the interval override mask");
+
+/*
+  priority of a message when the link is short of space.  High
+  priority messages are sent whenever they fit; lower priorities keep
+  some of the transmit buffer free for them
+ */
+enum interval_priority : uint8_t {
+    INTERVAL_PRIORITY_HIGH = 0,
+    INTERVAL_PRIORITY_NORMAL,
+    INTERVAL_PRIORITY_LOW,
+};
+
+struct interval_message_info {
+    uint16_t mavlink_id;
+    enum ap_message id;
+    uint8_t len;
+    enum interval_priority priority;
+};
+
+#define INTERVAL_MSG(msgid, apid, prio) { MAVLINK_MSG_ID_ ## msgid, apid, MAVLINK_MSG_ID_ ## msgid ## _LEN, INTERVAL_PRIORITY_ ## prio }
+
+/*
+  MAVLink messages which can be given an interval, and the ap_message
+  which sends each.  Messages which are only sent in response to an
+  event are not listed
+ */
+static const struct interval_message_info interval_messages[] = {
+    INTERVAL_MSG(HEARTBEAT,                 MSG_HEARTBEAT,                 HIGH),
+    INTERVAL_MSG(ATTITUDE,                  MSG_ATTITUDE,                  HIGH),
+    INTERVAL_MSG(GLOBAL_POSITION_INT,       MSG_LOCATION,                  HIGH),
+    INTERVAL_MSG(LOCAL_POSITION_NED,        MSG_LOCAL_POSITION,            HIGH),
+    INTERVAL_MSG(VFR_HUD,                   MSG_VFR_HUD,                   HIGH),
+    INTERVAL_MSG(SYS_STATUS,                MSG_EXTENDED_STATUS1,          HIGH),
+    INTERVAL_MSG(GPS_RAW_INT,               MSG_GPS_RAW,                   HIGH),
+    INTERVAL_MSG(MEMINFO,                   MSG_EXTENDED_STATUS2,          NORMAL),
+    INTERVAL_MSG(NAV_CONTROLLER_OUTPUT,     MSG_NAV_CONTROLLER_OUTPUT,     NORMAL),
+    INTERVAL_MSG(MISSION_CURRENT,           MSG_CURRENT_WAYPOINT,          NORMAL),
+    INTERVAL_MSG(SERVO_OUTPUT_RAW,          MSG_SERVO_OUTPUT_RAW,          NORMAL),
+    INTERVAL_MSG(RC_CHANNELS,               MSG_RADIO_IN,                  NORMAL),
+    INTERVAL_MSG(RC_CHANNELS_SCALED,        MSG_SERVO_OUT,                 NORMAL),
+    INTERVAL_MSG(GPS_RTK,                   MSG_GPS_RTK,                   NORMAL),
+    INTERVAL_MSG(GPS2_RAW,                  MSG_GPS2_RAW,                  NORMAL),
+    INTERVAL_MSG(GPS2_RTK,                  MSG_GPS2_RTK,                  NORMAL),
+    INTERVAL_MSG(LIMITS_STATUS,             MSG_LIMITS_STATUS,             NORMAL),
+    INTERVAL_MSG(FENCE_STATUS,              MSG_FENCE_STATUS,              NORMAL),
+    INTERVAL_MSG(WIND,                      MSG_WIND,                      NORMAL),
+    INTERVAL_MSG(RANGEFINDER,               MSG_RANGEFINDER,               NORMAL),
+    INTERVAL_MSG(TERRAIN_REQUEST,           MSG_TERRAIN,                   NORMAL),
+    INTERVAL_MSG(BATTERY2,                  MSG_BATTERY2,                  NORMAL),
+    INTERVAL_MSG(BATTERY_STATUS,            MSG_BATTERY_STATUS,            NORMAL),
+    INTERVAL_MSG(MOUNT_STATUS,              MSG_MOUNT_STATUS,              NORMAL),
+    INTERVAL_MSG(OPTICAL_FLOW,              MSG_OPTICAL_FLOW,              NORMAL),
+    INTERVAL_MSG(EKF_STATUS_REPORT,         MSG_EKF_STATUS_REPORT,         NORMAL),
+    INTERVAL_MSG(POSITION_TARGET_GLOBAL_INT, MSG_POSITION_TARGET_GLOBAL_INT, NORMAL),
+    INTERVAL_MSG(RAW_IMU,                   MSG_RAW_IMU1,                  LOW),
+    INTERVAL_MSG(SCALED_PRESSURE,           MSG_RAW_IMU2,                  LOW),
+    INTERVAL_MSG(SENSOR_OFFSETS,            MSG_RAW_IMU3,                  LOW),
+    INTERVAL_MSG(SYSTEM_TIME,               MSG_SYSTEM_TIME,               LOW),
+    INTERVAL_MSG(AHRS,                      MSG_AHRS,                      LOW),
+    INTERVAL_MSG(SIMSTATE,                  MSG_SIMSTATE,                  LOW),
+    INTERVAL_MSG(HWSTATUS,                  MSG_HWSTATUS,                  LOW),
+    INTERVAL_MSG(CAMERA_FEEDBACK,           MSG_CAMERA_FEEDBACK,           LOW),
+    INTERVAL_MSG(GIMBAL_REPORT,             MSG_GIMBAL_REPORT,             LOW),
+    INTERVAL_MSG(MAG_CAL_PROGRESS,          MSG_MAG_CAL_PROGRESS,          LOW),
+    INTERVAL_MSG(MAG_CAL_REPORT,            MSG_MAG_CAL_REPORT,            LOW),
+    INTERVAL_MSG(PID_TUNING,                MSG_PID_TUNING,                LOW),
+    INTERVAL_MSG(VIBRATION,                 MSG_VIBRATION,                 LOW),
+    INTERVAL_MSG(RPM,                       MSG_RPM,                       LOW),
+    INTERVAL_MSG(AOA_SSA,                   MSG_AOA_SSA,                   LOW),
+    INTERVAL_MSG(DEEPSTALL,                 MSG_LANDING,                   LOW),
+};
+
+static const struct interval_message_info *interval_info_for_mavlink_id(uint32_t mavlink_id)
+{
+    for (uint8_t i=0; i<ARRAY_SIZE(interval_messages); i++) {
+        if (interval_messages[i].mavlink_id == mavlink_id) {
+            return &interval_messages[i];
+        }
+    }
+    return nullptr;
+}
+
+static const struct interval_message_info *interval_info_for_ap_message(enum ap_message id)
+{
+    for (uint8_t i=0; i<ARRAY_SIZE(interval_messages); i++) {
+        if (interval_messages[i].id == id) {
+            return &interval_messages[i];
+        }
+    }
+    return nullptr;
+}
+
+/*
+  handle MAV_CMD_SET_MESSAGE_INTERVAL.  param1 is the MAVLink message
+  ID, param2 the interval in microseconds; -1 stops the message and 0
+  returns it to its stream.  HEARTBEAT can't be stopped as the vehicle
+  sends it once a second outside the streams
+ */
+MAV_RESULT GCS_MAVLINK::handle_command_set_message_interval(const mavlink_command_long_t &packet)
+{
+    const struct interval_message_info *info = interval_info_for_mavlink_id((uint32_t)packet.param1);
+    if (info == nullptr) {
+        return MAV_RESULT_UNSUPPORTED;
+    }
+    const uint64_t mask = 1ULL << info->id;
+    const int32_t interval_us = (int32_t)packet.param2;
+    if (interval_us < 0 && info->id == MSG_HEARTBEAT) {
+        return MAV_RESULT_DENIED;
+    }
+
+    interval_heap_remove(info->id);
+    _stream_deferred_mask &= ~mask;
+
+    if (interval_us == 0) {
+        _interval_override_mask &= ~mask;
+        return MAV_RESULT_ACCEPTED;
+    }
+    if (interval_us < 0) {
+        _interval_override_mask |= mask;
+        return MAV_RESULT_ACCEPTED;
+    }
+
+    if (_interval_heap == nullptr) {
+        _interval_heap = new interval_entry[MSG_LAST];
+        if (_interval_heap == nullptr) {
+            return MAV_RESULT_FAILED;
+        }
+    }
+    _interval_override_mask |= mask;
+
+    const uint32_t interval_ms = MAX((uint32_t)interval_us / 1000U, 1U);
+    interval_heap_push(AP_HAL::millis(), interval_ms, info->id);
+    return MAV_RESULT_ACCEPTED;
+}
+
+/*
+  handle MAV_CMD_GET_MESSAGE_INTERVAL, replying with MESSAGE_INTERVAL.
+  Messages still sent as part of a stream are reported with the
+  interval of the stream
+ */
+MAV_RESULT GCS_MAVLINK::handle_command_get_message_interval(const mavlink_command_long_t &packet)
+{
+    const uint32_t mavlink_id = (uint32_t)packet.param1;
+    const struct interval_message_info *info = interval_info_for_mavlink_id(mavlink_id);
+    if (info == nullptr) {
+        return MAV_RESULT_UNSUPPORTED;
+    }
+    if (!HAVE_PAYLOAD_SPACE(chan, MESSAGE_INTERVAL)) {
+        return MAV_RESULT_TEMPORARILY_REJECTED;
+    }
+
+    int32_t interval_us;
+    if (_interval_override_mask & (1ULL << info->id)) {
+        interval_us = -1;
+        for (uint8_t i=0; i<_interval_heap_len; i++) {
+            if (_interval_heap[i].id == info->id) {
+                interval_us = _interval_heap[i].interval_ms * 1000;
+                break;
+            }
+        }
+    } else {
+        interval_us = stream_interval_us(info->id);
+    }
+    mavlink_msg_message_interval_send(chan, mavlink_id, interval_us);
+    return MAV_RESULT_ACCEPTED;
+}
+
+/*
+  the interval a message is sent at by its stream on this channel,
+  worked out as stream_trigger() does. Returns -1 if the stream is off
+  and 0 if the message hasn't been sent from a stream
+ */
+int32_t GCS_MAVLINK::stream_interval_us(enum ap_message id)
+{
+    if (_message_stream[id] == 0) {
+        return 0;
+    }
+    const enum streams stream_num = (enum streams)(_message_stream[id] - 1);
+    float rate = (uint8_t)streamRates[stream_num].get();
+    rate *= adjust_rate_for_stream_trigger(stream_num);
+    if (rate <= 0) {
+        return -1;
+    }
+    if (rate > 50) {
+        rate = 50;
+    }
+    // the stream is sent every stream_ticks+1 calls at 50Hz
+    const uint8_t ticks = (50 / rate) - 1 + stream_slowdown;
+    return (ticks + 1) * 20000;
+}
+
+/*
+  try to send a message, recording the transmit space it used
+ */
+bool GCS_MAVLINK::try_send_message_sized(enum ap_message id)
+{
+    const uint16_t space = comm_get_txspace(chan);
+    if (!try_send_message_cached(id)) {
+        return false;
+    }
+    const uint16_t after = comm_get_txspace(chan);
+    if (after < space) {
+        _message_bytes[id] = space - after;
+    }
+    return true;
+}
+
+/*
+  min-heap of scheduled messages, ordered on the time each is next due
+ */
+bool GCS_MAVLINK::interval_heap_before(uint8_t a, uint8_t b) const
+{
+    return (int32_t)(_interval_heap[a].due_ms - _interval_heap[b].due_ms) < 0;
+}
+
+void GCS_MAVLINK::interval_heap_swap(uint8_t a, uint8_t b)
+{
+    const interval_entry tmp = _interval_heap[a];
+    _interval_heap[a] = _interval_heap[b];
+    _interval_heap[b] = tmp;
+}
+
+void GCS_MAVLINK::interval_heap_sift_up(uint8_t i)
+{
+    while (i > 0) {
+        const uint8_t parent = (i-1)/2;
+        if (!interval_heap_before(i, parent)) {
+            break;
+        }
+        interval_heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+void GCS_MAVLINK::interval_heap_sift_down(uint8_t i)
+{
+    while (true) {
+        const uint8_t left = 2*i+1;
+        const uint8_t right = left+1;
+        uint8_t smallest = i;
+        if (left < _interval_heap_len && interval_heap_before(left, smallest)) {
+            smallest = left;
+        }
+        if (right < _interval_heap_len && interval_heap_before(right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        interval_heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+void GCS_MAVLINK::interval_heap_push(uint32_t due_ms, uint32_t interval_ms, enum ap_message id)
+{
+    if (_interval_heap_len >= MSG_LAST) {
+        return;
+    }
+    const uint8_t i = _interval_heap_len++;
+    _interval_heap[i].due_ms = due_ms;
+    _interval_heap[i].interval_ms = interval_ms;
+    _interval_heap[i].id = id;
+    interval_heap_sift_up(i);
+}
+
+void GCS_MAVLINK::interval_heap_remove(enum ap_message id)
+{
+    for (uint8_t i=0; i<_interval_heap_len; i++) {
+        if (_interval_heap[i].id != id) {
+            continue;
+        }
+        _interval_heap_len--;
+        if (i != _interval_heap_len) {
+            _interval_heap[i] = _interval_heap[_interval_heap_len];
+            interval_heap_sift_down(i);
+            interval_heap_sift_up(i);
+        }
+        return;
+    }
+}
+
+/*
+  update the estimate of the rate the link drains our transmit buffer.
+  The space freed since the end of the last send pass is only a
+  measure of the link rate if the buffer stayed backed up; if it
+  emptied the link may be faster still
+ */
+void GCS_MAVLINK::update_link_rate(uint32_t now_ms)
+{
+    const uint16_t space = comm_get_txspace(chan);
+    if (space > _txspace_max) {
+        _txspace_max = space;
+    }
+    const uint32_t dt_ms = now_ms - _txspace_after_send_ms;
+    if (_txspace_after_send_ms == 0 || dt_ms == 0 || dt_ms > 1000 ||
+        space <= _txspace_after_send) {
+        return;
+    }
+    const float rate = (space - _txspace_after_send) * 1000.0f / dt_ms;
+    if (space < _txspace_max) {
+        if (is_zero(_link_rate)) {
+            _link_rate = rate;
+        } else {
+            _link_rate = 0.9f * _link_rate + 0.1f * rate;
+        }
+    } else if (rate > _link_rate) {
+        _link_rate = rate;
+    }
+}
+
+/*
+  bytes of transmit buffer to leave free for higher priority messages:
+  the given time's worth of link capacity, or a share of the buffer
+  until the link rate is known
+ */
+uint16_t GCS_MAVLINK::link_reserve(uint16_t reserve_ms) const
+{
+    uint32_t reserve;
+    if (is_positive(_link_rate)) {
+        reserve = (uint32_t)(_link_rate * reserve_ms * 0.001f);
+    } else {
+        reserve = (uint32_t)_txspace_max * reserve_ms / 400U;
+    }
+    return MIN(reserve, _txspace_max/2U);
+}
+
+/*
+  return true if there is transmit space to send a message without
+  eating into the space kept for higher priority messages.  Messages
+  we know nothing about are always allowed
+ */
+bool GCS_MAVLINK::interval_budget_ok(enum ap_message id) const
+{
+    const struct interval_message_info *info = interval_info_for_ap_message(id);
+    if (info == nullptr) {
+        return true;
+    }
+    // the last send of the message may have used more than the
+    // MAVLink message it is listed with
+    uint32_t needed = MAX(packet_overhead() + info->len, (uint32_t)_message_bytes[id]);
+    switch (info->priority) {
+    case INTERVAL_PRIORITY_HIGH:
+        break;
+    case INTERVAL_PRIORITY_NORMAL:
+        needed += link_reserve(50);
+        break;
+    case INTERVAL_PRIORITY_LOW:
+        needed += link_reserve(100);
+        break;
+    }
+    return comm_get_txspace(chan) >= needed;
+}
+
+/*
+  return true if a message may be sent from a stream.  Messages with
+  an interval set are sent from the schedule instead, and lower
+  priority messages give way when the link is backed up, to be sent
+  by send_stream_deferred() once there is room
+ */
+bool GCS_MAVLINK::stream_message_allowed(enum ap_message id)
+{
+    if (_stream_current < NUM_STREAMS) {
+        _message_stream[id] = _stream_current + 1;
+    }
+    const uint64_t mask = 1ULL << id;
+    if (_interval_override_mask & mask) {
+        return false;
+    }
+    if (!interval_budget_ok(id)) {
+        // only the latest is sent, so a slow link doesn't build up a
+        // backlog of the same message
+        _stream_deferred_mask |= mask;
+        return false;
+    }
+    _stream_deferred_mask &= ~mask;
+    return true;
+}
+
+/*
+  send the stream messages held back by the budget which now fit,
+  highest priority first
+ */
+void GCS_MAVLINK::send_stream_deferred(void)
+{
+    if (_stream_deferred_mask == 0) {
+        return;
+    }
+    for (uint8_t p=INTERVAL_PRIORITY_HIGH; p<=INTERVAL_PRIORITY_LOW; p++) {
+        for (uint8_t i=0; i<ARRAY_SIZE(interval_messages); i++) {
+            const struct interval_message_info &info = interval_messages[i];
+            const uint64_t mask = 1ULL << info.id;
+            if (info.priority != p || !(_stream_deferred_mask & mask) ||
+                !interval_budget_ok(info.id)) {
+                continue;
+            }
+            _stream_deferred_mask &= ~mask;
+            send_message(info.id);
+        }
+    }
+}
+
+/*
+  send any scheduled messages which are due, earliest first.  A
+  message which doesn't fit in the budget is dropped for this
+  interval rather than delayed, so a slow link doesn't accumulate a
+  backlog
+ */
+void GCS_MAVLINK::send_interval_messages(uint32_t now_ms)
+{
+    while (_interval_heap_len > 0 &&
+           (int32_t)(now_ms - _interval_heap[0].due_ms) >= 0) {
+        interval_entry &e = _interval_heap[0];
+        if (interval_budget_ok(e.id)) {
+            send_message(e.id);
+        }
+        e.due_ms += e.interval_ms;
+        if ((int32_t)(now_ms - e.due_ms) >= 0) {
+            // we are more than an interval behind; don't try to catch up
+            e.due_ms = now_ms + e.interval_ms;
+        }
+        interval_heap_sift_down(0);
+    }
+}
+
+/*
+  send the vehicle's streams followed by any messages with an interval
+  set, measuring the link as we go
+ */
+void GCS_MAVLINK::scheduled_send()
+{
+    const uint32_t now_ms = AP_HAL::millis();
+    update_link_rate(now_ms);
+
+    _sending_streams = true;
+    _stream_current = NUM_STREAMS;
+    data_stream_send();
+    _sending_streams = false;
+
+    if (!waypoint_receiving) {
+        send_interval_messages(now_ms);
+    }
+    send_stream_deferred();
+
+    _txspace_after_send = comm_get_txspace(chan);
+    _txspace_after_send_ms = now_ms;
+}
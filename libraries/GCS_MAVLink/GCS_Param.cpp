@@ -42,6 +42,9 @@ GCS_MAVLINK::queued_param_send()
     // send one parameter async reply if pending
     send_parameter_reply();
 
+    // and any packed parameter file being read by FTP
+    send_ftp_burst();
+
     if (_queued_parameter == nullptr) {
         return;
     }
@@ -287,6 +290,7 @@ bool GCS_MAVLINK::stream_trigger(enum streams stream_num)
     rate *= adjust_rate_for_stream_trigger(stream_num);
 
     if (rate <= 0) {
+        _stream_current = NUM_STREAMS;
         if (chan_is_streaming & (1U<<(chan-MAVLINK_COMM_0))) {
             // if currently streaming then check if all streams are disabled
             // to allow runtime detection of user disabling streaming
@@ -312,11 +316,13 @@ bool GCS_MAVLINK::stream_trigger(enum streams stream_num)
             rate = 50;
         }
         stream_ticks[stream_num] = (50 / rate) - 1 + stream_slowdown;
+        _stream_current = stream_num;
         return true;
     }
 
     // count down at 50Hz
     stream_ticks[stream_num]--;
+    _stream_current = NUM_STREAMS;
     return false;
 }
 
@@ -357,7 +363,8 @@ void GCS_MAVLINK::send_queued_parameters(void)
     }
 
     if (_queued_parameter == nullptr &&
-        param_replies.empty()) {
+        param_replies.empty() &&
+        !ftp.burst) {
         return;
     }
     if (streamRates[STREAM_PARAMS].get() <= 0) {
@@ -141,6 +141,11 @@ void GCS_MAVLINK::load_signing_key(void)
         }
     }
     
+    if (!all_zero) {
+        // the key starts every signed message, so hash it once
+        mavlink_sha256_set_key_prefix(signing.secret_key);
+    }
+
     // enable signing on all channels
     for (uint8_t i=0; i<MAVLINK_COMM_NUM_BUFFERS; i++) {
         mavlink_status_t *cstatus = mavlink_get_channel_status((mavlink_channel_t)(MAVLINK_COMM_0 + i));
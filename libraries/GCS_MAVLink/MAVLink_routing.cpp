@@ -26,8 +26,18 @@ extern const AP_HAL::HAL& hal;
 
 #define ROUTING_DEBUG 0
 
+static_assert(MAVLINK_MAX_ROUTES < 255, "route indexes must fit in a uint8_t");
+static_assert(MAVLINK_ROUTE_HASH_BITS <= 8, "hash buckets must fit in a uint8_t");
+
 // constructor
-MAVLink_routing::MAVLink_routing(void) : num_routes(0) {}
+MAVLink_routing::MAVLink_routing(void) :
+    num_routes(0),
+    routes_evicted(0),
+    routes_dropped(0)
+{
+    memset(key_bucket, ROUTE_NONE, sizeof(key_bucket));
+    memset(sys_bucket, ROUTE_NONE, sizeof(sys_bucket));
+}
 
 /*
   forward a MAVLink message to the right port. This also
@@ -134,32 +144,51 @@ bool MAVLink_routing::check_and_forward(mavlink_channel_t in_channel, const mavl
         return true;
     }
 
-    // forward on any channels matching the targets
+    // forward on any channels matching the targets. A broadcast goes
+    // to every route, a message for another system or for any
+    // component of a system goes to all routes for that sysid, and
+    // anything else only to routes for the exact sysid/compid
     bool forwarded = false;
     bool sent_to_chan[MAVLINK_COMM_NUM_BUFFERS];
     memset(sent_to_chan, 0, sizeof(sent_to_chan));
-    for (uint8_t i=0; i<num_routes; i++) {
-        if (broadcast_system || (target_system == routes[i].sysid &&
-                                 (broadcast_component || 
-                                  target_component == routes[i].compid ||
-                                  !match_system))) {
-            if (in_channel != routes[i].channel && !sent_to_chan[routes[i].channel]) {
-                if (comm_get_txspace(routes[i].channel) >= ((uint16_t)msg->len) +
-                    GCS_MAVLINK::packet_overhead_chan(routes[i].channel)) {
+    const bool any_component = broadcast_component || !match_system;
+    uint8_t i;
+    if (broadcast_system) {
+        i = num_routes > 0 ? 0 : ROUTE_NONE;
+    } else if (any_component) {
+        i = sys_bucket[sys_hash(target_system)];
+    } else {
+        i = key_bucket[key_hash(target_system, target_component)];
+    }
+    while (i != ROUTE_NONE) {
+        struct route &r = routes[i];
+        if (broadcast_system || (target_system == r.sysid &&
+                                 (any_component || target_component == r.compid))) {
+            if (in_channel != r.channel && !sent_to_chan[r.channel]) {
+                if (comm_get_txspace(r.channel) >= ((uint16_t)msg->len) +
+                    GCS_MAVLINK::packet_overhead_chan(r.channel)) {
 #if ROUTING_DEBUG
                     ::printf("fwd msg %u from chan %u on chan %u sysid=%d compid=%d\n",
                              msg->msgid,
                              (unsigned)in_channel,
-                             (unsigned)routes[i].channel,
+                             (unsigned)r.channel,
                              (int)target_system,
                              (int)target_component);
 #endif
-                    _mavlink_resend_uart(routes[i].channel, msg);
+                    _mavlink_resend_uart(r.channel, msg);
+                    r.packets_out++;
                 }
-                sent_to_chan[routes[i].channel] = true;
+                sent_to_chan[r.channel] = true;
                 forwarded = true;
             }
         }
+        if (broadcast_system) {
+            i = (i+1 < num_routes) ? i+1 : ROUTE_NONE;
+        } else if (any_component) {
+            i = r.next_sys;
+        } else {
+            i = r.next_key;
+        }
     }
     if (!forwarded && match_system) {
         process_locally = true;
@@ -179,19 +208,21 @@ void MAVLink_routing::send_to_components(const mavlink_message_t* msg)
     memset(sent_to_chan, 0, sizeof(sent_to_chan));
 
     // check learned routes
-    for (uint8_t i=0; i<num_routes; i++) {
-        if ((routes[i].sysid == mavlink_system.sysid) && !sent_to_chan[routes[i].channel]) {
-            if (comm_get_txspace(routes[i].channel) >= ((uint16_t)msg->len) +
-                GCS_MAVLINK::packet_overhead_chan(routes[i].channel)) {
+    for (uint8_t i=sys_bucket[sys_hash(mavlink_system.sysid)]; i != ROUTE_NONE; i=routes[i].next_sys) {
+        struct route &r = routes[i];
+        if ((r.sysid == mavlink_system.sysid) && !sent_to_chan[r.channel]) {
+            if (comm_get_txspace(r.channel) >= ((uint16_t)msg->len) +
+                GCS_MAVLINK::packet_overhead_chan(r.channel)) {
 #if ROUTING_DEBUG
                 ::printf("send msg %u on chan %u sysid=%u compid=%u\n",
                          msg->msgid,
-                         (unsigned)routes[i].channel,
-                         (unsigned)routes[i].sysid,
-                         (unsigned)routes[i].compid);
+                         (unsigned)r.channel,
+                         (unsigned)r.sysid,
+                         (unsigned)r.compid);
 #endif
-                _mavlink_resend_uart(routes[i].channel, msg);
-                sent_to_chan[routes[i].channel] = true;
+                _mavlink_resend_uart(r.channel, msg);
+                r.packets_out++;
+                sent_to_chan[r.channel] = true;
             }
         }
     }
@@ -217,35 +248,131 @@ bool MAVLink_routing::find_by_mavtype(uint8_t mavtype, uint8_t &sysid, uint8_t &
     return false;
 }
 
+/*
+  get a learned route and its packet counters
+ */
+bool MAVLink_routing::get_route(uint8_t idx, uint8_t &sysid, uint8_t &compid, mavlink_channel_t &channel,
+                                uint32_t &packets_in, uint32_t &packets_out) const
+{
+    if (idx >= num_routes) {
+        return false;
+    }
+    const struct route &r = routes[idx];
+    sysid = r.sysid;
+    compid = r.compid;
+    channel = r.channel;
+    packets_in = r.packets_in;
+    packets_out = r.packets_out;
+    return true;
+}
+
+/*
+  add a route to the front of its hash chains
+ */
+void MAVLink_routing::link_route(uint8_t idx)
+{
+    struct route &r = routes[idx];
+    const uint8_t kh = key_hash(r.sysid, r.compid);
+    const uint8_t sh = sys_hash(r.sysid);
+    r.next_key = key_bucket[kh];
+    key_bucket[kh] = idx;
+    r.next_sys = sys_bucket[sh];
+    sys_bucket[sh] = idx;
+}
+
+/*
+  remove a route from its hash chains
+ */
+void MAVLink_routing::unlink_route(uint8_t idx)
+{
+    struct route &r = routes[idx];
+    uint8_t *p = &key_bucket[key_hash(r.sysid, r.compid)];
+    while (*p != ROUTE_NONE) {
+        if (*p == idx) {
+            *p = r.next_key;
+            break;
+        }
+        p = &routes[*p].next_key;
+    }
+    p = &sys_bucket[sys_hash(r.sysid)];
+    while (*p != ROUTE_NONE) {
+        if (*p == idx) {
+            *p = r.next_sys;
+            break;
+        }
+        p = &routes[*p].next_sys;
+    }
+}
+
+/*
+  find a slot for a new route. When the table is full the route heard
+  from least recently is replaced, provided it has not been heard from
+  for MAVLINK_ROUTE_TIMEOUT_MS. Returns -1 if there is no room
+ */
+int16_t MAVLink_routing::allocate_route(uint32_t now_ms)
+{
+    if (num_routes < MAVLINK_MAX_ROUTES) {
+        return num_routes++;
+    }
+    uint8_t oldest = 0;
+    for (uint8_t i=1; i<num_routes; i++) {
+        if (now_ms - routes[i].last_seen_ms > now_ms - routes[oldest].last_seen_ms) {
+            oldest = i;
+        }
+    }
+    if (now_ms - routes[oldest].last_seen_ms < MAVLINK_ROUTE_TIMEOUT_MS) {
+        routes_dropped++;
+        return -1;
+    }
+#if ROUTING_DEBUG
+    ::printf("evicted route %u %u via %u\n",
+             (unsigned)routes[oldest].sysid,
+             (unsigned)routes[oldest].compid,
+             (unsigned)routes[oldest].channel);
+#endif
+    unlink_route(oldest);
+    routes_evicted++;
+    return oldest;
+}
+
 /*
   see if the message is for a new route and learn it
 */
 void MAVLink_routing::learn_route(mavlink_channel_t in_channel, const mavlink_message_t* msg)
 {
-    uint8_t i;
     if (msg->sysid == 0 || 
         (msg->sysid == mavlink_system.sysid && 
          msg->compid == mavlink_system.compid)) {
         return;
     }
-    for (i=0; i<num_routes; i++) {
-        if (routes[i].sysid == msg->sysid && 
-            routes[i].compid == msg->compid &&
-            routes[i].channel == in_channel) {
-            if (routes[i].mavtype == 0 && msg->msgid == MAVLINK_MSG_ID_HEARTBEAT) {
-                routes[i].mavtype = mavlink_msg_heartbeat_get_type(msg);
+    const uint32_t now_ms = AP_HAL::millis();
+    for (uint8_t i=key_bucket[key_hash(msg->sysid, msg->compid)]; i != ROUTE_NONE; i=routes[i].next_key) {
+        struct route &r = routes[i];
+        if (r.sysid == msg->sysid && 
+            r.compid == msg->compid &&
+            r.channel == in_channel) {
+            if (r.mavtype == 0 && msg->msgid == MAVLINK_MSG_ID_HEARTBEAT) {
+                r.mavtype = mavlink_msg_heartbeat_get_type(msg);
             }
-            break;
+            r.last_seen_ms = now_ms;
+            r.packets_in++;
+            return;
         }
     }
-    if (i == num_routes && i<MAVLINK_MAX_ROUTES) {
-        routes[i].sysid = msg->sysid;
-        routes[i].compid = msg->compid;
-        routes[i].channel = in_channel;
+    const int16_t i = allocate_route(now_ms);
+    if (i >= 0) {
+        struct route &r = routes[i];
+        r.sysid = msg->sysid;
+        r.compid = msg->compid;
+        r.channel = in_channel;
+        r.mavtype = 0;
         if (msg->msgid == MAVLINK_MSG_ID_HEARTBEAT) {
-            routes[i].mavtype = mavlink_msg_heartbeat_get_type(msg);
+            r.mavtype = mavlink_msg_heartbeat_get_type(msg);
         }
-        num_routes++;
+        r.last_seen_ms = now_ms;
+        r.packets_in = 1;
+        r.packets_out = 0;
+        link_route(i);
 #if ROUTING_DEBUG
         ::printf("learned route %u %u via %u\n",
                  (unsigned)msg->sysid, 
@@ -273,7 +400,7 @@ void MAVLink_routing::handle_heartbeat(mavlink_channel_t in_channel, const mavli
     mask &= ~no_route_mask;
     
     // mask out channels that are known sources for this sysid/compid
-    for (uint8_t i=0; i<num_routes; i++) {
+    for (uint8_t i=key_bucket[key_hash(msg->sysid, msg->compid)]; i != ROUTE_NONE; i=routes[i].next_key) {
         if (routes[i].sysid == msg->sysid && routes[i].compid == msg->compid) {
             mask &= ~(1U<<((unsigned)(routes[i].channel-MAVLINK_COMM_0)));
         }
@@ -6,9 +6,26 @@
 #include <AP_Common/AP_Common.h>
 #include "GCS_MAVLink.h"
 
-// 20 routes should be enough for now. This may need to increase as
-// we make more extensive use of MAVLink forwarding
+// number of routes the table can hold. Boards with a lot of
+// forwarded components (companion computers, gimbals, ADSB and
+// bridged CAN nodes) and the RAM to spare may raise this, up to 254
+#ifndef MAVLINK_MAX_ROUTES
 #define MAVLINK_MAX_ROUTES 20
+#endif
+
+// routes not heard from for this long may be replaced by new routes
+// when the table is full
+#ifndef MAVLINK_ROUTE_TIMEOUT_MS
+#define MAVLINK_ROUTE_TIMEOUT_MS 30000
+#endif
+
+// log2 of the number of hash buckets, keeping the chains short
+#if MAVLINK_MAX_ROUTES > 32
+#define MAVLINK_ROUTE_HASH_BITS 7
+#else
+#define MAVLINK_ROUTE_HASH_BITS 5
+#endif
+#define MAVLINK_ROUTE_HASH_SIZE (1U<<MAVLINK_ROUTE_HASH_BITS)
 
 /*
   object to handle MAVLink packet routing
@@ -41,17 +58,57 @@ public:
      */
     bool find_by_mavtype(uint8_t mavtype, uint8_t &sysid, uint8_t &compid, mavlink_channel_t &channel);
 
+    /*
+      get a learned route and its packet counters. Returns false once
+      idx is past the last route
+     */
+    bool get_route(uint8_t idx, uint8_t &sysid, uint8_t &compid, mavlink_channel_t &channel,
+                   uint32_t &packets_in, uint32_t &packets_out) const;
+
+    uint8_t get_num_routes(void) const { return num_routes; }
+
+    // number of stale routes replaced, and of new routes dropped
+    // because the table was full of live routes
+    uint32_t get_routes_evicted(void) const { return routes_evicted; }
+    uint32_t get_routes_dropped(void) const { return routes_dropped; }
+
 private:
-    // a simple linear routing table. We don't expect to have a lot of
-    // routes, so a scalable structure isn't worthwhile yet.
+    // routes are held in a fixed array, indexed by two hash tables
+    // of singly linked chains. One is keyed by (sysid, compid) and
+    // one by sysid alone, matching the two ways targets are looked up
+    static const uint8_t ROUTE_NONE = 0xFF;
     uint8_t num_routes;
     struct route {
         uint8_t sysid;
         uint8_t compid;
         mavlink_channel_t channel;
         uint8_t mavtype;
+        uint8_t next_key;   // next route in the same key_bucket chain
+        uint8_t next_sys;   // next route in the same sys_bucket chain
+        uint32_t last_seen_ms;
+        uint32_t packets_in;   // packets received from this route
+        uint32_t packets_out;  // packets forwarded to this route
     } routes[MAVLINK_MAX_ROUTES];
-    
+    uint8_t key_bucket[MAVLINK_ROUTE_HASH_SIZE];
+    uint8_t sys_bucket[MAVLINK_ROUTE_HASH_SIZE];
+
+    uint32_t routes_evicted;
+    uint32_t routes_dropped;
+
+    static uint8_t key_hash(uint8_t sysid, uint8_t compid) {
+        return (uint16_t)((((uint16_t)sysid << 8) | compid) * 40503U) >> (16 - MAVLINK_ROUTE_HASH_BITS);
+    }
+    static uint8_t sys_hash(uint8_t sysid) {
+        return sysid & (MAVLINK_ROUTE_HASH_SIZE - 1);
+    }
+
+    // add a route to the hash chains, or remove it
+    void link_route(uint8_t idx);
+    void unlink_route(uint8_t idx);
+
+    // find a slot for a new route, replacing a stale route if full
+    int16_t allocate_route(uint32_t now_ms);
+
     // a channel mask to block routing as required
     uint8_t no_route_mask;
     
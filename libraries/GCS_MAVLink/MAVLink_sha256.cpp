@@ -0,0 +1,264 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/// @file	MAVLink_sha256.cpp
+/// @brief	SHA-256 used for MAVLink2 packet signing
+
+/*
+  A signed MAVLink2 packet is hashed as the 32 byte key followed by
+  the header, payload, CRC, link ID and timestamp, so most packets are
+  one or two blocks. The cost is almost all in the compression
+  function, which is unrolled here with the message schedule computed
+  in a rolling 16 word window. Whole blocks are compressed straight
+  from the caller's buffer, and final_48() only serialises the words
+  it returns.
+
+  The key fills the first eight message words, so the first eight
+  rounds of the first block are the same for every packet. They are
+  done once when the key is set, and skipped for each packet that
+  starts with that key.
+ */
+
+#include <string.h>
+#include "MAVLink_sha256.h"
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SIGMA0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define SIGMA1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define sigma0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define sigma1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/*
+  one round, with the working variables rotated by renaming rather
+  than by moving them
+ */
+#define ROUND(a, b, c, d, e, f, g, h, i, w) do { \
+        const uint32_t t1 = h + SIGMA1(e) + CH(e, f, g) + sha256_k[i] + (w); \
+        d += t1; \
+        h = t1 + SIGMA0(a) + MAJ(a, b, c); \
+    } while (0)
+
+// schedule word for round i >= 16, kept in a 16 word window
+#define SCHED(i) (W[(i) & 15] += sigma1(W[((i) - 2) & 15]) + W[((i) - 7) & 15] + sigma0(W[((i) - 15) & 15]))
+
+#define ROUNDS8(i, w) do { \
+        ROUND(a, b, c, d, e, f, g, h, (i)+0, w((i)+0)); \
+        ROUND(h, a, b, c, d, e, f, g, (i)+1, w((i)+1)); \
+        ROUND(g, h, a, b, c, d, e, f, (i)+2, w((i)+2)); \
+        ROUND(f, g, h, a, b, c, d, e, (i)+3, w((i)+3)); \
+        ROUND(e, f, g, h, a, b, c, d, (i)+4, w((i)+4)); \
+        ROUND(d, e, f, g, h, a, b, c, (i)+5, w((i)+5)); \
+        ROUND(c, d, e, f, g, h, a, b, (i)+6, w((i)+6)); \
+        ROUND(b, c, d, e, f, g, h, a, (i)+7, w((i)+7)); \
+    } while (0)
+
+#define LOADW(i) (W[i] = load_be32(&block[(i)*4]))
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/*
+  the state after the first eight rounds of a message starting with
+  the key
+ */
+static struct {
+    volatile bool valid;
+    uint8_t key[32];
+    uint32_t W[8];
+    uint32_t mid[8];
+} sha256_key_prefix;
+
+/*
+  compress a block. If keyed, this is the first block of a message
+  starting with the prefix key, and starts from the saved state after
+  round eight
+ */
+static void sha256_compress(uint32_t state[8], const uint8_t *block, bool keyed=false)
+{
+    uint32_t W[16];
+    uint32_t a, b, c, d, e, f, g, h;
+
+    if (keyed) {
+        memcpy(W, sha256_key_prefix.W, sizeof(sha256_key_prefix.W));
+        a = sha256_key_prefix.mid[0];
+        b = sha256_key_prefix.mid[1];
+        c = sha256_key_prefix.mid[2];
+        d = sha256_key_prefix.mid[3];
+        e = sha256_key_prefix.mid[4];
+        f = sha256_key_prefix.mid[5];
+        g = sha256_key_prefix.mid[6];
+        h = sha256_key_prefix.mid[7];
+    } else {
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+        ROUNDS8(0, LOADW);
+    }
+    ROUNDS8(8, LOADW);
+    ROUNDS8(16, SCHED);
+    ROUNDS8(24, SCHED);
+    ROUNDS8(32, SCHED);
+    ROUNDS8(40, SCHED);
+    ROUNDS8(48, SCHED);
+    ROUNDS8(56, SCHED);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void mavlink_sha256_set_key_prefix(const uint8_t key[32])
+{
+    sha256_key_prefix.valid = false;
+    memcpy(sha256_key_prefix.key, key, 32);
+
+    uint32_t W[16];
+    const uint8_t *block = key;
+    uint32_t a = sha256_iv[0];
+    uint32_t b = sha256_iv[1];
+    uint32_t c = sha256_iv[2];
+    uint32_t d = sha256_iv[3];
+    uint32_t e = sha256_iv[4];
+    uint32_t f = sha256_iv[5];
+    uint32_t g = sha256_iv[6];
+    uint32_t h = sha256_iv[7];
+    ROUNDS8(0, LOADW);
+    memcpy(sha256_key_prefix.W, W, sizeof(sha256_key_prefix.W));
+    sha256_key_prefix.mid[0] = a;
+    sha256_key_prefix.mid[1] = b;
+    sha256_key_prefix.mid[2] = c;
+    sha256_key_prefix.mid[3] = d;
+    sha256_key_prefix.mid[4] = e;
+    sha256_key_prefix.mid[5] = f;
+    sha256_key_prefix.mid[6] = g;
+    sha256_key_prefix.mid[7] = h;
+
+    sha256_key_prefix.valid = true;
+}
+
+void mavlink_sha256_init(mavlink_sha256_ctx *m)
+{
+    memcpy(m->state, sha256_iv, sizeof(m->state));
+    m->count = 0;
+    m->keyed = false;
+}
+
+void mavlink_sha256_update(mavlink_sha256_ctx *m, const void *v, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)v;
+    uint32_t used = m->count & 63;
+
+    if (m->count == 0 && len >= 32 && sha256_key_prefix.valid &&
+        memcmp(p, sha256_key_prefix.key, 32) == 0) {
+        m->keyed = true;
+    }
+    m->count += len;
+
+    if (used != 0) {
+        const uint32_t n = 64 - used;
+        if (len < n) {
+            memcpy(&m->buf[used], p, len);
+            return;
+        }
+        memcpy(&m->buf[used], p, n);
+        sha256_compress(m->state, m->buf, m->keyed);
+        m->keyed = false;
+        p += n;
+        len -= n;
+    }
+    while (len >= 64) {
+        sha256_compress(m->state, p, m->keyed);
+        m->keyed = false;
+        p += 64;
+        len -= 64;
+    }
+    memcpy(m->buf, p, len);
+}
+
+/*
+  pad the message and compress the last block(s)
+ */
+static void sha256_finish(mavlink_sha256_ctx *m)
+{
+    const uint64_t bits = (uint64_t)m->count * 8;
+    uint32_t used = m->count & 63;
+
+    m->buf[used++] = 0x80;
+    if (used > 56) {
+        memset(&m->buf[used], 0, 64 - used);
+        sha256_compress(m->state, m->buf, m->keyed);
+        m->keyed = false;
+        used = 0;
+    }
+    memset(&m->buf[used], 0, 56 - used);
+    store_be32(&m->buf[56], (uint32_t)(bits >> 32));
+    store_be32(&m->buf[60], (uint32_t)bits);
+    sha256_compress(m->state, m->buf, m->keyed);
+    m->keyed = false;
+}
+
+void mavlink_sha256_final_32(mavlink_sha256_ctx *m, uint8_t result[32])
+{
+    sha256_finish(m);
+    for (uint8_t i=0; i<8; i++) {
+        store_be32(&result[i*4], m->state[i]);
+    }
+}
+
+void mavlink_sha256_final_48(mavlink_sha256_ctx *m, uint8_t result[6])
+{
+    sha256_finish(m);
+    uint8_t b[8];
+    store_be32(&b[0], m->state[0]);
+    store_be32(&b[4], m->state[1]);
+    memcpy(result, b, 6);
+}
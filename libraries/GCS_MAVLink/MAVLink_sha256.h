@@ -0,0 +1,35 @@
+/// @file	MAVLink_sha256.h
+/// @brief	SHA-256 used for MAVLink2 packet signing
+#pragma once
+
+#include <stdint.h>
+
+/*
+  this replaces the generic SHA-256 in the generated MAVLink headers,
+  which allow an implementation to provide its own with the same
+  API. Every signed packet sent or received is hashed, so this is on
+  the per-packet path of any link with signing enabled
+ */
+#define HAVE_MAVLINK_SHA256
+
+typedef struct {
+    uint32_t state[8];
+    uint32_t count;         // bytes hashed so far
+    bool keyed;             // message started with the prefix key
+    uint8_t buf[64];        // partial block
+} mavlink_sha256_ctx;
+
+/*
+  set the signing key. Messages which start with this key skip the
+  rounds of the first block which only depend on it
+ */
+void mavlink_sha256_set_key_prefix(const uint8_t key[32]);
+
+void mavlink_sha256_init(mavlink_sha256_ctx *m);
+void mavlink_sha256_update(mavlink_sha256_ctx *m, const void *v, uint32_t len);
+
+// full 32 byte digest
+void mavlink_sha256_final_32(mavlink_sha256_ctx *m, uint8_t result[32]);
+
+// the 48 bit digest prefix used by MAVLink2 signatures
+void mavlink_sha256_final_48(mavlink_sha256_ctx *m, uint8_t result[6]);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+// number of mission items requested ahead during a mission upload.
+// Items are written to storage half a window at a time
+#define MISSION_UPLOAD_WINDOW 32
+
+/*
+  record of which mission items in a window of MISSION_UPLOAD_WINDOW
+  items from start() have been received during a windowed upload
+ */
+class MissionUploadWindow {
+public:
+    // empty the window and move it to start at seq
+    void reset(uint16_t seq) {
+        _start = seq;
+        _mask = 0;
+    }
+
+    // sequence number of the first item in the window
+    uint16_t start() const { return _start; }
+
+    // true if seq is within the window
+    bool contains(uint16_t seq) const {
+        return seq >= _start && seq - _start < MISSION_UPLOAD_WINDOW;
+    }
+
+    // true if seq is within the window and has been received
+    bool received(uint16_t seq) const {
+        return contains(seq) && (_mask & (1UL << (seq - _start))) != 0;
+    }
+
+    // mark seq as received. seq must be within the window
+    void set_received(uint16_t seq) {
+        if (contains(seq)) {
+            _mask |= (1UL << (seq - _start));
+        }
+    }
+
+    // first item at or after seq, and before last, not yet received
+    uint16_t first_missing(uint16_t seq, uint16_t last) const {
+        while (seq < last && received(seq)) {
+            seq++;
+        }
+        return seq;
+    }
+
+    // slide the window count items on, after they have been written
+    void advance(uint16_t count) {
+        // a shift of the whole width of the mask is undefined
+        _mask = (count >= MISSION_UPLOAD_WINDOW) ? 0 : (_mask >> count);
+        _start += count;
+    }
+
+private:
+    uint16_t _start;
+    uint32_t _mask;
+};
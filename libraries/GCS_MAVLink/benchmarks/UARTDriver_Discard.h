@@ -0,0 +1,30 @@
+#pragma once
+
+#include <AP_HAL/AP_HAL.h>
+
+/*
+  a port which discards everything written to it, for benchmarks of
+  the cost of sending. Include after AP_gbenchmark.h, which has no
+  include guard
+ */
+class UARTDriver_Discard : public AP_HAL::UARTDriver
+{
+public:
+    void begin(uint32_t baud) override {}
+    void begin(uint32_t baud, uint16_t rxSpace, uint16_t txSpace) override {}
+    void end() override {}
+    void flush() override {}
+    bool is_initialized() override { return true; }
+    void set_blocking_writes(bool blocking) override {}
+    bool tx_pending() override { return false; }
+
+    uint32_t available() override { return 0; }
+    uint32_t txspace() override { return 4096; }
+    int16_t read() override { return -1; }
+
+    size_t write(uint8_t c) override { return 1; }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        gbenchmark_escape((void *)buffer);
+        return size;
+    }
+};
@@ -0,0 +1,120 @@
+/*
+  compare the cost of sending the same stream messages on four
+  channels by generating and encoding them for each channel, against
+  generating them once, capturing the payload and re-framing it for
+  the other channels as GCS_MAVLINK::try_send_message_cached() does.
+
+  The vehicle's work to generate a message is represented by the
+  conversions done for ATTITUDE, GLOBAL_POSITION_INT and VFR_HUD.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AP_Math/AP_Math.h>
+#include <GCS_MAVLink/GCS_MAVLink.h>
+
+#include "UARTDriver_Discard.h"
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define NUM_CHANNELS 4
+
+static UARTDriver_Discard ports[NUM_CHANNELS];
+static Quaternion attitude(0.98f, 0.1f, -0.05f, 0.15f);
+static Vector3f gyro(0.01f, -0.02f, 0.03f);
+static Vector3f velocity(5.1f, -1.2f, 0.4f);
+
+static void setup_ports()
+{
+    for (uint8_t i=0; i<NUM_CHANNELS; i++) {
+        mavlink_comm_port[i] = &ports[i];
+    }
+}
+
+static void send_attitude(mavlink_channel_t chan, uint32_t now)
+{
+    float roll, pitch, yaw;
+    attitude.to_euler(roll, pitch, yaw);
+    mavlink_msg_attitude_send(chan, now, roll, pitch, yaw,
+                              gyro.x, gyro.y, gyro.z);
+}
+
+static void send_position(mavlink_channel_t chan, uint32_t now)
+{
+    mavlink_msg_global_position_int_send(chan, now,
+                                         -353632610, 1491652370,
+                                         584070, 10000,
+                                         velocity.x * 100, velocity.y * 100, velocity.z * 100,
+                                         wrap_360_cd(degrees(atan2f(velocity.y, velocity.x)) * 100));
+}
+
+static void send_vfr_hud(mavlink_channel_t chan, uint32_t now)
+{
+    const float groundspeed = norm(velocity.x, velocity.y);
+    mavlink_msg_vfr_hud_send(chan, groundspeed, groundspeed,
+                             (int16_t)wrap_360(degrees(atan2f(velocity.y, velocity.x))),
+                             45, 100.0f, -velocity.z);
+}
+
+typedef void (*send_fn)(mavlink_channel_t chan, uint32_t now);
+static const send_fn senders[] = { send_attitude, send_position, send_vfr_hud };
+static const struct {
+    uint8_t min_len, len, crc_extra;
+} framing[] = {
+    { MAVLINK_MSG_ID_ATTITUDE_MIN_LEN, MAVLINK_MSG_ID_ATTITUDE_LEN, MAVLINK_MSG_ID_ATTITUDE_CRC },
+    { MAVLINK_MSG_ID_GLOBAL_POSITION_INT_MIN_LEN, MAVLINK_MSG_ID_GLOBAL_POSITION_INT_LEN, MAVLINK_MSG_ID_GLOBAL_POSITION_INT_CRC },
+    { MAVLINK_MSG_ID_VFR_HUD_MIN_LEN, MAVLINK_MSG_ID_VFR_HUD_LEN, MAVLINK_MSG_ID_VFR_HUD_CRC },
+};
+
+static void BM_FanoutEncodeEach(benchmark::State& state)
+{
+    setup_ports();
+    uint32_t now = 0;
+
+    while (state.KeepRunning()) {
+        now += 10;
+        for (uint8_t c=0; c<NUM_CHANNELS; c++) {
+            const mavlink_channel_t chan = (mavlink_channel_t)c;
+            comm_send_begin(chan);
+            for (uint8_t m=0; m<ARRAY_SIZE(senders); m++) {
+                senders[m](chan, now);
+            }
+            comm_send_end(chan);
+        }
+    }
+}
+
+static void BM_FanoutEncodeOnce(benchmark::State& state)
+{
+    setup_ports();
+    uint32_t now = 0;
+    uint8_t payload[ARRAY_SIZE(senders)][64];
+    uint32_t msgid[ARRAY_SIZE(senders)];
+
+    while (state.KeepRunning()) {
+        now += 10;
+        comm_send_begin(MAVLINK_COMM_0);
+        for (uint8_t m=0; m<ARRAY_SIZE(senders); m++) {
+            uint8_t len;
+            comm_capture_begin(MAVLINK_COMM_0, payload[m], sizeof(payload[m]));
+            senders[m](MAVLINK_COMM_0, now);
+            comm_capture_end(MAVLINK_COMM_0, msgid[m], len);
+            memset(&payload[m][len], 0, framing[m].len - len);
+        }
+        comm_send_end(MAVLINK_COMM_0);
+        for (uint8_t c=1; c<NUM_CHANNELS; c++) {
+            const mavlink_channel_t chan = (mavlink_channel_t)c;
+            comm_send_begin(chan);
+            for (uint8_t m=0; m<ARRAY_SIZE(senders); m++) {
+                _mav_finalize_message_chan_send(chan, msgid[m], (const char *)payload[m],
+                                                framing[m].min_len, framing[m].len,
+                                                framing[m].crc_extra);
+            }
+            comm_send_end(chan);
+        }
+    }
+}
+
+BENCHMARK(BM_FanoutEncodeEach);
+BENCHMARK(BM_FanoutEncodeOnce);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,157 @@
+/*
+  compare the cost of parsing a received MAVLink stream a byte at a
+  time, with a UART read() and mavlink_parse_char() call per byte,
+  against reading it in blocks and using comm_parse_block().
+
+  The stream is a mix of the vision position and distance sensor
+  messages seen on a companion computer link. Throughput is reported
+  as bytes/second of a single core; dividing by 100 gives the bytes/s
+  parsed per percent of CPU.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AP_HAL/utility/RingBuffer.h>
+#include <GCS_MAVLink/GCS_MAVLink.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  a port which plays back a stream of received bytes
+ */
+class UARTDriver_Playback : public AP_HAL::UARTDriver
+{
+public:
+    ByteBuffer readbuf{8192};
+
+    void begin(uint32_t baud) override {}
+    void begin(uint32_t baud, uint16_t rxSpace, uint16_t txSpace) override {}
+    void end() override {}
+    void flush() override {}
+    bool is_initialized() override { return true; }
+    void set_blocking_writes(bool blocking) override {}
+    bool tx_pending() override { return false; }
+
+    uint32_t available() override { return readbuf.available(); }
+    uint32_t txspace() override { return 0; }
+    int16_t read() override {
+        uint8_t c;
+        if (!readbuf.read_byte(&c)) {
+            return -1;
+        }
+        return c;
+    }
+    ssize_t read_buffer(uint8_t *buffer, uint16_t count) override {
+        return readbuf.read(buffer, count);
+    }
+
+    size_t write(uint8_t c) override { return 0; }
+    size_t write(const uint8_t *buffer, size_t size) override { return 0; }
+};
+
+static const mavlink_channel_t chan = MAVLINK_COMM_1;
+static UARTDriver_Playback port;
+static uint8_t stream[4096];
+static uint16_t stream_len;
+// held outside the stack, as GCS_MAVLINK::_rx_buf is
+static uint8_t rx_buf[512];
+
+static void fill_stream()
+{
+    if (stream_len != 0) {
+        return;
+    }
+    mavlink_comm_port[chan] = &port;
+
+    mavlink_vision_position_estimate_t vision {};
+    vision.x = 1.5f;
+    vision.y = -2.5f;
+    vision.z = -0.75f;
+    mavlink_distance_sensor_t distance {};
+    distance.min_distance = 20;
+    distance.max_distance = 4000;
+    distance.current_distance = 123;
+
+    for (uint16_t i=0; ; i++) {
+        mavlink_message_t msg;
+        if (i % 4 == 0) {
+            vision.usec = i * 20000ULL;
+            mavlink_msg_vision_position_estimate_encode(1, 197, &msg, &vision);
+        } else {
+            distance.time_boot_ms = i * 20;
+            distance.orientation = i % 8;
+            mavlink_msg_distance_sensor_encode(1, 197, &msg, &distance);
+        }
+        uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+        const uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        if (stream_len + len > sizeof(stream)) {
+            break;
+        }
+        memcpy(&stream[stream_len], buf, len);
+        stream_len += len;
+    }
+}
+
+static void BM_ParseChar(benchmark::State& state)
+{
+    fill_stream();
+    mavlink_message_t msg;
+    mavlink_status_t status;
+    uint32_t count = 0;
+
+    while (state.KeepRunning()) {
+        port.readbuf.write(stream, stream_len);
+        const uint16_t nbytes = comm_get_available(chan);
+        for (uint16_t i=0; i<nbytes; i++) {
+            const uint8_t c = comm_receive_ch(chan);
+            if (mavlink_parse_char(chan, c, &msg, &status)) {
+                count++;
+            }
+        }
+        gbenchmark_escape(&msg);
+    }
+    gbenchmark_escape(&count);
+    state.SetBytesProcessed(state.iterations() * stream_len);
+}
+
+static void BM_ParseBlock(benchmark::State& state)
+{
+    fill_stream();
+    mavlink_message_t msg;
+    mavlink_status_t status;
+    uint32_t count = 0;
+
+    while (state.KeepRunning()) {
+        port.readbuf.write(stream, stream_len);
+        // the same loop as GCS_MAVLINK::receive_blocks()
+        uint8_t *buf = rx_buf;
+        uint16_t buflen = 0;
+        uint16_t nbytes = comm_get_available(chan);
+        while (nbytes > 0) {
+            const uint16_t nread = comm_receive_buffer(chan, &buf[buflen], (uint16_t)MIN(nbytes, sizeof(rx_buf)-buflen));
+            if (nread == 0) {
+                break;
+            }
+            nbytes -= nread;
+            buflen += nread;
+            uint16_t ofs = 0;
+            while (comm_parse_block(chan, buf, buflen, ofs, &msg, &status)) {
+                count++;
+            }
+            buflen -= ofs;
+            memmove(buf, &buf[ofs], buflen);
+        }
+        for (uint16_t i=0; i<buflen; i++) {
+            if (mavlink_parse_char(chan, buf[i], &msg, &status)) {
+                count++;
+            }
+        }
+        gbenchmark_escape(&msg);
+    }
+    gbenchmark_escape(&count);
+    state.SetBytesProcessed(state.iterations() * stream_len);
+}
+
+BENCHMARK(BM_ParseChar);
+BENCHMARK(BM_ParseBlock);
+
+BENCHMARK_MAIN()
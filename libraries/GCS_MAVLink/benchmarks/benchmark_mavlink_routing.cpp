@@ -0,0 +1,89 @@
+/*
+  measure the per-packet cost of MAVLink_routing::check_and_forward()
+  as the number of learned routes grows. Routes are learned for
+  components spread over four channels, then a message is received
+  from one of them targeted at another, so each iteration is one
+  route lookup for learning the sender plus one forwarding decision.
+ */
+#include <AP_gbenchmark.h>
+
+#include <GCS_MAVLink/GCS.h>
+#include <GCS_MAVLink/GCS_MAVLink.h>
+
+#include "UARTDriver_Discard.h"
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+const AP_Param::GroupInfo GCS_MAVLINK::var_info[] = {
+    AP_GROUPEND
+};
+
+#define NUM_CHANNELS 4
+
+static UARTDriver_Discard ports[NUM_CHANNELS];
+
+/*
+  learn nroutes routes, spread over the channels. Components are on
+  systems 10 upwards, eight components to a system
+ */
+static void learn_routes(MAVLink_routing &routing, uint8_t nroutes)
+{
+    for (uint8_t i=0; i<NUM_CHANNELS; i++) {
+        mavlink_comm_port[i] = &ports[i];
+    }
+    mavlink_heartbeat_t heartbeat {};
+    for (uint8_t i=0; i<nroutes; i++) {
+        mavlink_message_t msg;
+        heartbeat.type = MAV_TYPE_GIMBAL;
+        mavlink_msg_heartbeat_encode(10 + i/8, 1 + i%8, &msg, &heartbeat);
+        routing.check_and_forward((mavlink_channel_t)(i % NUM_CHANNELS), &msg);
+    }
+}
+
+static void BM_RouteTargeted(benchmark::State& state)
+{
+    const uint8_t nroutes = state.range_x();
+    MAVLink_routing *routing = new MAVLink_routing();
+    learn_routes(*routing, nroutes);
+
+    // from the last route learned, to the first
+    mavlink_command_long_t command {};
+    command.target_system = 10;
+    command.target_component = 1;
+    command.command = MAV_CMD_DO_MOUNT_CONTROL;
+    mavlink_message_t msg;
+    mavlink_msg_command_long_encode(10 + (nroutes-1)/8, 1 + (nroutes-1)%8, &msg, &command);
+    const mavlink_channel_t in_chan = (mavlink_channel_t)((nroutes-1) % NUM_CHANNELS);
+
+    while (state.KeepRunning()) {
+        bool local = routing->check_and_forward(in_chan, &msg);
+        gbenchmark_escape(&local);
+    }
+    delete routing;
+}
+
+static void BM_RouteNotForwarded(benchmark::State& state)
+{
+    const uint8_t nroutes = state.range_x();
+    MAVLink_routing *routing = new MAVLink_routing();
+    learn_routes(*routing, nroutes);
+
+    // a component of an unknown system on the last channel
+    mavlink_command_long_t command {};
+    command.target_system = 200;
+    command.target_component = 1;
+    mavlink_message_t msg;
+    mavlink_msg_command_long_encode(10 + (nroutes-1)/8, 1 + (nroutes-1)%8, &msg, &command);
+    const mavlink_channel_t in_chan = (mavlink_channel_t)((nroutes-1) % NUM_CHANNELS);
+
+    while (state.KeepRunning()) {
+        bool local = routing->check_and_forward(in_chan, &msg);
+        gbenchmark_escape(&local);
+    }
+    delete routing;
+}
+
+BENCHMARK(BM_RouteTargeted)->Arg(8)->Arg(20)->Arg(MAVLINK_MAX_ROUTES);
+BENCHMARK(BM_RouteNotForwarded)->Arg(8)->Arg(20)->Arg(MAVLINK_MAX_ROUTES);
+
+BENCHMARK_MAIN()
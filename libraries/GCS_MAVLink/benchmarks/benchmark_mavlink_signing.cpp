@@ -0,0 +1,148 @@
+/*
+  measure signed MAVLink2 packets per second, for sending (packing and
+  signing ATTITUDE) and for receiving (parsing and checking the
+  signature of a stream of signed ATTITUDE packets).
+
+  The Prefix variants hash with the signing key set as the SHA-256 key
+  prefix, as GCS_MAVLINK::load_signing_key() does, and the NoPrefix
+  variants with a different prefix so every round is computed.
+ */
+#include <AP_gbenchmark.h>
+
+#include <AP_HAL/utility/RingBuffer.h>
+#include <GCS_MAVLink/GCS_MAVLink.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  a port which discards what is written to it, and plays back a stream
+  of received bytes
+ */
+class UARTDriver_Loop : public AP_HAL::UARTDriver
+{
+public:
+    ByteBuffer readbuf{8192};
+
+    void begin(uint32_t baud) override {}
+    void begin(uint32_t baud, uint16_t rxSpace, uint16_t txSpace) override {}
+    void end() override {}
+    void flush() override {}
+    bool is_initialized() override { return true; }
+    void set_blocking_writes(bool blocking) override {}
+    bool tx_pending() override { return false; }
+
+    uint32_t available() override { return readbuf.available(); }
+    uint32_t txspace() override { return 4096; }
+    int16_t read() override {
+        uint8_t c;
+        if (!readbuf.read_byte(&c)) {
+            return -1;
+        }
+        return c;
+    }
+    ssize_t read_buffer(uint8_t *buffer, uint16_t count) override {
+        return readbuf.read(buffer, count);
+    }
+
+    size_t write(uint8_t c) override { return 1; }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        gbenchmark_escape((void *)buffer);
+        return size;
+    }
+};
+
+static const mavlink_channel_t chan = MAVLINK_COMM_1;
+static UARTDriver_Loop port;
+static mavlink_signing_t signing;
+static mavlink_signing_streams_t signing_streams;
+static uint8_t stream[4096];
+static uint16_t stream_len;
+static uint16_t stream_packets;
+
+static void setup_signing(bool prefix)
+{
+    mavlink_comm_port[chan] = &port;
+    for (uint8_t i=0; i<sizeof(signing.secret_key); i++) {
+        signing.secret_key[i] = i * 7 + 3;
+    }
+    signing.link_id = chan;
+    signing.timestamp = 1;
+    signing.flags = MAVLINK_SIGNING_FLAG_SIGN_OUTGOING;
+
+    uint8_t other_key[32] {};
+    mavlink_sha256_set_key_prefix(prefix ? signing.secret_key : other_key);
+
+    mavlink_status_t *status = mavlink_get_channel_status(chan);
+    status->signing = &signing;
+    status->signing_streams = &signing_streams;
+}
+
+static void fill_stream()
+{
+    // packets signed on this channel as another system
+    mavlink_attitude_t attitude {};
+    attitude.roll = 0.1f;
+    attitude.pitch = -0.2f;
+    attitude.yawspeed = 0.01f;
+    stream_len = 0;
+    stream_packets = 0;
+    for (uint32_t i=0; ; i++) {
+        mavlink_message_t msg;
+        attitude.time_boot_ms = i * 10;
+        mavlink_msg_attitude_encode_chan(255, 190, chan, &msg, &attitude);
+        uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+        const uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        if (stream_len + len > sizeof(stream)) {
+            break;
+        }
+        memcpy(&stream[stream_len], buf, len);
+        stream_len += len;
+        stream_packets++;
+    }
+}
+
+static void sign_packets(benchmark::State& state, bool prefix)
+{
+    setup_signing(prefix);
+    uint32_t now = 0;
+
+    while (state.KeepRunning()) {
+        mavlink_msg_attitude_send(chan, now++, 0.1f, -0.2f, 1.5f, 0.01f, 0.02f, 0.03f);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void check_packets(benchmark::State& state, bool prefix)
+{
+    setup_signing(prefix);
+    fill_stream();
+    mavlink_message_t msg;
+    mavlink_status_t status;
+    uint32_t count = 0;
+
+    while (state.KeepRunning()) {
+        // replay protection would reject the stream the second time
+        memset(&signing_streams, 0, sizeof(signing_streams));
+        port.readbuf.write(stream, stream_len);
+        const uint16_t nbytes = comm_get_available(chan);
+        for (uint16_t i=0; i<nbytes; i++) {
+            if (mavlink_parse_char(chan, comm_receive_ch(chan), &msg, &status)) {
+                count++;
+            }
+        }
+    }
+    gbenchmark_escape(&count);
+    state.SetItemsProcessed(state.iterations() * stream_packets);
+}
+
+static void BM_SignPrefix(benchmark::State& state) { sign_packets(state, true); }
+static void BM_SignNoPrefix(benchmark::State& state) { sign_packets(state, false); }
+static void BM_CheckPrefix(benchmark::State& state) { check_packets(state, true); }
+static void BM_CheckNoPrefix(benchmark::State& state) { check_packets(state, false); }
+
+BENCHMARK(BM_SignPrefix);
+BENCHMARK(BM_SignNoPrefix);
+BENCHMARK(BM_CheckPrefix);
+BENCHMARK(BM_CheckNoPrefix);
+
+BENCHMARK_MAIN()
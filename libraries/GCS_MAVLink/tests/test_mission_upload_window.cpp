@@ -0,0 +1,299 @@
+#include <AP_gtest.h>
+
+#include <AP_AHRS/AP_AHRS.h>
+#include <AP_Mission/AP_Mission.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+#include <GCS_MAVLink/MissionUploadWindow.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+const struct AP_Param::GroupInfo GCS_MAVLINK::var_info[] = {
+    AP_GROUPEND
+};
+GCS_Dummy _gcs;
+
+#define TEST_MISSION_ITEMS 200
+#define TEST_GCS_SYSID 255
+#define TEST_GCS_COMPID 190
+
+/*
+  a port keeping what is written to it for the GCS side of the test
+  to parse
+ */
+class UARTDriver_Capture : public AP_HAL::UARTDriver
+{
+public:
+    void begin(uint32_t baud) override {}
+    void begin(uint32_t baud, uint16_t rxSpace, uint16_t txSpace) override {}
+    void end() override {}
+    void flush() override {}
+    bool is_initialized() override { return true; }
+    void set_blocking_writes(bool blocking) override {}
+    bool tx_pending() override { return false; }
+
+    uint32_t available() override { return 0; }
+    uint32_t txspace() override { return sizeof(buf) - len; }
+    int16_t read() override { return -1; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        if (size > sizeof(buf) - len) {
+            return 0;
+        }
+        memcpy(&buf[len], buffer, size);
+        len += size;
+        return size;
+    }
+
+    // get the next message written, using a spare channel to parse
+    bool next_message(mavlink_message_t &msg) {
+        mavlink_status_t status;
+        while (ofs < len) {
+            if (mavlink_parse_char(MAVLINK_COMM_1, buf[ofs++], &msg, &status)) {
+                return true;
+            }
+        }
+        ofs = len = 0;
+        return false;
+    }
+
+private:
+    uint8_t buf[8192];
+    uint16_t len = 0;
+    uint16_t ofs = 0;
+};
+
+/*
+  a link handling mission messages with the GCS_MAVLINK upload code
+ */
+class GCS_MAVLINK_Upload : public GCS_MAVLINK
+{
+public:
+    GCS_MAVLINK_Upload(AP_Mission &_mission) :
+        mission(_mission)
+    {}
+
+    void data_stream_send(void) override {}
+    uint8_t sysid_my_gcs() const override { return TEST_GCS_SYSID; }
+
+    // a message arriving from the GCS
+    void receive(mavlink_message_t &msg) { handleMessage(&msg); }
+
+protected:
+    uint32_t telem_delay() const override { return 0; }
+    Compass *get_compass() const override { return nullptr; }
+    AP_Mission *get_mission() override { return &mission; }
+    AP_Rally *get_rally() const override { return nullptr; }
+    AP_GPS *get_gps() const override { return nullptr; }
+    AP_Camera *get_camera() const override { return nullptr; }
+    AP_ServoRelayEvents *get_servorelayevents() const override { return nullptr; }
+    const AP_FWVersion &get_fwver() const override { return fwver; }
+    void set_ekf_origin(const Location& loc) override {}
+    bool set_mode(uint8_t mode) override { return false; }
+
+private:
+    void handleMessage(mavlink_message_t *msg) override {
+        switch (msg->msgid) {
+        case MAVLINK_MSG_ID_MISSION_COUNT:
+            handle_mission_count(mission, msg);
+            break;
+        case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+            handle_mission_item(msg, mission);
+            break;
+        }
+    }
+    bool handle_guided_request(AP_Mission::Mission_Command &cmd) override { return false; }
+    void handle_change_alt_request(AP_Mission::Mission_Command &cmd) override {}
+
+    AP_Mission &mission;
+};
+
+class UploadTest {
+public:
+    AP_InertialSensor ins = AP_InertialSensor::create();
+    AP_Baro baro = AP_Baro::create();
+    AP_GPS gps = AP_GPS::create();
+    AP_AHRS_DCM ahrs = AP_AHRS_DCM::create(ins, baro, gps);
+    AP_Mission mission = AP_Mission::create(ahrs,
+            FUNCTOR_BIND_MEMBER(&UploadTest::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&UploadTest::mission_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&UploadTest::mission_complete, void));
+    GCS_MAVLINK_Upload link{mission};
+    UARTDriver_Capture port;
+
+    bool mission_cmd(const AP_Mission::Mission_Command &cmd) { return true; }
+    void mission_complete(void) {}
+
+    void setup(void) {
+        if (done) {
+            return;
+        }
+        done = true;
+        // run on a clock we can step, well past any telemetry delay
+        time_us = 10000000ULL;
+        hal.scheduler->stop_clock(time_us);
+        mission.init();
+        link.init(&port, MAVLINK_COMM_0);
+    }
+
+    // step the clock past the re-request time and update the link
+    void timeout(void) {
+        time_us += 1100000ULL;
+        hal.scheduler->stop_clock(time_us);
+        link.update();
+    }
+
+    uint64_t time_us;
+    bool done = false;
+};
+
+static UploadTest upload;
+
+static int32_t item_lat(uint16_t seq)
+{
+    return -353632620 + seq * 100;
+}
+
+/*
+  upload TEST_MISSION_ITEMS items through the GCS_MAVLINK handlers,
+  dropping the first send of each item for which drop() is true.
+  Returns the number of request passes needed
+ */
+static uint16_t run_upload(bool (*drop)(uint16_t seq))
+{
+    upload.setup();
+    GCS_MAVLINK_Upload &link = upload.link;
+    mavlink_message_t msg;
+
+    mavlink_mission_count_t count {};
+    count.target_system = mavlink_system.sysid;
+    count.target_component = mavlink_system.compid;
+    count.count = TEST_MISSION_ITEMS;
+    count.mission_type = MAV_MISSION_TYPE_MISSION;
+    mavlink_msg_mission_count_encode(TEST_GCS_SYSID, TEST_GCS_COMPID, &msg, &count);
+    link.receive(msg);
+
+    bool dropped[TEST_MISSION_ITEMS] {};
+    bool sent[TEST_MISSION_ITEMS] {};
+    uint16_t repeats = 0;
+    uint16_t naks = 0;
+    bool accepted = false;
+    uint16_t passes = 0;
+    while (!accepted && passes < 100) {
+        // nothing is outstanding, so the link re-requests what it is
+        // missing, as it does first after MISSION_COUNT
+        passes++;
+        upload.timeout();
+        while (upload.port.next_message(msg)) {
+            if (msg.msgid == MAVLINK_MSG_ID_MISSION_ACK) {
+                if (mavlink_msg_mission_ack_get_type(&msg) == MAV_MISSION_ACCEPTED) {
+                    accepted = true;
+                } else {
+                    naks++;
+                }
+                continue;
+            }
+            if (msg.msgid != MAVLINK_MSG_ID_MISSION_REQUEST) {
+                continue;
+            }
+            const uint16_t seq = mavlink_msg_mission_request_get_seq(&msg);
+            if (seq >= TEST_MISSION_ITEMS) {
+                ADD_FAILURE() << "request for item " << seq;
+                continue;
+            }
+            if (sent[seq]) {
+                repeats++;
+            }
+            if (!dropped[seq] && drop(seq)) {
+                dropped[seq] = true;
+                continue;
+            }
+            sent[seq] = true;
+            mavlink_mission_item_int_t item {};
+            item.target_system = mavlink_system.sysid;
+            item.target_component = mavlink_system.compid;
+            item.seq = seq;
+            item.frame = MAV_FRAME_GLOBAL_RELATIVE_ALT;
+            item.command = MAV_CMD_NAV_WAYPOINT;
+            item.autocontinue = 1;
+            item.x = item_lat(seq);
+            item.y = 1491652300;
+            item.z = 50;
+            item.mission_type = MAV_MISSION_TYPE_MISSION;
+            mavlink_msg_mission_item_int_encode(TEST_GCS_SYSID, TEST_GCS_COMPID, &msg, &item);
+            link.receive(msg);
+        }
+    }
+    EXPECT_TRUE(accepted);
+    EXPECT_EQ(0, naks);
+    EXPECT_EQ(0, repeats);
+
+    // item 0 is home, which is not read from storage
+    EXPECT_EQ(TEST_MISSION_ITEMS, upload.mission.num_commands());
+    for (uint16_t i = 1; i < TEST_MISSION_ITEMS; i++) {
+        AP_Mission::Mission_Command cmd;
+        EXPECT_TRUE(upload.mission.read_cmd_from_storage(i, cmd));
+        EXPECT_EQ(MAV_CMD_NAV_WAYPOINT, cmd.id);
+        EXPECT_EQ(item_lat(i), cmd.content.location.lat);
+    }
+    return passes;
+}
+
+TEST(MissionUploadWindowTest, FullWindowAdvance)
+{
+    // item 0 of the window is lost and items 1 to 31 arrive first
+    MissionUploadWindow window;
+    window.reset(0);
+    for (uint16_t seq = 1; seq < MISSION_UPLOAD_WINDOW; seq++) {
+        window.set_received(seq);
+    }
+    EXPECT_EQ(0, window.first_missing(0, 100));
+    window.set_received(0);
+    EXPECT_EQ(MISSION_UPLOAD_WINDOW, window.first_missing(0, 100));
+
+    // sliding by the whole window leaves it empty
+    window.advance(MISSION_UPLOAD_WINDOW);
+    EXPECT_EQ(MISSION_UPLOAD_WINDOW, window.start());
+    for (uint16_t seq = 0; seq < 3 * MISSION_UPLOAD_WINDOW; seq++) {
+        EXPECT_FALSE(window.received(seq));
+        EXPECT_EQ(seq >= MISSION_UPLOAD_WINDOW && seq < 2 * MISSION_UPLOAD_WINDOW, window.contains(seq));
+    }
+}
+
+TEST(MissionUploadWindowTest, PartialAdvance)
+{
+    MissionUploadWindow window;
+    window.reset(10);
+    window.set_received(10);
+    window.set_received(11);
+    window.set_received(20);
+    window.set_received(10 + MISSION_UPLOAD_WINDOW);
+    EXPECT_FALSE(window.received(10 + MISSION_UPLOAD_WINDOW));
+    EXPECT_EQ(12, window.first_missing(10, 100));
+    window.advance(2);
+    EXPECT_EQ(12, window.start());
+    EXPECT_FALSE(window.received(11));
+    EXPECT_FALSE(window.received(12));
+    EXPECT_TRUE(window.received(20));
+}
+
+static bool drop_none(uint16_t seq) { return false; }
+static bool drop_first(uint16_t seq) { return seq == 0; }
+static bool drop_window_start(uint16_t seq) { return seq % MISSION_UPLOAD_WINDOW == 0; }
+static bool drop_some(uint16_t seq) { return (seq * 7) % 5 == 0; }
+
+TEST(MissionUploadWindowTest, Upload)
+{
+    run_upload(drop_none);
+    run_upload(drop_some);
+}
+
+TEST(MissionUploadWindowTest, UploadDropFirstItem)
+{
+    // all items after the lost one must still be requested and
+    // written, rather than taken as repeats
+    EXPECT_GT(10, run_upload(drop_first));
+    EXPECT_GT(30, run_upload(drop_window_start));
+}
+
+AP_GTEST_MAIN()
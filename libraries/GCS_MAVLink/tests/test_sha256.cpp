@@ -0,0 +1,142 @@
+#include <AP_gtest.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <GCS_MAVLink/MAVLink_sha256.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  test vectors from FIPS 180-2 appendix B, and the empty message
+ */
+static const uint8_t digest_empty[32] = {
+    0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+    0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55
+};
+
+static const char msg_abc[] = "abc";
+static const uint8_t digest_abc[32] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+};
+
+static const char msg_448[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+static const uint8_t digest_448[32] = {
+    0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+    0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1
+};
+
+// one million repetitions of 'a'
+static const uint8_t digest_million_a[32] = {
+    0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92, 0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+    0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e, 0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0
+};
+
+static void sha256(const void *data, uint32_t len, uint8_t result[32])
+{
+    mavlink_sha256_ctx ctx;
+    mavlink_sha256_init(&ctx);
+    mavlink_sha256_update(&ctx, data, len);
+    mavlink_sha256_final_32(&ctx, result);
+}
+
+TEST(SHA256Test, Vectors)
+{
+    uint8_t result[32];
+
+    sha256("", 0, result);
+    EXPECT_EQ(0, memcmp(result, digest_empty, 32));
+
+    sha256(msg_abc, strlen(msg_abc), result);
+    EXPECT_EQ(0, memcmp(result, digest_abc, 32));
+
+    sha256(msg_448, strlen(msg_448), result);
+    EXPECT_EQ(0, memcmp(result, digest_448, 32));
+}
+
+TEST(SHA256Test, MillionA)
+{
+    uint8_t a[1000];
+    memset(a, 'a', sizeof(a));
+
+    // 1000 byte updates, which leave a partial block each time
+    mavlink_sha256_ctx ctx;
+    mavlink_sha256_init(&ctx);
+    for (uint16_t i=0; i<1000; i++) {
+        mavlink_sha256_update(&ctx, a, sizeof(a));
+    }
+    uint8_t result[32];
+    mavlink_sha256_final_32(&ctx, result);
+    EXPECT_EQ(0, memcmp(result, digest_million_a, 32));
+}
+
+/*
+  the message split across two updates at every position, and fed a
+  byte at a time
+ */
+TEST(SHA256Test, SplitUpdates)
+{
+    const uint32_t len = strlen(msg_448);
+    for (uint32_t split=0; split<=len; split++) {
+        mavlink_sha256_ctx ctx;
+        mavlink_sha256_init(&ctx);
+        mavlink_sha256_update(&ctx, msg_448, split);
+        mavlink_sha256_update(&ctx, &msg_448[split], len - split);
+        uint8_t result[32];
+        mavlink_sha256_final_32(&ctx, result);
+        EXPECT_EQ(0, memcmp(result, digest_448, 32)) << "split at " << split;
+    }
+
+    mavlink_sha256_ctx ctx;
+    mavlink_sha256_init(&ctx);
+    for (uint32_t i=0; i<len; i++) {
+        mavlink_sha256_update(&ctx, &msg_448[i], 1);
+    }
+    uint8_t result[32];
+    mavlink_sha256_final_32(&ctx, result);
+    EXPECT_EQ(0, memcmp(result, digest_448, 32));
+}
+
+/*
+  messages starting with the key prefix skip the first rounds of their
+  first block. They must hash the same as when the key is fed in
+  pieces, which doesn't match the prefix, for every length of message
+  after the key, including those padded into a second block
+ */
+TEST(SHA256Test, KeyedPrefix)
+{
+    uint8_t data[32 + 150];
+    for (uint8_t i=0; i<32; i++) {
+        data[i] = 0xA0 + i;
+    }
+    for (uint16_t i=32; i<sizeof(data); i++) {
+        data[i] = i * 7;
+    }
+    mavlink_sha256_set_key_prefix(data);
+
+    for (uint16_t len=32; len<=sizeof(data); len++) {
+        uint8_t keyed[32];
+        sha256(data, len, keyed);
+
+        uint8_t unkeyed[32];
+        mavlink_sha256_ctx ctx;
+        mavlink_sha256_init(&ctx);
+        mavlink_sha256_update(&ctx, data, 16);
+        mavlink_sha256_update(&ctx, &data[16], len - 16);
+        mavlink_sha256_final_32(&ctx, unkeyed);
+        EXPECT_EQ(0, memcmp(keyed, unkeyed, 32)) << "length " << len;
+
+        // the signature is the first 48 bits of the digest
+        uint8_t sig[6];
+        mavlink_sha256_init(&ctx);
+        mavlink_sha256_update(&ctx, data, len);
+        mavlink_sha256_final_48(&ctx, sig);
+        EXPECT_EQ(0, memcmp(sig, keyed, 6)) << "length " << len;
+    }
+
+    // messages not starting with the key are hashed as usual
+    uint8_t result[32];
+    sha256(msg_448, strlen(msg_448), result);
+    EXPECT_EQ(0, memcmp(result, digest_448, 32));
+}
+
+AP_GTEST_MAIN()
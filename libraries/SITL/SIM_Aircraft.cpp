@@ -167,7 +167,7 @@ void Aircraft::update_position(void)
 #if 0
     // logging of raw sitl data
     Vector3f accel_ef = dcm * accel_body;
-    DataFlash_Class::instance()->Log_Write("SITL", "TimeUS,VN,VE,VD,AN,AE,AD,PN,PE,PD", "Qfffffffff",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f','f','f','f'>("SITL", "TimeUS,VN,VE,VD,AN,AE,AD,PN,PE,PD",
                                            AP_HAL::micros64(),
                                            velocity_ef.x, velocity_ef.y, velocity_ef.z,
                                            accel_ef.x, accel_ef.y, accel_ef.z,
@@ -625,8 +625,7 @@ void Aircraft::smooth_sensors(void)
     dcm.to_euler(&R2, &P2, &Y2);
 
 #if 0
-    DataFlash_Class::instance()->Log_Write("SMOO", "TimeUS,AEx,AEy,AEz,DPx,DPy,DPz,R,P,Y,R2,P2,Y2",
-                                           "Qffffffffffff",
+    DataFlash_Class::instance()->Log_Write_Typed<'Q','f','f','f','f','f','f','f','f','f','f','f','f'>("SMOO", "TimeUS,AEx,AEy,AEz,DPx,DPy,DPz,R,P,Y,R2,P2,Y2",
                                            AP_HAL::micros64(),
                                            degrees(angle_differential.x),
                                            degrees(angle_differential.y),
@@ -32,7 +32,8 @@ extern const AP_HAL::HAL& hal;
 /*
   layout for fixed wing and rovers
   On PX4v1 this gives 309 waypoints, 30 rally points and 52 fence points
-  On Pixhawk this gives 724 waypoints, 50 rally points and 84 fence points
+  On Pixhawk this gives 724 waypoints, 50 rally points, 84 fence points
+  and 31 fence zone points
  */
 const StorageManager::StorageArea StorageManager::layout_default[STORAGE_NUM_AREAS] = {
     { StorageParam,   0,     1280}, // 0x500 parameter bytes
@@ -51,7 +52,8 @@ const StorageManager::StorageArea StorageManager::layout_default[STORAGE_NUM_ARE
     { StorageParam,    8192,  1280},
     { StorageRally,    9472,   300},
     { StorageFence,    9772,   256},
-    { StorageMission, 10028,  6228}, // leave 128 byte gap for expansion
+    { StorageMission, 10028,  6228},
+    { StorageFenceZones, 16256, 128}, // 31 compact zone points
 #endif
 };
 
@@ -59,7 +61,8 @@ const StorageManager::StorageArea StorageManager::layout_default[STORAGE_NUM_ARE
 /*
   layout for copter.
   On PX4v1 this gives 303 waypoints, 26 rally points and 38 fence points
-  On Pixhawk this gives 718 waypoints, 46 rally points and 70 fence points
+  On Pixhawk this gives 718 waypoints, 46 rally points, 70 fence points
+  and 31 fence zone points
  */
 const StorageManager::StorageArea StorageManager::layout_copter[STORAGE_NUM_AREAS] = {
     { StorageParam,   0,     1536}, // 0x600 param bytes
@@ -78,13 +81,57 @@ const StorageManager::StorageArea StorageManager::layout_copter[STORAGE_NUM_AREA
     { StorageParam,    8192,  1280},
     { StorageRally,    9472,   300},
     { StorageFence,    9772,   256},
-    { StorageMission, 10028,  6228}, // leave 128 byte gap for expansion
+    { StorageMission, 10028,  6228},
+    { StorageFenceZones, 16256, 128}, // 31 compact zone points
 #endif
 };
 
 // setup default layout
 const StorageManager::StorageArea *StorageManager::layout = layout_default;
 
+bool StorageManager::flush_priorities_set;
+
+/*
+  tell the storage backend which areas to flush first when writes are
+  buffered. Keys and parameters are small and needed after a reboot,
+  so a mission upload should not hold them up
+ */
+void StorageManager::set_flush_priorities(void)
+{
+    for (uint8_t i=0; i<STORAGE_NUM_AREAS; i++) {
+        const StorageManager::StorageArea &area = StorageManager::layout[i];
+        uint8_t priority;
+        switch (area.type) {
+        case StorageKeys:
+        case StorageBindInfo:
+            priority = 0;
+            break;
+        case StorageParam:
+            priority = 1;
+            break;
+        case StorageFence:
+        case StorageFenceZones:
+        case StorageRally:
+            priority = 2;
+            break;
+        case StorageMission:
+        default:
+            priority = 3;
+            break;
+        }
+        hal.storage->set_flush_priority(area.offset, area.length, priority);
+    }
+    flush_priorities_set = true;
+}
+
+/*
+  get write statistics from the storage backend
+ */
+bool StorageManager::get_write_stats(AP_HAL::Storage::WriteStats &stats)
+{
+    return hal.storage->get_write_stats(stats);
+}
+
 /*
   erase all storage
  */
@@ -169,6 +216,12 @@ bool StorageAccess::read_block(void *data, uint16_t addr, size_t n) const
 */
 bool StorageAccess::write_block(uint16_t addr, const void *data, size_t n) const
 {
+    // the default layout gets its priorities on the first write. The
+    // backend locks them, so this may run in any thread
+    if (!StorageManager::flush_priorities_set) {
+        StorageManager::set_flush_priorities();
+    }
+
     const uint8_t *b = (const uint8_t *)data;
     for (uint8_t i=0; i<STORAGE_NUM_AREAS; i++) {
         const StorageManager::StorageArea &area = StorageManager::layout[i];
@@ -27,7 +27,7 @@
   storage. Use larger areas for other boards
  */
 #if HAL_STORAGE_SIZE >= 16384
-#define STORAGE_NUM_AREAS 14
+#define STORAGE_NUM_AREAS 15
 #elif HAL_STORAGE_SIZE >= 8192
 #define STORAGE_NUM_AREAS 10
 #elif HAL_STORAGE_SIZE >= 4096
@@ -48,14 +48,21 @@ public:
         StorageRally   = 2,
         StorageMission = 3,
         StorageKeys    = 4,
-        StorageBindInfo= 5
+        StorageBindInfo= 5,
+        StorageFenceZones = 6
     };
 
     // erase whole of storage
     static void erase(void);
 
     // setup for copter layout of storage
-    static void set_layout_copter(void) { layout = layout_copter; }
+    static void set_layout_copter(void) {
+        layout = layout_copter;
+        set_flush_priorities();
+    }
+
+    // get write statistics from the storage backend, returns false if it does not keep them
+    static bool get_write_stats(AP_HAL::Storage::WriteStats &stats);
 
 private:
     struct StorageArea {
@@ -68,6 +75,10 @@ private:
     static const StorageArea layout_copter[STORAGE_NUM_AREAS];
     static const StorageArea layout_default[STORAGE_NUM_AREAS];
     static const StorageArea *layout;
+
+    // tell the storage backend which areas to flush first
+    static void set_flush_priorities(void);
+    static bool flush_priorities_set;
 };
 
 /*
@@ -94,6 +94,13 @@ void loop(void)
     count++;
     if (count % 10000 == 0) {
         hal.console->printf("%u ops\n", count);
+        AP_HAL::Storage::WriteStats stats;
+        if (StorageManager::get_write_stats(stats)) {
+            hal.console->printf("requested %u changed %u flushed %u in %u writes, %u pending\n",
+                                (unsigned)stats.bytes_requested, (unsigned)stats.bytes_changed,
+                                (unsigned)stats.bytes_flushed, (unsigned)stats.flushes,
+                                (unsigned)stats.bytes_pending);
+        }
     }
 }
 